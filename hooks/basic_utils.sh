@@ -104,6 +104,19 @@ is_sw() {
   esac
 }
 
+# Print extra mkfs options of filesystem $1 on current platform, same as
+# partman uses when formatting partitions.
+get_mkfs_options() {
+  case "$1" in
+    ext4)
+      # Disable 64bit support on loongson and sw platforms.
+      if is_loongson || is_sw; then
+        echo "-O ^64bit"
+      fi
+      ;;
+  esac
+}
+
 # Check whether current platform is x86/x86_64 or not.
 is_x86() {
   case $(uname -m) in
@@ -127,3 +140,85 @@ is_arm64() {
       ;;
   esac
 }
+
+# Check whether btrfs filesystem is used in machine.
+detect_btrfs() {
+  for i in $(lsblk -o FSTYPE | sed '/^$/d' | uniq); do
+    [ "${i}" = "btrfs" ] && return 0
+  done
+  return 1
+}
+
+# Check whether current machine is virtualbox.
+detect_vbox() {
+  if dmidecode | grep -q "Product Name: VirtualBox"; then
+    return 0
+  fi
+  return 1
+}
+
+# Check whether current machine is vmware.
+detect_vmware() {
+  if dmidecode | grep -q "Product Name: VMware"; then
+    return 0
+  fi
+  return 1
+}
+
+# Print shell patterns of packages not used on this machine, one per line.
+# "deepin-installer" itself is not printed, as hooks in chroot still need it.
+get_unused_packages() {
+  local setup_after_reboot=$(installer_get "system_info_setup_after_reboot")
+  if [ x${setup_after_reboot} != xtrue ]; then
+    echo "tshark"
+    echo "wireshark-common"
+    echo "libwireshark*"
+    echo "libwiretap*"
+  fi
+
+  if grep -q boot=casper /proc/cmdline; then
+    echo "casper"
+  fi
+  if grep -q boot=live /proc/cmdline; then
+    echo "live-boot*"
+    echo "live-config*"
+  fi
+
+  # installer depends on btrfs, so remove btrfs-tools only if reboot-setup
+  # mode is off.
+  if [ x${setup_after_reboot} != xtrue ]; then
+    detect_btrfs || echo "btrfs-tools"
+  fi
+
+  if [ x$(installer_get "DI_LUPIN") = "xtrue" ]; then
+    echo "live-filesystem"
+  else
+    echo "lupin-support"
+  fi
+  detect_vbox || echo "virtualbox-guest-*"
+  detect_vmware || echo "open-vm-tools*"
+}
+
+# Print overlay modules of current locale, bottom first.
+get_overlay_modules() {
+  local cdrom=$(installer_get "CDROM")
+  local locale=$(installer_get "DI_LOCALE")
+  local module
+  case ${locale%.*} in
+    zh_CN)
+      module="${cdrom}/overlay/filesystem.zh-hans.module"
+      ;;
+    zh_*)
+      module="${cdrom}/overlay/filesystem.zh-hant.module"
+      ;;
+    *)
+      module="${cdrom}/overlay/filesystem.en-us.module"
+      ;;
+  esac
+
+  if [ -f ${module} ]; then
+    for file in $(cat ${module}); do
+      echo "${cdrom}/overlay/${file}"
+    done
+  fi
+}
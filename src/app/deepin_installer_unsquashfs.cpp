@@ -19,22 +19,45 @@
 //  * First mount squashfs to system
 //  * Then copy each file in that folder to target, including file permissions.
 // If extraction progress is required, use --progress option.
+// Directory subtrees are copied by a pool of workers, see --jobs option.
+// With --native option, squashfs file is read and decompressed in process
+// without mounting, and mounting is only used if that fails.
+// With --resume option, finished items are recorded in a journal in dest
+// folder, and an interrupted extraction continues from where it stopped.
+// With --manifest option, content of files is hashed while it is written and
+// compared with the manifest, and --verify checks an extracted folder.
+// With --memory-budget option, memory used by extraction is bounded, for live
+// sessions with little RAM.
+// With --extract-manifest option, a binary manifest of extracted items is
+// written, and --lookup checks one item against it.
+// With --incremental option, an existing root in dest folder is updated in
+// place: unchanged files are kept and items not in squashfs file are removed.
+// With --priority-list option, files of early boot are written first and
+// together, see tools/generate_priority_list.py.
+// With --exclude-packages option, files of unused packages are not extracted
+// at all, and names of those packages are written to --excluded-packages file
+// so that they are purged from dpkg database later.
+// With several files, they are layers of an overlay filesystem, base first,
+// merged and extracted in one pass.
+// With --write-image option, file is a raw filesystem image instead, maybe
+// compressed with xz or gzip, which is written to --dest block device block
+// by block. Filesystem is grown and given new UUID by caller.
 // Known issues:
 //  * Selected squashfs file can be mounted to one mount-point each time.
 //    Or else `mount` command raise device-busy error.
 
 #define _XOPEN_SOURCE 500  // Required by nftw().
-#include <fcntl.h>
 #include <ftw.h>
-#include <limits.h>
 #include <stdlib.h>
-#include <sys/sendfile.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
-#include <sys/xattr.h>
 #include <unistd.h>
 
+#include <memory>
+#include <vector>
+
 #include <QCoreApplication>
 #include <QCommandLineOption>
 #include <QCommandLineParser>
@@ -42,13 +65,21 @@
 #include <QDebug>
 #include <QDir>
 #include <QFile>
-#include <QtMath>
 
 #include "base/command.h"
 #include "base/consts.h"
 #include "base/file_util.h"
-
-#define S_IMODE 07777
+#include "unsquashfs/extract_journal.h"
+#include "unsquashfs/extract_manifest.h"
+#include "unsquashfs/extract_progress.h"
+#include "unsquashfs/extract_stats.h"
+#include "unsquashfs/extract_totals.h"
+#include "unsquashfs/image_writer.h"
+#include "unsquashfs/memory_budget.h"
+#include "unsquashfs/native_extractor.h"
+#include "unsquashfs/squashfs_image.h"
+#include "unsquashfs/tree_copier.h"
+#include "unsquashfs/tree_verifier.h"
 
 // TODO(xushaohua): Added --debug option.
 // TODO(xushaohua): Added --force option.
@@ -73,268 +104,77 @@ const int kExitErr = 1;
 // See /proc/self/limits for more information.
 const int kMaxOpenFd = 512;
 
-// File descriptor of progress file.
-FILE* g_progress_fd = nullptr;
-
-// Global references to src_dir and dest_dir.
-QString g_src_dir;
-QString g_dest_dir;
-
 // Total number of files in squashfs filesystem.
 int g_total_files = 0;
-// Number of files has been copied.
-int g_current_files = 0;
 
-// Use sendfile() system call or not.
-bool g_use_sendfile = true;
-
-// Write progress value to file.
-void WriteProgress(int progress) {
-  if (g_progress_fd) {
-    fseek(g_progress_fd, 0, SEEK_SET);
-    fprintf(g_progress_fd, "%d", progress);
-  } else {
-    fprintf(stdout, "\r%d", progress);
-  }
+int CountItem(const char* fpath, const struct stat* sb,
+              int typeflag, struct FTW* ftwbuf) {
+  Q_UNUSED(fpath);
+  Q_UNUSED(sb);
+  Q_UNUSED(typeflag);
+  Q_UNUSED(ftwbuf);
+  g_total_files ++;
+  return 0;
 }
 
-// Copy regular file with sendfile() system call, from |src_file| to
-// |dest_file|. Size of |src_file| is |file_size|.
-bool SendFile(const char* src_file, const char* dest_file, ssize_t file_size) {
-  int src_fd, dest_fd;
-  src_fd = open(src_file, O_RDONLY);
-  if (src_fd == -1) {
-    fprintf(stderr, "SendFile() Failed to open src file: %s\n", src_file);
-    perror("Open src file failed!");
-    return false;
-  }
-
-  // TODO(xushaohua): handles umask
-  dest_fd = open(dest_file, O_CREAT | O_RDWR, S_IREAD | S_IWRITE);
-  if (dest_fd == -1) {
-    fprintf(stderr, "SendFile() Failed to open dest file: %s\n", dest_file);
-    perror("Open dest file failed!");
+// Copy files from |mount_point| to |dest_dir|, keeping xattrs.
+// If |totals| is unknown, walk |src_dir| to count files first.
+bool CopyFiles(const QString& src_dir, const QString& dest_dir,
+               const QString& progress_file,
+               const installer::ExtractTotals& totals,
+               const installer::ExtractOptions& options) {
+  if (!installer::CreateDirs(dest_dir)) {
+    fprintf(stderr, "CopyFiles() failed to create dest dir: %s\n",
+            dest_dir.toLocal8Bit().constData());
     return false;
   }
 
-  bool ok = true;
-  if (g_use_sendfile) {
-    size_t num_to_read = size_t(file_size);
-    while (num_to_read > 0) {
-      const ssize_t num_sent = sendfile(dest_fd, src_fd, nullptr, num_to_read);
-      if (num_sent <= 0) {
-        fprintf(stderr, "sendfile() error: %s\nSkip %s\n",
-                strerror(errno), src_file);
-        // NOTE(xushaohua): Skip sendfile() error.
-        // xz uncompress error, Input/output error.
-        // squashfs file might have some defects.
-//      ok = false;
-        ok = true;
-        break;
-      }
-      num_to_read -= num_sent;
-    }
-  } else {
-    const size_t kBufSize = 32 * 1024;  // 32k
-    char buf[kBufSize];
-    ssize_t num_read;
-    while ((num_read = read(src_fd, buf, kBufSize)) > 0) {
-      // TODO(xushaohua): write() may write less buf.
-      if (write(dest_fd, buf, (size_t)num_read) != num_read) {
-        ok = false;
-        break;
-      }
-    }
-    if (num_read < 0) {
-      ok = false;
-    }
-  }
-
-  close(src_fd);
-  close(dest_fd);
-
-  return ok;
-}
-
-bool CopySymLink(const char* src_file, const char* link_path) {
-  char buf[PATH_MAX];
-  ssize_t link_len = readlink(src_file, buf, PATH_MAX);
-  if (link_len <= 0) {
-    fprintf(stderr, "CopySymLink() readlink() failed: %s\n", src_file);
-    perror("readlink() error");
-    return false;
-  }
+  // Save current umask.
+  const mode_t old_mask = umask(0);
 
-  char target[link_len + 1];
-  strncpy(target, buf, (size_t)link_len);
-  target[link_len] = '\0';
-  if (symlink(target, link_path) != 0) {
-    fprintf(stderr, "CopySymLink() symlink() failed, %s (%s -> %s)\n",
-            strerror(errno), link_path, target);
-    // Ignores EEXIST.
-    return (errno == EEXIST);
-  } else {
-    return true;
+  installer::ExtractProgress progress;
+  if (!progress_file.isEmpty()) {
+    progress.open(progress_file.toStdString());
   }
-}
 
-// Update xattr (access control lists and file capabilities)
-bool CopyXAttr(const char* src_file, const char* dest_file) {
   bool ok = true;
-  // size of extended attribute list, 64k.
-  char list[XATTR_LIST_MAX];
-  char value[XATTR_NAME_MAX];
-  ssize_t xlist_len = llistxattr(src_file, list, XATTR_LIST_MAX);
-  if (xlist_len < 0) {
-    // Check errno.
-    if (errno == ENOTSUP) {
-      // Target filesystem does not support extended attributes.
-      ok = true;
-    } else {
-      fprintf(stdout, "CopyXAttr() llistxattr() failed: %s, %s\n", src_file,
-              strerror(errno));
-      ok = false;
-    }
+  if (totals.files > 0) {
+    g_total_files = static_cast<int>(totals.files);
   } else {
-    ssize_t value_len;
-    for (int ns = 0; ns < xlist_len; ns += strlen(&list[ns] + 1)) {
-      value_len = lgetxattr(src_file, &list[ns], value, XATTR_NAME_MAX);
-      if (value_len == -1) {
-        fprintf(stdout, "CopyXAttr() could not get value: %s\n", src_file);
-        break;
-      } else {
-        if (lsetxattr(dest_file, &list[ns], value, size_t(value_len), 0) != 0) {
-          fprintf(stdout, "CopyXAttr() setxattr() failed: %s, %s, %s, %s\n",
-                  dest_file, &list[ns], value, strerror(errno));
-          ok = false;
-          break;
-        }
-      }
-    }
+    // Count file numbers.
+    ok = (nftw(src_dir.toUtf8().data(),
+               CountItem, kMaxOpenFd, FTW_PHYS) == 0);
   }
-
-  return ok;
-}
-
-// Tree walk handler. Copy one item from |fpath|.
-int CopyItem(const char* fpath, const struct stat* sb,
-             int typeflag, struct FTW* ftwbuf) {
-  Q_UNUSED(sb);
-  Q_UNUSED(typeflag);
-  Q_UNUSED(ftwbuf);
-
-  struct stat st;
-  if (lstat(fpath, &st) != 0) {
-    fprintf(stderr, "CopyItem() call lstat() failed: %s\n", fpath);
-    perror("lstat()");
-    return 1;
-  }
-
-  QString relative_path(fpath);
-  relative_path.remove(g_src_dir);
-  if (relative_path.startsWith('/')) {
-    relative_path = relative_path.mid(1);
-  }
-  const QString dest_filepath =
-      QDir(g_dest_dir).absoluteFilePath(relative_path);
-
-  // Create parent dirs.
-  installer::CreateParentDirs(dest_filepath);
-
-  const std::string std_dest_filepath(dest_filepath.toStdString());
-  const char* dest_file = std_dest_filepath.c_str();
-
-  // Get file mode.
-  const mode_t mode = st.st_mode & S_IMODE;
-  bool ok = true;
-
-  // Remove dest_file if it exists.
-  struct stat dest_stat;
-  if (stat(dest_file, &dest_stat) == 0) {
-    if (!S_ISDIR(dest_stat.st_mode)) {
-      unlink(dest_file);
-    }
-  }
-
-  if (S_ISLNK(st.st_mode)) {
-    // Symbolic link
-    ok = CopySymLink(fpath, dest_file);
-  } else if (S_ISREG(sb->st_mode)) {
-    // Regular file
-    ok = SendFile(fpath, dest_file, st.st_size);
-  } else if (S_ISDIR(st.st_mode)) {
-    // Directory
-    ok = installer::CreateDirs(dest_filepath);
-  } else if (S_ISCHR(st.st_mode)) {
-    // Character device
-    ok = (mknod(dest_file, mode | S_IFCHR, st.st_dev) == 0);
-  } else if (S_ISBLK(st.st_mode)) {
-    // For block device.
-    ok = (mknod(dest_file, mode | S_IFBLK, st.st_dev) == 0);
-  } else if (S_ISFIFO(st.st_mode)) {
-    // FIFO
-    ok = (mknod(dest_file, mode | S_IFIFO, st.st_dev) == 0);
-  } else if (S_ISSOCK(st.st_mode)) {
-    // Socket
-    ok = (mknod(dest_file, mode | S_IFSOCK, st.st_dev) == 0);
+  if (!ok || (g_total_files == 0)) {
+    fprintf(stderr, "CopyFiles() Failed to count file number!\n");
   } else {
-    fprintf(stderr, "CopyItem() Unknown file mode: %d\n", st.st_mode);
+    progress.setTotal(g_total_files, totals.bytes);
+    fprintf(stdout, "jobs: %d\n", options.jobs);
+    installer::ExtractStats stats;
+    ok = installer::CopyTree(src_dir.toStdString(), dest_dir.toStdString(),
+                             options, &progress, &stats);
+    stats.print(stdout);
   }
 
-  if (!ok) {
-    fprintf(stderr, "Failed to copy item: %s\n", dest_file);
-    // Ignore copy file error.
-    // Return if error occurs
-//    return 1;
-  }
-
-  // Update ownership first, or chmod() might ignore SUID/SGID or sticky flag.
-  if (lchown(dest_file, st.st_uid, st.st_gid) != 0) {
-    fprintf(stderr, "CopyItem() lchown() failed: %s, %d, %d\n",
-            dest_file, st.st_uid, st.st_gid);
-    perror("lchown()");
-    // Ignores copy file error.
-//    ok = false;
-  }
-  // Update permissions.
-  if (!S_ISLNK(st.st_mode)) {
-    if (chmod(dest_file, mode) != 0) {
-      fprintf(stderr, "CopyItem() chmod failed: %s, %ul\n", dest_file, mode);
-      perror("chmod()");
-      // Ignores chmod error.
-//      ok = false;
-    }
-  }
+  // Reset umask.
+  umask(old_mask);
 
-  if (!CopyXAttr(fpath, dest_file)) {
-    // NOTE(xushaohua): Do not exit when failed to copy file capacities.
-    // This may be happen in Alpha based computer.
-    fprintf(stderr, "CopyXAttr() failed: %s\n", fpath);
-//    ok = false;
+  if (ok) {
+    progress.finish();
   }
 
-  g_current_files ++;
-  const int progress = qFloor(g_current_files * 100.0 / g_total_files);
-  WriteProgress(progress);
-
-  return ok ? 0 : 1;
-}
-
-int CountItem(const char* fpath, const struct stat* sb,
-              int typeflag, struct FTW* ftwbuf) {
-  Q_UNUSED(fpath);
-  Q_UNUSED(sb);
-  Q_UNUSED(typeflag);
-  Q_UNUSED(ftwbuf);
-  g_total_files ++;
-  return 0;
+  return ok;
 }
 
-// Copy files from |mount_point| to |dest_dir|, keeping xattrs.
-bool CopyFiles(const QString& src_dir, const QString& dest_dir,
-               const QString& progress_file) {
+// Extract files from squashfs |layers|, base first, to |dest_dir| without
+// mounting them.
+bool ExtractFiles(const std::vector<const installer::SquashfsImage*>& layers,
+                  const QString& dest_dir,
+                  const QString& progress_file,
+                  const installer::ExtractTotals& totals,
+                  const installer::ExtractOptions& options) {
   if (!installer::CreateDirs(dest_dir)) {
-    fprintf(stderr, "CopyFiles() failed to create dest dir: %s\n",
+    fprintf(stderr, "ExtractFiles() failed to create dest dir: %s\n",
             dest_dir.toLocal8Bit().constData());
     return false;
   }
@@ -342,37 +182,52 @@ bool CopyFiles(const QString& src_dir, const QString& dest_dir,
   // Save current umask.
   const mode_t old_mask = umask(0);
 
+  installer::ExtractProgress progress;
   if (!progress_file.isEmpty()) {
-    // Set progress file descriptor.
-    g_progress_fd = fopen(progress_file.toStdString().c_str(), "w");
-    if (g_progress_fd == nullptr) {
-      perror("fopen() Failed to open progress file");
-    }
+    progress.open(progress_file.toStdString());
   }
-
-  g_src_dir = src_dir;
-  g_dest_dir = dest_dir;
-
-  // Count file numbers.
-  bool ok = (nftw(src_dir.toUtf8().data(),
-                  CountItem, kMaxOpenFd, FTW_PHYS) == 0);
-  if (!ok || (g_total_files == 0)) {
-    fprintf(stderr, "CopyFiles() Failed to count file number!\n");
-  } else {
-    ok = (nftw(src_dir.toUtf8().data(), CopyItem, kMaxOpenFd, FTW_PHYS) == 0);
+  int64_t num_inodes = 0;
+  for (const installer::SquashfsImage* image : layers) {
+    num_inodes += image->superBlock().inodes;
   }
+  progress.setTotal(totals.files > 0 ? totals.files : num_inodes,
+                    totals.bytes);
+  fprintf(stdout, "jobs: %d, compression: %s, layers: %zu\n",
+          options.jobs, layers.back()->compressionName(), layers.size());
+
+  installer::ExtractStats stats;
+  const bool ok = installer::ExtractImages(layers, dest_dir.toStdString(),
+                                           options, &progress, &stats);
+  stats.print(stdout);
 
   // Reset umask.
   umask(old_mask);
 
   if (ok) {
-    WriteProgress(100);
+    progress.finish();
   }
 
-  if (g_progress_fd) {
-    fclose(g_progress_fd);
+  return ok;
+}
+
+// Write filesystem image |src| to block device |dest|.
+bool WriteImageFile(const QString& src, const QString& dest,
+                    const QString& progress_file,
+                    const installer::ExtractOptions& options) {
+  installer::ExtractProgress progress;
+  if (!progress_file.isEmpty()) {
+    progress.open(progress_file.toStdString());
   }
 
+  installer::ExtractStats stats;
+  const bool ok = installer::WriteImage(src.toStdString(),
+                                        dest.toStdString(), options,
+                                        &progress, &stats);
+  stats.print(stdout);
+
+  if (ok) {
+    progress.finish();
+  }
   return ok;
 }
 
@@ -403,6 +258,57 @@ bool UnMountFs(const QString& mount_point) {
   return ok;
 }
 
+// Returns folder where layer |index| of overlay filesystem at |mount_point|
+// is mounted.
+QString GetLayerMountPoint(const QString& mount_point, int index) {
+  return QString("%1-layer%2").arg(mount_point).arg(index);
+}
+
+// Mount |layers| of overlay filesystem, base first, to |mount_point|. Each
+// layer is mounted to its own folder, then they are merged by overlayfs.
+bool MountLayers(const QStringList& layers, const QString& mount_point) {
+  if (layers.length() == 1) {
+    return MountFs(layers.first(), mount_point);
+  }
+
+  QStringList lower_dirs;
+  for (int i = 0; i < layers.length(); ++i) {
+    const QString layer_mount_point = GetLayerMountPoint(mount_point, i);
+    if (!MountFs(layers.at(i), layer_mount_point)) {
+      return false;
+    }
+    // Top layer comes first in lowerdir option.
+    lower_dirs.prepend(layer_mount_point);
+  }
+  if (!installer::CreateDirs(mount_point)) {
+    fprintf(stderr, "MountLayers() failed to create folder: %s\n",
+            mount_point.toLocal8Bit().constData());
+    return false;
+  }
+  QString output, err;
+  const bool ok = installer::SpawnCmd("mount", {
+      "-t", "overlay", "overlay",
+      "-o", QString("ro,lowerdir=%1").arg(lower_dirs.join(':')),
+      mount_point}, output, err);
+  if (!ok) {
+    fprintf(stderr, "MountLayers() err: %s\n", err.toLocal8Bit().constData());
+  }
+  return ok;
+}
+
+// Umount filesystem from |mount_point|, retrying if it is busy.
+void UnMountFsRetry(const QString& mount_point) {
+  for (int retry = 0; retry < 5; ++retry) {
+    if (!UnMountFs(mount_point)) {
+      fprintf(stderr, "Unmount %s failed\n",
+              mount_point.toLocal8Bit().constData());
+      sleep((unsigned int)(retry * 2 + 1));
+    } else {
+      break;
+    }
+  }
+}
+
 }  // namespace
 
 int main(int argc, char* argv[]) {
@@ -431,10 +337,105 @@ int main(int argc, char* argv[]) {
       "progress","print progress info to <file>",
       "file", "");
   parser.addOption(progress_option);
+  const QCommandLineOption jobs_option(
+      "jobs", "copy files with <number> parallel workers, "
+      "default is number of processors",
+      "number", "0");
+  parser.addOption(jobs_option);
+  const QCommandLineOption native_option(
+      "native", "read squashfs file directly instead of mounting it");
+  parser.addOption(native_option);
+  const QCommandLineOption write_image_option(
+      "write-image", "write raw filesystem image <file>, maybe compressed "
+      "with xz or gzip, to --dest block device instead of extracting files");
+  parser.addOption(write_image_option);
+  const QCommandLineOption total_file_option(
+      "total-file", "read number of files to be extracted from <file>",
+      "file", "");
+  parser.addOption(total_file_option);
+  const QCommandLineOption copy_method_option(
+      "copy-method", "copy file content with <method>: auto, clone, "
+      "copy_file_range, sendfile, splice or read_write, default is auto",
+      "method", "auto");
+  parser.addOption(copy_method_option);
+  const QCommandLineOption buffer_size_option(
+      "buffer-size", "size of copy buffer in <KiB>, default is 256",
+      "KiB", "256");
+  parser.addOption(buffer_size_option);
+  const QCommandLineOption preallocate_option(
+      "preallocate", "reserve extents of files of at least <KiB> before "
+      "writing them, 0 to disable, default is 1024", "KiB", "1024");
+  parser.addOption(preallocate_option);
+  const QCommandLineOption io_uring_option(
+      "io-uring", "create small files with io_uring if supported, "
+      "used with --native");
+  parser.addOption(io_uring_option);
+  const QCommandLineOption resume_option(
+      "resume", "record finished items in a journal and skip items "
+      "finished by previous run, used with --native");
+  parser.addOption(resume_option);
+  const QCommandLineOption dirty_window_option(
+      "dirty-window", "flush file content during extraction, keeping at most "
+      "<MiB> not written to disk, default is 0 which leaves it to kernel",
+      "MiB", "0");
+  parser.addOption(dirty_window_option);
+  const QCommandLineOption memory_budget_option(
+      "memory-budget", "keep memory used by buffers, caches and unflushed "
+      "content under <MiB>, bypassing page cache where possible; auto picks "
+      "it from available memory", "MiB", "");
+  parser.addOption(memory_budget_option);
+  const QCommandLineOption ordered_option(
+      "ordered", "extract files in order of their content in squashfs file, "
+      "reading ahead of workers");
+  parser.addOption(ordered_option);
+  const QCommandLineOption incremental_option(
+      "incremental", "install over existing items in dest folder, keeping "
+      "files whose type, size and mtime match and removing items not in "
+      "squashfs file");
+  parser.addOption(incremental_option);
+  const QCommandLineOption priority_list_option(
+      "priority-list", "extract files listed in <file> before others, in "
+      "order of the list, implies --ordered, used with --native",
+      "file", "");
+  parser.addOption(priority_list_option);
+  const QCommandLineOption exclude_packages_option(
+      "exclude-packages", "skip files of packages matching patterns in "
+      "<file>, and of packages depending on them", "file", "");
+  parser.addOption(exclude_packages_option);
+  const QCommandLineOption excluded_packages_option(
+      "excluded-packages", "write names of packages skipped by "
+      "--exclude-packages to <file>", "file", "");
+  parser.addOption(excluded_packages_option);
+  const QCommandLineOption manifest_option(
+      "manifest", "hash content of files while extracting them, and compare "
+      "it with manifest <file>", "file", "");
+  parser.addOption(manifest_option);
+  const QCommandLineOption failure_report_option(
+      "failure-report", "write files which do not match manifest to <file>, "
+      "default is stderr", "file", "");
+  parser.addOption(failure_report_option);
+  const QCommandLineOption verify_option(
+      "verify", "compare files already extracted to dest folder with "
+      "--manifest, without extracting anything");
+  parser.addOption(verify_option);
+  const QCommandLineOption create_manifest_option(
+      "create-manifest", "write manifest of files in dest folder to <file>, "
+      "without extracting anything", "file", "");
+  parser.addOption(create_manifest_option);
+  const QCommandLineOption extract_manifest_option(
+      "extract-manifest", "write binary manifest of extracted items to "
+      "<file>, used with --native", "file", "");
+  parser.addOption(extract_manifest_option);
+  const QCommandLineOption lookup_option(
+      "lookup", "print item <path> of --extract-manifest and check it in "
+      "dest folder, without extracting anything", "path", "");
+  parser.addOption(lookup_option);
   parser.setApplicationDescription(kAppDesc);
   parser.addHelpOption();
   parser.addVersionOption();
-  parser.addPositionalArgument("file", "squashfs filesystem to be extracted");
+  parser.addPositionalArgument("files", "squashfs filesystem to be extracted, "
+                               "followed by its overlay layers if any",
+                               "file...");
 
   if (!parser.parse(app.arguments())) {
     parser.showHelp(kExitErr);
@@ -445,46 +446,271 @@ int main(int argc, char* argv[]) {
     parser.showHelp(kExitOk);
   }
 
-  const QStringList positional_args = parser.positionalArguments();
-  if (positional_args.length() != 1) {
-    fprintf(stderr, "Too many files to extract, expect one!\n");
+  installer::ExtractOptions options;
+  struct utsname uname_buf;
+  if (uname(&uname_buf) == 0) {
+    // Do not use sendfile() on "sw" platform, as do_sendfile() always crashes!
+    options.use_sendfile = (strncmp(uname_buf.machine, "sw", 2) != 0);
+  } else {
+    options.use_sendfile = false;
+  }
+  fprintf(stdout, "use_sendfile: %s\n", options.use_sendfile ? "yes" : "no");
+
+  bool jobs_ok = false;
+  options.jobs = parser.value(jobs_option).toInt(&jobs_ok);
+  if (!jobs_ok || options.jobs < 0) {
+    fprintf(stderr, "Invalid --jobs value: %s\n",
+            parser.value(jobs_option).toLocal8Bit().constData());
+    parser.showHelp(kExitErr);
+  }
+  if (options.jobs == 0) {
+    options.jobs = installer::GetDefaultJobs();
+  }
+
+  const QString copy_method = parser.value(copy_method_option);
+  if (!installer::ParseCopyMethod(copy_method.toStdString(),
+                                  options.copy_method)) {
+    fprintf(stderr, "Invalid --copy-method value: %s\n",
+            copy_method.toLocal8Bit().constData());
     parser.showHelp(kExitErr);
   }
 
-  const QString src(positional_args.at(0));
-  const QFile src_file(src);
-  if (!src_file.exists()) {
-    fprintf(stderr, "File not found: %s\n", src.toLocal8Bit().constData());
+  bool buffer_size_ok = false;
+  const int buffer_size = parser.value(buffer_size_option).toInt(
+      &buffer_size_ok);
+  if (!buffer_size_ok || buffer_size <= 0) {
+    fprintf(stderr, "Invalid --buffer-size value: %s\n",
+            parser.value(buffer_size_option).toLocal8Bit().constData());
+    parser.showHelp(kExitErr);
+  }
+  options.buffer_size = size_t(buffer_size) * 1024;
+  bool preallocate_ok = false;
+  const int preallocate = parser.value(preallocate_option).toInt(
+      &preallocate_ok);
+  if (!preallocate_ok || preallocate < 0) {
+    fprintf(stderr, "Invalid --preallocate value: %s\n",
+            parser.value(preallocate_option).toLocal8Bit().constData());
     parser.showHelp(kExitErr);
   }
-  if (src_file.size() == 0) {
-    fprintf(stderr, "Filesystem is empty: %s\n", src.toLocal8Bit().constData());
+  options.preallocate_size = int64_t(preallocate) * 1024;
+  options.use_io_uring = parser.isSet(io_uring_option);
+  options.ordered = parser.isSet(ordered_option);
+  options.incremental = parser.isSet(incremental_option);
+  options.priority_list = parser.value(priority_list_option).toStdString();
+  options.exclude_packages =
+      parser.value(exclude_packages_option).toStdString();
+  options.excluded_packages_file =
+      parser.value(excluded_packages_option).toStdString();
+
+  bool dirty_window_ok = false;
+  const int dirty_window = parser.value(dirty_window_option).toInt(
+      &dirty_window_ok);
+  if (!dirty_window_ok || dirty_window < 0) {
+    fprintf(stderr, "Invalid --dirty-window value: %s\n",
+            parser.value(dirty_window_option).toLocal8Bit().constData());
     parser.showHelp(kExitErr);
   }
+  options.dirty_window = int64_t(dirty_window) * 1024 * 1024;
 
-  struct utsname uname_buf;
-  if (uname(&uname_buf) == 0) {
-    // Do not use sendfile() on "sw" platform, as do_sendfile() always crashes!
-    g_use_sendfile = (strncmp(uname_buf.machine, "sw", 2) != 0);
-  } else {
-    g_use_sendfile = false;
+  const QString memory_budget = parser.value(memory_budget_option);
+  if (!memory_budget.isEmpty()) {
+    int64_t budget = 0;
+    if (memory_budget == "auto") {
+      budget = installer::GetDefaultMemoryBudget();
+    } else {
+      bool memory_budget_ok = false;
+      budget = memory_budget.toLongLong(&memory_budget_ok) * 1024 * 1024;
+      if (!memory_budget_ok || budget <= 0) {
+        fprintf(stderr, "Invalid --memory-budget value: %s\n",
+                memory_budget.toLocal8Bit().constData());
+        parser.showHelp(kExitErr);
+      }
+    }
+    installer::ApplyMemoryBudget(budget, options);
+    fprintf(stdout, "memory budget: %lld MiB, dirty window: %lld MiB, "
+            "buffer: %zu KiB\n",
+            static_cast<long long>(options.memory_budget >> 20),
+            static_cast<long long>(options.dirty_window >> 20),
+            options.buffer_size >> 10);
+  }
+  options.manifest_file = parser.value(manifest_option).toStdString();
+  options.failure_report = parser.value(failure_report_option).toStdString();
+  options.extract_manifest =
+      parser.value(extract_manifest_option).toStdString();
+
+  const QString dest_dir = parser.value(dest_option);
+  const QString lookup = parser.value(lookup_option);
+  if (!lookup.isEmpty()) {
+    if (options.extract_manifest.empty()) {
+      fprintf(stderr, "--lookup requires --extract-manifest\n");
+      parser.showHelp(kExitErr);
+    }
+    installer::ExtractManifest manifest;
+    installer::ExtractManifestEntry entry;
+    if (!manifest.open(options.extract_manifest)) {
+      exit(kExitErr);
+    }
+    if (!manifest.find(lookup.toStdString(), entry)) {
+      fprintf(stdout, "%s: not installed\n", lookup.toLocal8Bit().constData());
+      exit(kExitErr);
+    }
+    fprintf(stdout, "%s: mode %o, uid %u, gid %u, size %llu, xattrs %016llx",
+            entry.path.c_str(), static_cast<unsigned int>(entry.mode),
+            static_cast<unsigned int>(entry.uid),
+            static_cast<unsigned int>(entry.gid),
+            static_cast<unsigned long long>(entry.size),
+            static_cast<unsigned long long>(entry.xattr_hash));
+    if (entry.hashed) {
+      fprintf(stdout, ", content %016llx",
+              static_cast<unsigned long long>(entry.content_hash));
+    }
+    std::string problem;
+    const bool ok = installer::CheckExtractedItem(dest_dir.toStdString(),
+                                                  entry, problem);
+    fprintf(stdout, "\n%s\n", ok ? "intact" : problem.c_str());
+    exit(ok ? kExitOk : kExitErr);
+  }
+  const QString create_manifest = parser.value(create_manifest_option);
+  if (parser.isSet(verify_option) || !create_manifest.isEmpty()) {
+    // Check files extracted before, without extracting anything.
+    installer::ExtractStats stats;
+    bool ok = false;
+    if (!create_manifest.isEmpty()) {
+      ok = installer::CreateManifest(dest_dir.toStdString(),
+                                     create_manifest.toStdString(),
+                                     options, &stats);
+    } else if (options.manifest_file.empty()) {
+      fprintf(stderr, "--verify requires --manifest\n");
+      parser.showHelp(kExitErr);
+    } else {
+      ok = installer::VerifyTree(dest_dir.toStdString(), options, &stats);
+    }
+    stats.print(stdout);
+    if (!ok) {
+      fprintf(stderr, "Verify files failed!\n");
+    }
+    exit(ok ? kExitOk : kExitErr);
+  }
+
+  const QStringList positional_args = parser.positionalArguments();
+  if (positional_args.isEmpty()) {
+    fprintf(stderr, "No file to extract!\n");
+    parser.showHelp(kExitErr);
+  }
+
+  for (const QString& src : positional_args) {
+    const QFile src_file(src);
+    if (!src_file.exists()) {
+      fprintf(stderr, "File not found: %s\n", src.toLocal8Bit().constData());
+      parser.showHelp(kExitErr);
+    }
+    if (src_file.size() == 0) {
+      fprintf(stderr, "Filesystem is empty: %s\n",
+              src.toLocal8Bit().constData());
+      parser.showHelp(kExitErr);
+    }
+  }
+  const QString src(positional_args.first());
+  const bool layered = positional_args.length() > 1;
+
+  if (parser.isSet(write_image_option)) {
+    const bool ok = WriteImageFile(src, dest_dir,
+                                   parser.value(progress_option), options);
+    if (!ok) {
+      fprintf(stderr, "Write image failed!\n");
+    }
+    exit(ok ? kExitOk : kExitErr);
   }
-  fprintf(stdout, "use_sendfile: %s\n", g_use_sendfile ? "yes" : "no");
 
   const qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
   const QString mount_point(QString(kMountPointTmp).arg(timestamp));
 
-  const QString dest_dir = parser.value(dest_option);
+  if (parser.isSet(resume_option)) {
+    options.resume = true;
+    options.journal_file = QDir(dest_dir).absoluteFilePath(
+        installer::kExtractJournalFile).toStdString();
+  }
   const QString progress_file = parser.value(progress_option);
 
-  if (!MountFs(src, mount_point)) {
+  // Progress totals are read from precomputed file or from metadata of
+  // image, so that copying starts without walking the whole tree first.
+  // Totals of merged layers are known only after they are merged.
+  installer::ExtractTotals totals;
+  const QString total_file = parser.value(total_file_option);
+  if (!total_file.isEmpty() && !layered) {
+    installer::ReadTotalsFile(total_file.toStdString(), totals);
+  }
+
+  if (parser.isSet(native_option)) {
+    std::vector<std::unique_ptr<installer::SquashfsImage>> images;
+    std::vector<const installer::SquashfsImage*> layers;
+    for (const QString& layer : positional_args) {
+      images.emplace_back(new installer::SquashfsImage());
+      installer::SquashfsImage& image = *images.back();
+      if (!image.open(layer.toStdString())) {
+        // Image is not supported by built-in reader, mount it instead.
+        fprintf(stderr, "Failed to read %s, fall back to mount\n",
+                layer.toLocal8Bit().constData());
+        layers.clear();
+        break;
+      }
+      const size_t cache_size = installer::GetFragmentCacheSize(
+          options, image.superBlock().block_size);
+      if (cache_size > 0) {
+        image.setFragmentCacheSize(cache_size);
+        fprintf(stdout, "fragment cache: %zu blocks\n", cache_size);
+      }
+      layers.push_back(&image);
+    }
+
+    if (!layers.empty()) {
+      // Inode table is loaded already, so size of files is cheap to get
+      // for byte weighted progress.
+      if (!layered && totals.bytes == 0 &&
+          installer::CountImageTotals(*layers.front(), totals)) {
+        fprintf(stdout, "image files: %lld, bytes: %lld\n",
+                static_cast<long long>(totals.files),
+                static_cast<long long>(totals.bytes));
+      }
+      const bool ok = ExtractFiles(layers, dest_dir, progress_file,
+                                   totals, options);
+      if (!ok) {
+        fprintf(stderr, "Extract files failed!\n");
+      }
+      exit(ok ? kExitOk : kExitErr);
+    }
+  }
+
+  // Options of built-in reader have no effect on mounted squashfs files.
+  for (const QCommandLineOption* option : {&io_uring_option, &resume_option,
+                                           &priority_list_option,
+                                           &extract_manifest_option}) {
+    if (parser.isSet(*option)) {
+      fprintf(stderr, "--%s is ignored, as squashfs file is mounted\n",
+              option->names().first().toLocal8Bit().constData());
+    }
+  }
+
+  if (totals.files == 0 && !layered) {
+    installer::SquashfsImage image;
+    if (!image.open(src.toStdString()) ||
+        !installer::CountImageTotals(image, totals)) {
+      installer::ReadImageTotals(src.toStdString(), totals);
+    }
+  }
+  fprintf(stdout, "total files: %lld, bytes: %lld\n",
+          static_cast<long long>(totals.files),
+          static_cast<long long>(totals.bytes));
+
+  if (!MountLayers(positional_args, mount_point)) {
     fprintf(stderr, "Mount %s to %s failed!\n",
-            src.toLocal8Bit().constData(),
+            positional_args.join(' ').toLocal8Bit().constData(),
             mount_point.toLocal8Bit().constData());
     exit(kExitErr);
   }
 
-  const bool ok = CopyFiles(mount_point, dest_dir, progress_file);
+  const bool ok = CopyFiles(mount_point, dest_dir, progress_file,
+                            totals, options);
   if (!ok) {
     fprintf(stderr, "Copy files failed!\n");
   }
@@ -492,13 +718,10 @@ int main(int argc, char* argv[]) {
   // Commit filesystem caches to disk.
 //  sync();
 
-  for (int retry = 0; retry < 5; ++retry) {
-    if (!UnMountFs(mount_point)) {
-      fprintf(stderr, "Unmount %s failed\n",
-              mount_point.toLocal8Bit().constData());
-      sleep((unsigned int)(retry * 2 + 1));
-    } else {
-      break;
+  UnMountFsRetry(mount_point);
+  if (layered) {
+    for (int i = 0; i < positional_args.length(); ++i) {
+      UnMountFsRetry(GetLayerMountPoint(mount_point, i));
     }
   }
 
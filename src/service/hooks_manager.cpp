@@ -17,8 +17,11 @@
 
 #include "service/hooks_manager.h"
 
+#include <unistd.h>
+
 #include <QDebug>
 #include <QDir>
+#include <QSocketNotifier>
 #include <QThread>
 #include <QTimer>
 #include <QDateTime>
@@ -29,6 +32,7 @@
 #include "service/backend/hook_worker.h"
 #include "service/settings_name.h"
 #include "service/settings_manager.h"
+#include "unsquashfs/progress_shm.h"
 
 namespace installer {
 
@@ -41,10 +45,19 @@ const int kAfterChrootStartVal = kInChrootEndVal;
 const int kAfterChrootEndVal = 100;
 
 const char kUnsquashfsProgressFile[] = "/dev/shm/unsquashfs_progress";
-// Interval to read unsquashfs progress file, 5000ms.
-const int kReadUnsquashfsInterval = 5000;
-
-int ReadProgressValue(const QString& file) {
+// Interval to read unsquashfs progress, 1000ms. Reading shared memory is
+// cheap, so that progress bar moves smoothly.
+const int kReadUnsquashfsInterval = 1000;
+
+// |info| is filled with detailed progress if it is available, or zeroed.
+int ReadProgressValue(const QString& file, const ProgressShm* shm,
+                      ProgressShm& info) {
+  // Detailed progress is published in shared memory by newer
+  // deepin-installer-unsquashfs, and text file is kept for older ones.
+  if (shm && ReadProgressShm(shm, info)) {
+    return info.progress;
+  }
+  info = ProgressShm();
   if (QFile::exists(file)) {
     const QString val(ReadFile(file));
     if (!val.isEmpty()) {
@@ -72,6 +85,7 @@ HooksManager::HooksManager(QObject* parent)
 
 HooksManager::~HooksManager() {
   QuitThread(hook_worker_thread_);
+  this->stopMonitorProgressFiles();
 
   while (hooks_pack_ != nullptr) {
     HooksPack* next_pack = hooks_pack_->next;
@@ -102,7 +116,7 @@ void HooksManager::runNextHook() {
   if (hooks_pack_->current_hook >= hooks_pack_->hooks.length()) {
     // Clear environment of current hooks pack.
     if (hooks_pack_->type == HookType::BeforeChroot) {
-      unsquashfs_timer_->stop();
+      this->stopMonitorProgressFiles();
     }
 
     HooksPack* next_hooks_pack = hooks_pack_->next;
@@ -169,7 +183,71 @@ void HooksManager::monitorProgressFiles() {
   qDebug() << "monitorProgressFiles()";
   // Remove old progress files first.
   QFile::remove(kUnsquashfsProgressFile);
+  unsquashfs_progress_ = -1;
+
+  // Shared memory file is re-created empty and mapped here, and
+  // deepin-installer-unsquashfs writes to it in place.
+  UnmapProgressShm(unsquashfs_shm_);
+  unsquashfs_shm_ = MapProgressShm(GetProgressShmFile(kUnsquashfsProgressFile));
   unsquashfs_timer_->start();
+
+  // deepin-installer-unsquashfs wakes us up through FIFO as soon as its
+  // progress changes, timer is only a fallback then.
+  if (unsquashfs_fifo_fd_ == -1) {
+    unsquashfs_fifo_fd_ = OpenProgressFifo(
+        GetProgressFifoFile(kUnsquashfsProgressFile));
+    if (unsquashfs_fifo_fd_ != -1) {
+      unsquashfs_notifier_ = new QSocketNotifier(
+          unsquashfs_fifo_fd_, QSocketNotifier::Read, this);
+      connect(unsquashfs_notifier_, &QSocketNotifier::activated,
+              this, &HooksManager::handleUnsquashfsNotified);
+    }
+  }
+}
+
+void HooksManager::stopMonitorProgressFiles() {
+  if (unsquashfs_timer_->isActive()) {
+    unsquashfs_timer_->stop();
+  }
+  if (unsquashfs_notifier_) {
+    // It might be stopped in its own activated() handler.
+    unsquashfs_notifier_->setEnabled(false);
+    unsquashfs_notifier_->deleteLater();
+    unsquashfs_notifier_ = nullptr;
+  }
+  if (unsquashfs_fifo_fd_ != -1) {
+    close(unsquashfs_fifo_fd_);
+    unsquashfs_fifo_fd_ = -1;
+    QFile::remove(QString::fromStdString(
+        GetProgressFifoFile(kUnsquashfsProgressFile)));
+  }
+  if (unsquashfs_shm_) {
+    UnmapProgressShm(unsquashfs_shm_);
+    unsquashfs_shm_ = nullptr;
+  }
+}
+
+void HooksManager::updateUnsquashfsProgress() {
+  if (!hooks_pack_ || hooks_pack_->type != HookType::BeforeChroot) {
+    this->stopMonitorProgressFiles();
+    return;
+  }
+  // Read progress value and notify UI thread.
+  ProgressShm info;
+  const int val = ReadProgressValue(kUnsquashfsProgressFile,
+                                    unsquashfs_shm_, info);
+  if (val == unsquashfs_progress_) {
+    return;
+  }
+  unsquashfs_progress_ = val;
+  // Logged only when progress changes, as it is read several times a second.
+  qDebug() << "unsquashfs progress:" << val
+           << "files:" << info.files_done << "/" << info.files_total
+           << "MB/s:" << info.bytes_per_second / (1024 * 1024)
+           << "eta:" << info.eta_seconds;
+  const int progress = kBeforeChrootStartVal +
+      (kBeforeChrootEndVal - kBeforeChrootStartVal) * val / 100;
+  emit this->processUpdate(progress);
 }
 
 void HooksManager::handleRunHooks() {
@@ -202,15 +280,13 @@ void HooksManager::handleRunHooks() {
 }
 
 void HooksManager::handleReadUnsquashfsTimeout() {
-  // Read progress value and notify UI thread.
-  const int val = ReadProgressValue(kUnsquashfsProgressFile);
-  const int progress = kBeforeChrootStartVal +
-      (kBeforeChrootEndVal - kBeforeChrootStartVal) * val / 100;
-  if (hooks_pack_ && hooks_pack_->type == HookType::BeforeChroot) {
-    emit this->processUpdate(progress);
-  } else {
-    unsquashfs_timer_->stop();
-  }
+  this->updateUnsquashfsProgress();
+}
+
+void HooksManager::handleUnsquashfsNotified() {
+  // Several updates since last wake up are read as one.
+  DrainProgressFifo(unsquashfs_fifo_fd_);
+  this->updateUnsquashfsProgress();
 }
 
 void HooksManager::onHooksManagerFinished() {
@@ -222,9 +298,7 @@ void HooksManager::onHooksManagerFinished() {
   }
 
   // Stop unsquashfs progress file monitor
-  if (unsquashfs_timer_->isActive()) {
-    unsquashfs_timer_->stop();
-  }
+  this->stopMonitorProgressFiles();
 
   if (enableScriptAnalyze) {
       qlonglong allTime { 0 };
@@ -21,6 +21,7 @@
 #include <QObject>
 #include <utility>
 
+class QSocketNotifier;
 class QThread;
 class QTimer;
 
@@ -31,6 +32,7 @@ const int kBeforeChrootStartVal = 5;
 
 class HooksPack;
 class HookWorker;
+struct ProgressShm;
 
 // HookManager is used to do:
 //   * run hook jobs one by one;
@@ -77,9 +79,27 @@ class HooksManager : public QObject {
   // Monitors unsquashfs progress file changing.
   void monitorProgressFiles();
 
-  // This timer is used to read progress file each second.
+  // Stops monitoring unsquashfs progress and removes progress FIFO.
+  void stopMonitorProgressFiles();
+
+  // Reads unsquashfs progress and notifies UI thread if it has changed.
+  void updateUnsquashfsProgress();
+
+  // This timer is used to read progress file each second. It is kept for
+  // oem hooks which only write text progress file.
   QTimer* unsquashfs_timer_ = nullptr;
 
+  // Progress FIFO written by deepin-installer-unsquashfs each time its
+  // progress is updated, and its notifier, or -1 and nullptr.
+  int unsquashfs_fifo_fd_ = -1;
+  QSocketNotifier* unsquashfs_notifier_ = nullptr;
+
+  // Shared memory progress, mapped once while monitoring, or nullptr.
+  const ProgressShm* unsquashfs_shm_ = nullptr;
+
+  // Last progress value sent to UI thread.
+  int unsquashfs_progress_ = -1;
+
   // Recored the script run time
   bool enableScriptAnalyze;
   qlonglong lastRunTime;
@@ -88,6 +108,7 @@ class HooksManager : public QObject {
  private slots:
   void handleRunHooks();
   void handleReadUnsquashfsTimeout();
+  void handleUnsquashfsNotified();
 
   // Handles any errors.
   void onHooksManagerFinished();
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/content_hash.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace installer {
+
+namespace {
+
+const uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+const uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+// Content of holes, fed to hasher chunk by chunk.
+const uint8_t kZeros[kHashChunkSize] = {};
+
+inline uint64_t RotateLeft(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t Read64(const uint8_t* p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap64(value);
+#endif
+  return value;
+}
+
+inline uint32_t Read32(const uint8_t* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  value = __builtin_bswap32(value);
+#endif
+  return value;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+  acc += input * kPrime2;
+  acc = RotateLeft(acc, 31);
+  return acc * kPrime1;
+}
+
+inline uint64_t MergeRound(uint64_t acc, uint64_t value) {
+  acc ^= Round(0, value);
+  return acc * kPrime1 + kPrime4;
+}
+
+// Consume 32 bytes stripes of |data| into |acc|. Returns bytes consumed.
+size_t ConsumeStripes(uint64_t acc[4], const uint8_t* data, size_t len) {
+  const uint8_t* p = data;
+  const uint8_t* const limit = data + len - len % 32;
+  // Four independent lanes, which CPU runs in parallel.
+  uint64_t v1 = acc[0];
+  uint64_t v2 = acc[1];
+  uint64_t v3 = acc[2];
+  uint64_t v4 = acc[3];
+  while (p < limit) {
+    v1 = Round(v1, Read64(p));
+    v2 = Round(v2, Read64(p + 8));
+    v3 = Round(v3, Read64(p + 16));
+    v4 = Round(v4, Read64(p + 24));
+    p += 32;
+  }
+  acc[0] = v1;
+  acc[1] = v2;
+  acc[2] = v3;
+  acc[3] = v4;
+  return static_cast<size_t>(p - data);
+}
+
+}  // namespace
+
+Xxh64::Xxh64(uint64_t seed) {
+  reset(seed);
+}
+
+void Xxh64::reset(uint64_t seed) {
+  acc_[0] = seed + kPrime1 + kPrime2;
+  acc_[1] = seed + kPrime2;
+  acc_[2] = seed;
+  acc_[3] = seed - kPrime1;
+  seed_ = seed;
+  total_len_ = 0;
+  buf_len_ = 0;
+}
+
+void Xxh64::update(const void* data, size_t len) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  total_len_ += len;
+  if (buf_len_ > 0) {
+    const size_t n = std::min(len, sizeof(buf_) - buf_len_);
+    memcpy(buf_ + buf_len_, p, n);
+    buf_len_ += n;
+    p += n;
+    len -= n;
+    if (buf_len_ < sizeof(buf_)) {
+      return;
+    }
+    ConsumeStripes(acc_, buf_, sizeof(buf_));
+    buf_len_ = 0;
+  }
+  const size_t consumed = ConsumeStripes(acc_, p, len);
+  memcpy(buf_, p + consumed, len - consumed);
+  buf_len_ = len - consumed;
+}
+
+uint64_t Xxh64::digest() const {
+  uint64_t h;
+  if (total_len_ >= 32) {
+    h = RotateLeft(acc_[0], 1) + RotateLeft(acc_[1], 7) +
+        RotateLeft(acc_[2], 12) + RotateLeft(acc_[3], 18);
+    for (int i = 0; i < 4; ++i) {
+      h = MergeRound(h, acc_[i]);
+    }
+  } else {
+    h = seed_ + kPrime5;
+  }
+  h += total_len_;
+
+  const uint8_t* p = buf_;
+  const uint8_t* const end = buf_ + buf_len_;
+  for (; p + 8 <= end; p += 8) {
+    h ^= Round(0, Read64(p));
+    h = RotateLeft(h, 27) * kPrime1 + kPrime4;
+  }
+  if (p + 4 <= end) {
+    h ^= Read32(p) * kPrime1;
+    h = RotateLeft(h, 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= *p * kPrime5;
+    h = RotateLeft(h, 11) * kPrime1;
+  }
+
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t HashXxh64(const void* data, size_t len, uint64_t seed) {
+  Xxh64 hash(seed);
+  hash.update(data, len);
+  return hash.digest();
+}
+
+ContentHasher::ContentHasher() : chunk_len_(0), size_(0) {
+}
+
+void ContentHasher::update(const void* data, size_t len) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  size_ += len;
+  while (len > 0) {
+    const size_t n = std::min(len, kHashChunkSize - chunk_len_);
+    chunk_.update(p, n);
+    chunk_len_ += n;
+    p += n;
+    len -= n;
+    if (chunk_len_ == kHashChunkSize) {
+      chunks_.push_back(chunk_.digest());
+      chunk_.reset();
+      chunk_len_ = 0;
+    }
+  }
+}
+
+void ContentHasher::updateZeros(uint64_t len) {
+  while (len > 0) {
+    const size_t n = static_cast<size_t>(
+        std::min<uint64_t>(len, kHashChunkSize - chunk_len_));
+    update(kZeros, n);
+    len -= n;
+  }
+}
+
+const std::vector<uint64_t>& ContentHasher::finishChunks() {
+  if (chunk_len_ > 0) {
+    chunks_.push_back(chunk_.digest());
+    chunk_.reset();
+    chunk_len_ = 0;
+  }
+  return chunks_;
+}
+
+uint64_t ContentHasher::finish() {
+  return CombineChunkHashes(finishChunks(), size_);
+}
+
+uint64_t CombineChunkHashes(const std::vector<uint64_t>& chunks,
+                            uint64_t size) {
+  Xxh64 hash(size);
+  for (uint64_t digest : chunks) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; ++i) {
+      bytes[i] = static_cast<uint8_t>(digest >> (i * 8));
+    }
+    hash.update(bytes, sizeof(bytes));
+  }
+  return hash.digest();
+}
+
+bool HashFile(int fd, uint64_t& size, uint64_t& hash) {
+  std::vector<char> buf(4 * kHashChunkSize);
+  ContentHasher hasher;
+  bool ok = true;
+  while (true) {
+    const ssize_t len = read(fd, buf.data(), buf.size());
+    if (len < 0 && errno == EINTR) {
+      continue;
+    }
+    if (len <= 0) {
+      ok = (len == 0);
+      break;
+    }
+    hasher.update(buf.data(), static_cast<size_t>(len));
+  }
+  size = hasher.size();
+  hash = hasher.finish();
+  return ok;
+}
+
+}  // namespace installer
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_CONTENT_HASH_H
+#define INSTALLER_UNSQUASHFS_CONTENT_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace installer {
+
+// Size of chunks hashed independently of each other.
+const size_t kHashChunkSize = 64 * 1024;
+
+// Streaming XXH64 hash.
+class Xxh64 {
+ public:
+  explicit Xxh64(uint64_t seed = 0);
+
+  void reset(uint64_t seed = 0);
+  void update(const void* data, size_t len);
+  uint64_t digest() const;
+
+ private:
+  uint64_t acc_[4];
+  uint64_t seed_;
+  uint64_t total_len_;
+  // Input not yet consumed by a full 32 bytes stripe.
+  uint8_t buf_[32];
+  size_t buf_len_;
+};
+
+// XXH64 of |len| bytes at |data|.
+uint64_t HashXxh64(const void* data, size_t len, uint64_t seed = 0);
+
+// Content hash of a file. Content is cut into kHashChunkSize chunks, each
+// hashed with XXH64, then digests of chunks are hashed again seeded with
+// file size. Chunks are independent, so that parts of a large file written
+// by several workers are hashed by them at the same time.
+// Content hash of an empty file is XXH64 of nothing.
+class ContentHasher {
+ public:
+  ContentHasher();
+
+  // Append |len| bytes of content.
+  void update(const void* data, size_t len);
+
+  // Append |len| zero bytes, content of holes.
+  void updateZeros(uint64_t len);
+
+  // Finish the last partial chunk and return digests of all chunks.
+  const std::vector<uint64_t>& finishChunks();
+
+  // Returns content hash of all bytes appended.
+  uint64_t finish();
+
+  // Number of bytes appended.
+  uint64_t size() const { return size_; }
+
+ private:
+  Xxh64 chunk_;
+  size_t chunk_len_;
+  uint64_t size_;
+  std::vector<uint64_t> chunks_;
+};
+
+// Returns content hash of a file with |size| bytes from digests of its
+// chunks.
+uint64_t CombineChunkHashes(const std::vector<uint64_t>& chunks,
+                            uint64_t size);
+
+// Read file |fd| from its current offset to the end, and get |size| and
+// content hash of what was read. Returns false on read error.
+bool HashFile(int fd, uint64_t& size, uint64_t& hash);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_CONTENT_HASH_H
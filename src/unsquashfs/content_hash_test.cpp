@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/content_hash.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(ContentHash, HashXxh64) {
+  EXPECT_EQ(0xEF46DB3751D8E999ULL, HashXxh64("", 0));
+  EXPECT_EQ(0xD24EC4F1A98C6E5BULL, HashXxh64("a", 1));
+  EXPECT_EQ(0x44BC2CF5AD770999ULL, HashXxh64("abc", 3));
+  const char kText[] = "Nobody inspects the spammish repetition";
+  EXPECT_EQ(0xFBCEA83C8A378BF1ULL, HashXxh64(kText, strlen(kText)));
+
+  // Same digest when fed in pieces.
+  Xxh64 hash;
+  for (size_t i = 0; i < strlen(kText); ++i) {
+    hash.update(kText + i, 1);
+  }
+  EXPECT_EQ(0xFBCEA83C8A378BF1ULL, hash.digest());
+}
+
+TEST(ContentHash, ContentHasher) {
+  std::string content(kHashChunkSize * 2 + 1000, '\0');
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = static_cast<char>(i * 7 + i / 3);
+  }
+
+  ContentHasher whole;
+  whole.update(content.data(), content.size());
+  const std::vector<uint64_t> chunks = whole.finishChunks();
+  ASSERT_EQ(3u, chunks.size());
+  EXPECT_EQ(HashXxh64(content.data(), kHashChunkSize), chunks[0]);
+  EXPECT_EQ(HashXxh64(content.data() + kHashChunkSize * 2, 1000), chunks[2]);
+  const uint64_t digest = whole.finish();
+  EXPECT_EQ(CombineChunkHashes(chunks, content.size()), digest);
+
+  // Content split at random places gives the same hash.
+  ContentHasher pieces;
+  size_t offset = 0;
+  for (size_t len = 1; offset < content.size(); len = len * 3 + 1) {
+    len = std::min(len, content.size() - offset);
+    pieces.update(content.data() + offset, len);
+    offset += len;
+  }
+  EXPECT_EQ(digest, pieces.finish());
+
+  // Each chunk might be hashed by another worker.
+  ContentHasher first;
+  first.update(content.data(), kHashChunkSize);
+  ContentHasher rest;
+  rest.update(content.data() + kHashChunkSize,
+              content.size() - kHashChunkSize);
+  std::vector<uint64_t> joined = first.finishChunks();
+  for (uint64_t chunk : rest.finishChunks()) {
+    joined.push_back(chunk);
+  }
+  EXPECT_EQ(digest, CombineChunkHashes(joined, content.size()));
+}
+
+TEST(ContentHash, Zeros) {
+  ContentHasher empty;
+  EXPECT_EQ(0xEF46DB3751D8E999ULL, empty.finish());
+
+  const std::string zeros(kHashChunkSize + 10, '\0');
+  ContentHasher data;
+  data.update(zeros.data(), zeros.size());
+  ContentHasher hole;
+  hole.updateZeros(zeros.size());
+  EXPECT_EQ(data.finish(), hole.finish());
+  EXPECT_EQ(zeros.size(), hole.size());
+}
+
+}  // namespace
+}  // namespace installer
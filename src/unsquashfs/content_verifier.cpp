@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/content_verifier.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+namespace installer {
+
+bool WriteManifestEntry(FILE* fp, const std::string& path, int64_t size,
+                        uint64_t hash) {
+  return fprintf(fp, "%016" PRIx64 " %" PRId64 " %s\n",
+                 hash, size, path.c_str()) > 0;
+}
+
+ContentVerifier::ContentVerifier() : report_(nullptr), failures_(0) {
+}
+
+ContentVerifier::~ContentVerifier() {
+  if (report_ && report_ != stderr) {
+    fclose(report_);
+  }
+}
+
+bool ContentVerifier::open(const std::string& manifest_file,
+                           const std::string& report_file) {
+  FILE* fp = fopen(manifest_file.c_str(), "re");
+  if (!fp) {
+    fprintf(stderr, "ContentVerifier::open() failed to open %s: %s\n",
+            manifest_file.c_str(), strerror(errno));
+    return false;
+  }
+  char* line = nullptr;
+  size_t line_size = 0;
+  ssize_t len;
+  int line_number = 0;
+  bool ok = true;
+  while ((len = getline(&line, &line_size, fp)) > 0) {
+    ++line_number;
+    if (line[len - 1] == '\n') {
+      line[--len] = '\0';
+    }
+    if (len == 0) {
+      continue;
+    }
+    Entry entry;
+    int path_pos = 0;
+    if (sscanf(line, "%" SCNx64 " %" SCNd64 " %n",
+               &entry.hash, &entry.size, &path_pos) != 2 ||
+        path_pos == 0 || line[path_pos] != '/') {
+      fprintf(stderr, "ContentVerifier::open() invalid line %d of %s\n",
+              line_number, manifest_file.c_str());
+      ok = false;
+      break;
+    }
+    entry.checked = false;
+    entries_[std::string(line + path_pos)] = entry;
+  }
+  free(line);
+  fclose(fp);
+  if (!ok) {
+    return false;
+  }
+
+  if (report_file.empty()) {
+    report_ = stderr;
+  } else {
+    report_ = fopen(report_file.c_str(), "we");
+    if (!report_) {
+      fprintf(stderr, "ContentVerifier::open() failed to create %s: %s\n",
+              report_file.c_str(), strerror(errno));
+      return false;
+    }
+  }
+  fprintf(stdout, "manifest: %zu files\n", entries_.size());
+  return true;
+}
+
+bool ContentVerifier::check(const std::string& path, int64_t size,
+                            uint64_t hash) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(path);
+  if (it == entries_.end()) {
+    return true;
+  }
+  Entry& entry = it->second;
+  entry.checked = true;
+  if (entry.size == size && entry.hash == hash) {
+    return true;
+  }
+  char message[128];
+  snprintf(message, sizeof(message),
+           "expected %016" PRIx64 " %" PRId64 ", got %016" PRIx64
+           " %" PRId64, entry.hash, entry.size, hash, size);
+  report("MISMATCH", path, message);
+  return false;
+}
+
+bool ContentVerifier::matches(const std::string& path, int64_t size,
+                              uint64_t hash) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(path);
+  return it != entries_.end() && it->second.size == size &&
+         it->second.hash == hash;
+}
+
+void ContentVerifier::reportError(const std::string& path,
+                                  const char* message) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(path);
+  if (it != entries_.end()) {
+    it->second.checked = true;
+  }
+  report("ERROR", path, message);
+}
+
+void ContentVerifier::skip(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(path);
+  if (it != entries_.end()) {
+    it->second.checked = true;
+  }
+}
+
+void ContentVerifier::skipDir(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  skipped_dirs_.insert(path);
+}
+
+int64_t ContentVerifier::finish() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& item : entries_) {
+    if (!item.second.checked && !isInSkippedDir(item.first)) {
+      report("MISSING", item.first, "");
+    }
+  }
+  if (report_) {
+    fflush(report_);
+  }
+  return failures_;
+}
+
+int64_t ContentVerifier::numFailures() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return failures_;
+}
+
+void ContentVerifier::report(const char* kind, const std::string& path,
+                             const std::string& message) {
+  ++failures_;
+  if (!report_) {
+    return;
+  }
+  if (message.empty()) {
+    fprintf(report_, "%s %s\n", kind, path.c_str());
+  } else {
+    fprintf(report_, "%s %s: %s\n", kind, path.c_str(), message.c_str());
+  }
+  fflush(report_);
+}
+
+bool ContentVerifier::isInSkippedDir(const std::string& path) const {
+  if (skipped_dirs_.empty()) {
+    return false;
+  }
+  if (skipped_dirs_.count("/") > 0) {
+    return true;
+  }
+  size_t pos = path.size();
+  while ((pos = path.rfind('/', pos - 1)) != std::string::npos && pos > 0) {
+    if (skipped_dirs_.count(path.substr(0, pos)) > 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace installer
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_CONTENT_VERIFIER_H
+#define INSTALLER_UNSQUASHFS_CONTENT_VERIFIER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace installer {
+
+// Manifest lists content hash of regular files, one per line:
+//   <content hash in 16 hex digits> <size> <path>
+// |path| is relative to root of filesystem and starts with "/".
+// See ContentHasher for content hash.
+
+// Append entry of |path| to manifest |fp|.
+bool WriteManifestEntry(FILE* fp, const std::string& path, int64_t size,
+                        uint64_t hash);
+
+// Compares content hash of extracted files with manifest, and writes
+// mismatched, unreadable and missing files to failure report.
+// Its methods are thread safe.
+class ContentVerifier {
+ public:
+  ContentVerifier();
+  ~ContentVerifier();
+
+  // Load |manifest_file|, and create |report_file|. Failures are written to
+  // stderr if |report_file| is empty.
+  bool open(const std::string& manifest_file, const std::string& report_file);
+
+  // Compare |size| and |hash| of file |path| with manifest. Files not in
+  // manifest are ignored. Returns false if they do not match.
+  bool check(const std::string& path, int64_t size, uint64_t hash);
+
+  // Returns true if |path| is listed in manifest with |size| and |hash|.
+  // Nothing is reported or marked as checked.
+  bool matches(const std::string& path, int64_t size, uint64_t hash) const;
+
+  // Report that content of |path| cannot be read or written.
+  void reportError(const std::string& path, const char* message);
+
+  // Mark |path| as checked without hashing, as it is a hard link to a
+  // checked file.
+  void skip(const std::string& path);
+
+  // Mark files in folder |path| and its subtree as checked, as they were
+  // extracted and checked by previous run.
+  void skipDir(const std::string& path);
+
+  // Report files of manifest not checked as missing. Returns number of
+  // failures.
+  int64_t finish();
+
+  int64_t numFailures() const;
+
+ private:
+  ContentVerifier(const ContentVerifier&) = delete;
+  ContentVerifier& operator=(const ContentVerifier&) = delete;
+
+  struct Entry {
+    uint64_t hash;
+    int64_t size;
+    bool checked;
+  };
+
+  // Write one line to report, |mutex_| held.
+  void report(const char* kind, const std::string& path,
+              const std::string& message);
+
+  // Returns true if |path| is in a folder passed to skipDir().
+  bool isInSkippedDir(const std::string& path) const;
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_;
+  std::unordered_set<std::string> skipped_dirs_;
+  FILE* report_;
+  int64_t failures_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_CONTENT_VERIFIER_H
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/content_verifier.h"
+
+#include <stdio.h>
+
+#include <string>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kManifestFile[] = "/tmp/installer-content-verifier.manifest";
+const char kReportFile[] = "/tmp/installer-content-verifier.report";
+
+std::string ReadReport() {
+  std::string content;
+  FILE* fp = fopen(kReportFile, "r");
+  if (fp) {
+    char buf[256];
+    while (fgets(buf, sizeof(buf), fp)) {
+      content += buf;
+    }
+    fclose(fp);
+  }
+  return content;
+}
+
+TEST(ContentVerifier, Check) {
+  FILE* fp = fopen(kManifestFile, "w");
+  ASSERT_NE(nullptr, fp);
+  EXPECT_TRUE(WriteManifestEntry(fp, "/usr/bin/ls", 100, 0x1234));
+  EXPECT_TRUE(WriteManifestEntry(fp, "/usr/bin/cp", 200, 0x5678));
+  EXPECT_TRUE(WriteManifestEntry(fp, "/usr/lib/libc.so", 300, 0x9abc));
+  EXPECT_TRUE(WriteManifestEntry(fp, "/usr/lib/a/libm.so", 10, 0xdef0));
+  EXPECT_TRUE(WriteManifestEntry(fp, "/etc/hostname", 5, 0x1111));
+  fclose(fp);
+
+  {
+    ContentVerifier verifier;
+    ASSERT_TRUE(verifier.open(kManifestFile, kReportFile));
+    // Matching neither reports nor marks files as checked.
+    EXPECT_TRUE(verifier.matches("/usr/bin/ls", 100, 0x1234));
+    EXPECT_FALSE(verifier.matches("/usr/bin/ls", 101, 0x1234));
+    EXPECT_FALSE(verifier.matches("/usr/bin/mv", 1, 2));
+    EXPECT_TRUE(verifier.check("/usr/bin/ls", 100, 0x1234));
+    EXPECT_FALSE(verifier.check("/usr/bin/cp", 200, 0x5679));
+    // Files not in manifest are ignored.
+    EXPECT_TRUE(verifier.check("/usr/bin/mv", 1, 2));
+    verifier.skipDir("/usr/lib");
+    EXPECT_EQ(1, verifier.numFailures());
+    // /etc/hostname is missing.
+    EXPECT_EQ(2, verifier.finish());
+  }
+  EXPECT_EQ("MISMATCH /usr/bin/cp: expected 0000000000005678 200, "
+            "got 0000000000005679 200\n"
+            "MISSING /etc/hostname\n", ReadReport());
+
+  remove(kManifestFile);
+  remove(kReportFile);
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/dir_times.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+namespace installer {
+
+namespace {
+
+size_t Depth(const std::string& path) {
+  return static_cast<size_t>(std::count(path.begin(), path.end(), '/'));
+}
+
+}  // namespace
+
+DirTimes::DirTimes() {
+}
+
+void DirTimes::add(const std::string& path, const struct timespec& atime,
+                   const struct timespec& mtime) {
+  Entry entry;
+  entry.path = path;
+  entry.times[0] = atime;
+  entry.times[1] = mtime;
+  std::lock_guard<std::mutex> lock(mutex_);
+  dirs_.push_back(std::move(entry));
+}
+
+void DirTimes::restore() {
+  std::vector<Entry> dirs;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dirs.swap(dirs_);
+  }
+
+  // Deepest folders first, so that each folder is set after everything
+  // below it.
+  std::vector<std::pair<size_t, size_t>> order;
+  order.reserve(dirs.size());
+  for (size_t i = 0; i < dirs.size(); ++i) {
+    order.push_back(std::make_pair(Depth(dirs[i].path), i));
+  }
+  std::sort(order.begin(), order.end(),
+            [](const std::pair<size_t, size_t>& a,
+               const std::pair<size_t, size_t>& b) {
+              return a.first > b.first;
+            });
+
+  for (const auto& item : order) {
+    const Entry& entry = dirs[item.second];
+    if (utimensat(AT_FDCWD, entry.path.c_str(), entry.times,
+                  AT_SYMLINK_NOFOLLOW) != 0) {
+      fprintf(stderr, "DirTimes() utimensat() failed: %s, %s\n",
+              entry.path.c_str(), strerror(errno));
+    }
+  }
+}
+
+}  // namespace installer
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_DIR_TIMES_H
+#define INSTALLER_UNSQUASHFS_DIR_TIMES_H
+
+#include <time.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace installer {
+
+// Times of extracted folders. Creating items in a folder updates its mtime,
+// so times of folders are restored after all items are extracted, deepest
+// folders first.
+// add() is thread safe.
+class DirTimes {
+ public:
+  DirTimes();
+
+  // Remember access time |atime| and modification time |mtime| of folder
+  // at full |path|.
+  void add(const std::string& path, const struct timespec& atime,
+           const struct timespec& mtime);
+
+  // Set times of all folders added, children before their parents, then
+  // forget them. Errors are logged and ignored.
+  void restore();
+
+ private:
+  DirTimes(const DirTimes&) = delete;
+  DirTimes& operator=(const DirTimes&) = delete;
+
+  struct Entry {
+    std::string path;
+    struct timespec times[2];
+  };
+
+  std::mutex mutex_;
+  std::vector<Entry> dirs_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_DIR_TIMES_H
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/dir_times.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(DirTimes, Restore) {
+  char tmp_dir[] = "/tmp/installer-dir-times-XXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+  const std::string parent = std::string(tmp_dir) + "/a";
+  const std::string child = parent + "/b";
+  ASSERT_EQ(mkdir(parent.c_str(), 0755), 0);
+  ASSERT_EQ(mkdir(child.c_str(), 0755), 0);
+
+  struct timespec atime = {1000000000, 0};
+  struct timespec mtime = {1200000000, 500};
+  DirTimes dir_times;
+  // Parent is added first, as folders are created top down.
+  dir_times.add(parent, atime, mtime);
+  mtime.tv_sec += 1;
+  dir_times.add(child, atime, mtime);
+
+  // Items created afterwards do not change restored times.
+  const std::string file = child + "/file";
+  const int fd = open(file.c_str(), O_WRONLY | O_CREAT, 0644);
+  ASSERT_NE(fd, -1);
+  close(fd);
+  dir_times.restore();
+
+  struct stat st;
+  ASSERT_EQ(stat(parent.c_str(), &st), 0);
+  EXPECT_EQ(st.st_atim.tv_sec, 1000000000);
+  EXPECT_EQ(st.st_mtim.tv_sec, 1200000000);
+  EXPECT_EQ(st.st_mtim.tv_nsec, 500);
+  ASSERT_EQ(stat(child.c_str(), &st), 0);
+  EXPECT_EQ(st.st_mtim.tv_sec, 1200000001);
+
+  // Folders are forgotten after restored.
+  ASSERT_EQ(unlink(file.c_str()), 0);
+  dir_times.restore();
+  ASSERT_EQ(stat(child.c_str(), &st), 0);
+  EXPECT_NE(st.st_mtim.tv_sec, 1200000001);
+
+  EXPECT_EQ(rmdir(child.c_str()), 0);
+  EXPECT_EQ(rmdir(parent.c_str()), 0);
+  EXPECT_EQ(rmdir(tmp_dir), 0);
+}
+
+}  // namespace
+}  // namespace installer
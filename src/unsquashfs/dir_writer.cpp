@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/dir_writer.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+namespace installer {
+
+DirWriter::DirWriter() {
+}
+
+DirWriter::~DirWriter() {
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+bool DirWriter::open(const std::string& path) {
+  path_ = path;
+  fd_ = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  return (fd_ != -1);
+}
+
+const char* DirWriter::fullPath(const char* name) const {
+  thread_local std::string buf;
+  buf.assign(path_);
+  buf.push_back('/');
+  buf.append(name);
+  return buf.c_str();
+}
+
+void DirWriter::removeItem(const char* name) {
+  // Fails with EISDIR for folders and ENOENT for new items, both ignored.
+  unlinkat(fd_, name, 0);
+}
+
+bool DirWriter::removeTree(const char* name) {
+  if (unlinkat(fd_, name, 0) == 0 || errno == ENOENT) {
+    return true;
+  }
+  if (errno != EISDIR && errno != EPERM) {
+    return false;
+  }
+  DirWriter dir;
+  std::vector<std::string> names;
+  struct stat dir_st;
+  if (!dir.open(fullPath(name)) || fstat(dir.fd(), &dir_st) != 0 ||
+      !dir.listItems(names)) {
+    return false;
+  }
+  bool ok = true;
+  for (const std::string& item : names) {
+    struct stat st;
+    if (dir.statItem(item.c_str(), st) && st.st_dev != dir_st.st_dev) {
+      // Mount point is kept with everything in it.
+      errno = EBUSY;
+      ok = false;
+    } else if (!dir.removeTree(item.c_str())) {
+      return false;
+    }
+  }
+  return ok && (unlinkat(fd_, name, AT_REMOVEDIR) == 0);
+}
+
+bool DirWriter::listItems(std::vector<std::string>& names) const {
+  names.clear();
+  // closedir() closes its own descriptor.
+  const int fd = openat(fd_, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  DIR* dir = fdopendir(fd);
+  if (dir == nullptr) {
+    close(fd);
+    return false;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+      names.push_back(entry->d_name);
+    }
+  }
+  closedir(dir);
+  return true;
+}
+
+int DirWriter::createFile(const char* name) {
+  // TODO(xushaohua): handles umask
+  return openat(fd_, name, O_CREAT | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR);
+}
+
+bool DirWriter::createDir(const char* name, mode_t mode) {
+  return (mkdirat(fd_, name, mode) == 0 || errno == EEXIST);
+}
+
+bool DirWriter::createSymlink(const char* name, const char* target) {
+  return (symlinkat(target, fd_, name) == 0 || errno == EEXIST);
+}
+
+bool DirWriter::createNode(const char* name, mode_t mode, dev_t rdev) {
+  return (mknodat(fd_, name, mode, rdev) == 0);
+}
+
+bool DirWriter::linkFrom(const char* target, const char* name) {
+  return (linkat(AT_FDCWD, target, fd_, name, 0) == 0);
+}
+
+bool DirWriter::setOwner(const char* name, uid_t uid, gid_t gid) {
+  return (fchownat(fd_, name, uid, gid, AT_SYMLINK_NOFOLLOW) == 0);
+}
+
+bool DirWriter::statItem(const char* name, struct stat& st) const {
+  return (fstatat(fd_, name, &st, AT_SYMLINK_NOFOLLOW) == 0);
+}
+
+bool DirWriter::setMode(const char* name, mode_t mode) {
+  return (fchmodat(fd_, name, mode, 0) == 0);
+}
+
+bool DirWriter::setTimes(const char* name, const struct timespec times[2]) {
+  return (utimensat(fd_, name, times, AT_SYMLINK_NOFOLLOW) == 0);
+}
+
+bool DirWriter::setXattr(const char* name, const char* key,
+                         const void* value, size_t size) {
+  // There is no *at() variant of setxattr().
+  return (lsetxattr(fullPath(name), key, value, size, 0) == 0);
+}
+
+}  // namespace installer
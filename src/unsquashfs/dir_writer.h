@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_DIR_WRITER_H
+#define INSTALLER_UNSQUASHFS_DIR_WRITER_H
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+namespace installer {
+
+// Creates items in one destination folder with *at() system calls relative
+// to an open descriptor of that folder, so that kernel resolves only the
+// last path component of each item.
+// Full paths are only built for system calls without *at() variant, in a
+// buffer reused by each thread.
+// All methods are thread safe.
+class DirWriter {
+ public:
+  DirWriter();
+  ~DirWriter();
+
+  // Open folder at |path|.
+  bool open(const std::string& path);
+
+  int fd() const { return fd_; }
+  const std::string& path() const { return path_; }
+
+  // Returns full path of item |name|. Returned buffer is reused by the next
+  // call in the same thread.
+  const char* fullPath(const char* name) const;
+
+  // Remove item |name| if it exists and is not a folder.
+  void removeItem(const char* name);
+
+  // Remove item |name|, or folder |name| and everything in it. Mount points
+  // in the folder are not crossed, they are kept and false is returned.
+  bool removeTree(const char* name);
+
+  // Get names of items in this folder, "." and ".." excluded.
+  bool listItems(std::vector<std::string>& names) const;
+
+  // Create regular file |name| for writing. Returns file descriptor, or -1.
+  int createFile(const char* name);
+
+  bool createDir(const char* name, mode_t mode);
+  bool createSymlink(const char* name, const char* target);
+  // Create device, fifo or socket, |mode| includes file type.
+  bool createNode(const char* name, mode_t mode, dev_t rdev);
+
+  // Create hard link |name| to existing file at absolute path |target|.
+  bool linkFrom(const char* target, const char* name);
+
+  // Get status of |name|, without following symbolic link.
+  bool statItem(const char* name, struct stat& st) const;
+
+  // Update ownership of |name|, without following symbolic link.
+  bool setOwner(const char* name, uid_t uid, gid_t gid);
+  // Update permissions of |name|, which shall not be a symbolic link.
+  bool setMode(const char* name, mode_t mode);
+  // Set access and modification time of |name|, without following symbolic
+  // link.
+  bool setTimes(const char* name, const struct timespec times[2]);
+  // Set xattr of |name|, without following symbolic link.
+  bool setXattr(const char* name, const char* key, const void* value,
+                size_t size);
+
+ private:
+  DirWriter(const DirWriter&) = delete;
+  DirWriter& operator=(const DirWriter&) = delete;
+
+  int fd_ = -1;
+  std::string path_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_DIR_WRITER_H
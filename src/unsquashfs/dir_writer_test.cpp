@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/dir_writer.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(DirWriter, CreateItems) {
+  char tmp_dir[] = "/tmp/installer-dir-writer-XXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+
+  DirWriter writer;
+  ASSERT_TRUE(writer.open(tmp_dir));
+  EXPECT_EQ(writer.path(), tmp_dir);
+  EXPECT_EQ(std::string(writer.fullPath("file")),
+            std::string(tmp_dir) + "/file");
+
+  const int fd = writer.createFile("file");
+  ASSERT_NE(fd, -1);
+  EXPECT_EQ(write(fd, "abc", 3), 3);
+  close(fd);
+  EXPECT_TRUE(writer.setMode("file", 0640));
+  struct stat st;
+  ASSERT_EQ(stat(writer.fullPath("file"), &st), 0);
+  EXPECT_TRUE(S_ISREG(st.st_mode));
+  EXPECT_EQ(st.st_mode & 07777, 0640u);
+  EXPECT_EQ(st.st_size, 3);
+
+  EXPECT_TRUE(writer.createDir("dir", 0755));
+  // Existing folder is accepted.
+  EXPECT_TRUE(writer.createDir("dir", 0755));
+  EXPECT_TRUE(writer.createSymlink("link", "file"));
+  char target[PATH_MAX] = {0};
+  EXPECT_EQ(readlink(writer.fullPath("link"), target, PATH_MAX - 1), 4);
+  EXPECT_STREQ(target, "file");
+
+  const std::string file_path = writer.fullPath("file");
+  EXPECT_TRUE(writer.linkFrom(file_path.c_str(), "hard"));
+  ASSERT_EQ(stat(writer.fullPath("hard"), &st), 0);
+  EXPECT_EQ(st.st_nlink, 2u);
+
+  // Folders are kept, other items are removed.
+  writer.removeItem("dir");
+  writer.removeItem("link");
+  writer.removeItem("hard");
+  writer.removeItem("file");
+  EXPECT_EQ(access(writer.fullPath("dir"), F_OK), 0);
+  EXPECT_NE(access(writer.fullPath("file"), F_OK), 0);
+
+  EXPECT_EQ(rmdir(writer.fullPath("dir")), 0);
+  EXPECT_EQ(rmdir(tmp_dir), 0);
+}
+
+TEST(DirWriter, RemoveTree) {
+  char tmp_dir[] = "/tmp/installer-dir-writer-XXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+  DirWriter writer;
+  ASSERT_TRUE(writer.open(tmp_dir));
+  ASSERT_TRUE(writer.createDir("dir", 0755));
+  ASSERT_TRUE(writer.createDir("dir/sub", 0755));
+  const int fd = writer.createFile("dir/sub/file");
+  ASSERT_NE(fd, -1);
+  close(fd);
+  ASSERT_TRUE(writer.createSymlink("dir/link", "sub"));
+  ASSERT_TRUE(writer.createSymlink("link", "dir"));
+
+  std::vector<std::string> names;
+  ASSERT_TRUE(writer.listItems(names));
+  std::sort(names.begin(), names.end());
+  EXPECT_EQ(names, std::vector<std::string>({"dir", "link"}));
+
+  // Symbolic links are removed, not followed.
+  EXPECT_TRUE(writer.removeTree("link"));
+  EXPECT_EQ(access(writer.fullPath("dir/sub/file"), F_OK), 0);
+  EXPECT_TRUE(writer.removeTree("dir"));
+  EXPECT_TRUE(writer.removeTree("missing"));
+  ASSERT_TRUE(writer.listItems(names));
+  EXPECT_TRUE(names.empty());
+
+  EXPECT_EQ(rmdir(tmp_dir), 0);
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace installer {
+
+namespace {
+
+const uint32_t kJournalMagic = 0x4c4e4a55;  // "UJNL"
+const uint32_t kJournalVersion = 1;
+
+const uint32_t kRecordDir = 1;
+const uint32_t kRecordFile = 2;
+
+// Pending records are written once they reach this size. Records lost in a
+// crash only cause those items to be extracted again.
+const size_t kFlushSize = 64 * 1024;
+
+struct JournalHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t image_id;
+};
+
+}  // namespace
+
+ExtractJournal::ExtractJournal() {
+}
+
+ExtractJournal::~ExtractJournal() {
+  if (fd_ != -1) {
+    this->flush();
+    close(fd_);
+  }
+}
+
+bool ExtractJournal::open(const std::string& journal_file, uint64_t image_id,
+                          bool resume) {
+  journal_file_ = journal_file;
+  fd_ = ::open(journal_file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd_ == -1) {
+    fprintf(stderr, "ExtractJournal() failed to open %s: %s\n",
+            journal_file.c_str(), strerror(errno));
+    return false;
+  }
+
+  // Read old journal.
+  std::string data;
+  if (resume) {
+    char buf[64 * 1024];
+    ssize_t num_read;
+    while ((num_read = read(fd_, buf, sizeof(buf))) > 0) {
+      data.append(buf, static_cast<size_t>(num_read));
+    }
+  }
+
+  JournalHeader header;
+  size_t valid_size = 0;
+  if (data.size() >= sizeof(header)) {
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.magic == kJournalMagic && header.version == kJournalVersion &&
+        header.image_id == image_id) {
+      valid_size = sizeof(header) + this->load(data.substr(sizeof(header)));
+    } else {
+      fprintf(stderr, "ExtractJournal() %s is not written for this image, "
+              "ignored\n", journal_file.c_str());
+    }
+  }
+
+  // Drop old records which are not used, or the truncated last record.
+  if (ftruncate(fd_, static_cast<off_t>(valid_size)) != 0 ||
+      lseek(fd_, static_cast<off_t>(valid_size), SEEK_SET) == -1) {
+    fprintf(stderr, "ExtractJournal() failed to reset %s: %s\n",
+            journal_file.c_str(), strerror(errno));
+    return false;
+  }
+  if (valid_size == 0) {
+    header.magic = kJournalMagic;
+    header.version = kJournalVersion;
+    header.image_id = image_id;
+    buffer_.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    return this->flush();
+  }
+  return true;
+}
+
+bool ExtractJournal::isDirDone(const std::string& path, int64_t& files,
+                               int64_t& bytes) const {
+  const auto iter = dirs_.find(path);
+  if (iter == dirs_.end()) {
+    return false;
+  }
+  files = iter->second.files;
+  bytes = iter->second.size;
+  return true;
+}
+
+bool ExtractJournal::isFileDone(const std::string& path,
+                                const struct stat& st) const {
+  const auto iter = files_.find(path);
+  if (iter == files_.end()) {
+    return false;
+  }
+  const Record& record = iter->second;
+  return (S_ISREG(st.st_mode) &&
+          st.st_size == record.size &&
+          st.st_mtim.tv_sec == record.mtime_sec &&
+          st.st_mtim.tv_nsec == record.mtime_nsec);
+}
+
+std::vector<std::pair<uint64_t, std::string>> ExtractJournal::links() const {
+  std::vector<std::pair<uint64_t, std::string>> links;
+  for (const auto& item : files_) {
+    if (item.second.inode != 0) {
+      links.push_back(std::make_pair(item.second.inode, item.first));
+    }
+  }
+  return links;
+}
+
+void ExtractJournal::addDir(const std::string& path, int64_t files,
+                            int64_t bytes) {
+  Record record;
+  memset(&record, 0, sizeof(record));
+  record.type = kRecordDir;
+  record.size = bytes;
+  record.files = files;
+  this->append(record, path);
+}
+
+void ExtractJournal::addFile(const std::string& path, const struct stat& st,
+                             uint64_t inode) {
+  Record record;
+  memset(&record, 0, sizeof(record));
+  record.type = kRecordFile;
+  record.size = st.st_size;
+  record.mtime_sec = st.st_mtim.tv_sec;
+  record.mtime_nsec = st.st_mtim.tv_nsec;
+  record.inode = inode;
+  this->append(record, path);
+}
+
+bool ExtractJournal::flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (fd_ == -1) {
+    return false;
+  }
+  const char* data = buffer_.data();
+  size_t len = buffer_.size();
+  while (len > 0) {
+    const ssize_t num_written = write(fd_, data, len);
+    if (num_written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num_written <= 0) {
+      fprintf(stderr, "ExtractJournal() failed to write %s: %s\n",
+              journal_file_.c_str(), strerror(errno));
+      buffer_.clear();
+      return false;
+    }
+    data += num_written;
+    len -= static_cast<size_t>(num_written);
+  }
+  buffer_.clear();
+  return true;
+}
+
+bool ExtractJournal::remove() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer_.clear();
+    if (fd_ != -1) {
+      close(fd_);
+      fd_ = -1;
+    }
+  }
+  if (unlink(journal_file_.c_str()) != 0 && errno != ENOENT) {
+    fprintf(stderr, "ExtractJournal() failed to remove %s: %s\n",
+            journal_file_.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+size_t ExtractJournal::load(const std::string& data) {
+  size_t pos = 0;
+  Record record;
+  while (pos + sizeof(record) <= data.size()) {
+    memcpy(&record, data.data() + pos, sizeof(record));
+    const size_t end = pos + sizeof(record) + record.path_size;
+    if (end > data.size() ||
+        (record.type != kRecordDir && record.type != kRecordFile)) {
+      break;
+    }
+    const std::string path(data, pos + sizeof(record), record.path_size);
+    if (record.type == kRecordDir) {
+      dirs_[path] = record;
+    } else {
+      files_[path] = record;
+    }
+    pos = end;
+  }
+  return pos;
+}
+
+void ExtractJournal::append(const Record& record, const std::string& path) {
+  Record item = record;
+  item.path_size = static_cast<uint32_t>(path.size());
+  bool full;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ == -1) {
+      return;
+    }
+    buffer_.append(reinterpret_cast<const char*>(&item), sizeof(item));
+    buffer_.append(path);
+    full = (buffer_.size() >= kFlushSize);
+  }
+  if (full) {
+    this->flush();
+  }
+}
+
+}  // namespace installer
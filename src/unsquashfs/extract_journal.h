@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_EXTRACT_JOURNAL_H
+#define INSTALLER_UNSQUASHFS_EXTRACT_JOURNAL_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace installer {
+
+// Name of journal file in dest folder.
+const char kExtractJournalFile[] = ".deepin-installer-unsquashfs.journal";
+
+// Append-only log of finished items, so that an interrupted extraction can
+// be resumed without writing everything again.
+// Paths are relative to dest folder and start with "/", and "/" itself is
+// the dest folder.
+// Records of previous run are loaded once in open() and never modified, so
+// that lookup methods are thread safe. Other methods are thread safe too.
+class ExtractJournal {
+ public:
+  ExtractJournal();
+  ~ExtractJournal();
+
+  // Open |journal_file| for appending. If |resume| is true, records of
+  // previous run are loaded, unless they were written for another image.
+  // |image_id| identifies the source image.
+  bool open(const std::string& journal_file, uint64_t image_id, bool resume);
+
+  // Returns true if all items in folder |path| were finished in previous
+  // run. |files| and |bytes| are set to number of items and size of regular
+  // files in it.
+  bool isDirDone(const std::string& path, int64_t& files,
+                 int64_t& bytes) const;
+
+  // Returns true if regular file |path| was finished in previous run, and
+  // dest file |st| still has the recorded size and mtime.
+  bool isFileDone(const std::string& path, const struct stat& st) const;
+
+  // Returns inode number and path of finished files with several names
+  // in previous run.
+  std::vector<std::pair<uint64_t, std::string>> links() const;
+
+  // Record that all items in folder |path| are finished.
+  void addDir(const std::string& path, int64_t files, int64_t bytes);
+
+  // Record that regular file |path| is finished and has |st| now.
+  // |inode| is its inode number in image if it has several names, or 0.
+  void addFile(const std::string& path, const struct stat& st,
+               uint64_t inode);
+
+  // Write pending records to journal file.
+  bool flush();
+
+  // Remove journal file, after all items are extracted.
+  bool remove();
+
+ private:
+  ExtractJournal(const ExtractJournal&) = delete;
+  ExtractJournal& operator=(const ExtractJournal&) = delete;
+
+  struct Record {
+    uint32_t type;
+    uint32_t path_size;
+    // Size of file, or total size of regular files in folder.
+    int64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t inode;
+    // Number of items in folder.
+    int64_t files;
+  };
+
+  // Parse records in |data|. Returns size of valid records, as the last one
+  // might be truncated by a crash.
+  size_t load(const std::string& data);
+
+  void append(const Record& record, const std::string& path);
+
+  std::string journal_file_;
+  int fd_ = -1;
+
+  std::unordered_map<std::string, Record> dirs_;
+  std::unordered_map<std::string, Record> files_;
+
+  // Protects |buffer_| and |fd_| after open().
+  std::mutex mutex_;
+  std::string buffer_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_EXTRACT_JOURNAL_H
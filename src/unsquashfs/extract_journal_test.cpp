@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_journal.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kJournalFile[] = "/tmp/installer-unsquashfs-journal";
+
+TEST(ExtractJournal, Resume) {
+  struct stat st;
+  memset(&st, 0, sizeof(st));
+  st.st_mode = S_IFREG | 0644;
+  st.st_size = 4096;
+  st.st_mtim.tv_sec = 1500000000;
+  st.st_mtim.tv_nsec = 123;
+
+  {
+    ExtractJournal journal;
+    ASSERT_TRUE(journal.open(kJournalFile, 42, false));
+    journal.addFile("/usr/bin/ls", st, 0);
+    journal.addFile("/usr/bin/vi", st, 17);
+    journal.addDir("/usr/bin", 2, 8192);
+  }
+
+  ExtractJournal journal;
+  ASSERT_TRUE(journal.open(kJournalFile, 42, true));
+  int64_t files = 0;
+  int64_t bytes = 0;
+  EXPECT_TRUE(journal.isDirDone("/usr/bin", files, bytes));
+  EXPECT_EQ(files, 2);
+  EXPECT_EQ(bytes, 8192);
+  EXPECT_FALSE(journal.isDirDone("/usr", files, bytes));
+  EXPECT_TRUE(journal.isFileDone("/usr/bin/ls", st));
+  ASSERT_EQ(journal.links().size(), 1u);
+  EXPECT_EQ(journal.links()[0].first, 17u);
+  EXPECT_EQ(journal.links()[0].second, "/usr/bin/vi");
+
+  // File changed after it was recorded.
+  st.st_size = 100;
+  EXPECT_FALSE(journal.isFileDone("/usr/bin/ls", st));
+  EXPECT_TRUE(journal.remove());
+}
+
+TEST(ExtractJournal, OtherImage) {
+  struct stat st;
+  memset(&st, 0, sizeof(st));
+  st.st_mode = S_IFREG | 0644;
+  {
+    ExtractJournal journal;
+    ASSERT_TRUE(journal.open(kJournalFile, 1, false));
+    journal.addFile("/etc/passwd", st, 0);
+  }
+
+  // Records of another image are dropped.
+  ExtractJournal journal;
+  ASSERT_TRUE(journal.open(kJournalFile, 2, true));
+  EXPECT_FALSE(journal.isFileDone("/etc/passwd", st));
+  EXPECT_TRUE(journal.remove());
+}
+
+TEST(ExtractJournal, TruncatedRecord) {
+  struct stat st;
+  memset(&st, 0, sizeof(st));
+  st.st_mode = S_IFREG | 0644;
+  {
+    ExtractJournal journal;
+    ASSERT_TRUE(journal.open(kJournalFile, 1, false));
+    journal.addFile("/etc/passwd", st, 0);
+  }
+  // Append part of a record, as if writing it was interrupted.
+  FILE* fp = fopen(kJournalFile, "a");
+  ASSERT_NE(fp, nullptr);
+  fwrite("\x02\0\0\0", 1, 4, fp);
+  fclose(fp);
+
+  {
+    ExtractJournal journal;
+    ASSERT_TRUE(journal.open(kJournalFile, 1, true));
+    EXPECT_TRUE(journal.isFileDone("/etc/passwd", st));
+    journal.addFile("/etc/group", st, 0);
+  }
+
+  ExtractJournal journal;
+  ASSERT_TRUE(journal.open(kJournalFile, 1, true));
+  EXPECT_TRUE(journal.isFileDone("/etc/passwd", st));
+  EXPECT_TRUE(journal.isFileDone("/etc/group", st));
+  EXPECT_TRUE(journal.remove());
+}
+
+}  // namespace
+}  // namespace installer
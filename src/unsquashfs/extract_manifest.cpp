@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_manifest.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "unsquashfs/content_hash.h"
+
+namespace installer {
+
+namespace {
+
+// Layout of manifest file does not depend on compiler.
+static_assert(sizeof(ExtractManifestHeader) == 24, "header size");
+static_assert(sizeof(ExtractManifestRecord) == 48, "record size");
+
+// Returns number of hash table buckets for |num_entries| items.
+size_t GetNumBuckets(size_t num_entries) {
+  size_t num_buckets = 16;
+  while (num_buckets < num_entries * 2) {
+    num_buckets *= 2;
+  }
+  return num_buckets;
+}
+
+bool WriteAll(FILE* fp, const void* data, size_t len) {
+  return len == 0 || fwrite(data, 1, len, fp) == len;
+}
+
+// Read all xattrs of |path|, without following symbolic link.
+bool ReadXattrs(const std::string& path,
+                std::vector<std::pair<std::string, std::string>>& xattrs) {
+  xattrs.clear();
+  const ssize_t list_size = llistxattr(path.c_str(), nullptr, 0);
+  if (list_size < 0) {
+    // Filesystem without xattr support has no xattr.
+    return errno == ENOTSUP;
+  }
+  std::vector<char> names(static_cast<size_t>(list_size));
+  const ssize_t names_size = llistxattr(path.c_str(), names.data(),
+                                        names.size());
+  if (names_size < 0) {
+    return false;
+  }
+  for (ssize_t pos = 0; pos < names_size;
+       pos += static_cast<ssize_t>(strlen(names.data() + pos)) + 1) {
+    const char* name = names.data() + pos;
+    const ssize_t value_size = lgetxattr(path.c_str(), name, nullptr, 0);
+    if (value_size < 0) {
+      return false;
+    }
+    std::string value(static_cast<size_t>(value_size), '\0');
+    if (value_size > 0 &&
+        lgetxattr(path.c_str(), name, &value[0], value.size()) !=
+            value_size) {
+      return false;
+    }
+    xattrs.push_back(std::make_pair(std::string(name), value));
+  }
+  return true;
+}
+
+// Hash content of regular file |path|.
+bool HashFilePath(const std::string& path, uint64_t& size, uint64_t& hash) {
+  const int fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  const bool ok = HashFile(fd, size, hash);
+  close(fd);
+  return ok;
+}
+
+std::string FormatMismatch(const char* name, unsigned long long value,
+                           unsigned long long expected, bool octal) {
+  char buf[128];
+  snprintf(buf, sizeof(buf), octal ? "%s %llo, expected %llo" :
+                                     "%s %llu, expected %llu",
+           name, value, expected);
+  return buf;
+}
+
+}  // namespace
+
+uint64_t HashXattrs(std::vector<std::pair<std::string, std::string>> xattrs) {
+  if (xattrs.empty()) {
+    return 0;
+  }
+  std::sort(xattrs.begin(), xattrs.end());
+  Xxh64 hasher;
+  for (const auto& xattr : xattrs) {
+    // Name is terminated, and value is prefixed by its size.
+    hasher.update(xattr.first.c_str(), xattr.first.size() + 1);
+    const uint32_t value_size = static_cast<uint32_t>(xattr.second.size());
+    hasher.update(&value_size, sizeof(value_size));
+    hasher.update(xattr.second.data(), xattr.second.size());
+  }
+  return hasher.digest();
+}
+
+ExtractManifestWriter::ExtractManifestWriter() {
+}
+
+void ExtractManifestWriter::add(const ExtractManifestEntry& entry) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.push_back(entry);
+}
+
+void ExtractManifestWriter::addLink(const std::string& path,
+                                    const std::string& target) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  links_.push_back(std::make_pair(path, target));
+}
+
+bool ExtractManifestWriter::write(const std::string& manifest_file) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto by_path = [](const ExtractManifestEntry& a,
+                          const ExtractManifestEntry& b) {
+    return a.path < b.path;
+  };
+  std::sort(entries_.begin(), entries_.end(), by_path);
+
+  // Other names of a file share its attributes and content.
+  const size_t num_files = entries_.size();
+  ExtractManifestEntry key;
+  for (const auto& link : links_) {
+    key.path = link.second;
+    const auto target = std::lower_bound(entries_.begin(),
+                                         entries_.begin() + num_files, key,
+                                         by_path);
+    if (target == entries_.begin() + num_files ||
+        target->path != link.second) {
+      fprintf(stderr, "ExtractManifestWriter::write() link target not "
+              "found: %s -> %s\n", link.first.c_str(), link.second.c_str());
+      continue;
+    }
+    ExtractManifestEntry entry = *target;
+    entry.path = link.first;
+    entries_.push_back(std::move(entry));
+  }
+  links_.clear();
+  std::sort(entries_.begin(), entries_.end(), by_path);
+  entries_.erase(std::unique(entries_.begin(), entries_.end(),
+                             [](const ExtractManifestEntry& a,
+                                const ExtractManifestEntry& b) {
+                               return a.path == b.path;
+                             }),
+                 entries_.end());
+
+  std::vector<ExtractManifestRecord> records(entries_.size());
+  std::vector<uint32_t> buckets(GetNumBuckets(entries_.size()), 0);
+  const size_t mask = buckets.size() - 1;
+  std::string strings;
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const ExtractManifestEntry& entry = entries_[i];
+    if (strings.size() + entry.path.size() > UINT32_MAX) {
+      fprintf(stderr, "ExtractManifestWriter::write() too many items\n");
+      return false;
+    }
+    ExtractManifestRecord& record = records[i];
+    memset(&record, 0, sizeof(record));
+    record.size = entry.size;
+    record.content_hash = entry.content_hash;
+    record.xattr_hash = entry.xattr_hash;
+    record.path_offset = static_cast<uint32_t>(strings.size());
+    record.path_size = static_cast<uint32_t>(entry.path.size());
+    record.mode = entry.mode;
+    record.uid = entry.uid;
+    record.gid = entry.gid;
+    record.flags = entry.hashed ? kExtractManifestHashed : 0;
+    strings.append(entry.path);
+
+    size_t bucket = HashXxh64(entry.path.data(), entry.path.size()) & mask;
+    while (buckets[bucket] != 0) {
+      bucket = (bucket + 1) & mask;
+    }
+    buckets[bucket] = static_cast<uint32_t>(i + 1);
+  }
+
+  ExtractManifestHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kExtractManifestMagic;
+  header.version = kExtractManifestVersion;
+  header.num_entries = static_cast<uint32_t>(records.size());
+  header.num_buckets = static_cast<uint32_t>(buckets.size());
+  header.strings_size = strings.size();
+
+  // Readers never see a partial manifest.
+  const std::string tmp_file = manifest_file + ".tmp";
+  FILE* fp = fopen(tmp_file.c_str(), "we");
+  if (fp == nullptr) {
+    fprintf(stderr, "ExtractManifestWriter::write() failed to open %s: %s\n",
+            tmp_file.c_str(), strerror(errno));
+    return false;
+  }
+  bool ok = WriteAll(fp, &header, sizeof(header)) &&
+            WriteAll(fp, records.data(),
+                     records.size() * sizeof(ExtractManifestRecord)) &&
+            WriteAll(fp, buckets.data(), buckets.size() * sizeof(uint32_t)) &&
+            WriteAll(fp, strings.data(), strings.size());
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok || rename(tmp_file.c_str(), manifest_file.c_str()) != 0) {
+    fprintf(stderr, "ExtractManifestWriter::write() failed to write %s: %s\n",
+            manifest_file.c_str(), strerror(errno));
+    unlink(tmp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+ExtractManifest::ExtractManifest()
+    : data_(nullptr),
+      data_size_(0),
+      num_entries_(0),
+      num_buckets_(0),
+      records_(nullptr),
+      buckets_(nullptr),
+      strings_(nullptr),
+      strings_size_(0) {
+}
+
+ExtractManifest::~ExtractManifest() {
+  close();
+}
+
+void ExtractManifest::close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t*>(data_), data_size_);
+    data_ = nullptr;
+  }
+  data_size_ = 0;
+  num_entries_ = 0;
+  num_buckets_ = 0;
+}
+
+bool ExtractManifest::open(const std::string& manifest_file) {
+  close();
+  const int fd = ::open(manifest_file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(stderr, "ExtractManifest::open() failed to open %s: %s\n",
+            manifest_file.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      st.st_size < static_cast<off_t>(sizeof(ExtractManifestHeader))) {
+    fprintf(stderr, "ExtractManifest::open() invalid manifest: %s\n",
+            manifest_file.c_str());
+    ::close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                    MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "ExtractManifest::open() mmap() failed: %s, %s\n",
+            manifest_file.c_str(), strerror(errno));
+    return false;
+  }
+  data_ = static_cast<const uint8_t*>(data);
+  data_size_ = static_cast<size_t>(st.st_size);
+
+  const ExtractManifestHeader* header =
+      reinterpret_cast<const ExtractManifestHeader*>(data_);
+  const uint64_t records_size =
+      uint64_t(header->num_entries) * sizeof(ExtractManifestRecord);
+  const uint64_t buckets_size = uint64_t(header->num_buckets) *
+                                sizeof(uint32_t);
+  if (header->magic != kExtractManifestMagic ||
+      header->version != kExtractManifestVersion ||
+      header->num_buckets < header->num_entries ||
+      header->num_buckets == 0 ||
+      (header->num_buckets & (header->num_buckets - 1)) != 0 ||
+      header->strings_size > data_size_ ||
+      sizeof(ExtractManifestHeader) + records_size + buckets_size +
+          header->strings_size != data_size_) {
+    fprintf(stderr, "ExtractManifest::open() invalid manifest: %s\n",
+            manifest_file.c_str());
+    close();
+    return false;
+  }
+  num_entries_ = header->num_entries;
+  num_buckets_ = header->num_buckets;
+  records_ = reinterpret_cast<const ExtractManifestRecord*>(
+      data_ + sizeof(ExtractManifestHeader));
+  buckets_ = reinterpret_cast<const uint32_t*>(
+      data_ + sizeof(ExtractManifestHeader) + records_size);
+  strings_ = reinterpret_cast<const char*>(
+      data_ + sizeof(ExtractManifestHeader) + records_size + buckets_size);
+  strings_size_ = header->strings_size;
+  return true;
+}
+
+const char* ExtractManifest::pathOf(size_t index) const {
+  const ExtractManifestRecord& record = records_[index];
+  if (uint64_t(record.path_offset) + record.path_size > strings_size_) {
+    return nullptr;
+  }
+  return strings_ + record.path_offset;
+}
+
+bool ExtractManifest::at(size_t index, ExtractManifestEntry& entry) const {
+  if (index >= num_entries_) {
+    return false;
+  }
+  const char* path = pathOf(index);
+  if (path == nullptr) {
+    return false;
+  }
+  const ExtractManifestRecord& record = records_[index];
+  entry.path.assign(path, record.path_size);
+  entry.mode = static_cast<mode_t>(record.mode);
+  entry.uid = static_cast<uid_t>(record.uid);
+  entry.gid = static_cast<gid_t>(record.gid);
+  entry.size = record.size;
+  entry.hashed = (record.flags & kExtractManifestHashed) != 0;
+  entry.content_hash = record.content_hash;
+  entry.xattr_hash = record.xattr_hash;
+  return true;
+}
+
+bool ExtractManifest::find(const std::string& path,
+                           ExtractManifestEntry& entry) const {
+  if (num_buckets_ == 0) {
+    return false;
+  }
+  const size_t mask = num_buckets_ - 1;
+  size_t bucket = HashXxh64(path.data(), path.size()) & mask;
+  // Table is never full, but a corrupted one might be.
+  for (size_t i = 0; i < num_buckets_; ++i) {
+    const uint32_t value = buckets_[bucket];
+    if (value == 0) {
+      return false;
+    }
+    const size_t index = value - 1;
+    if (index < num_entries_) {
+      const char* item_path = pathOf(index);
+      if (item_path != nullptr &&
+          records_[index].path_size == path.size() &&
+          memcmp(item_path, path.data(), path.size()) == 0) {
+        return at(index, entry);
+      }
+    }
+    bucket = (bucket + 1) & mask;
+  }
+  return false;
+}
+
+bool CheckExtractedItem(const std::string& dest_dir,
+                        const ExtractManifestEntry& entry,
+                        std::string& problem) {
+  const std::string path = (entry.path == "/") ? dest_dir :
+                                                 dest_dir + entry.path;
+  struct stat st;
+  if (lstat(path.c_str(), &st) != 0) {
+    problem = std::string("cannot stat: ") + strerror(errno);
+    return false;
+  }
+  if ((st.st_mode & (S_IFMT | 07777)) != entry.mode) {
+    problem = FormatMismatch("mode", st.st_mode & (S_IFMT | 07777),
+                             entry.mode, true);
+    return false;
+  }
+  if (st.st_uid != entry.uid) {
+    problem = FormatMismatch("uid", st.st_uid, entry.uid, false);
+    return false;
+  }
+  if (st.st_gid != entry.gid) {
+    problem = FormatMismatch("gid", st.st_gid, entry.gid, false);
+    return false;
+  }
+  if ((S_ISREG(st.st_mode) || S_ISLNK(st.st_mode)) &&
+      uint64_t(st.st_size) != entry.size) {
+    problem = FormatMismatch("size", uint64_t(st.st_size), entry.size, false);
+    return false;
+  }
+
+  std::vector<std::pair<std::string, std::string>> xattrs;
+  if (!ReadXattrs(path, xattrs)) {
+    problem = std::string("cannot read xattrs: ") + strerror(errno);
+    return false;
+  }
+  if (HashXattrs(xattrs) != entry.xattr_hash) {
+    problem = "xattrs differ";
+    return false;
+  }
+
+  if (!entry.hashed) {
+    return true;
+  }
+  uint64_t size = 0;
+  uint64_t hash = 0;
+  if (S_ISLNK(st.st_mode)) {
+    std::vector<char> target(static_cast<size_t>(st.st_size) + 1);
+    const ssize_t len = readlink(path.c_str(), target.data(), target.size());
+    if (len < 0) {
+      problem = std::string("cannot read link: ") + strerror(errno);
+      return false;
+    }
+    ContentHasher hasher;
+    hasher.update(target.data(), static_cast<size_t>(len));
+    size = hasher.size();
+    hash = hasher.finish();
+  } else if (!HashFilePath(path, size, hash)) {
+    problem = std::string("cannot read content: ") + strerror(errno);
+    return false;
+  }
+  if (size != entry.size || hash != entry.content_hash) {
+    problem = "content differs";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace installer
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_EXTRACT_MANIFEST_H
+#define INSTALLER_UNSQUASHFS_EXTRACT_MANIFEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace installer {
+
+// Binary manifest of items written by ExtractImage(), which is mapped into
+// memory by ExtractManifest to look up an item without walking dest folder.
+// All integers are in host byte order. Layout:
+//   ExtractManifestHeader
+//   ExtractManifestRecord x num_entries, sorted by path
+//   uint32_t x num_buckets, hash table of (index + 1) of records keyed by
+//     XXH64 of path, with linear probing. 0 marks an empty bucket.
+//   String table of paths, not terminated, |strings_size| bytes.
+// Paths are relative to dest folder and start with "/", and "/" itself is
+// the dest folder.
+
+const uint32_t kExtractManifestMagic = 0x464d5844;  // "DXMF"
+const uint32_t kExtractManifestVersion = 1;
+
+struct ExtractManifestHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t num_entries;
+  // Power of 2, at least twice of |num_entries|.
+  uint32_t num_buckets;
+  uint64_t strings_size;
+};
+
+// Set if |content_hash| holds ContentHasher digest of file content, or of
+// symbolic link target.
+const uint32_t kExtractManifestHashed = 1;
+
+struct ExtractManifestRecord {
+  // Size of regular file, or length of symbolic link target.
+  uint64_t size;
+  uint64_t content_hash;
+  // See HashXattrs().
+  uint64_t xattr_hash;
+  // Path in string table.
+  uint32_t path_offset;
+  uint32_t path_size;
+  // File type and permission bits, same as st_mode.
+  uint32_t mode;
+  uint32_t uid;
+  uint32_t gid;
+  uint32_t flags;
+};
+
+// An item of manifest.
+struct ExtractManifestEntry {
+  std::string path;
+  mode_t mode = 0;
+  uid_t uid = 0;
+  gid_t gid = 0;
+  uint64_t size = 0;
+  bool hashed = false;
+  uint64_t content_hash = 0;
+  uint64_t xattr_hash = 0;
+};
+
+// Returns digest of xattrs, which does not depend on their order, or 0 if
+// there is no xattr.
+uint64_t HashXattrs(std::vector<std::pair<std::string, std::string>> xattrs);
+
+// Collects items while they are extracted, and writes them to manifest file
+// at the end. Its methods are thread safe.
+class ExtractManifestWriter {
+ public:
+  ExtractManifestWriter();
+
+  void add(const ExtractManifestEntry& entry);
+
+  // Add |path| as another name of |target|, which is added before write().
+  void addLink(const std::string& path, const std::string& target);
+
+  // Write all items to |manifest_file|, replacing it atomically.
+  bool write(const std::string& manifest_file);
+
+ private:
+  ExtractManifestWriter(const ExtractManifestWriter&) = delete;
+  ExtractManifestWriter& operator=(const ExtractManifestWriter&) = delete;
+
+  std::mutex mutex_;
+  std::vector<ExtractManifestEntry> entries_;
+  // Pairs of (path, target).
+  std::vector<std::pair<std::string, std::string>> links_;
+};
+
+// Read-only view of a manifest file mapped into memory. Lookup takes
+// constant time and does not read the whole file.
+class ExtractManifest {
+ public:
+  ExtractManifest();
+  ~ExtractManifest();
+
+  bool open(const std::string& manifest_file);
+
+  size_t size() const { return num_entries_; }
+
+  // Get entry |index|, in order of path. Returns false if it is corrupted.
+  bool at(size_t index, ExtractManifestEntry& entry) const;
+
+  // Find entry of |path|.
+  bool find(const std::string& path, ExtractManifestEntry& entry) const;
+
+ private:
+  ExtractManifest(const ExtractManifest&) = delete;
+  ExtractManifest& operator=(const ExtractManifest&) = delete;
+
+  void close();
+
+  // Path of record |index|, or nullptr if it is out of string table.
+  const char* pathOf(size_t index) const;
+
+  const uint8_t* data_;
+  size_t data_size_;
+  size_t num_entries_;
+  size_t num_buckets_;
+  const ExtractManifestRecord* records_;
+  const uint32_t* buckets_;
+  const char* strings_;
+  uint64_t strings_size_;
+};
+
+// Compare item |entry.path| in |dest_dir| with |entry|, including content
+// of regular files if it is hashed. |problem| is set to the first mismatch.
+bool CheckExtractedItem(const std::string& dest_dir,
+                        const ExtractManifestEntry& entry,
+                        std::string& problem);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_EXTRACT_MANIFEST_H
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_manifest.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+#include "unsquashfs/content_hash.h"
+
+namespace installer {
+namespace {
+
+TEST(ExtractManifest, HashXattrs) {
+  EXPECT_EQ(HashXattrs({}), 0u);
+  const uint64_t hash = HashXattrs({{"user.a", "1"}, {"user.b", "2"}});
+  EXPECT_NE(hash, 0u);
+  // Order does not matter, but names and values do.
+  EXPECT_EQ(HashXattrs({{"user.b", "2"}, {"user.a", "1"}}), hash);
+  EXPECT_NE(HashXattrs({{"user.a", "2"}, {"user.b", "1"}}), hash);
+  EXPECT_NE(HashXattrs({{"user.a", "12"}}), HashXattrs({{"user.a1", "2"}}));
+}
+
+TEST(ExtractManifest, WriteAndFind) {
+  const char kManifestFile[] = "/tmp/installer-extract-manifest";
+  ExtractManifestWriter writer;
+  ExtractManifestEntry entry;
+  entry.path = "/";
+  entry.mode = S_IFDIR | 0755;
+  writer.add(entry);
+  entry.path = "/usr/bin/ls";
+  entry.mode = S_IFREG | 0755;
+  entry.size = 12345;
+  entry.hashed = true;
+  entry.content_hash = 0x1122334455667788ULL;
+  entry.xattr_hash = 42;
+  writer.add(entry);
+  // Link target is added after the link.
+  writer.addLink("/usr/bin/dir", "/usr/bin/vdir");
+  entry.path = "/usr/bin/vdir";
+  entry.uid = 1000;
+  entry.gid = 100;
+  writer.add(entry);
+  writer.addLink("/usr/bin/missing", "/usr/bin/nothing");
+  ASSERT_TRUE(writer.write(kManifestFile));
+
+  ExtractManifest manifest;
+  ASSERT_TRUE(manifest.open(kManifestFile));
+  ASSERT_EQ(manifest.size(), 4u);
+  ExtractManifestEntry found;
+  ASSERT_TRUE(manifest.at(0, found));
+  EXPECT_EQ(found.path, "/");
+  EXPECT_EQ(found.mode, mode_t(S_IFDIR | 0755));
+  EXPECT_FALSE(found.hashed);
+  ASSERT_TRUE(manifest.at(1, found));
+  EXPECT_EQ(found.path, "/usr/bin/dir");
+  EXPECT_FALSE(manifest.at(4, found));
+
+  ASSERT_TRUE(manifest.find("/usr/bin/ls", found));
+  EXPECT_EQ(found.path, "/usr/bin/ls");
+  EXPECT_EQ(found.size, 12345u);
+  EXPECT_TRUE(found.hashed);
+  EXPECT_EQ(found.content_hash, 0x1122334455667788ULL);
+  EXPECT_EQ(found.xattr_hash, 42u);
+  ASSERT_TRUE(manifest.find("/usr/bin/dir", found));
+  EXPECT_EQ(found.uid, 1000u);
+  EXPECT_EQ(found.gid, 100u);
+  EXPECT_FALSE(manifest.find("/usr/bin", found));
+  EXPECT_FALSE(manifest.find("/usr/bin/missing", found));
+
+  // Truncated manifest is rejected.
+  ASSERT_EQ(truncate(kManifestFile, 30), 0);
+  EXPECT_FALSE(manifest.open(kManifestFile));
+  EXPECT_EQ(manifest.size(), 0u);
+  EXPECT_FALSE(manifest.find("/usr/bin/ls", found));
+  EXPECT_EQ(unlink(kManifestFile), 0);
+}
+
+TEST(ExtractManifest, CheckExtractedItem) {
+  char tmp_dir[] = "/tmp/installer-extract-manifest-XXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+  const std::string file = std::string(tmp_dir) + "/file";
+  FILE* fp = fopen(file.c_str(), "w");
+  ASSERT_NE(fp, nullptr);
+  fputs("content", fp);
+  fclose(fp);
+  ASSERT_EQ(chmod(file.c_str(), 0640), 0);
+
+  ContentHasher hasher;
+  hasher.update("content", 7);
+  ExtractManifestEntry entry;
+  entry.path = "/file";
+  entry.mode = S_IFREG | 0640;
+  entry.uid = getuid();
+  entry.gid = getgid();
+  entry.size = 7;
+  entry.hashed = true;
+  entry.content_hash = hasher.finish();
+  std::string problem;
+  EXPECT_TRUE(CheckExtractedItem(tmp_dir, entry, problem)) << problem;
+
+  entry.mode = S_IFREG | 0644;
+  EXPECT_FALSE(CheckExtractedItem(tmp_dir, entry, problem));
+  EXPECT_EQ(problem, "mode 100640, expected 100644");
+  entry.mode = S_IFREG | 0640;
+
+  fp = fopen(file.c_str(), "w");
+  ASSERT_NE(fp, nullptr);
+  fputs("CONTENT", fp);
+  fclose(fp);
+  EXPECT_FALSE(CheckExtractedItem(tmp_dir, entry, problem));
+  EXPECT_EQ(problem, "content differs");
+
+  entry.path = "/missing";
+  EXPECT_FALSE(CheckExtractedItem(tmp_dir, entry, problem));
+
+  EXPECT_EQ(unlink(file.c_str()), 0);
+  EXPECT_EQ(rmdir(tmp_dir), 0);
+}
+
+}  // namespace
+}  // namespace installer
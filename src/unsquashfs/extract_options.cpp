@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_options.h"
+
+#include <thread>
+
+namespace installer {
+
+namespace {
+
+// Upper limit of workers used by default. Reading from squashfs on optical
+// or USB media gets slower if too many readers seek at once.
+const int kMaxDefaultJobs = 16;
+
+const char* const kCopyMethodNames[kCopyMethodCount] = {
+    "clone",
+    "copy_file_range",
+    "sendfile",
+    "splice",
+    "read_write",
+};
+
+}  // namespace
+
+int GetDefaultJobs() {
+  int jobs = static_cast<int>(std::thread::hardware_concurrency());
+  if (jobs < 1) {
+    jobs = 1;
+  }
+  if (jobs > kMaxDefaultJobs) {
+    jobs = kMaxDefaultJobs;
+  }
+  return jobs;
+}
+
+const char* GetCopyMethodName(int method) {
+  if (method >= 0 && method < kCopyMethodCount) {
+    return kCopyMethodNames[method];
+  }
+  return "auto";
+}
+
+bool ParseCopyMethod(const std::string& name, int& method) {
+  if (name == "auto") {
+    method = kCopyMethodAuto;
+    return true;
+  }
+  for (int i = 0; i < kCopyMethodCount; ++i) {
+    if (name == kCopyMethodNames[i]) {
+      method = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace installer
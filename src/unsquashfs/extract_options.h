@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_EXTRACT_OPTIONS_H
+#define INSTALLER_UNSQUASHFS_EXTRACT_OPTIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace installer {
+
+// Ways to copy content of regular files, tried in this order.
+enum CopyMethod {
+  // Probe the fastest method which works.
+  kCopyMethodAuto = -1,
+  // Share extents with ioctl(FICLONE), copy-on-write filesystems only.
+  kCopyMethodClone = 0,
+  // copy_file_range() system call, in-kernel copy.
+  kCopyMethodCopyFileRange,
+  kCopyMethodSendfile,
+  // splice() through a pipe, in-kernel copy without sendfile().
+  kCopyMethodSplice,
+  // Plain read() and write() through a user space buffer.
+  kCopyMethodReadWrite,
+  kCopyMethodCount,
+};
+
+// Default size of buffer used by read()/write() and of splice() pipe.
+const size_t kDefaultCopyBufferSize = 256 * 1024;
+
+// Default size from which regular files are preallocated.
+const int64_t kDefaultPreallocateSize = 1024 * 1024;
+
+// Options shared by CopyTree() and ExtractImage().
+struct ExtractOptions {
+  // Number of workers, at least 1.
+  int jobs = 1;
+
+  // Use sendfile() system call or not.
+  bool use_sendfile = true;
+
+  // One of CopyMethod, or kCopyMethodAuto.
+  int copy_method = kCopyMethodAuto;
+
+  // Buffer size of kCopyMethodReadWrite and kCopyMethodSplice.
+  size_t buffer_size = kDefaultCopyBufferSize;
+
+  // Create small files with io_uring if kernel supports it.
+  // Used by ExtractImage() only.
+  bool use_io_uring = false;
+
+  // Reserve extents of regular files of at least this size with fallocate()
+  // before their content is written, so that parallel writers do not
+  // fragment them. 0 to disable. Sparse files are not preallocated.
+  int64_t preallocate_size = kDefaultPreallocateSize;
+
+  // Extract regular files in order of their content in image instead of
+  // folder by folder, reading ahead of workers. CopyTree() only sorts items
+  // of each folder by inode number.
+  bool ordered = false;
+
+  // Skip files of packages in this package list, empty to disable. See
+  // PackageFilter.
+  std::string exclude_packages;
+  // Packages excluded are written to this file, so that they are purged
+  // from dpkg database after installation. Empty to disable.
+  std::string excluded_packages_file;
+
+  // Regular files listed in this priority list are extracted before all
+  // others, in order of the list and by one worker, so that they are laid
+  // out together on disk. Empty to disable. Implies |ordered|.
+  // See ReadPriorityList(). Used by ExtractImage() only.
+  std::string priority_list;
+
+  // Maximum size in bytes of file content written but not flushed to disk,
+  // 0 to leave writeback to kernel.
+  int64_t dirty_window = 0;
+
+  // Memory-bounded mode, set by ApplyMemoryBudget(). Memory used by buffers,
+  // caches and unflushed content is kept under |memory_budget| bytes,
+  // 0 for no limit.
+  int64_t memory_budget = 0;
+  // Write content of large files with O_DIRECT, bypassing page cache.
+  bool direct_io = false;
+  // Drop content of finished files from page cache of source and dest.
+  bool drop_cache = false;
+
+  // Install over an existing tree in dest folder. Regular files and symbolic
+  // links which match source in type, size and mtime are kept, and only their
+  // metadata is updated. With |manifest_file|, content of kept files is
+  // hashed and compared too. Items not in source are removed.
+  bool incremental = false;
+
+  // Record finished items in this journal file, empty to disable.
+  // Used by ExtractImage() only.
+  std::string journal_file;
+  // Skip items recorded in |journal_file| by previous run.
+  bool resume = false;
+
+  // Hash content of regular files while they are written, and compare it
+  // with this manifest, empty to disable. See ContentVerifier.
+  std::string manifest_file;
+  // Mismatched, unreadable and missing files are written to this file,
+  // or to stderr if it is empty.
+  std::string failure_report;
+
+  // Write binary manifest of extracted items to this file, empty to
+  // disable. See ExtractManifest. Used by ExtractImage() only.
+  std::string extract_manifest;
+};
+
+// Returns name of |method|, e.g. "splice".
+const char* GetCopyMethodName(int method);
+
+// Parse copy method from its |name|, "auto" included.
+bool ParseCopyMethod(const std::string& name, int& method);
+
+// Returns number of workers to use if not specified in command line,
+// based on number of online processors.
+int GetDefaultJobs();
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_EXTRACT_OPTIONS_H
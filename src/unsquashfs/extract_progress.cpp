@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_progress.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "unsquashfs/progress_shm.h"
+
+namespace installer {
+
+namespace {
+
+// Shared memory is updated at most once in this interval.
+const int64_t kShmUpdateIntervalMs = 250;
+
+// Weight of latest sample in throughput, smoothing short stalls.
+const double kRateSmoothing = 0.3;
+
+int64_t NowMsecs() {
+  struct timespec ts;
+  // Coarse clock is enough here, and cheaper to read for every file.
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return int64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+}  // namespace
+
+ExtractProgress::ExtractProgress()
+    : current_files_(0),
+      current_bytes_(0),
+      last_progress_(-1),
+      next_update_ms_(0) {
+  start_ms_ = NowMsecs();
+  rate_ms_ = start_ms_;
+}
+
+ExtractProgress::~ExtractProgress() {
+  if (progress_fd_) {
+    fclose(progress_fd_);
+  }
+  if (shm_) {
+    munmap(shm_, sizeof(ProgressShm));
+  }
+  if (notify_fd_ != -1) {
+    close(notify_fd_);
+  }
+}
+
+bool ExtractProgress::open(const std::string& progress_file) {
+  progress_fd_ = fopen(progress_file.c_str(), "w");
+  if (progress_fd_ == nullptr) {
+    perror("fopen() Failed to open progress file");
+    return false;
+  }
+
+  // Shared memory is optional, text progress file is still written if it
+  // fails.
+  const std::string shm_file = GetProgressShmFile(progress_file);
+  const int fd = ::open(shm_file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd == -1 || ftruncate(fd, sizeof(ProgressShm)) != 0) {
+    fprintf(stderr, "ExtractProgress() failed to create %s: %s\n",
+            shm_file.c_str(), strerror(errno));
+  } else {
+    void* addr = mmap(nullptr, sizeof(ProgressShm), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    if (addr != MAP_FAILED) {
+      shm_ = static_cast<ProgressShm*>(addr);
+      memset(shm_, 0, sizeof(ProgressShm));
+      shm_->magic = kProgressShmMagic;
+      shm_->version = kProgressShmVersion;
+      shm_->eta_seconds = -1;
+    }
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+
+  if (shm_) {
+    notify_fd_ = ConnectProgressFifo(GetProgressFifoFile(progress_file));
+    if (notify_fd_ != -1) {
+      // Installer might exit before extraction finishes, then write()
+      // fails with EPIPE instead of killing this process.
+      signal(SIGPIPE, SIG_IGN);
+    }
+  }
+  return true;
+}
+
+void ExtractProgress::setTotal(int64_t total_files, int64_t total_bytes) {
+  total_files_ = total_files;
+  total_bytes_ = total_bytes;
+}
+
+void ExtractProgress::increase(int64_t bytes) {
+  ++current_files_;
+  if (bytes > 0) {
+    current_bytes_ += bytes;
+  }
+  this->update(false);
+}
+
+void ExtractProgress::addBytes(int64_t bytes) {
+  current_bytes_ += bytes;
+  this->update(false);
+}
+
+void ExtractProgress::skip(int64_t files, int64_t bytes) {
+  current_files_ += files;
+  current_bytes_ += bytes;
+  this->update(false);
+}
+
+void ExtractProgress::finish() {
+  last_progress_ = -1;
+  this->update(true);
+}
+
+int ExtractProgress::progress() const {
+  int64_t progress;
+  if (total_bytes_ > 0) {
+    progress = current_bytes_ * 100 / total_bytes_;
+  } else if (total_files_ > 0) {
+    progress = current_files_ * 100 / total_files_;
+  } else {
+    return 0;
+  }
+  return (progress > 100) ? 100 : static_cast<int>(progress);
+}
+
+void ExtractProgress::update(bool force) {
+  const int progress = force ? 100 : this->progress();
+  const int64_t now_ms = NowMsecs();
+  const bool shm_due = (shm_ != nullptr && now_ms >= next_update_ms_);
+  // Avoid taking the lock for every file, progress value changes rarely.
+  if (!force && progress == last_progress_ && !shm_due) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+  if (force) {
+    lock.lock();
+  } else if (!lock.try_lock()) {
+    // Another worker is writing, this change is picked up next time.
+    return;
+  }
+
+  // Skip fseek() and fprintf() if progress value is not changed.
+  if (progress != last_progress_) {
+    last_progress_ = progress;
+    if (progress_fd_) {
+      fseek(progress_fd_, 0, SEEK_SET);
+      fprintf(progress_fd_, "%d", progress);
+      fflush(progress_fd_);
+    } else {
+      fprintf(stdout, "\r%d", progress);
+      if (force) {
+        fprintf(stdout, "\n");
+      }
+    }
+  }
+
+  if (shm_ && (force || now_ms >= next_update_ms_)) {
+    next_update_ms_ = now_ms + kShmUpdateIntervalMs;
+    this->writeShm(progress, now_ms, force);
+    this->notify();
+  }
+}
+
+void ExtractProgress::notify() {
+  if (notify_fd_ == -1) {
+    return;
+  }
+  // Reader has not consumed previous notifications if FIFO is full, it
+  // reads latest shared memory anyway.
+  const char byte = 0;
+  if (write(notify_fd_, &byte, 1) == -1 && errno != EAGAIN) {
+    close(notify_fd_);
+    notify_fd_ = -1;
+  }
+}
+
+void ExtractProgress::writeShm(int progress, int64_t now_ms, bool finished) {
+  const int64_t bytes_done = current_bytes_;
+  const int64_t files_done = current_files_;
+
+  // Smoothed throughput since last update.
+  if (now_ms > rate_ms_) {
+    const double rate = (bytes_done - rate_bytes_) * 1000.0 /
+                        (now_ms - rate_ms_);
+    bytes_per_second_ = (rate_bytes_ == 0) ? rate :
+        kRateSmoothing * rate + (1 - kRateSmoothing) * bytes_per_second_;
+    rate_ms_ = now_ms;
+    rate_bytes_ = bytes_done;
+  }
+
+  // Time left is estimated from throughput if total size is known,
+  // or else from elapsed time and progress of files.
+  int64_t eta_seconds = -1;
+  if (finished) {
+    eta_seconds = 0;
+  } else if (total_bytes_ > 0 && bytes_per_second_ > 0) {
+    eta_seconds = static_cast<int64_t>(
+        (total_bytes_ - bytes_done) / bytes_per_second_);
+  } else if (total_files_ > 0 && files_done > 0) {
+    eta_seconds = (now_ms - start_ms_) * (total_files_ - files_done) /
+                  files_done / 1000;
+  }
+  if (eta_seconds < -1) {
+    eta_seconds = 0;
+  }
+
+  // Readers retry while |sequence| is odd or changed.
+  const uint64_t sequence = shm_->sequence;
+  __atomic_store_n(&shm_->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  shm_->bytes_done = bytes_done;
+  shm_->bytes_total = total_bytes_;
+  shm_->files_done = files_done;
+  shm_->files_total = total_files_;
+  shm_->bytes_per_second = static_cast<int64_t>(bytes_per_second_);
+  shm_->eta_seconds = eta_seconds;
+  shm_->progress = progress;
+  shm_->finished = finished ? 1 : 0;
+  __atomic_store_n(&shm_->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+}  // namespace installer
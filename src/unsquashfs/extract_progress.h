@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_EXTRACT_PROGRESS_H
+#define INSTALLER_UNSQUASHFS_EXTRACT_PROGRESS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+namespace installer {
+
+struct ProgressShm;
+
+// Writes extraction progress, an integer in range [0, 100], to progress file.
+// If no progress file is opened, progress is printed to stdout.
+// Progress is weighted by bytes if total size is known, or else by files.
+// Detailed progress with throughput and ETA is also published in shared
+// memory next to progress file, see ProgressShm, and its reader is notified
+// through FIFO next to progress file if it has created one.
+// Its methods are thread safe.
+class ExtractProgress {
+ public:
+  ExtractProgress();
+  ~ExtractProgress();
+
+  // Open |progress_file| to write progress value to, create shared memory
+  // file for ProgressShm, and connect to progress FIFO if it exists.
+  bool open(const std::string& progress_file);
+
+  // Set total number of files and total size of regular files to be
+  // extracted. |total_bytes| is 0 if unknown.
+  void setTotal(int64_t total_files, int64_t total_bytes);
+  int64_t total() const { return total_files_; }
+
+  // Mark one more file as extracted, with |bytes| of content not reported
+  // by addBytes() yet.
+  void increase(int64_t bytes);
+
+  // Report |bytes| of content written, for files written in several steps.
+  void addBytes(int64_t bytes);
+
+  // Mark |files| items with |bytes| of content as extracted in previous
+  // run.
+  void skip(int64_t files, int64_t bytes);
+
+  // Write 100 to progress file.
+  void finish();
+
+ private:
+  // Returns progress value in range [0, 100].
+  int progress() const;
+
+  // Write progress value and shared memory if progress value has changed
+  // or update interval has passed. Always write if |force| is true.
+  void update(bool force);
+
+  void writeShm(int progress, int64_t now_ms, bool finished);
+
+  // Wake up reader of shared memory after it is updated.
+  void notify();
+
+  FILE* progress_fd_ = nullptr;
+  ProgressShm* shm_ = nullptr;
+  // Write end of progress FIFO, or -1.
+  int notify_fd_ = -1;
+  int64_t total_files_ = 0;
+  int64_t total_bytes_ = 0;
+  std::atomic<int64_t> current_files_;
+  std::atomic<int64_t> current_bytes_;
+
+  // Protects |progress_fd_|, |shm_|, |notify_fd_| and throughput fields below.
+  std::mutex mutex_;
+  std::atomic<int> last_progress_;
+  // Time of next shared memory update, in milliseconds.
+  std::atomic<int64_t> next_update_ms_;
+
+  int64_t start_ms_ = 0;
+  int64_t rate_ms_ = 0;
+  int64_t rate_bytes_ = 0;
+  double bytes_per_second_ = 0;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_EXTRACT_PROGRESS_H
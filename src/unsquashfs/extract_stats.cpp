@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_stats.h"
+
+namespace installer {
+
+ExtractStats::ExtractStats()
+    : hard_links(0),
+      hard_link_bytes(0),
+      sparse_files(0),
+      sparse_bytes(0),
+      preallocated_files(0),
+      preallocated_bytes(0),
+      copy_method(kCopyMethodAuto),
+      uring_files(0),
+      uring_ops(0),
+      uring_enters(0),
+      resumed_dirs(0),
+      resumed_files(0),
+      resumed_bytes(0),
+      unchanged_files(0),
+      unchanged_bytes(0),
+      removed_items(0),
+      excluded_files(0),
+      excluded_bytes(0),
+      priority_files(0),
+      priority_bytes(0),
+      xattr_items(0),
+      xattr_sets(0),
+      xattr_values(0),
+      xattr_bytes(0),
+      xattr_nsecs(0),
+      xattr_cache_hits(0),
+      fragment_lookups(0),
+      fragment_reads(0),
+      fragment_rereads(0),
+      writeback_files(0),
+      writeback_bytes(0),
+      writeback_nsecs(0),
+      direct_files(0),
+      direct_bytes(0),
+      image_bytes(0),
+      image_zero_bytes(0),
+      image_nsecs(0),
+      hashed_files(0),
+      hashed_bytes(0),
+      hash_nsecs(0),
+      verify_failures(0),
+      read_errors(0) {
+  for (int i = 0; i < kCopyMethodCount; ++i) {
+    copy_files[i] = 0;
+    copy_bytes[i] = 0;
+    copy_nsecs[i] = 0;
+  }
+}
+
+void ExtractStats::print(FILE* fp) const {
+  fprintf(fp, "hard links: %lld, saved bytes: %lld\n",
+          static_cast<long long>(hard_links),
+          static_cast<long long>(hard_link_bytes));
+  fprintf(fp, "sparse files: %lld, skipped bytes: %lld\n",
+          static_cast<long long>(sparse_files),
+          static_cast<long long>(sparse_bytes));
+
+  if (preallocated_files > 0) {
+    fprintf(fp, "preallocated files: %lld, bytes: %lld\n",
+            static_cast<long long>(preallocated_files),
+            static_cast<long long>(preallocated_bytes));
+  }
+
+  if (copy_method != kCopyMethodAuto) {
+    fprintf(fp, "copy method: %s\n", GetCopyMethodName(copy_method));
+  }
+  for (int i = 0; i < kCopyMethodCount; ++i) {
+    if (copy_files[i] == 0) {
+      continue;
+    }
+    // Throughput of a single worker, as time is summed over workers.
+    const double seconds = copy_nsecs[i] / 1e9;
+    const double mb = copy_bytes[i] / (1024.0 * 1024.0);
+    fprintf(fp, "  %s: files: %lld, bytes: %lld, %.1f MB/s\n",
+            GetCopyMethodName(i),
+            static_cast<long long>(copy_files[i]),
+            static_cast<long long>(copy_bytes[i]),
+            seconds > 0 ? mb / seconds : 0.0);
+  }
+
+  if (uring_files > 0) {
+    // Without io_uring, each operation is a system call, except that
+    // unlink() is replaced by stat(), and lchown() and chmod() are added.
+    const int64_t saved = uring_ops + 2 * uring_files - uring_enters;
+    fprintf(fp, "io_uring: files: %lld, operations: %lld, submits: %lld, "
+            "syscalls saved: %lld\n",
+            static_cast<long long>(uring_files),
+            static_cast<long long>(uring_ops),
+            static_cast<long long>(uring_enters),
+            static_cast<long long>(saved));
+  }
+
+  if (resumed_files > 0) {
+    fprintf(fp, "resumed: folders: %lld, items: %lld, bytes: %lld\n",
+            static_cast<long long>(resumed_dirs),
+            static_cast<long long>(resumed_files),
+            static_cast<long long>(resumed_bytes));
+  }
+
+  if (unchanged_files > 0 || removed_items > 0) {
+    fprintf(fp, "incremental: unchanged files: %lld, bytes: %lld, "
+            "removed items: %lld\n",
+            static_cast<long long>(unchanged_files),
+            static_cast<long long>(unchanged_bytes),
+            static_cast<long long>(removed_items));
+  }
+
+  if (excluded_files > 0) {
+    fprintf(fp, "excluded packages: files: %lld, bytes: %lld\n",
+            static_cast<long long>(excluded_files),
+            static_cast<long long>(excluded_bytes));
+  }
+
+  if (priority_files > 0) {
+    fprintf(fp, "priority list: files: %lld, bytes: %lld\n",
+            static_cast<long long>(priority_files),
+            static_cast<long long>(priority_bytes));
+  }
+
+  if (xattr_items > 0) {
+    // Overhead of each item, most of which have no xattrs at all.
+    fprintf(fp, "xattrs: items: %lld, with xattrs: %lld, values: %lld, "
+            "bytes: %lld, cache hits: %lld, %.2f us per item\n",
+            static_cast<long long>(xattr_items),
+            static_cast<long long>(xattr_sets),
+            static_cast<long long>(xattr_values),
+            static_cast<long long>(xattr_bytes),
+            static_cast<long long>(xattr_cache_hits),
+            xattr_nsecs / 1e3 / xattr_items);
+  }
+
+  if (fragment_lookups > 0) {
+    fprintf(fp, "fragments: lookups: %lld, decompressed: %lld, "
+            "decompressed again: %lld\n",
+            static_cast<long long>(fragment_lookups),
+            static_cast<long long>(fragment_reads),
+            static_cast<long long>(fragment_rereads));
+  }
+
+  if (writeback_files > 0) {
+    fprintf(fp, "writeback: files: %lld, bytes: %lld, wait: %.1f s\n",
+            static_cast<long long>(writeback_files),
+            static_cast<long long>(writeback_bytes),
+            writeback_nsecs / 1e9);
+  }
+
+  if (direct_files > 0) {
+    fprintf(fp, "direct io: files: %lld, bytes: %lld\n",
+            static_cast<long long>(direct_files),
+            static_cast<long long>(direct_bytes));
+  }
+
+  if (image_bytes > 0) {
+    const double seconds = image_nsecs / 1e9;
+    fprintf(fp, "image: bytes: %lld, zero bytes not written: %lld, "
+            "%.1f MB/s\n",
+            static_cast<long long>(image_bytes),
+            static_cast<long long>(image_zero_bytes),
+            seconds > 0 ? image_bytes / (1024.0 * 1024.0) / seconds : 0.0);
+  }
+
+  if (hashed_files > 0) {
+    fprintf(fp, "verify: files: %lld, bytes: %lld, hash: %.1f s, "
+            "failures: %lld\n",
+            static_cast<long long>(hashed_files),
+            static_cast<long long>(hashed_bytes),
+            hash_nsecs / 1e9,
+            static_cast<long long>(verify_failures));
+  }
+  if (read_errors > 0) {
+    fprintf(fp, "read errors: %lld files\n",
+            static_cast<long long>(read_errors));
+  }
+}
+
+}  // namespace installer
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_EXTRACT_STATS_H
+#define INSTALLER_UNSQUASHFS_EXTRACT_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+
+#include "unsquashfs/extract_options.h"
+
+namespace installer {
+
+// Counters collected during extraction, printed as summary at exit.
+// All fields are updated by worker threads.
+struct ExtractStats {
+  // Number of names created with link() instead of copying content.
+  std::atomic<int64_t> hard_links;
+  // Size of file content not written thanks to |hard_links|.
+  std::atomic<int64_t> hard_link_bytes;
+
+  // Number of files with holes, and size of holes not written.
+  std::atomic<int64_t> sparse_files;
+  std::atomic<int64_t> sparse_bytes;
+
+  // Files whose extents were reserved before writing, and their size.
+  std::atomic<int64_t> preallocated_files;
+  std::atomic<int64_t> preallocated_bytes;
+
+  // Copy method chosen by the first regular file, or kCopyMethodAuto.
+  std::atomic<int> copy_method;
+  // Files, bytes and time in nanoseconds spent by each copy method.
+  // Time is summed over all workers.
+  std::atomic<int64_t> copy_files[kCopyMethodCount];
+  std::atomic<int64_t> copy_bytes[kCopyMethodCount];
+  std::atomic<int64_t> copy_nsecs[kCopyMethodCount];
+
+  // Files created with io_uring, operations submitted for them and
+  // number of io_uring_enter() calls.
+  std::atomic<int64_t> uring_files;
+  std::atomic<int64_t> uring_ops;
+  std::atomic<int64_t> uring_enters;
+
+  // Folders and files skipped as they were finished in previous run,
+  // and items and bytes in them.
+  std::atomic<int64_t> resumed_dirs;
+  std::atomic<int64_t> resumed_files;
+  std::atomic<int64_t> resumed_bytes;
+
+  // Files and bytes kept unchanged from previous installation, and items
+  // removed as they are not in image, in incremental mode.
+  std::atomic<int64_t> unchanged_files;
+  std::atomic<int64_t> unchanged_bytes;
+  std::atomic<int64_t> removed_items;
+
+  // Files of excluded packages not extracted, and their size.
+  std::atomic<int64_t> excluded_files;
+  std::atomic<int64_t> excluded_bytes;
+
+  // Files of priority list extracted before others, and their size.
+  std::atomic<int64_t> priority_files;
+  std::atomic<int64_t> priority_bytes;
+
+  // Items whose xattrs were copied, items which had any, xattr values and
+  // bytes copied, and time spent on them summed over all workers. Xattr
+  // sets read from XattrSetCache instead of decoding them again.
+  std::atomic<int64_t> xattr_items;
+  std::atomic<int64_t> xattr_sets;
+  std::atomic<int64_t> xattr_values;
+  std::atomic<int64_t> xattr_bytes;
+  std::atomic<int64_t> xattr_nsecs;
+  std::atomic<int64_t> xattr_cache_hits;
+
+  // Fragment block lookups, decompressions and repeated decompressions
+  // in ExtractImage().
+  std::atomic<int64_t> fragment_lookups;
+  std::atomic<int64_t> fragment_reads;
+  std::atomic<int64_t> fragment_rereads;
+
+  // Files and bytes flushed by WritebackPacer, and time spent waiting for
+  // them, summed over all workers.
+  std::atomic<int64_t> writeback_files;
+  std::atomic<int64_t> writeback_bytes;
+  std::atomic<int64_t> writeback_nsecs;
+
+  // Files and bytes written with O_DIRECT in memory-bounded mode.
+  std::atomic<int64_t> direct_files;
+  std::atomic<int64_t> direct_bytes;
+
+  // Size of filesystem image written by WriteImage(), zero runs in it
+  // which were not written as content, and time spent.
+  std::atomic<int64_t> image_bytes;
+  std::atomic<int64_t> image_zero_bytes;
+  std::atomic<int64_t> image_nsecs;
+
+  // Files and bytes hashed to be compared with manifest, time spent on
+  // hashing summed over all workers, and files which did not match.
+  std::atomic<int64_t> hashed_files;
+  std::atomic<int64_t> hashed_bytes;
+  std::atomic<int64_t> hash_nsecs;
+  std::atomic<int64_t> verify_failures;
+
+  // Files whose content cannot be read from source, which fail extraction.
+  std::atomic<int64_t> read_errors;
+
+  ExtractStats();
+
+  // Print summary to |fp|.
+  void print(FILE* fp) const;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_EXTRACT_STATS_H
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_totals.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "unsquashfs/squashfs_format.h"
+#include "unsquashfs/squashfs_image.h"
+
+namespace installer {
+
+bool ReadImageTotals(const std::string& image_file, ExtractTotals& totals) {
+  const int fd = open(image_file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(stderr, "ReadImageTotals() failed to open %s: %s\n",
+            image_file.c_str(), strerror(errno));
+    return false;
+  }
+  uint8_t buf[kSquashfsSuperBlockSize];
+  const ssize_t num_read = pread(fd, buf, sizeof(buf), 0);
+  close(fd);
+
+  SquashfsSuperBlock sb;
+  if (num_read != sizeof(buf) || !ParseSquashfsSuperBlock(buf, sb) ||
+      sb.inodes == 0) {
+    fprintf(stderr, "ReadImageTotals() invalid superblock: %s\n",
+            image_file.c_str());
+    return false;
+  }
+  totals.files = sb.inodes;
+  return true;
+}
+
+bool CountImageTotals(const SquashfsImage& image, ExtractTotals& totals) {
+  uint64_t num_inodes = 0;
+  uint64_t file_bytes = 0;
+  if (!image.countInodes(num_inodes, file_bytes)) {
+    fprintf(stderr, "CountImageTotals() failed to walk inode table\n");
+    return false;
+  }
+
+  // Progress increases once per name, so items are counted by walking
+  // directory table, and each hard link is counted. Content of hard linked
+  // files is copied once, so |file_bytes| is summed by inode.
+  SquashfsInode dir;
+  if (!image.readRootInode(dir)) {
+    return false;
+  }
+  int64_t num_items = 1;
+  std::vector<uint64_t> dir_refs;
+  std::vector<SquashfsDirEntry> entries;
+  while (true) {
+    if (!image.readDir(dir, entries)) {
+      fprintf(stderr, "CountImageTotals() failed to walk directory table\n");
+      return false;
+    }
+    num_items += static_cast<int64_t>(entries.size());
+    for (const SquashfsDirEntry& entry : entries) {
+      if (entry.type == kSquashfsDirType) {
+        dir_refs.push_back(entry.inode_ref);
+      }
+    }
+    if (dir_refs.empty()) {
+      break;
+    }
+    if (!image.readInode(dir_refs.back(), dir)) {
+      return false;
+    }
+    dir_refs.pop_back();
+  }
+
+  totals.files = num_items;
+  totals.bytes = static_cast<int64_t>(file_bytes);
+  return true;
+}
+
+bool ReadTotalsFile(const std::string& totals_file, ExtractTotals& totals) {
+  FILE* fp = fopen(totals_file.c_str(), "r");
+  if (fp == nullptr) {
+    fprintf(stderr, "ReadTotalsFile() failed to open %s: %s\n",
+            totals_file.c_str(), strerror(errno));
+    return false;
+  }
+  long long files = 0;
+  long long bytes = 0;
+  const int num_items = fscanf(fp, "%lld %lld", &files, &bytes);
+  fclose(fp);
+
+  if (num_items < 1 || files <= 0 || bytes < 0) {
+    fprintf(stderr, "ReadTotalsFile() invalid totals file: %s\n",
+            totals_file.c_str());
+    return false;
+  }
+  totals.files = files;
+  totals.bytes = (num_items == 2) ? bytes : 0;
+  return true;
+}
+
+}  // namespace installer
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_EXTRACT_TOTALS_H
+#define INSTALLER_UNSQUASHFS_EXTRACT_TOTALS_H
+
+#include <stdint.h>
+
+#include <string>
+
+namespace installer {
+
+class SquashfsImage;
+
+// Amount of work to be done, used as denominator of progress value.
+struct ExtractTotals {
+  // Number of items in filesystem.
+  int64_t files = 0;
+  // Size of all regular files in bytes, 0 if unknown.
+  int64_t bytes = 0;
+};
+
+// Read number of inodes from superblock of squashfs |image_file|.
+// This only reads the first 96 bytes of image, and does not walk the tree.
+// It is less than number of items if image has hard links, so it is only
+// used when CountImageTotals() fails.
+bool ReadImageTotals(const std::string& image_file, ExtractTotals& totals);
+
+// Count items, including each hard link, and size of regular files in
+// opened |image| by walking its directory and inode tables, which are
+// already in memory.
+bool CountImageTotals(const SquashfsImage& image, ExtractTotals& totals);
+
+// Read precomputed totals from text file |totals_file|, which is shipped
+// along with squashfs image. Its first line is number of items, and an
+// optional second line holds size of all regular files in bytes.
+bool ReadTotalsFile(const std::string& totals_file, ExtractTotals& totals);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_EXTRACT_TOTALS_H
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_totals.h"
+
+#include <stdio.h>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(ExtractTotals, ReadTotalsFile) {
+  const char kTotalsFile[] = "/tmp/installer-unsquashfs-totals";
+  FILE* fp = fopen(kTotalsFile, "w");
+  ASSERT_NE(fp, nullptr);
+  fprintf(fp, "251234\n2684354560\n");
+  fclose(fp);
+
+  ExtractTotals totals;
+  EXPECT_TRUE(ReadTotalsFile(kTotalsFile, totals));
+  EXPECT_EQ(totals.files, 251234);
+  EXPECT_EQ(totals.bytes, 2684354560LL);
+
+  fp = fopen(kTotalsFile, "w");
+  ASSERT_NE(fp, nullptr);
+  fprintf(fp, "not a number\n");
+  fclose(fp);
+  EXPECT_FALSE(ReadTotalsFile(kTotalsFile, totals));
+
+  remove(kTotalsFile);
+}
+
+TEST(ExtractTotals, ReadImageTotals) {
+  ExtractTotals totals;
+  EXPECT_FALSE(ReadImageTotals("/etc/passwd", totals));
+  EXPECT_EQ(totals.files, 0);
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,500 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/file_copier.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "unsquashfs/content_hash.h"
+#include "unsquashfs/extract_stats.h"
+#include "unsquashfs/memory_budget.h"
+
+namespace installer {
+
+namespace {
+
+// Smaller files are not checked for holes, to save lseek() calls.
+const int64_t kMinSparseFileSize = 64 * 1024;
+
+// Largest chunk passed to one in-kernel copy call, below the 2G limit of
+// sendfile() and copy_file_range().
+const size_t kMaxKernelChunk = 1 << 30;
+
+int64_t NowNsecs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Returns true if |error| means that a copy method is not available for
+// these two files, instead of an I/O error.
+bool IsUnsupportedError(int error) {
+  return (error == EXDEV || error == EINVAL || error == EOPNOTSUPP ||
+          error == ENOSYS || error == ENOTTY || error == EBADF);
+}
+
+// Pipe used by splice(), one per worker thread.
+struct SplicePipe {
+  int fds[2] = {-1, -1};
+  size_t size = 0;
+
+  ~SplicePipe() {
+    reset();
+  }
+
+  bool init(size_t buffer_size) {
+    if (fds[0] != -1) {
+      return true;
+    }
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+      return false;
+    }
+    // Larger pipe means fewer round trips. Maximum size of pipe is limited
+    // by /proc/sys/fs/pipe-max-size, keep default size if it is rejected.
+    fcntl(fds[1], F_SETPIPE_SZ, static_cast<int>(buffer_size));
+    const int pipe_size = fcntl(fds[1], F_GETPIPE_SZ);
+    size = (pipe_size > 0) ? size_t(pipe_size) : 64 * 1024;
+    return true;
+  }
+
+  // Close pipe, which might still hold data after an error.
+  void reset() {
+    if (fds[0] != -1) {
+      close(fds[0]);
+      close(fds[1]);
+      fds[0] = fds[1] = -1;
+    }
+  }
+};
+
+}  // namespace
+
+bool PreallocateFile(int fd, int64_t size) {
+  if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size)) == 0) {
+    return true;
+  }
+  // posix_fallocate() is not used as fallback, as it emulates preallocation
+  // by writing every block, which costs more than fragments do.
+  if (errno != EOPNOTSUPP && errno != ENOSYS) {
+    fprintf(stderr, "PreallocateFile() fallocate() failed: %s\n",
+            strerror(errno));
+  }
+  return false;
+}
+
+FileCopier::FileCopier(const ExtractOptions& options, ExtractStats* stats)
+    : options_(options),
+      stats_(stats),
+      method_(kCopyMethodAuto) {
+}
+
+bool FileCopier::copy(int src_fd, int dest_fd, int64_t file_size,
+                      const char* src_file, ContentHasher* hasher) {
+  if (file_size == 0) {
+    // Nothing to copy, and nothing to learn about copy methods.
+    return true;
+  }
+
+  // In memory-bounded mode, large files bypass page cache of dest if its
+  // filesystem supports O_DIRECT.
+  const bool direct = options_.direct_io && file_size >= kMinDirectIoSize &&
+                      SetDirectIo(dest_fd, true);
+  const bool ok = copyContent(src_fd, dest_fd, file_size, src_file, hasher,
+                              direct);
+  if (direct && stats_) {
+    stats_->direct_files++;
+    stats_->direct_bytes += file_size;
+  }
+  if (options_.drop_cache) {
+    // Source file is read only once. Pages of dest are dropped by
+    // WritebackPacer after they are written back.
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_DONTNEED);
+  }
+  return ok;
+}
+
+bool FileCopier::copyContent(int src_fd, int dest_fd, int64_t file_size,
+                             const char* src_file, ContentHasher* hasher,
+                             bool direct) {
+  // Filesystems without hole support report the whole file as data.
+  const off_t first_hole = (file_size >= kMinSparseFileSize) ?
+                           lseek(src_fd, 0, SEEK_HOLE) : -1;
+  if (first_hole < 0 || first_hole >= file_size) {
+    // Cloned extents are shared with source, reserving new ones is wasted.
+    if (options_.preallocate_size > 0 &&
+        file_size >= options_.preallocate_size &&
+        method_ != kCopyMethodClone && PreallocateFile(dest_fd, file_size) &&
+        stats_) {
+      stats_->preallocated_files++;
+      stats_->preallocated_bytes += file_size;
+    }
+    return copyRange(src_fd, dest_fd, 0, file_size, true, src_file, hasher,
+                     direct);
+  }
+
+  // Set size of sparse file first, then copy data extents only, so that
+  // holes are kept in |dest_fd|.
+  if (ftruncate(dest_fd, file_size) != 0) {
+    fprintf(stderr, "FileCopier() ftruncate() failed: %s, %s\n",
+            src_file, strerror(errno));
+    return false;
+  }
+  int64_t data_bytes = 0;
+  off_t offset = 0;
+  while (offset < file_size) {
+    const off_t data = lseek(src_fd, offset, SEEK_DATA);
+    if (data < 0 || data >= file_size) {
+      // ENXIO, no more data.
+      break;
+    }
+    off_t hole = lseek(src_fd, data, SEEK_HOLE);
+    if (hole < 0 || hole > file_size) {
+      hole = file_size;
+    }
+    if (hasher) {
+      hasher->updateZeros(static_cast<uint64_t>(data - offset));
+    }
+    if (!copyRange(src_fd, dest_fd, data, hole, false, src_file, hasher,
+                   direct)) {
+      return false;
+    }
+    data_bytes += hole - data;
+    offset = hole;
+  }
+  if (hasher && offset < file_size) {
+    hasher->updateZeros(static_cast<uint64_t>(file_size - offset));
+  }
+  if (stats_) {
+    stats_->sparse_files++;
+    stats_->sparse_bytes += file_size - data_bytes;
+  }
+  return true;
+}
+
+bool FileCopier::copyRange(int src_fd, int dest_fd, int64_t start,
+                           int64_t end, bool whole_file,
+                           const char* src_file, ContentHasher* hasher,
+                           bool direct) {
+  int first = options_.copy_method;
+  if (hasher || direct) {
+    // Content has to pass through user space to be hashed, or to be written
+    // with O_DIRECT.
+    first = kCopyMethodReadWrite;
+  } else if (first == kCopyMethodAuto) {
+    first = (method_ == kCopyMethodAuto) ? 0 : int(method_);
+  }
+
+  int64_t offset = start;
+  for (int method = first; method < kCopyMethodCount; ++method) {
+    if (method != first && !isEnabled(method)) {
+      continue;
+    }
+    // Extents are shared for the whole file only.
+    if (method == kCopyMethodClone && !whole_file) {
+      continue;
+    }
+
+    const int64_t start_offset = offset;
+    const int64_t start_time = NowNsecs();
+    const Result result = copyWith(method, src_fd, dest_fd, end, hasher,
+                                   direct, offset);
+    const int error = errno;
+    if (result == kResultUnsupported) {
+      continue;
+    }
+
+    if (stats_) {
+      if (start == 0) {
+        stats_->copy_files[method]++;
+      }
+      stats_->copy_bytes[method] += offset - start_offset;
+      stats_->copy_nsecs[method] += NowNsecs() - start_time;
+    }
+
+    if (result == kResultDone) {
+      int expected = kCopyMethodAuto;
+      if (whole_file && !hasher && !direct &&
+          method_.compare_exchange_strong(expected, method) && stats_) {
+        stats_->copy_method = method;
+      }
+      return true;
+    }
+
+    // xz uncompress error or Input/output error of squashfs file, which
+    // might have some defects, is not skipped, as file would be corrupted.
+    fprintf(stderr, "FileCopier() %s error: %s, %s\n",
+            GetCopyMethodName(method), strerror(error), src_file);
+    if (stats_) {
+      stats_->read_errors++;
+    }
+    return false;
+  }
+
+  // Not reached, as kCopyMethodReadWrite is always supported.
+  return false;
+}
+
+FileCopier::Result FileCopier::copyWith(int method, int src_fd, int dest_fd,
+                                        int64_t end, ContentHasher* hasher,
+                                        bool direct, int64_t& offset) {
+  switch (method) {
+    case kCopyMethodClone: {
+      return cloneFile(src_fd, dest_fd, end, offset);
+    }
+    case kCopyMethodCopyFileRange: {
+      return copyFileRange(src_fd, dest_fd, end, offset);
+    }
+    case kCopyMethodSendfile: {
+      return sendFile(src_fd, dest_fd, end, offset);
+    }
+    case kCopyMethodSplice: {
+      return spliceFile(src_fd, dest_fd, end, offset);
+    }
+    default: {
+      return readWrite(src_fd, dest_fd, end, hasher, direct, offset);
+    }
+  }
+}
+
+FileCopier::Result FileCopier::cloneFile(int src_fd, int dest_fd,
+                                         int64_t end, int64_t& offset) {
+#ifdef FICLONE
+  if (offset != 0) {
+    return kResultUnsupported;
+  }
+  if (ioctl(dest_fd, FICLONE, src_fd) != 0) {
+    return IsUnsupportedError(errno) ? kResultUnsupported : kResultError;
+  }
+  offset = end;
+  return kResultDone;
+#else
+  (void) src_fd;
+  (void) dest_fd;
+  (void) end;
+  (void) offset;
+  return kResultUnsupported;
+#endif
+}
+
+FileCopier::Result FileCopier::copyFileRange(int src_fd, int dest_fd,
+                                             int64_t end,
+                                             int64_t& offset) {
+#ifdef __NR_copy_file_range
+  // Call it directly, as old glibc has no wrapper, and some versions of
+  // glibc emulate it with read() and write().
+  const int64_t start_offset = offset;
+  while (offset < end) {
+    loff_t in_off = offset;
+    loff_t out_off = offset;
+    const size_t len = size_t(std::min<int64_t>(end - offset,
+                                                kMaxKernelChunk));
+    const long num_copied = syscall(__NR_copy_file_range, src_fd, &in_off,
+                                    dest_fd, &out_off, len, 0);
+    if (num_copied < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (offset == start_offset && IsUnsupportedError(errno)) {
+        return kResultUnsupported;
+      }
+      return kResultError;
+    }
+    if (num_copied == 0) {
+      // File is shorter than expected.
+      break;
+    }
+    offset += num_copied;
+  }
+  return kResultDone;
+#else
+  (void) src_fd;
+  (void) dest_fd;
+  (void) end;
+  (void) offset;
+  return kResultUnsupported;
+#endif
+}
+
+FileCopier::Result FileCopier::sendFile(int src_fd, int dest_fd,
+                                        int64_t end, int64_t& offset) {
+  // sendfile() writes at current position of |dest_fd|.
+  if (lseek(dest_fd, offset, SEEK_SET) != offset) {
+    return kResultError;
+  }
+  const int64_t start_offset = offset;
+  while (offset < end) {
+    off_t in_off = offset;
+    const size_t len = size_t(std::min<int64_t>(end - offset,
+                                                kMaxKernelChunk));
+    const ssize_t num_sent = sendfile(dest_fd, src_fd, &in_off, len);
+    if (num_sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (offset == start_offset && IsUnsupportedError(errno)) {
+        return kResultUnsupported;
+      }
+      return kResultError;
+    }
+    if (num_sent == 0) {
+      break;
+    }
+    offset += num_sent;
+  }
+  return kResultDone;
+}
+
+FileCopier::Result FileCopier::spliceFile(int src_fd, int dest_fd,
+                                          int64_t end, int64_t& offset) {
+  static thread_local SplicePipe pipe;
+  if (!pipe.init(options_.buffer_size)) {
+    return kResultUnsupported;
+  }
+
+  const unsigned int flags = SPLICE_F_MOVE | SPLICE_F_MORE;
+  const int64_t start_offset = offset;
+  while (offset < end) {
+    loff_t in_off = offset;
+    const size_t len = size_t(std::min<int64_t>(end - offset,
+                                                int64_t(pipe.size)));
+    ssize_t num_in = splice(src_fd, &in_off, pipe.fds[1], nullptr, len, flags);
+    if (num_in < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (offset == start_offset && IsUnsupportedError(errno)) {
+        return kResultUnsupported;
+      }
+      return kResultError;
+    }
+    if (num_in == 0) {
+      break;
+    }
+
+    // Drain the pipe into |dest_fd|.
+    while (num_in > 0) {
+      loff_t out_off = offset;
+      const ssize_t num_out = splice(pipe.fds[0], nullptr, dest_fd, &out_off,
+                                     size_t(num_in), flags);
+      if (num_out <= 0) {
+        if (num_out < 0 && errno == EINTR) {
+          continue;
+        }
+        const int error = errno;
+        pipe.reset();
+        errno = error;
+        return kResultError;
+      }
+      num_in -= num_out;
+      offset += num_out;
+    }
+  }
+  return kResultDone;
+}
+
+FileCopier::Result FileCopier::readWrite(int src_fd, int dest_fd,
+                                         int64_t end, ContentHasher* hasher,
+                                         bool direct, int64_t& offset) {
+  // Aligned for O_DIRECT, and reused by each worker thread.
+  static thread_local AlignedBuffer buf;
+  const size_t buf_size = std::max<size_t>(
+      (options_.buffer_size + kDirectIoAlignment - 1) / kDirectIoAlignment *
+      kDirectIoAlignment, kDirectIoAlignment);
+  if (!buf.reserve(buf_size)) {
+    errno = ENOMEM;
+    return kResultError;
+  }
+
+  while (offset < end) {
+    const size_t len = size_t(std::min<int64_t>(end - offset,
+                                                int64_t(buf_size)));
+    const ssize_t num_read = pread(src_fd, buf.data(), len, offset);
+    if (num_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return kResultError;
+    }
+    if (num_read == 0) {
+      break;
+    }
+    if (hasher) {
+      const int64_t start_time = NowNsecs();
+      hasher->update(buf.data(), size_t(num_read));
+      if (stats_) {
+        stats_->hash_nsecs += NowNsecs() - start_time;
+      }
+    }
+
+    // Offset and length of O_DIRECT write shall be aligned, which is not
+    // true for tail of file. Dest fd is owned by this worker, so the flag
+    // is cleared for the rest of file.
+    if (direct && ((offset | num_read) & int64_t(kDirectIoAlignment - 1))) {
+      SetDirectIo(dest_fd, false);
+      direct = false;
+    }
+
+    // write() might write fewer bytes than requested.
+    ssize_t num_written = 0;
+    while (num_written < num_read) {
+      const ssize_t n = pwrite(dest_fd, buf.data() + num_written,
+                               size_t(num_read - num_written),
+                               offset + num_written);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EINVAL && direct) {
+          // Filesystem accepted O_DIRECT flag but rejects the write.
+          SetDirectIo(dest_fd, false);
+          direct = false;
+          continue;
+        }
+        return kResultError;
+      }
+      num_written += n;
+    }
+    offset += num_read;
+  }
+  return kResultDone;
+}
+
+bool FileCopier::isEnabled(int method) const {
+  if (options_.copy_method != kCopyMethodAuto) {
+    // Requested method falls back to read()/write() only.
+    return (method == kCopyMethodReadWrite);
+  }
+  if (!options_.use_sendfile) {
+    // copy_file_range() between different filesystems goes through the same
+    // do_splice_direct() as sendfile() on some kernels.
+    return (method != kCopyMethodSendfile &&
+            method != kCopyMethodCopyFileRange);
+  }
+  return true;
+}
+
+}  // namespace installer
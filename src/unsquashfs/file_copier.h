@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_FILE_COPIER_H
+#define INSTALLER_UNSQUASHFS_FILE_COPIER_H
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "unsquashfs/extract_options.h"
+
+namespace installer {
+
+class ContentHasher;
+struct ExtractStats;
+
+// Copies content of regular files with the fastest method supported by
+// source and destination filesystems.
+// Methods are probed in CopyMethod order on the first file, and the one which
+// works is used by all later files. A file falls back to slower methods
+// only if the chosen one is rejected for it.
+// All methods are thread safe.
+class FileCopier {
+ public:
+  FileCopier(const ExtractOptions& options, ExtractStats* stats);
+
+  // Copy |file_size| bytes from |src_fd| to |dest_fd|, both opened by caller.
+  // Holes reported by SEEK_HOLE are kept in |dest_fd|.
+  // |src_file| is used in error messages.
+  // If |hasher| is not nullptr, content is copied with read() and write()
+  // and appended to it, holes included.
+  // Files without holes are preallocated if they are large enough, see
+  // ExtractOptions::preallocate_size.
+  // In memory-bounded mode, large files are written with O_DIRECT, and
+  // |src_fd| is dropped from page cache afterwards.
+  bool copy(int src_fd, int dest_fd, int64_t file_size, const char* src_file,
+            ContentHasher* hasher = nullptr);
+
+  // Returns method chosen after probing, or kCopyMethodAuto.
+  int method() const { return method_; }
+
+ private:
+  enum Result {
+    kResultDone,
+    // Method is not supported by filesystem or kernel, nothing copied.
+    kResultUnsupported,
+    kResultError,
+  };
+
+  // Copy content of file, see copy(). |dest_fd| has O_DIRECT flag set if
+  // |direct| is true.
+  bool copyContent(int src_fd, int dest_fd, int64_t file_size,
+                   const char* src_file, ContentHasher* hasher, bool direct);
+
+  // Copy range [start, end) with the chosen method, falling back to slower
+  // ones. |whole_file| is true if the range covers the whole file.
+  // Only read() and write() are used if |hasher| is given or |direct| is
+  // true.
+  // Returns false on error, which is counted in ExtractStats::read_errors.
+  bool copyRange(int src_fd, int dest_fd, int64_t start, int64_t end,
+                 bool whole_file, const char* src_file,
+                 ContentHasher* hasher, bool direct);
+
+  // Copy range [offset, end) with |method|. |offset| is updated to the end
+  // of bytes copied.
+  Result copyWith(int method, int src_fd, int dest_fd, int64_t end,
+                  ContentHasher* hasher, bool direct, int64_t& offset);
+
+  Result cloneFile(int src_fd, int dest_fd, int64_t end,
+                   int64_t& offset);
+  Result copyFileRange(int src_fd, int dest_fd, int64_t end,
+                       int64_t& offset);
+  Result sendFile(int src_fd, int dest_fd, int64_t end,
+                  int64_t& offset);
+  Result spliceFile(int src_fd, int dest_fd, int64_t end,
+                    int64_t& offset);
+  Result readWrite(int src_fd, int dest_fd, int64_t end,
+                   ContentHasher* hasher, bool direct, int64_t& offset);
+
+  // Returns true if |method| shall be tried.
+  bool isEnabled(int method) const;
+
+  const ExtractOptions& options_;
+  ExtractStats* stats_;
+  std::atomic<int> method_;
+};
+
+// Reserve extents for |size| bytes of newly created file |fd| with
+// fallocate(), without changing its size. Returns false if filesystem does
+// not support it, which is not logged, or on error.
+bool PreallocateFile(int fd, int64_t size);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_FILE_COPIER_H
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/hard_link_map.h"
+
+namespace installer {
+
+bool HardLinkMap::find(uint64_t dev, uint64_t ino,
+                       std::string& dest_file) const {
+  const Key key = { dev, ino };
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = links_.find(key);
+  if (it == links_.end() || it->second.empty()) {
+    return false;
+  }
+  dest_file = it->second;
+  return true;
+}
+
+bool HardLinkMap::claim(uint64_t dev, uint64_t ino) {
+  const Key key = { dev, ino };
+  std::lock_guard<std::mutex> lock(mutex_);
+  return links_.insert(std::make_pair(key, std::string())).second;
+}
+
+void HardLinkMap::insert(uint64_t dev, uint64_t ino,
+                         const std::string& dest_file) {
+  const Key key = { dev, ino };
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto result = links_.insert(std::make_pair(key, dest_file));
+  if (!result.second && result.first->second.empty()) {
+    result.first->second = dest_file;
+  }
+}
+
+}  // namespace installer
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_HARD_LINK_MAP_H
+#define INSTALLER_UNSQUASHFS_HARD_LINK_MAP_H
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace installer {
+
+// Remembers target path of each extracted file which has more than one
+// hard link in source filesystem, so that later names of the same inode
+// are created with link() instead of copying content again.
+// Its methods are thread safe.
+class HardLinkMap {
+ public:
+  // Returns true and sets |dest_file| if inode (|dev|, |ino|) has been
+  // extracted to |dest_file| before.
+  bool find(uint64_t dev, uint64_t ino, std::string& dest_file) const;
+
+  // Returns true if caller is the first to reach inode (|dev|, |ino|), then
+  // it shall extract the inode and insert() it. Returns false if another
+  // name of the inode was claimed before, which might still be extracted
+  // by another worker.
+  bool claim(uint64_t dev, uint64_t ino);
+
+  // Record that inode (|dev|, |ino|) has been extracted to |dest_file|.
+  // The first record of each inode is kept.
+  void insert(uint64_t dev, uint64_t ino, const std::string& dest_file);
+
+ private:
+  struct Key {
+    uint64_t dev;
+    uint64_t ino;
+
+    bool operator==(const Key& other) const {
+      return dev == other.dev && ino == other.ino;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<uint64_t>()(key.ino * 31 + key.dev);
+    }
+  };
+
+  mutable std::mutex mutex_;
+  // Dest file of each inode, empty if it is claimed but not extracted yet.
+  std::unordered_map<Key, std::string, KeyHash> links_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_HARD_LINK_MAP_H
@@ -0,0 +1,497 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/image_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <lzma.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "unsquashfs/extract_progress.h"
+#include "unsquashfs/extract_stats.h"
+
+namespace installer {
+
+namespace {
+
+// Size of compressed input read at once.
+const size_t kInputSize = 1 << 20;
+
+// Size of decompressed content written at once.
+const size_t kChunkSize = 4 << 20;
+
+// Zero runs are detected in units of filesystem blocks.
+const size_t kZeroBlockSize = 4096;
+
+// Shorter zero runs are written as part of content around them, so that
+// writes stay large and sequential.
+const int64_t kMinZeroRun = 1 << 20;
+
+const uint8_t kXzMagic[] = {0xfd, '7', 'z', 'X', 'Z', 0x00};
+const uint8_t kGzipMagic[] = {0x1f, 0x8b};
+
+enum ImageCompression {
+  kImageRaw,
+  kImageXz,
+  kImageGzip,
+};
+
+int64_t NowNsecs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+bool IsZero(const uint8_t* data, size_t len) {
+  // Compare with itself shifted by one byte, after checking the first one.
+  return len == 0 || (data[0] == 0 && memcmp(data, data + 1, len - 1) == 0);
+}
+
+// Reads decompressed content of image file.
+class ImageReader {
+ public:
+  ImageReader() : input_(kInputSize) {}
+
+  ~ImageReader() {
+    if (compression_ == kImageXz) {
+      lzma_end(&xz_);
+    } else if (compression_ == kImageGzip) {
+      inflateEnd(&gz_);
+    }
+    if (fd_ != -1) {
+      close(fd_);
+    }
+  }
+
+  bool open(const std::string& path) {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd_ == -1 || fstat(fd_, &st) != 0) {
+      fprintf(stderr, "WriteImage() failed to open %s: %s\n", path.c_str(),
+              strerror(errno));
+      return false;
+    }
+    input_size_ = st.st_size;
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (!fill()) {
+      return false;
+    }
+
+    if (in_len_ >= sizeof(kXzMagic) &&
+        memcmp(input_.data(), kXzMagic, sizeof(kXzMagic)) == 0) {
+      // Concatenated streams, as written by parallel xz, are accepted.
+      if (lzma_stream_decoder(&xz_, UINT64_MAX, LZMA_CONCATENATED) !=
+          LZMA_OK) {
+        return false;
+      }
+      compression_ = kImageXz;
+    } else if (in_len_ >= sizeof(kGzipMagic) &&
+               memcmp(input_.data(), kGzipMagic, sizeof(kGzipMagic)) == 0) {
+      memset(&gz_, 0, sizeof(gz_));
+      // Accept gzip header only.
+      if (inflateInit2(&gz_, 16 + MAX_WBITS) != Z_OK) {
+        return false;
+      }
+      compression_ = kImageGzip;
+    }
+    return true;
+  }
+
+  const char* compressionName() const {
+    switch (compression_) {
+      case kImageXz: return "xz";
+      case kImageGzip: return "gzip";
+      default: return "none";
+    }
+  }
+
+  // Size of image file, and bytes of it read so far.
+  int64_t inputSize() const { return input_size_; }
+  int64_t inputRead() const { return input_read_; }
+
+  // Read up to |size| bytes of decompressed content into |buf|, less only
+  // at end of image. Returns number of bytes read, or -1 on error.
+  ssize_t read(uint8_t* buf, size_t size) {
+    size_t done = 0;
+    while (done < size && !finished_) {
+      if (in_pos_ == in_len_ && !in_eof_ && !fill()) {
+        return -1;
+      }
+      const size_t avail_in = in_len_ - in_pos_;
+      if (compression_ == kImageRaw) {
+        const size_t len = std::min(avail_in, size - done);
+        memcpy(buf + done, input_.data() + in_pos_, len);
+        in_pos_ += len;
+        done += len;
+        finished_ = (in_eof_ && in_pos_ == in_len_);
+      } else if (!decompress(buf, size, done)) {
+        return -1;
+      }
+    }
+    return static_cast<ssize_t>(done);
+  }
+
+ private:
+  // Read next part of image file, which replaces consumed input.
+  bool fill() {
+    const ssize_t len = ::read(fd_, input_.data(), input_.size());
+    if (len < 0) {
+      fprintf(stderr, "WriteImage() failed to read image: %s\n",
+              strerror(errno));
+      return false;
+    }
+    in_pos_ = 0;
+    in_len_ = static_cast<size_t>(len);
+    in_eof_ = (len == 0);
+    input_read_ += len;
+    return true;
+  }
+
+  // Decompress available input into |buf| after |done| bytes.
+  bool decompress(uint8_t* buf, size_t size, size_t& done) {
+    const size_t avail_in = in_len_ - in_pos_;
+    if (compression_ == kImageXz) {
+      xz_.next_in = input_.data() + in_pos_;
+      xz_.avail_in = avail_in;
+      xz_.next_out = buf + done;
+      xz_.avail_out = size - done;
+      const lzma_ret ret = lzma_code(&xz_, in_eof_ ? LZMA_FINISH : LZMA_RUN);
+      in_pos_ = in_len_ - xz_.avail_in;
+      done = size - xz_.avail_out;
+      if (ret == LZMA_STREAM_END) {
+        finished_ = true;
+      } else if (ret != LZMA_OK) {
+        fprintf(stderr, "WriteImage() xz error: %d\n", ret);
+        return false;
+      }
+      return true;
+    }
+
+    gz_.next_in = input_.data() + in_pos_;
+    gz_.avail_in = static_cast<uInt>(avail_in);
+    gz_.next_out = buf + done;
+    gz_.avail_out = static_cast<uInt>(size - done);
+    const int ret = inflate(&gz_, Z_NO_FLUSH);
+    in_pos_ = in_len_ - gz_.avail_in;
+    done = size - gz_.avail_out;
+    if (ret == Z_STREAM_END) {
+      // Another gzip member might follow, as written by pigz.
+      if (in_pos_ == in_len_ && !fill()) {
+        return false;
+      }
+      if (in_pos_ == in_len_) {
+        finished_ = true;
+      } else {
+        inflateReset(&gz_);
+      }
+    } else if (ret == Z_BUF_ERROR && in_eof_) {
+      fprintf(stderr, "WriteImage() gzip image is truncated\n");
+      return false;
+    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      fprintf(stderr, "WriteImage() gzip error: %d\n", ret);
+      return false;
+    }
+    return true;
+  }
+
+  int fd_ = -1;
+  ImageCompression compression_ = kImageRaw;
+  lzma_stream xz_ = LZMA_STREAM_INIT;
+  z_stream gz_;
+
+  std::vector<uint8_t> input_;
+  size_t in_pos_ = 0;
+  size_t in_len_ = 0;
+  bool in_eof_ = false;
+  bool finished_ = false;
+  int64_t input_size_ = 0;
+  int64_t input_read_ = 0;
+};
+
+// Writes decompressed image to dest sequentially, turning long zero runs
+// into BLKZEROOUT or holes.
+class ImageSink {
+ public:
+  ImageSink(const ExtractOptions& options, ExtractStats* stats)
+      : options_(options),
+        stats_(stats) {}
+
+  ~ImageSink() {
+    if (fd_ != -1) {
+      close(fd_);
+    }
+  }
+
+  bool open(const std::string& dest) {
+    struct stat st;
+    if (stat(dest.c_str(), &st) == 0 && S_ISBLK(st.st_mode)) {
+      // O_EXCL fails if device is mounted or used by another holder.
+      fd_ = ::open(dest.c_str(), O_WRONLY | O_EXCL | O_CLOEXEC);
+      uint64_t size = 0;
+      if (fd_ != -1 && ioctl(fd_, BLKGETSIZE64, &size) == 0) {
+        dest_size_ = static_cast<int64_t>(size);
+      }
+      block_device_ = true;
+    } else {
+      fd_ = ::open(dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644);
+    }
+    if (fd_ == -1) {
+      fprintf(stderr, "WriteImage() failed to open %s: %s\n", dest.c_str(),
+              strerror(errno));
+      return false;
+    }
+    dest_ = dest;
+    return true;
+  }
+
+  // Append |len| bytes of image content.
+  bool write(const uint8_t* data, size_t len) {
+    size_t start = 0;
+    size_t i = 0;
+    while (i < len) {
+      const size_t n = std::min(kZeroBlockSize, len - i);
+      if (!IsZero(data + i, n)) {
+        i += n;
+        continue;
+      }
+      size_t end = i + n;
+      while (end < len) {
+        const size_t m = std::min(kZeroBlockSize, len - end);
+        if (!IsZero(data + end, m)) {
+          break;
+        }
+        end += m;
+      }
+      if (end == len) {
+        // Zero run at end of chunk might go on in next chunk.
+        if (!writeData(data + start, i - start)) {
+          return false;
+        }
+        pending_zeros_ += static_cast<int64_t>(end - i);
+        return true;
+      }
+      if (i == 0 && pending_zeros_ > 0) {
+        // Zero run of previous chunk goes on.
+        pending_zeros_ += static_cast<int64_t>(end);
+        start = end;
+      } else if (static_cast<int64_t>(end - i) >= kMinZeroRun) {
+        if (!writeData(data + start, i - start)) {
+          return false;
+        }
+        pending_zeros_ = static_cast<int64_t>(end - i);
+        start = end;
+      }
+      i = end;
+    }
+    return writeData(data + start, len - start);
+  }
+
+  // Write zero run at end of image and flush content to disk.
+  bool finish() {
+    if (!flushZeros()) {
+      return false;
+    }
+    if (!block_device_ && ftruncate(fd_, pos_) != 0) {
+      fprintf(stderr, "WriteImage() ftruncate() failed: %s, %s\n",
+              dest_.c_str(), strerror(errno));
+      return false;
+    }
+    if (fsync(fd_) != 0) {
+      fprintf(stderr, "WriteImage() fsync() failed: %s, %s\n",
+              dest_.c_str(), strerror(errno));
+      return false;
+    }
+    if (stats_) {
+      stats_->image_bytes += pos_;
+    }
+    return true;
+  }
+
+ private:
+  // Returns false if |len| bytes more do not fit in dest.
+  bool checkSize(int64_t len) const {
+    if (dest_size_ > 0 && pos_ + len > dest_size_) {
+      fprintf(stderr, "WriteImage() image is larger than %s, %lld bytes\n",
+              dest_.c_str(), static_cast<long long>(dest_size_));
+      return false;
+    }
+    return true;
+  }
+
+  bool writeData(const uint8_t* data, size_t len) {
+    if (len == 0) {
+      return true;
+    }
+    if (!flushZeros() || !checkSize(static_cast<int64_t>(len))) {
+      return false;
+    }
+    if (!pwriteAll(data, len)) {
+      return false;
+    }
+    return pace();
+  }
+
+  bool pwriteAll(const uint8_t* data, size_t len) {
+    while (len > 0) {
+      const ssize_t n = pwrite(fd_, data, len, pos_);
+      if (n <= 0) {
+        fprintf(stderr, "WriteImage() pwrite() failed: %s, %s\n",
+                dest_.c_str(), strerror(errno));
+        return false;
+      }
+      data += n;
+      len -= static_cast<size_t>(n);
+      pos_ += n;
+    }
+    return true;
+  }
+
+  // Write pending zero run, skipping it if it is long enough.
+  bool flushZeros() {
+    const int64_t len = pending_zeros_;
+    if (len == 0) {
+      return true;
+    }
+    pending_zeros_ = 0;
+    if (!checkSize(len)) {
+      return false;
+    }
+    if (len >= kMinZeroRun) {
+      if (!block_device_) {
+        pos_ += len;
+        countZeros(len);
+        return true;
+      }
+      uint64_t range[2] = {static_cast<uint64_t>(pos_),
+                           static_cast<uint64_t>(len)};
+      if (ioctl(fd_, BLKZEROOUT, range) == 0) {
+        pos_ += len;
+        countZeros(len);
+        return true;
+      }
+      // Not supported by device, or unaligned.
+    }
+    const std::vector<uint8_t> zeros(
+        static_cast<size_t>(std::min<int64_t>(len, kChunkSize)), 0);
+    int64_t left = len;
+    while (left > 0) {
+      const size_t n = static_cast<size_t>(
+          std::min<int64_t>(left, static_cast<int64_t>(zeros.size())));
+      if (!pwriteAll(zeros.data(), n)) {
+        return false;
+      }
+      left -= static_cast<int64_t>(n);
+    }
+    return pace();
+  }
+
+  void countZeros(int64_t len) {
+    if (stats_) {
+      stats_->image_zero_bytes += len;
+    }
+  }
+
+  // Flush written content once it exceeds dirty window, so that page cache
+  // is not filled with image content and final fsync() is short.
+  bool pace() {
+    if (options_.dirty_window <= 0 ||
+        pos_ - synced_ < options_.dirty_window) {
+      return true;
+    }
+    if (sync_file_range(fd_, synced_, pos_ - synced_,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                        SYNC_FILE_RANGE_WAIT_AFTER) != 0) {
+      fprintf(stderr, "WriteImage() sync_file_range() failed: %s, %s\n",
+              dest_.c_str(), strerror(errno));
+      return false;
+    }
+    if (options_.drop_cache) {
+      posix_fadvise(fd_, synced_, pos_ - synced_, POSIX_FADV_DONTNEED);
+    }
+    synced_ = pos_;
+    return true;
+  }
+
+  const ExtractOptions& options_;
+  ExtractStats* stats_;
+  std::string dest_;
+  int fd_ = -1;
+  bool block_device_ = false;
+  // Size of block device, 0 for regular file.
+  int64_t dest_size_ = 0;
+  // Offset of next byte to write.
+  int64_t pos_ = 0;
+  // Zeros read but not written yet.
+  int64_t pending_zeros_ = 0;
+  // Content before this offset is flushed to disk.
+  int64_t synced_ = 0;
+};
+
+}  // namespace
+
+bool WriteImage(const std::string& image_file, const std::string& dest,
+                const ExtractOptions& options, ExtractProgress* progress,
+                ExtractStats* stats) {
+  ImageReader reader;
+  ImageSink sink(options, stats);
+  if (!reader.open(image_file) || !sink.open(dest)) {
+    return false;
+  }
+  fprintf(stdout, "image: %s, compression: %s\n", image_file.c_str(),
+          reader.compressionName());
+  if (progress) {
+    progress->setTotal(1, reader.inputSize());
+  }
+
+  const int64_t start_time = NowNsecs();
+  std::vector<uint8_t> chunk(kChunkSize);
+  int64_t reported = 0;
+  while (true) {
+    const ssize_t len = reader.read(chunk.data(), chunk.size());
+    if (len < 0 || !sink.write(chunk.data(), static_cast<size_t>(len))) {
+      return false;
+    }
+    if (progress) {
+      progress->addBytes(reader.inputRead() - reported);
+      reported = reader.inputRead();
+    }
+    if (static_cast<size_t>(len) < chunk.size()) {
+      break;
+    }
+  }
+  if (!sink.finish()) {
+    return false;
+  }
+  if (stats) {
+    stats->image_nsecs += NowNsecs() - start_time;
+  }
+  return true;
+}
+
+}  // namespace installer
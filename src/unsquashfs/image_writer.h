@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_IMAGE_WRITER_H
+#define INSTALLER_UNSQUASHFS_IMAGE_WRITER_H
+
+#include <string>
+
+#include "unsquashfs/extract_options.h"
+
+namespace installer {
+
+class ExtractProgress;
+struct ExtractStats;
+
+// Write raw filesystem image |image_file| to |dest|, a block device or a
+// regular file, from its first byte to the last with large sequential
+// writes, instead of extracting files one by one.
+// Image may be compressed with xz or gzip, detected from its magic, and it
+// is decompressed while it is streamed. Long runs of zero blocks are zeroed
+// with BLKZEROOUT on block devices, so that device may skip writing them,
+// and are left as holes in regular files. Block device is opened
+// exclusively, so it fails if it is mounted, and it shall be at least as
+// large as image.
+// Progress is weighted by bytes of |image_file| read, and its total is set
+// here. |options.dirty_window| bounds content not flushed to disk.
+bool WriteImage(const std::string& image_file, const std::string& dest,
+                const ExtractOptions& options, ExtractProgress* progress,
+                ExtractStats* stats);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_IMAGE_WRITER_H
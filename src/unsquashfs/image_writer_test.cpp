@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/image_writer.h"
+
+#include <lzma.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <string>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+#include "unsquashfs/extract_stats.h"
+
+namespace installer {
+namespace {
+
+// Image with content, a long zero run, a short one and zeros at end.
+std::string MakeImage() {
+  std::string image;
+  image.append(8192, 'a');
+  image.append(3 << 20, '\0');
+  image.append(4096, 'b');
+  image.append(8192, '\0');
+  image.append(5 << 20, 'c');
+  image.append(2 << 20, '\0');
+  return image;
+}
+
+std::string CompressXz(const std::string& data) {
+  std::string out(data.size() + 4096, '\0');
+  size_t out_pos = 0;
+  EXPECT_EQ(lzma_easy_buffer_encode(
+      1, LZMA_CHECK_CRC64, nullptr,
+      reinterpret_cast<const uint8_t*>(data.data()), data.size(),
+      reinterpret_cast<uint8_t*>(&out[0]), &out_pos, out.size()), LZMA_OK);
+  out.resize(out_pos);
+  return out;
+}
+
+std::string CompressGzip(const std::string& data) {
+  z_stream stream = {};
+  EXPECT_EQ(deflateInit2(&stream, 1, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                         Z_DEFAULT_STRATEGY), Z_OK);
+  std::string out(deflateBound(&stream, data.size()), '\0');
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  stream.avail_out = static_cast<uInt>(out.size());
+  EXPECT_EQ(deflate(&stream, Z_FINISH), Z_STREAM_END);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return out;
+}
+
+void WriteFile(const std::string& path, const std::string& content) {
+  FILE* fp = fopen(path.c_str(), "wb");
+  ASSERT_NE(fp, nullptr);
+  EXPECT_EQ(fwrite(content.data(), 1, content.size(), fp), content.size());
+  fclose(fp);
+}
+
+std::string ReadFile(const std::string& path) {
+  std::string content;
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (fp) {
+    char buf[65536];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+      content.append(buf, len);
+    }
+    fclose(fp);
+  }
+  return content;
+}
+
+TEST(ImageWriter, WriteCompressedImages) {
+  char tmp_dir[] = "/tmp/installer-image-writer-XXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+  const std::string dir(tmp_dir);
+  const std::string image = MakeImage();
+  const std::string dest = dir + "/dest.img";
+
+  const std::string inputs[] = {image, CompressXz(image),
+                                CompressGzip(image)};
+  for (const std::string& input : inputs) {
+    WriteFile(dir + "/src.img", input);
+    // Stale content of dest is replaced.
+    WriteFile(dest, std::string(16 << 20, 'x'));
+    ExtractOptions options;
+    options.dirty_window = 1 << 20;
+    ExtractStats stats;
+    ASSERT_TRUE(WriteImage(dir + "/src.img", dest, options, nullptr,
+                           &stats));
+    EXPECT_TRUE(ReadFile(dest) == image);
+    EXPECT_EQ(stats.image_bytes, static_cast<int64_t>(image.size()));
+    // Short zero run is written as content.
+    EXPECT_EQ(stats.image_zero_bytes, (3 << 20) + (2 << 20));
+  }
+
+  // Truncated image fails.
+  const std::string xz = CompressXz(image);
+  WriteFile(dir + "/src.img", xz.substr(0, xz.size() / 2));
+  ExtractOptions options;
+  EXPECT_FALSE(WriteImage(dir + "/src.img", dest, options, nullptr,
+                          nullptr));
+
+  unlink((dir + "/src.img").c_str());
+  unlink(dest.c_str());
+  rmdir(tmp_dir);
+}
+
+}  // namespace
+}  // namespace installer
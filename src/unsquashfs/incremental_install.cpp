@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/incremental_install.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "unsquashfs/dir_writer.h"
+#include "unsquashfs/extract_journal.h"
+#include "unsquashfs/extract_stats.h"
+
+namespace installer {
+
+namespace {
+
+// Created by mkfs in root of ext filesystems, and used by fsck.
+const char kLostFoundDir[] = "lost+found";
+
+// Signature written by mkswap at the end of first page.
+const char kSwapSignature[] = "SWAPSPACE2";
+
+// Returns true if item |name| in |dest| with status |st| is a swap file,
+// such as /swapfile created by installer before files are extracted.
+bool IsSwapFile(const DirWriter& dest, const char* name,
+                const struct stat& st) {
+  const long page_size = sysconf(_SC_PAGESIZE);
+  const size_t len = sizeof(kSwapSignature) - 1;
+  if (!S_ISREG(st.st_mode) || page_size <= 0 || st.st_size < page_size) {
+    return false;
+  }
+  const int fd = openat(dest.fd(), name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  char buf[sizeof(kSwapSignature)];
+  const bool ok = pread(fd, buf, len, page_size - long(len)) ==
+                      static_cast<ssize_t>(len) &&
+                  memcmp(buf, kSwapSignature, len) == 0;
+  close(fd);
+  return ok;
+}
+
+}  // namespace
+
+bool IsUnchangedItem(const DirWriter& dest, const char* name, mode_t mode,
+                     uint64_t size, const struct timespec& mtime,
+                     nlink_t nlink, const std::string& symlink) {
+  struct stat st;
+  if (!dest.statItem(name, st) ||
+      (st.st_mode & S_IFMT) != (mode & S_IFMT) ||
+      uint64_t(st.st_size) != size ||
+      st.st_mtim.tv_sec != mtime.tv_sec ||
+      st.st_mtim.tv_nsec != mtime.tv_nsec) {
+    return false;
+  }
+  if (S_ISREG(mode)) {
+    return nlink == 1 && st.st_nlink == 1;
+  }
+  if (!S_ISLNK(mode) || symlink.size() != size) {
+    return false;
+  }
+  std::string target(symlink.size(), '\0');
+  return readlinkat(dest.fd(), name, &target[0], target.size()) ==
+             static_cast<ssize_t>(target.size()) &&
+         target == symlink;
+}
+
+void PruneDir(DirWriter& dest,
+              const std::unordered_map<std::string, bool>& items,
+              bool is_root, dev_t dev, ExtractStats* stats) {
+  std::vector<std::string> names;
+  if (!dest.listItems(names)) {
+    fprintf(stderr, "PruneDir() failed to list %s: %s\n",
+            dest.path().c_str(), strerror(errno));
+    return;
+  }
+  for (const std::string& name : names) {
+    struct stat st;
+    if (!dest.statItem(name.c_str(), st) || st.st_dev != dev) {
+      continue;
+    }
+    const auto it = items.find(name);
+    if (it != items.end()) {
+      // Other items are replaced when they are installed.
+      if (it->second || !S_ISDIR(st.st_mode)) {
+        continue;
+      }
+    } else if (is_root && (name == kExtractJournalFile ||
+                           name == kLostFoundDir ||
+                           IsSwapFile(dest, name.c_str(), st))) {
+      continue;
+    }
+    if (!dest.removeTree(name.c_str())) {
+      fprintf(stderr, "PruneDir() failed to remove %s: %s\n",
+              dest.fullPath(name.c_str()), strerror(errno));
+      continue;
+    }
+    if (stats) {
+      stats->removed_items++;
+    }
+  }
+}
+
+}  // namespace installer
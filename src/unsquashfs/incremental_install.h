@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_INCREMENTAL_INSTALL_H
+#define INSTALLER_UNSQUASHFS_INCREMENTAL_INSTALL_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <string>
+#include <unordered_map>
+
+namespace installer {
+
+class DirWriter;
+struct ExtractStats;
+
+// Helpers of incremental mode, which installs over items left in dest folder
+// by previous installation. See ExtractOptions::incremental.
+
+// Returns true if item |name| in |dest| is a regular file or symbolic link
+// with file type of |mode|, |size| and |mtime|, which is about to be
+// installed from source. Symbolic links shall point to |symlink| too.
+// Regular files with several names are never unchanged, so that names of
+// one inode stay linked after they are written again.
+bool IsUnchangedItem(const DirWriter& dest, const char* name, mode_t mode,
+                     uint64_t size, const struct timespec& mtime,
+                     nlink_t nlink, const std::string& symlink);
+
+// Remove items in |dest| which are not in |items|, which maps names of items
+// to be installed to whether they are folders. Folders are removed too if
+// an item of another type is installed with their names, as they cannot be
+// replaced. If |is_root| is true, |dest| is dest folder, and its journal,
+// lost+found and swap files are kept.
+// Items not on device |dev| of dest folder are mount points, such as a
+// separate /home partition, and are kept with everything in them.
+void PruneDir(DirWriter& dest,
+              const std::unordered_map<std::string, bool>& items,
+              bool is_root, dev_t dev, ExtractStats* stats);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_INCREMENTAL_INSTALL_H
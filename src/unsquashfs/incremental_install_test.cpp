@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/incremental_install.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+#include "unsquashfs/dir_writer.h"
+#include "unsquashfs/extract_journal.h"
+#include "unsquashfs/extract_stats.h"
+
+namespace installer {
+namespace {
+
+TEST(IncrementalInstall, IsUnchangedItem) {
+  char tmp_dir[] = "/tmp/installer-incremental-XXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+  DirWriter dest;
+  ASSERT_TRUE(dest.open(tmp_dir));
+
+  const int fd = dest.createFile("file");
+  ASSERT_NE(fd, -1);
+  EXPECT_EQ(write(fd, "abc", 3), 3);
+  close(fd);
+  ASSERT_TRUE(dest.createSymlink("link", "file"));
+  struct timespec mtime;
+  mtime.tv_sec = 1500000000;
+  mtime.tv_nsec = 0;
+  const struct timespec times[2] = {mtime, mtime};
+  ASSERT_TRUE(dest.setTimes("file", times));
+  ASSERT_TRUE(dest.setTimes("link", times));
+
+  EXPECT_TRUE(IsUnchangedItem(dest, "file", S_IFREG | 0644, 3, mtime, 1, ""));
+  EXPECT_FALSE(IsUnchangedItem(dest, "file", S_IFREG | 0644, 4, mtime, 1,
+                               ""));
+  EXPECT_FALSE(IsUnchangedItem(dest, "file", S_IFLNK | 0777, 3, mtime, 1,
+                               "abc"));
+  // Files with several names are written again.
+  EXPECT_FALSE(IsUnchangedItem(dest, "file", S_IFREG | 0644, 3, mtime, 2,
+                               ""));
+  EXPECT_TRUE(IsUnchangedItem(dest, "link", S_IFLNK | 0777, 4, mtime, 1,
+                              "file"));
+  EXPECT_FALSE(IsUnchangedItem(dest, "link", S_IFLNK | 0777, 4, mtime, 1,
+                               "fila"));
+  EXPECT_FALSE(IsUnchangedItem(dest, "missing", S_IFREG | 0644, 3, mtime, 1,
+                               ""));
+  mtime.tv_sec++;
+  EXPECT_FALSE(IsUnchangedItem(dest, "file", S_IFREG | 0644, 3, mtime, 1,
+                               ""));
+
+  EXPECT_EQ(unlink(dest.fullPath("link")), 0);
+  EXPECT_EQ(unlink(dest.fullPath("file")), 0);
+  EXPECT_EQ(rmdir(tmp_dir), 0);
+}
+
+TEST(IncrementalInstall, PruneDir) {
+  char tmp_dir[] = "/tmp/installer-incremental-XXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+  DirWriter dest;
+  ASSERT_TRUE(dest.open(tmp_dir));
+
+  close(dest.createFile("kept"));
+  close(dest.createFile("stale"));
+  close(dest.createFile(kExtractJournalFile));
+  ASSERT_TRUE(dest.createDir("dir", 0755));
+  ASSERT_TRUE(dest.createDir("dir_now_file", 0755));
+  ASSERT_TRUE(dest.createDir("lost+found", 0700));
+  close(openat(dest.fd(), "dir_now_file/item", O_CREAT | O_WRONLY, 0644));
+
+  std::unordered_map<std::string, bool> items;
+  items["kept"] = false;
+  items["dir"] = true;
+  items["dir_now_file"] = false;
+  struct stat root_st;
+  ASSERT_EQ(fstat(dest.fd(), &root_st), 0);
+  ExtractStats stats;
+  // Items on another device are mount points, which are kept.
+  PruneDir(dest, items, true, root_st.st_dev + 1, &stats);
+  EXPECT_EQ(stats.removed_items, 0);
+  PruneDir(dest, items, true, root_st.st_dev, &stats);
+  EXPECT_EQ(stats.removed_items, 2);
+
+  std::vector<std::string> names;
+  ASSERT_TRUE(dest.listItems(names));
+  std::sort(names.begin(), names.end());
+  const std::vector<std::string> expected = {
+      kExtractJournalFile, "dir", "kept", "lost+found"};
+  EXPECT_EQ(names, expected);
+
+  // Journal and lost+found are kept only in dest folder.
+  PruneDir(dest, items, false, root_st.st_dev, &stats);
+  EXPECT_EQ(stats.removed_items, 4);
+
+  EXPECT_EQ(unlink(dest.fullPath("kept")), 0);
+  EXPECT_EQ(rmdir(dest.fullPath("dir")), 0);
+  EXPECT_EQ(rmdir(tmp_dir), 0);
+}
+
+TEST(IncrementalInstall, PruneDirKeepsSwapFile) {
+  char tmp_dir[] = "/tmp/installer-incremental-XXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+  DirWriter dest;
+  ASSERT_TRUE(dest.open(tmp_dir));
+
+  // Same layout as mkswap, signature at the end of first page.
+  const long page_size = sysconf(_SC_PAGESIZE);
+  std::string page(static_cast<size_t>(page_size), '\0');
+  page.replace(page.size() - 10, 10, "SWAPSPACE2");
+  for (const char* name : {"swapfile", "notswap"}) {
+    const int fd = dest.createFile(name);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(write(fd, page.data(), page.size()),
+              static_cast<ssize_t>(page.size()));
+    close(fd);
+    page.replace(page.size() - 10, 10, "SWAPSPACE0");
+  }
+
+  struct stat root_st;
+  ASSERT_EQ(fstat(dest.fd(), &root_st), 0);
+  const std::unordered_map<std::string, bool> items;
+  ExtractStats stats;
+  PruneDir(dest, items, true, root_st.st_dev, &stats);
+  EXPECT_EQ(stats.removed_items, 1);
+  struct stat st;
+  EXPECT_TRUE(dest.statItem("swapfile", st));
+  EXPECT_FALSE(dest.statItem("notswap", st));
+
+  EXPECT_EQ(unlink(dest.fullPath("swapfile")), 0);
+  EXPECT_EQ(rmdir(tmp_dir), 0);
+}
+
+}  // namespace
+}  // namespace installer
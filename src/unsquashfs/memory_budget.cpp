@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/memory_budget.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace installer {
+
+namespace {
+
+const char kMemInfoFile[] = "/proc/meminfo";
+
+// Copy buffers are multiples of this size.
+const size_t kMinBufferSize = 64 * 1024;
+
+// Cache a few fragment blocks at least, or else small files sharing
+// a fragment block decompress it again and again.
+const size_t kMinFragmentCacheSize = 4;
+
+}  // namespace
+
+int64_t ParseMemAvailable(const std::string& content) {
+  int64_t available = -1;
+  int64_t free_kb = -1;
+  int64_t cached_kb = -1;
+  std::istringstream stream(content);
+  std::string line;
+  while (std::getline(stream, line)) {
+    char key[64];
+    long long value = 0;
+    // Values are in kB.
+    if (sscanf(line.c_str(), "%63[^:]: %lld", key, &value) != 2) {
+      continue;
+    }
+    const std::string name(key);
+    if (name == "MemAvailable") {
+      available = value * 1024;
+    } else if (name == "MemFree") {
+      free_kb = value;
+    } else if (name == "Cached") {
+      cached_kb = value;
+    }
+  }
+  if (available < 0 && free_kb >= 0 && cached_kb >= 0) {
+    available = (free_kb + cached_kb) * 1024;
+  }
+  return available;
+}
+
+int64_t PickMemoryBudget(int64_t mem_available) {
+  // Leave most of available memory to desktop and installer UI.
+  return std::min(std::max(mem_available / 8, kMinMemoryBudget),
+                  kMaxMemoryBudget);
+}
+
+int64_t GetDefaultMemoryBudget() {
+  std::string content;
+  FILE* fp = fopen(kMemInfoFile, "re");
+  if (fp) {
+    char buf[4096];
+    size_t len;
+    while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+      content.append(buf, len);
+    }
+    fclose(fp);
+  }
+  const int64_t mem_available = ParseMemAvailable(content);
+  if (mem_available < 0) {
+    fprintf(stderr, "GetDefaultMemoryBudget() failed to read %s\n",
+            kMemInfoFile);
+    return kMinMemoryBudget;
+  }
+  return PickMemoryBudget(mem_available);
+}
+
+void ApplyMemoryBudget(int64_t budget, ExtractOptions& options) {
+  options.memory_budget = budget;
+  options.direct_io = true;
+  options.drop_cache = true;
+
+  const int64_t dirty_window = budget / 2;
+  if (options.dirty_window == 0 || options.dirty_window > dirty_window) {
+    options.dirty_window = dirty_window;
+  }
+
+  const int jobs = std::max(options.jobs, 1);
+  size_t buffer_size = static_cast<size_t>(budget / 4 / jobs);
+  buffer_size = std::max(buffer_size / kMinBufferSize * kMinBufferSize,
+                         kMinBufferSize);
+  options.buffer_size = std::min(options.buffer_size, buffer_size);
+}
+
+size_t GetFragmentCacheSize(const ExtractOptions& options,
+                            uint32_t block_size) {
+  if (options.memory_budget <= 0 || block_size == 0) {
+    return 0;
+  }
+  return std::max(static_cast<size_t>(options.memory_budget / 4 / block_size),
+                  kMinFragmentCacheSize);
+}
+
+bool SetDirectIo(int fd, bool enable) {
+  const int flags = fcntl(fd, F_GETFL);
+  if (flags == -1) {
+    return false;
+  }
+  const int new_flags = enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+  if (new_flags == flags) {
+    return true;
+  }
+  // tmpfs and some FUSE filesystems reject O_DIRECT with EINVAL.
+  return fcntl(fd, F_SETFL, new_flags) == 0;
+}
+
+AlignedBuffer::~AlignedBuffer() {
+  free(data_);
+}
+
+bool AlignedBuffer::reserve(size_t size) {
+  if (size <= size_) {
+    return true;
+  }
+  free(data_);
+  data_ = nullptr;
+  size_ = 0;
+  void* data = nullptr;
+  if (posix_memalign(&data, kDirectIoAlignment, size) != 0) {
+    return false;
+  }
+  data_ = static_cast<uint8_t*>(data);
+  size_ = size;
+  return true;
+}
+
+}  // namespace installer
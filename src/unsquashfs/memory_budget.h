@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_MEMORY_BUDGET_H
+#define INSTALLER_UNSQUASHFS_MEMORY_BUDGET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "unsquashfs/extract_options.h"
+
+namespace installer {
+
+// In memory-bounded mode, memory used by extraction is split as:
+//  * half of budget for file content written but not flushed to disk,
+//    see ExtractOptions::dirty_window;
+//  * a quarter for decompressed fragment blocks cached by SquashfsImage;
+//  * a quarter for copy buffers of all workers.
+// Content of finished files is dropped from page cache of both source and
+// dest, and large files are written with O_DIRECT.
+
+// Memory budget picked by GetDefaultMemoryBudget() is kept in this range.
+const int64_t kMinMemoryBudget = 16 * 1024 * 1024;
+const int64_t kMaxMemoryBudget = 256 * 1024 * 1024;
+
+// Files of at least this size are written with O_DIRECT in memory-bounded
+// mode. Smaller files are not worth the synchronous writes.
+const int64_t kMinDirectIoSize = 1024 * 1024;
+
+// Alignment of buffer, file offset and length of O_DIRECT writes, which
+// covers logical block size of all disks.
+const size_t kDirectIoAlignment = 4096;
+
+// Parse MemAvailable of /proc/meminfo |content|, in bytes. MemFree plus
+// Cached is used on old kernels without it. Returns -1 on error.
+int64_t ParseMemAvailable(const std::string& content);
+
+// Returns memory budget for a system with |mem_available| bytes of
+// available memory.
+int64_t PickMemoryBudget(int64_t mem_available);
+
+// Returns memory budget based on /proc/meminfo.
+int64_t GetDefaultMemoryBudget();
+
+// Enable memory-bounded mode in |options|, keeping memory usage of
+// extraction under |budget| bytes.
+void ApplyMemoryBudget(int64_t budget, ExtractOptions& options);
+
+// Returns number of fragment blocks of |block_size| to cache within
+// memory budget of |options|, or 0 if it is not limited.
+size_t GetFragmentCacheSize(const ExtractOptions& options,
+                            uint32_t block_size);
+
+// Set or clear O_DIRECT flag of |fd|. Returns false if filesystem does not
+// support it.
+bool SetDirectIo(int fd, bool enable);
+
+// Buffer aligned to kDirectIoAlignment, reused by one worker thread.
+class AlignedBuffer {
+ public:
+  AlignedBuffer() {}
+  ~AlignedBuffer();
+
+  // Make sure that buffer holds at least |size| bytes. Old content is not
+  // kept. Returns false if out of memory.
+  bool reserve(size_t size);
+
+  uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  AlignedBuffer(const AlignedBuffer&) = delete;
+  AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+  uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_MEMORY_BUDGET_H
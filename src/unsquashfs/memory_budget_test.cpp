@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/memory_budget.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const int64_t kMiB = 1024 * 1024;
+
+TEST(MemoryBudget, ParseMemAvailable) {
+  const char kMemInfo[] =
+      "MemTotal:        2017840 kB\n"
+      "MemFree:          101036 kB\n"
+      "MemAvailable:     524288 kB\n"
+      "Buffers:           20228 kB\n"
+      "Cached:          1213344 kB\n";
+  EXPECT_EQ(512 * kMiB, ParseMemAvailable(kMemInfo));
+
+  // Kernels older than 3.14 do not report MemAvailable.
+  const char kOldMemInfo[] =
+      "MemTotal:        2017840 kB\n"
+      "MemFree:           65536 kB\n"
+      "Buffers:           20228 kB\n"
+      "Cached:            65536 kB\n";
+  EXPECT_EQ(128 * kMiB, ParseMemAvailable(kOldMemInfo));
+
+  EXPECT_EQ(-1, ParseMemAvailable(""));
+}
+
+TEST(MemoryBudget, PickMemoryBudget) {
+  EXPECT_EQ(64 * kMiB, PickMemoryBudget(512 * kMiB));
+  EXPECT_EQ(kMinMemoryBudget, PickMemoryBudget(0));
+  EXPECT_EQ(kMaxMemoryBudget, PickMemoryBudget(64 * 1024 * kMiB));
+}
+
+TEST(MemoryBudget, ApplyMemoryBudget) {
+  ExtractOptions options;
+  options.jobs = 4;
+  ApplyMemoryBudget(64 * kMiB, options);
+  EXPECT_EQ(64 * kMiB, options.memory_budget);
+  EXPECT_TRUE(options.direct_io);
+  EXPECT_TRUE(options.drop_cache);
+  EXPECT_EQ(32 * kMiB, options.dirty_window);
+  // Default buffer fits in budget already.
+  EXPECT_EQ(kDefaultCopyBufferSize, options.buffer_size);
+  // 16 MiB of fragment cache.
+  EXPECT_EQ(128u, GetFragmentCacheSize(options, 128 * 1024));
+
+  // Smaller dirty window and buffer are kept, larger ones are reduced.
+  options = ExtractOptions();
+  options.jobs = 16;
+  options.dirty_window = 8 * kMiB;
+  options.buffer_size = 4 * kMiB;
+  ApplyMemoryBudget(16 * kMiB, options);
+  EXPECT_EQ(8 * kMiB, options.dirty_window);
+  EXPECT_EQ(256u * 1024, options.buffer_size);
+  EXPECT_EQ(4u, GetFragmentCacheSize(options, 1024 * 1024));
+
+  EXPECT_EQ(0u, GetFragmentCacheSize(ExtractOptions(), 128 * 1024));
+}
+
+}  // namespace
+}  // namespace installer
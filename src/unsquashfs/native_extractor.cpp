@@ -0,0 +1,2014 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/native_extractor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "unsquashfs/content_hash.h"
+#include "unsquashfs/content_verifier.h"
+#include "unsquashfs/dir_times.h"
+#include "unsquashfs/dir_writer.h"
+#include "unsquashfs/extract_journal.h"
+#include "unsquashfs/extract_manifest.h"
+#include "unsquashfs/extract_progress.h"
+#include "unsquashfs/extract_stats.h"
+#include "unsquashfs/file_copier.h"
+#include "unsquashfs/hard_link_map.h"
+#include "unsquashfs/incremental_install.h"
+#include "unsquashfs/memory_budget.h"
+#include "unsquashfs/package_filter.h"
+#include "unsquashfs/priority_list.h"
+#include "unsquashfs/squashfs_image.h"
+#include "unsquashfs/uring_writer.h"
+#include "unsquashfs/xattr_copier.h"
+#include "unsquashfs/work_stealing_pool.h"
+#include "unsquashfs/writeback_pacer.h"
+
+namespace installer {
+
+namespace {
+
+// Files with at least this many data blocks are split into several tasks.
+const size_t kMinParallelBlocks = 8;
+// Number of data blocks decompressed in each task.
+const size_t kBlocksPerTask = 8;
+
+// In ordered mode, items are extracted in chunks of at most this many items
+// or bytes of image.
+const size_t kChunkItems = 512;
+const uint64_t kChunkBytes = 4 * 1024 * 1024;
+// Ranges of image closer than this are read ahead together.
+const uint64_t kReadaheadGap = 256 * 1024;
+
+// Write all of |len| bytes in |buf| to |fd| at |offset|.
+bool WriteAt(int fd, const uint8_t* buf, size_t len, off_t offset) {
+  while (len > 0) {
+    const ssize_t num_written = pwrite(fd, buf, len, offset);
+    if (num_written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num_written <= 0) {
+      return false;
+    }
+    buf += num_written;
+    len -= static_cast<size_t>(num_written);
+    offset += num_written;
+  }
+  return true;
+}
+
+// Returns |len| rounded up to alignment of O_DIRECT writes.
+size_t AlignDirectIo(size_t len) {
+  return (len + kDirectIoAlignment - 1) / kDirectIoAlignment *
+         kDirectIoAlignment;
+}
+
+int64_t NowNsecs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Returns file mode creation mask of current process.
+mode_t GetUmask() {
+  const mode_t mask = umask(0);
+  umask(mask);
+  return mask;
+}
+
+// Squashfs keeps mtime only, which is used as atime too.
+void GetInodeTimes(const SquashfsInode& inode, struct timespec times[2]) {
+  times[0].tv_sec = static_cast<time_t>(inode.mtime);
+  times[0].tv_nsec = 0;
+  times[1] = times[0];
+}
+
+// Returns id of |sb| recorded in journal. Images built at the same time
+// with the same size are considered the same.
+uint64_t GetImageId(const SquashfsSuperBlock& sb) {
+  return (uint64_t(sb.mkfs_time) << 32) ^ (uint64_t(sb.inodes) << 8) ^
+         sb.bytes_used;
+}
+
+// Number of ImageExtractor objects created.
+std::atomic<uint64_t> g_serial(0);
+
+// Names in upper layers with this prefix are aufs whiteouts, which hide the
+// item without prefix in lower layers.
+const char kWhiteoutPrefix[] = ".wh.";
+// Marks its folder as opaque, hiding content of the folder in lower layers.
+const char kOpaqueMarker[] = ".wh..wh..opq";
+// Xattr prefix of overlayfs, and the xattr of an opaque folder.
+const char kOverlayXattrPrefix[] = "trusted.overlay.";
+const char kOverlayOpaqueXattr[] = "trusted.overlay.opaque";
+
+// Returns true if |inode| is an overlayfs whiteout, a character device with
+// device number 0/0.
+bool IsWhiteout(const SquashfsInode& inode) {
+  return inode.type == kSquashfsChrdevType && inode.rdev == 0;
+}
+
+// Returns true if folder |dir| in |image| is opaque.
+bool IsOpaqueDir(const SquashfsImage& image, const SquashfsInode& dir) {
+  std::vector<SquashfsXattr> xattrs;
+  if (dir.xattr == kSquashfsInvalidXattr ||
+      !image.readXattrs(dir.xattr, xattrs)) {
+    return false;
+  }
+  for (const SquashfsXattr& xattr : xattrs) {
+    if (xattr.first == kOverlayOpaqueXattr && xattr.second == "y") {
+      return true;
+    }
+  }
+  return false;
+}
+
+typedef std::shared_ptr<DirWriter> DirWriterPtr;
+
+// A folder whose subtree is being extracted, used only if journal is
+// enabled. Tasks and files in its subtree keep a reference to it, so that
+// it is recorded in journal after the last of them is finished.
+struct PendingDir {
+  ExtractJournal* journal = nullptr;
+  // Set if extraction failed, then subtree might be incomplete.
+  const std::atomic<bool>* failed = nullptr;
+  // Path relative to dest folder.
+  std::string path;
+  std::shared_ptr<PendingDir> parent;
+  // Number of items and size of regular files finished in subtree.
+  std::atomic<int64_t> files;
+  std::atomic<int64_t> bytes;
+  // Set if content of some file in subtree cannot be read from image. Then
+  // neither this folder nor its parents are recorded, so that the file is
+  // extracted again by resumed run.
+  std::atomic<bool> incomplete;
+
+  PendingDir() : files(0), bytes(0), incomplete(false) {}
+
+  ~PendingDir() {
+    if (*failed) {
+      return;
+    }
+    if (incomplete) {
+      if (parent) {
+        parent->incomplete = true;
+      }
+      return;
+    }
+    journal->addDir(path, files, bytes);
+    if (parent) {
+      parent->files += files;
+      parent->bytes += bytes;
+    }
+  }
+};
+
+typedef std::shared_ptr<PendingDir> PendingDirPtr;
+
+// A regular file being written by one or more tasks.
+struct PendingFile {
+  SquashfsInode inode;
+  // Parent folder, kept open until file is finished.
+  DirWriterPtr dir;
+  PendingDirPtr pending_dir;
+  std::string name;
+  int fd = -1;
+  // Offset of each data block in image.
+  std::vector<uint64_t> block_offsets;
+  // Digests of content chunks if content is verified, filled by tasks.
+  std::vector<uint64_t> chunk_hashes;
+  // Content is written with O_DIRECT, in blocks padded to alignment.
+  bool direct = false;
+  // Set if some content cannot be read from image.
+  std::atomic<bool> corrupted;
+  // Number of unfinished tasks.
+  std::atomic<int> remaining;
+
+  PendingFile() : corrupted(false), remaining(0) {}
+};
+
+typedef std::shared_ptr<PendingFile> PendingFilePtr;
+
+// Another name of a file being written by other worker, linked to it
+// after all tasks are finished.
+struct DeferredLink {
+  // Inode key in HardLinkMap, see linkKey().
+  uint64_t key = 0;
+  uint64_t file_size = 0;
+  std::string path;
+  // Folder is recorded in journal only after the link is created.
+  PendingDirPtr pending_dir;
+};
+
+// A folder in ordered mode, created before other items.
+struct OrderedDir {
+  std::string path;
+  // Released after all items in this folder are extracted.
+  PendingDirPtr pending_dir;
+  // See extractDir().
+  bool use_batch = false;
+  // Number of items in this folder not extracted yet, sub-folders excluded.
+  std::atomic<int64_t> remaining;
+
+  OrderedDir() : remaining(0) {}
+};
+
+// A non-folder item in ordered mode.
+struct OrderedItem {
+  // Range of image holding its content, 0 if none.
+  uint64_t start;
+  uint64_t end;
+  uint64_t inode_ref;
+  // Index of the layer holding this item.
+  uint32_t layer;
+  // Rank in priority list, 0 if not listed.
+  uint32_t priority;
+  // Index of parent folder.
+  uint32_t dir;
+  std::string name;
+};
+
+// Folder |inode| at the same path in one of the layers.
+struct LayerDir {
+  uint32_t layer;
+  SquashfsInode inode;
+};
+
+// An item of merged folder, taken from the topmost layer which has it.
+struct MergedEntry {
+  // Hidden by a whiteout of an upper layer, or a whiteout itself.
+  bool whiteout = false;
+  uint32_t layer = 0;
+  uint64_t inode_ref = 0;
+  SquashfsInode inode;
+  // Folder only, folders at this path in this and lower layers, top first.
+  std::vector<LayerDir> dirs;
+  // Set if a lower layer has a non-folder at this path, which hides
+  // folders of layers below it.
+  bool closed = false;
+};
+
+// Range [first, last) of ordered items extracted by one task.
+struct OrderedChunk {
+  size_t first;
+  size_t last;
+};
+
+class ImageExtractor {
+ public:
+  ImageExtractor(const std::vector<const SquashfsImage*>& layers,
+                 const ExtractOptions& options,
+                 ExtractProgress* progress,
+                 ExtractStats* stats)
+      : layers_(layers),
+        options_(options),
+        progress_(progress),
+        stats_(stats),
+        next_chunk_(0),
+        euid_(geteuid()),
+        egid_(getegid()),
+        umask_(GetUmask()),
+        uring_enabled_(options.use_io_uring),
+        failed_(false),
+        read_errors_(0),
+        pool_(options.jobs) {
+    // Small files written by io_uring are closed by the ring, and their
+    // writeback is left to kernel.
+    if (options.dirty_window > 0) {
+      pacer_.reset(new WritebackPacer(options.dirty_window, stats));
+    }
+    selectLayer(0);
+  }
+
+  bool run(const std::string& dest_dir) {
+    // Root folder takes attributes of the top layer.
+    selectLayer(static_cast<uint32_t>(layers_.size() - 1));
+    SquashfsInode root;
+    if (!image_->readRootInode(root)) {
+      return false;
+    }
+
+    DirWriterPtr dest(new DirWriter());
+    if (!dest->open(dest_dir)) {
+      fprintf(stderr, "ExtractImage() failed to open %s: %s\n",
+              dest_dir.c_str(), strerror(errno));
+      return false;
+    }
+    dest_root_ = dest_dir;
+    struct stat root_st;
+    if (fstat(dest->fd(), &root_st) == 0) {
+      dest_dev_ = root_st.st_dev;
+    }
+
+    if (!options_.manifest_file.empty()) {
+      verifier_.reset(new ContentVerifier());
+      if (!verifier_->open(options_.manifest_file, options_.failure_report)) {
+        return false;
+      }
+    }
+    if (!options_.extract_manifest.empty()) {
+      manifest_.reset(new ExtractManifestWriter());
+    }
+    hashing_ = verifier_ || manifest_;
+    // Files of all packages are extracted if package list is invalid, they
+    // are purged after installation then.
+    if (!options_.exclude_packages.empty()) {
+      filter_.reset(new PackageFilter());
+      if (!filter_->init(options_.exclude_packages,
+                         [this](const std::string& path,
+                                std::string& content) {
+                           return readSourceFile(path, content);
+                         })) {
+        filter_.reset();
+      }
+    }
+    // Priority list is a hint of layout, extraction goes on without it.
+    if (!options_.priority_list.empty() &&
+        !ReadPriorityList(options_.priority_list, priorities_)) {
+      priorities_.clear();
+    }
+
+    // Root folder of merged layers is never skipped as a whole, as it is
+    // recorded in journal with items of all layers.
+    PendingDirPtr pending_dir;
+    if (!options_.journal_file.empty()) {
+      if (openJournal() && layers_.size() == 1 &&
+          skipItem(root, *dest, "/", nullptr)) {
+        // Everything was extracted in previous run.
+        journal_->remove();
+        dir_times_.restore();
+        return writeManifest() && writeExcludedPackages();
+      }
+      if (journal_) {
+        pending_dir = newPendingDir("/", nullptr);
+      }
+    }
+
+    // Copy attributes of root folder, which is "." of itself.
+    if (!extractItem(root, dest, ".", nullptr)) {
+      return false;
+    }
+
+    // Layers are merged and priority list is applied in ordered mode only,
+    // as all folders shall be walked before any file is written.
+    if (options_.ordered || layers_.size() > 1 || !priorities_.empty()) {
+      collectItems(dest_dir, pending_dir);
+      // Root folder is recorded when all of its tasks are finished.
+      pending_dir.reset();
+      extractItems();
+    } else {
+      pool_.submit(std::bind(&ImageExtractor::extractDir, this,
+                             root, dest_dir, pending_dir));
+      pending_dir.reset();
+      pool_.waitForDone();
+      linkDeferred();
+    }
+    if (pacer_) {
+      pacer_->finish();
+    }
+    if (stats_) {
+      for (const SquashfsImage* image : layers_) {
+        const SquashfsFragmentStats fragment_stats = image->fragmentStats();
+        stats_->fragment_lookups += fragment_stats.lookups;
+        stats_->fragment_reads += fragment_stats.reads;
+        stats_->fragment_rereads += fragment_stats.rereads;
+      }
+    }
+
+    if (verifier_ && !failed_) {
+      const int64_t failures = verifier_->finish();
+      if (stats_) {
+        stats_->verify_failures += failures;
+      }
+      if (failures > 0) {
+        fprintf(stderr, "ExtractImage() %lld files failed verification\n",
+                static_cast<long long>(failures));
+        return false;
+      }
+    }
+    if (read_errors_ > 0 && !failed_) {
+      fprintf(stderr, "ExtractImage() failed to read content of %lld files\n",
+              static_cast<long long>(read_errors_));
+      return false;
+    }
+
+    if (journal_ && !failed_) {
+      journal_->remove();
+    }
+    // Journal in dest folder is removed already.
+    if (!failed_) {
+      dir_times_.restore();
+    }
+    return !failed_ && writeManifest() && writeExcludedPackages();
+  }
+
+ private:
+  // Write manifest of extracted items if it is enabled.
+  bool writeManifest() {
+    return !manifest_ || manifest_->write(options_.extract_manifest);
+  }
+
+  // Write packages excluded by |filter_|, so that they are purged from
+  // dpkg database after installation.
+  bool writeExcludedPackages() {
+    return !filter_ || options_.excluded_packages_file.empty() ||
+           filter_->writePackages(options_.excluded_packages_file);
+  }
+
+  // Read regular file at |path| of merged layers, from the topmost layer
+  // which has it. Whiteouts are not checked, as dpkg database is never
+  // removed by upper layers.
+  bool readSourceFile(const std::string& path, std::string& content) const {
+    SquashfsInode inode;
+    for (size_t layer = layers_.size(); layer-- > 0; ) {
+      if (layers_[layer]->lookup(path, inode)) {
+        return layers_[layer]->readFile(inode, content);
+      }
+    }
+    return false;
+  }
+
+  // Returns true if item |inode| at |path| relative to dest folder is a file
+  // of a package excluded by |filter_|. Then it is not extracted.
+  bool excludeItem(const SquashfsInode& inode, const std::string& path) {
+    if (!filter_ || inode.type == kSquashfsDirType ||
+        !filter_->excludes(path)) {
+      return false;
+    }
+    const int64_t bytes = (inode.type == kSquashfsRegType) ?
+                          static_cast<int64_t>(inode.file_size) : 0;
+    if (verifier_) {
+      verifier_->skip(path);
+    }
+    if (progress_) {
+      progress_->skip(1, bytes);
+    }
+    if (stats_) {
+      stats_->excluded_files++;
+      stats_->excluded_bytes += bytes;
+    }
+    return true;
+  }
+
+  // Extract content of layer |layer| from now on. Called only when no task
+  // is running.
+  void selectLayer(uint32_t layer) {
+    layer_ = layer;
+    image_ = layers_[layer];
+    block_size_ = image_->superBlock().block_size;
+    serial_ = ++g_serial;
+  }
+
+  // Returns key of |inode| of current layer in |hard_links_|. Inode numbers
+  // of different layers are unrelated.
+  uint64_t linkKey(const SquashfsInode& inode) const {
+    return (uint64_t(layer_) << 32) | inode.inode_number;
+  }
+
+  // Open journal of finished items. Journal is optional, extraction goes on
+  // without it if it fails.
+  bool openJournal() {
+    // Id of a single image is kept, so that journal of previous versions
+    // can be resumed.
+    uint64_t image_id = 0;
+    for (const SquashfsImage* image : layers_) {
+      image_id = image_id * 31 + GetImageId(image->superBlock());
+    }
+    journal_.reset(new ExtractJournal());
+    if (!journal_->open(options_.journal_file, image_id, options_.resume)) {
+      journal_.reset();
+      return false;
+    }
+    // Later names of files finished in previous run are linked to them.
+    for (const auto& link : journal_->links()) {
+      hard_links_.insert(0, link.first, dest_root_ + link.second);
+    }
+    return true;
+  }
+
+  PendingDirPtr newPendingDir(const std::string& path,
+                              const PendingDirPtr& parent) {
+    PendingDirPtr pending_dir(new PendingDir());
+    pending_dir->journal = journal_.get();
+    pending_dir->failed = &failed_;
+    pending_dir->path = path;
+    pending_dir->parent = parent;
+    return pending_dir;
+  }
+
+  // Returns path of item |name| in |dest_dir| relative to dest folder, as
+  // recorded in journal.
+  std::string journalPath(const std::string& dest_dir,
+                          const std::string& name) const {
+    return dest_dir.substr(dest_root_.size()) + "/" + name;
+  }
+
+  // Add |files| finished items with |bytes| of content to |pending_dir|.
+  static void countItems(const PendingDirPtr& pending_dir, int64_t files,
+                         int64_t bytes) {
+    if (pending_dir) {
+      pending_dir->files += files;
+      pending_dir->bytes += bytes;
+    }
+  }
+
+  // Record regular file |name| in |dest| as finished in journal.
+  void recordFile(const SquashfsInode& inode, const DirWriter& dest,
+                  const std::string& name) {
+    struct stat st;
+    if (journal_ && dest.statItem(name.c_str(), st)) {
+      journal_->addFile(journalPath(dest.path(), name), st,
+                        inode.nlink > 1 ? linkKey(inode) : 0);
+    }
+  }
+
+  // Returns true if |inode| at |path| was extracted to item |name| in |dest|
+  // by previous run, then the item, or the whole subtree of a folder, is
+  // skipped. Only folders and regular files are recorded in journal, others
+  // are cheap to create again.
+  bool skipItem(const SquashfsInode& inode, const DirWriter& dest,
+                const std::string& path, const PendingDirPtr& pending_dir) {
+    if (!journal_ || !options_.resume) {
+      return false;
+    }
+
+    int64_t files = 0;
+    int64_t bytes = 0;
+    if (inode.type == kSquashfsDirType) {
+      if (!journal_->isDirDone(path, files, bytes)) {
+        return false;
+      }
+      // The folder itself.
+      files++;
+      if (stats_) {
+        stats_->resumed_dirs++;
+      }
+      // Previous run stopped before times of folders were restored.
+      addSkippedDir(inode, path);
+    } else if (inode.type == kSquashfsRegType) {
+      const size_t pos = path.rfind('/');
+      struct stat st;
+      if (!dest.statItem(path.c_str() + pos + 1, st) ||
+          uint64_t(st.st_size) != inode.file_size ||
+          !journal_->isFileDone(path, st)) {
+        return false;
+      }
+      files = 1;
+      bytes = static_cast<int64_t>(inode.file_size);
+      // Content is not read again to hash it.
+      addManifestItem(inode, path, nullptr);
+    } else {
+      return false;
+    }
+
+    countItems(pending_dir, files, bytes);
+    if (progress_) {
+      progress_->skip(files, bytes);
+    }
+    // Content was verified by previous run.
+    if (verifier_) {
+      if (inode.type == kSquashfsDirType) {
+        verifier_->skipDir(path);
+      } else {
+        verifier_->skip(path);
+      }
+    }
+    if (stats_) {
+      stats_->resumed_files += files;
+      stats_->resumed_bytes += bytes;
+    }
+    return true;
+  }
+
+  // Remember times of folder |dir| at |path| relative to dest folder and
+  // all folders below it, whose items are skipped. Skipped items are added
+  // to manifest too.
+  void addSkippedDir(const SquashfsInode& dir, const std::string& path) {
+    std::vector<std::pair<SquashfsInode, std::string>> stack;
+    stack.push_back(std::make_pair(dir, path));
+    std::vector<SquashfsDirEntry> entries;
+    SquashfsInode inode;
+    while (!stack.empty()) {
+      const std::pair<SquashfsInode, std::string> item = stack.back();
+      stack.pop_back();
+      struct timespec times[2];
+      GetInodeTimes(item.first, times);
+      dir_times_.add(dest_root_ + item.second, times[0], times[1]);
+      addManifestItem(item.first, item.second, nullptr);
+      if (!image_->readDir(item.first, entries)) {
+        continue;
+      }
+      const std::string prefix = (item.second == "/") ? "" : item.second;
+      for (const SquashfsDirEntry& entry : entries) {
+        if (entry.type != kSquashfsDirType && !manifest_) {
+          continue;
+        }
+        if (!image_->readInode(entry.inode_ref, inode)) {
+          continue;
+        }
+        if (entry.type == kSquashfsDirType) {
+          stack.push_back(std::make_pair(inode, prefix + "/" + entry.name));
+        } else {
+          addManifestItem(inode, prefix + "/" + entry.name, nullptr);
+        }
+      }
+    }
+  }
+
+  // Returns true if item |name| at |path| in |dest|, left by previous
+  // installation in incremental mode, has content of |inode| already. Then
+  // only its metadata is updated.
+  bool keepItem(const SquashfsInode& inode, DirWriter& dest,
+                const std::string& name, const std::string& path,
+                const PendingDirPtr& pending_dir) {
+    if (!options_.incremental ||
+        (inode.type != kSquashfsRegType &&
+         inode.type != kSquashfsSymlinkType)) {
+      return false;
+    }
+    const bool is_file = (inode.type == kSquashfsRegType);
+    struct timespec mtime;
+    mtime.tv_sec = static_cast<time_t>(inode.mtime);
+    mtime.tv_nsec = 0;
+    if (!IsUnchangedItem(dest, name.c_str(), inode.mode,
+                         is_file ? inode.file_size : inode.symlink.size(),
+                         mtime, inode.nlink, inode.symlink)) {
+      return false;
+    }
+
+    uint64_t hash = 0;
+    bool hashed = false;
+    if (is_file && hashing_) {
+      // Reading is much cheaper than writing, so content is compared
+      // with manifest if it is available.
+      uint64_t size = 0;
+      const int fd = openat(dest.fd(), name.c_str(),
+                            O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+      if (fd == -1) {
+        return false;
+      }
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      hashed = HashFile(fd, size, hash);
+      close(fd);
+      if (!hashed || (verifier_ && !verifier_->matches(
+              path, static_cast<int64_t>(size), hash))) {
+        return false;
+      }
+      verifyFile(path, size, hash);
+    }
+    const int64_t bytes =
+        is_file ? static_cast<int64_t>(inode.file_size) : 0;
+
+    updateMetadata(inode, dest, name.c_str());
+    addManifestItem(inode, path, hashed ? &hash : nullptr);
+    countItems(pending_dir, 1, bytes);
+    if (pending_dir && is_file) {
+      recordFile(inode, dest, name);
+    }
+    if (progress_) {
+      progress_->skip(1, bytes);
+    }
+    if (stats_) {
+      stats_->unchanged_files++;
+      stats_->unchanged_bytes += bytes;
+    }
+    return true;
+  }
+
+  // Extract children of |dir| into |dest_dir|. Items are created relative to
+  // descriptor of |dest_dir|. Sub-folders are scheduled as new tasks after
+  // they are created.
+  // |pending_dir| is journal record of |dir|, or nullptr.
+  void extractDir(const SquashfsInode& dir, const std::string& dest_dir,
+                  const PendingDirPtr& pending_dir) {
+    if (failed_) {
+      return;
+    }
+
+    DirWriterPtr dest(new DirWriter());
+    if (!dest->open(dest_dir)) {
+      fprintf(stderr, "ExtractImage() failed to open %s: %s\n",
+              dest_dir.c_str(), strerror(errno));
+      failed_ = true;
+      return;
+    }
+
+    std::vector<SquashfsDirEntry> entries;
+    if (!image_->readDir(dir, entries)) {
+      failed_ = true;
+      return;
+    }
+    if (options_.incremental) {
+      std::unordered_map<std::string, bool> items;
+      for (const SquashfsDirEntry& entry : entries) {
+        const bool is_dir = (entry.type == kSquashfsDirType);
+        // Files of excluded packages left by previous installation are
+        // removed too.
+        if (is_dir || !filter_ ||
+            !filter_->excludes(journalPath(dest_dir, entry.name))) {
+          items[entry.name] = is_dir;
+        }
+      }
+      PruneDir(*dest, items, dest->path() == dest_root_, dest_dev_,
+               stats_);
+    }
+
+    // New files in setgid folder inherit its group, which is then fixed by
+    // lchown() in updateMetadata().
+    const bool use_batch = !(dir.mode & S_ISGID);
+    std::vector<UringFile> batch;
+    std::vector<SquashfsInode> batch_inodes;
+
+    SquashfsInode inode;
+    for (const SquashfsDirEntry& entry : entries) {
+      if (failed_) {
+        break;
+      }
+      if (!image_->readInode(entry.inode_ref, inode)) {
+        fprintf(stderr, "Failed to copy item: %s\n",
+                dest->fullPath(entry.name.c_str()));
+        failed_ = true;
+        break;
+      }
+
+      if (excludeItem(inode, journalPath(dest_dir, entry.name))) {
+        continue;
+      }
+      if (pending_dir &&
+          skipItem(inode, *dest, journalPath(dest_dir, entry.name),
+                   pending_dir)) {
+        continue;
+      }
+      if (keepItem(inode, *dest, entry.name,
+                   journalPath(dest_dir, entry.name), pending_dir)) {
+        continue;
+      }
+
+      if (use_batch && addToBatch(inode, *dest, entry.name, batch,
+                                  batch_inodes)) {
+        if (batch.size() == UringWriter::kMaxFiles) {
+          flushBatch(dest, pending_dir, batch, batch_inodes);
+        }
+        continue;
+      }
+
+      if (!extractItem(inode, dest, entry.name, pending_dir)) {
+        fprintf(stderr, "Failed to copy item: %s\n",
+                dest->fullPath(entry.name.c_str()));
+        failed_ = true;
+        break;
+      }
+
+      if (inode.type == kSquashfsDirType) {
+        PendingDirPtr child;
+        if (pending_dir) {
+          child = newPendingDir(journalPath(dest_dir, entry.name),
+                                pending_dir);
+        }
+        pool_.submit(std::bind(&ImageExtractor::extractDir, this,
+                               inode, dest_dir + "/" + entry.name, child));
+      }
+    }
+
+    flushBatch(dest, pending_dir, batch, batch_inodes);
+  }
+
+  // Walk all folders in current worker for ordered mode. Folders are
+  // created at once, and other items are collected to be extracted in
+  // order of their content in image. Metadata tables are in memory, so
+  // walking is cheap.
+  // Folders of all layers are merged while they are walked, so that each
+  // item is extracted only once, from the topmost layer which has it.
+  void collectItems(const std::string& dest_dir,
+                    const PendingDirPtr& pending_dir) {
+    std::vector<LayerDir> roots;
+    for (uint32_t layer = static_cast<uint32_t>(layers_.size());
+         layer-- > 0; ) {
+      LayerDir root;
+      root.layer = layer;
+      if (!layers_[layer]->readRootInode(root.inode)) {
+        failed_ = true;
+        return;
+      }
+      roots.push_back(std::move(root));
+    }
+    // Root folder is extracted by run() already.
+    int64_t total_files = 1;
+    int64_t total_bytes = 0;
+
+    std::vector<std::pair<std::vector<LayerDir>, uint32_t>> stack;
+    const uint32_t root_index = addOrderedDir(roots.front().inode, dest_dir,
+                                              pending_dir);
+    stack.push_back(std::make_pair(std::move(roots), root_index));
+
+    std::map<std::string, MergedEntry> merged;
+    while (!stack.empty() && !failed_) {
+      const std::vector<LayerDir> dirs = std::move(stack.back().first);
+      const uint32_t index = stack.back().second;
+      stack.pop_back();
+      // Elements of deque are not moved by push_back().
+      OrderedDir& parent = ordered_dirs_[index];
+
+      DirWriterPtr dest(new DirWriter());
+      if (!dest->open(parent.path)) {
+        fprintf(stderr, "ExtractImage() failed to open %s: %s\n",
+                parent.path.c_str(), strerror(errno));
+        failed_ = true;
+        break;
+      }
+      if (!mergeDirs(dirs, merged)) {
+        fprintf(stderr, "ExtractImage() failed to read folder: %s\n",
+                parent.path.c_str());
+        failed_ = true;
+        break;
+      }
+      if (options_.incremental) {
+        std::unordered_map<std::string, bool> items;
+        for (const auto& it : merged) {
+          const bool is_dir = (it.second.inode.type == kSquashfsDirType);
+          if (!it.second.whiteout &&
+              (is_dir || !filter_ ||
+               !filter_->excludes(journalPath(parent.path, it.first)))) {
+            items[it.first] = is_dir;
+          }
+        }
+        PruneDir(*dest, items, dest->path() == dest_root_, dest_dev_,
+                 stats_);
+      }
+
+      for (auto& it : merged) {
+        const std::string& name = it.first;
+        MergedEntry& entry = it.second;
+        if (entry.whiteout) {
+          continue;
+        }
+        const SquashfsInode& inode = entry.inode;
+        total_files++;
+        if (inode.type == kSquashfsRegType) {
+          total_bytes += static_cast<int64_t>(inode.file_size);
+        }
+        if (entry.layer != layer_) {
+          selectLayer(entry.layer);
+        }
+        if (excludeItem(inode, journalPath(parent.path, name))) {
+          continue;
+        }
+        // Merged folders may get new items from any layer, only their files
+        // are skipped.
+        if (parent.pending_dir &&
+            (layers_.size() == 1 || inode.type != kSquashfsDirType) &&
+            skipItem(inode, *dest, journalPath(parent.path, name),
+                     parent.pending_dir)) {
+          continue;
+        }
+        if (keepItem(inode, *dest, name, journalPath(parent.path, name),
+                     parent.pending_dir)) {
+          continue;
+        }
+
+        if (inode.type == kSquashfsDirType) {
+          if (!extractItem(inode, dest, name, parent.pending_dir)) {
+            fprintf(stderr, "Failed to copy item: %s\n",
+                    dest->fullPath(name.c_str()));
+            failed_ = true;
+            break;
+          }
+          PendingDirPtr child;
+          if (parent.pending_dir) {
+            child = newPendingDir(journalPath(parent.path, name),
+                                  parent.pending_dir);
+          }
+          const uint32_t child_index =
+              addOrderedDir(inode, parent.path + "/" + name, child);
+          stack.push_back(std::make_pair(std::move(entry.dirs),
+                                         child_index));
+          continue;
+        }
+
+        OrderedItem item;
+        layers_[entry.layer]->dataRange(inode, item.start, item.end);
+        item.inode_ref = entry.inode_ref;
+        item.layer = entry.layer;
+        item.priority = 0;
+        if (!priorities_.empty() && inode.type == kSquashfsRegType) {
+          const auto found = priorities_.find(journalPath(parent.path, name));
+          if (found != priorities_.end()) {
+            item.priority = found->second;
+            if (stats_) {
+              stats_->priority_files++;
+              stats_->priority_bytes +=
+                  static_cast<int64_t>(inode.file_size);
+            }
+          }
+        }
+        item.dir = index;
+        item.name = name;
+        ordered_items_.push_back(std::move(item));
+        parent.remaining++;
+      }
+    }
+
+    // Folders without other items are finished after their sub-folders.
+    for (OrderedDir& dir : ordered_dirs_) {
+      if (dir.remaining == 0) {
+        dir.pending_dir.reset();
+      }
+    }
+    // Total given by caller counts items of each layer, including hidden
+    // ones.
+    if (progress_ && layers_.size() > 1 && !failed_) {
+      progress_->setTotal(total_files, total_bytes);
+    }
+  }
+
+  // Merge items of folders |dirs| at the same path of several layers, top
+  // first, into |merged| by name. Whiteouts of upper layers hide items of
+  // lower layers, and an opaque folder hides all items of lower layers.
+  // Whiteouts are kept in |merged| and marked.
+  bool mergeDirs(const std::vector<LayerDir>& dirs,
+                 std::map<std::string, MergedEntry>& merged) {
+    merged.clear();
+    std::vector<SquashfsDirEntry> entries;
+    for (const LayerDir& dir : dirs) {
+      const SquashfsImage& image = *layers_[dir.layer];
+      if (!image.readDir(dir.inode, entries)) {
+        return false;
+      }
+      // Whiteouts in bottom layer have nothing to hide, they are extracted
+      // as they are.
+      const bool upper = dir.layer > 0;
+      bool opaque = upper && IsOpaqueDir(image, dir.inode);
+      for (const SquashfsDirEntry& dir_entry : entries) {
+        std::string name = dir_entry.name;
+        bool whiteout = false;
+        if (upper && name.compare(0, sizeof(kWhiteoutPrefix) - 1,
+                                  kWhiteoutPrefix) == 0) {
+          if (name == kOpaqueMarker) {
+            opaque = true;
+            continue;
+          }
+          name.erase(0, sizeof(kWhiteoutPrefix) - 1);
+          whiteout = true;
+        }
+
+        auto found = merged.find(name);
+        if (found != merged.end()) {
+          // Taken from an upper layer already. A folder of upper layer is
+          // merged with folder of this layer, until a non-folder is met.
+          MergedEntry& entry = found->second;
+          if (entry.whiteout || entry.closed ||
+              entry.inode.type != kSquashfsDirType) {
+            continue;
+          }
+          if (whiteout || dir_entry.type != kSquashfsDirType) {
+            entry.closed = true;
+            continue;
+          }
+          LayerDir lower;
+          lower.layer = dir.layer;
+          if (!image.readInode(dir_entry.inode_ref, lower.inode)) {
+            return false;
+          }
+          if (upper && IsWhiteout(lower.inode)) {
+            entry.closed = true;
+            continue;
+          }
+          entry.dirs.push_back(std::move(lower));
+          continue;
+        }
+
+        MergedEntry& entry = merged[name];
+        entry.layer = dir.layer;
+        entry.inode_ref = dir_entry.inode_ref;
+        if (whiteout) {
+          entry.whiteout = true;
+          continue;
+        }
+        if (!image.readInode(dir_entry.inode_ref, entry.inode)) {
+          return false;
+        }
+        if (upper && IsWhiteout(entry.inode)) {
+          entry.whiteout = true;
+          continue;
+        }
+        if (entry.inode.type == kSquashfsDirType) {
+          LayerDir self;
+          self.layer = dir.layer;
+          self.inode = entry.inode;
+          entry.dirs.push_back(std::move(self));
+        }
+      }
+      if (opaque) {
+        break;
+      }
+    }
+    return true;
+  }
+
+  uint32_t addOrderedDir(const SquashfsInode& dir, const std::string& path,
+                         const PendingDirPtr& pending_dir) {
+    ordered_dirs_.emplace_back();
+    OrderedDir& ordered_dir = ordered_dirs_.back();
+    ordered_dir.path = path;
+    ordered_dir.pending_dir = pending_dir;
+    ordered_dir.use_batch = !(dir.mode & S_ISGID);
+    return static_cast<uint32_t>(ordered_dirs_.size() - 1);
+  }
+
+  // Sort collected items by layer and position of their content in image,
+  // then extract layers one by one, each from start to end of its image.
+  // Files of priority list come before all others, in order of the list.
+  void extractItems() {
+    std::stable_sort(ordered_items_.begin(), ordered_items_.end(),
+                     [](const OrderedItem& a, const OrderedItem& b) {
+                       if (a.priority != b.priority) {
+                         return a.priority != 0 &&
+                                (b.priority == 0 || a.priority < b.priority);
+                       }
+                       return a.layer < b.layer ||
+                              (a.layer == b.layer && a.start < b.start);
+                     });
+    size_t first = 0;
+    // Listed files are extracted by a single task, so that filesystem
+    // allocates their blocks one after another. Large files are still
+    // written by several workers.
+    while (first < ordered_items_.size() &&
+           ordered_items_[first].priority != 0 && !failed_) {
+      size_t last = first;
+      while (last < ordered_items_.size() &&
+             ordered_items_[last].priority != 0 &&
+             ordered_items_[last].layer == ordered_items_[first].layer) {
+        ++last;
+      }
+      selectLayer(ordered_items_[first].layer);
+      chunks_.clear();
+      next_chunk_ = 0;
+      chunks_.push_back(OrderedChunk{first, last});
+      readaheadChunk(0);
+      pool_.submit(std::bind(&ImageExtractor::extractChunks, this));
+      pool_.waitForDone();
+      linkDeferred();
+      first = last;
+    }
+    while (first < ordered_items_.size() && !failed_) {
+      size_t last = first;
+      while (last < ordered_items_.size() &&
+             ordered_items_[last].layer == ordered_items_[first].layer) {
+        ++last;
+      }
+      selectLayer(ordered_items_[first].layer);
+      chunks_.clear();
+      next_chunk_ = 0;
+      splitChunks(first, last);
+      // Read first chunk of each worker, later ones are read ahead by
+      // workers.
+      for (int i = 0; i < pool_.numWorkers(); ++i) {
+        readaheadChunk(static_cast<size_t>(i));
+        pool_.submit(std::bind(&ImageExtractor::extractChunks, this));
+      }
+      pool_.waitForDone();
+      // Hard links are resolved in each layer.
+      linkDeferred();
+      first = last;
+    }
+  }
+
+  // Split sorted items [begin, end) into chunks. Items without content come
+  // first.
+  void splitChunks(size_t begin, size_t end) {
+    size_t first = begin;
+    uint64_t bytes = 0;
+    for (size_t i = begin; i < end; ++i) {
+      bytes += ordered_items_[i].end - ordered_items_[i].start;
+      // Files sharing a fragment block are kept in one chunk, or else
+      // several workers would decompress it.
+      const bool same_block =
+          (i + 1 < end && ordered_items_[i].start != 0 &&
+           ordered_items_[i + 1].start == ordered_items_[i].start);
+      if (!same_block &&
+          (i + 1 - first >= kChunkItems || bytes >= kChunkBytes)) {
+        chunks_.push_back(OrderedChunk{first, i + 1});
+        first = i + 1;
+        bytes = 0;
+      }
+    }
+    if (first < end) {
+      chunks_.push_back(OrderedChunk{first, end});
+    }
+  }
+
+  // Read content of chunk |index| in background. Ranges of its items are
+  // merged if they are close to each other.
+  void readaheadChunk(size_t index) {
+    if (index >= chunks_.size()) {
+      return;
+    }
+    const OrderedChunk& chunk = chunks_[index];
+    uint64_t start = 0;
+    uint64_t end = 0;
+    for (size_t i = chunk.first; i < chunk.last; ++i) {
+      const OrderedItem& item = ordered_items_[i];
+      if (item.start == item.end) {
+        continue;
+      }
+      if (end != 0 && item.start <= end + kReadaheadGap) {
+        end = std::max(end, item.end);
+        continue;
+      }
+      if (end != 0) {
+        image_->readahead(start, end - start);
+      }
+      start = item.start;
+      end = item.end;
+    }
+    if (end != 0) {
+      image_->readahead(start, end - start);
+    }
+  }
+
+  // Task of ordered mode. Each worker takes the next chunk, so that image
+  // is read from start to end.
+  void extractChunks() {
+    while (!failed_) {
+      const size_t index = next_chunk_++;
+      if (index >= chunks_.size()) {
+        break;
+      }
+      // Chunk to be taken after other workers finish their current chunks.
+      readaheadChunk(index + static_cast<size_t>(pool_.numWorkers()));
+      extractChunk(chunks_[index]);
+    }
+  }
+
+  void extractChunk(const OrderedChunk& chunk) {
+    DirWriterPtr dest;
+    PendingDirPtr pending_dir;
+    uint32_t dir_index = 0;
+    bool use_batch = false;
+    std::vector<UringFile> batch;
+    std::vector<SquashfsInode> batch_inodes;
+
+    SquashfsInode inode;
+    for (size_t i = chunk.first; i < chunk.last && !failed_; ++i) {
+      const OrderedItem& item = ordered_items_[i];
+      if (!dest || item.dir != dir_index) {
+        flushBatch(dest, pending_dir, batch, batch_inodes);
+        OrderedDir& dir = ordered_dirs_[item.dir];
+        dest.reset(new DirWriter());
+        if (!dest->open(dir.path)) {
+          fprintf(stderr, "ExtractImage() failed to open %s: %s\n",
+                  dir.path.c_str(), strerror(errno));
+          failed_ = true;
+          break;
+        }
+        dir_index = item.dir;
+        pending_dir = dir.pending_dir;
+        use_batch = dir.use_batch;
+      }
+
+      if (!image_->readInode(item.inode_ref, inode)) {
+        fprintf(stderr, "Failed to copy item: %s\n",
+                dest->fullPath(item.name.c_str()));
+        failed_ = true;
+        break;
+      }
+      if (use_batch && addToBatch(inode, *dest, item.name, batch,
+                                  batch_inodes)) {
+        if (batch.size() == UringWriter::kMaxFiles) {
+          flushBatch(dest, pending_dir, batch, batch_inodes);
+        }
+      } else if (!extractItem(inode, dest, item.name, pending_dir)) {
+        fprintf(stderr, "Failed to copy item: %s\n",
+                dest->fullPath(item.name.c_str()));
+        failed_ = true;
+        break;
+      }
+
+      // Journal record of the folder is kept by |pending_dir| and pending
+      // files until they are finished.
+      OrderedDir& dir = ordered_dirs_[dir_index];
+      if (--dir.remaining == 0) {
+        dir.pending_dir.reset();
+      }
+    }
+
+    flushBatch(dest, pending_dir, batch, batch_inodes);
+  }
+
+  // Queue small file |inode| to be created with io_uring. Only files which
+  // get right ownership and permissions from open() are queued, so that
+  // lchown() and chmod() are not needed.
+  // Returns false if |inode| shall be extracted with extractItem().
+  bool addToBatch(const SquashfsInode& inode, const DirWriter& dest,
+                  const std::string& name, std::vector<UringFile>& batch,
+                  std::vector<SquashfsInode>& batch_inodes) {
+    if (!uring_enabled_ ||
+        inode.type != kSquashfsRegType ||
+        inode.nlink > 1 ||
+        !inode.block_sizes.empty() ||
+        (inode.mode & 07000) != 0 ||
+        (inode.mode & umask_) != 0 ||
+        inode.uid != euid_ ||
+        inode.gid != egid_) {
+      return false;
+    }
+
+    UringFile file;
+    file.xattrs = readXattrs(inode);
+    if (!file.xattrs || file.xattrs->size() > UringWriter::kMaxXattrs) {
+      return false;
+    }
+    if (inode.file_size > 0) {
+      if (inode.fragment == kSquashfsInvalidFragment) {
+        return false;
+      }
+      file.buffer = readFragment(inode.fragment);
+      if (!file.buffer ||
+          inode.fragment_offset + inode.file_size > file.buffer->size()) {
+        return false;
+      }
+      file.data = file.buffer->data() + inode.fragment_offset;
+      file.size = static_cast<size_t>(inode.file_size);
+    }
+    file.dir_fd = dest.fd();
+    file.path = name;
+    file.mode = inode.mode & 0777;
+    batch.push_back(std::move(file));
+    batch_inodes.push_back(inode);
+    return true;
+  }
+
+  // Create queued files. Files failed in io_uring are extracted again
+  // with extractItem().
+  void flushBatch(const DirWriterPtr& dest, const PendingDirPtr& pending_dir,
+                  std::vector<UringFile>& batch,
+                  std::vector<SquashfsInode>& batch_inodes) {
+    if (batch.empty()) {
+      return;
+    }
+
+    UringWriter* writer = uringWriter();
+    int num_ops = 0;
+    int num_enters = 0;
+    const bool ok = writer && writer->write(batch, num_ops, num_enters);
+    if (stats_) {
+      stats_->uring_ops += num_ops;
+      stats_->uring_enters += num_enters;
+    }
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      if (ok && batch[i].ok) {
+        if (stats_) {
+          stats_->uring_files++;
+        }
+        struct timespec times[2];
+        GetInodeTimes(batch_inodes[i], times);
+        if (!dest->setTimes(batch[i].path.c_str(), times)) {
+          fprintf(stderr, "ExtractImage() utimensat() failed: %s, %s\n",
+                  dest->fullPath(batch[i].path.c_str()), strerror(errno));
+        }
+        if (progress_) {
+          progress_->increase(static_cast<int64_t>(batch[i].size));
+        }
+        if (hashing_) {
+          const std::string path = journalPath(dest->path(), batch[i].path);
+          ContentHasher hasher;
+          hasher.update(batch[i].data, batch[i].size);
+          const uint64_t hash = hasher.finish();
+          verifyFile(path, hasher.size(), hash);
+          addManifestItem(batch_inodes[i], path, &hash);
+        }
+        if (pending_dir) {
+          countItems(pending_dir, 1, static_cast<int64_t>(batch[i].size));
+          recordFile(batch_inodes[i], *dest, batch[i].path);
+        }
+      } else if (!failed_ &&
+                 !extractItem(batch_inodes[i], dest, batch[i].path,
+                              pending_dir)) {
+        fprintf(stderr, "Failed to copy item: %s\n",
+                dest->fullPath(batch[i].path.c_str()));
+        failed_ = true;
+      }
+    }
+    batch.clear();
+    batch_inodes.clear();
+  }
+
+  // Returns fragment block |index|. The last one of each worker is kept, as
+  // files sharing it are extracted one after another, while the shared
+  // cache of image might have evicted it when many workers are busy.
+  std::shared_ptr<const std::vector<uint8_t>> readFragment(uint32_t index) {
+    thread_local uint64_t owner = 0;
+    thread_local uint32_t last_index = 0;
+    thread_local std::shared_ptr<const std::vector<uint8_t>> last;
+    if (owner != serial_ || last_index != index || !last) {
+      last = image_->readFragment(index);
+      owner = serial_;
+      last_index = index;
+    }
+    return last;
+  }
+
+  // Returns io_uring writer of current worker, or nullptr if io_uring is not
+  // available.
+  UringWriter* uringWriter() {
+    thread_local std::unique_ptr<UringWriter> writer;
+    thread_local bool initialized = false;
+    if (!initialized) {
+      initialized = true;
+      writer.reset(new UringWriter());
+      if (!writer->init()) {
+        writer.reset();
+        if (uring_enabled_.exchange(false)) {
+          fprintf(stderr, "ExtractImage() io_uring is not available, "
+                  "fall back to system calls\n");
+        }
+      }
+    }
+    return writer.get();
+  }
+
+  // Create item |name| in |dest| from |inode|. Metadata of regular files is
+  // updated after its content is written, which may happen in other workers.
+  bool extractItem(const SquashfsInode& inode, const DirWriterPtr& dest,
+                   const std::string& name,
+                   const PendingDirPtr& pending_dir) {
+    const char* item = name.c_str();
+    const mode_t mode = inode.mode & 07777;
+
+    // Remove dest item if it exists and is not a folder.
+    dest->removeItem(item);
+
+    bool ok = true;
+    switch (inode.type) {
+      case kSquashfsRegType: {
+        if (inode.nlink > 1) {
+          if (linkFile(inode, *dest, item)) {
+            countItems(pending_dir, 1, 0);
+            return true;
+          }
+          if (!hard_links_.claim(0, linkKey(inode))) {
+            deferLink(inode, *dest, name, pending_dir);
+            return true;
+          }
+        }
+        return extractFile(inode, dest, name, pending_dir);
+      }
+      case kSquashfsDirType: {
+        ok = dest->createDir(item, mode);
+        break;
+      }
+      case kSquashfsSymlinkType: {
+        ok = dest->createSymlink(item, inode.symlink.c_str());
+        break;
+      }
+      case kSquashfsBlkdevType:
+      case kSquashfsChrdevType: {
+        ok = dest->createNode(item, inode.mode, inode.rdev);
+        break;
+      }
+      default: {
+        ok = dest->createNode(item, inode.mode, 0);
+        break;
+      }
+    }
+    if (!ok) {
+      fprintf(stderr, "ExtractImage() failed to create %s: %s\n",
+              dest->fullPath(item), strerror(errno));
+    }
+
+    updateMetadata(inode, *dest, item);
+    // Root folder is "." of itself.
+    addManifestItem(inode, name == "." ? "/" : journalPath(dest->path(), name),
+                    nullptr);
+    if (progress_) {
+      progress_->increase(0);
+    }
+    countItems(pending_dir, 1, 0);
+    return ok;
+  }
+
+  // Link |name| to the file already written from the same inode.
+  bool linkFile(const SquashfsInode& inode, DirWriter& dest,
+                const char* name) {
+    std::string target;
+    if (!hard_links_.find(0, linkKey(inode), target)) {
+      return false;
+    }
+    if (!dest.linkFrom(target.c_str(), name)) {
+      fprintf(stderr, "ExtractImage() link() failed: %s -> %s, %s\n",
+              dest.fullPath(name), target.c_str(), strerror(errno));
+      return false;
+    }
+    if (stats_) {
+      stats_->hard_links++;
+      stats_->hard_link_bytes += inode.file_size;
+    }
+    if (progress_) {
+      progress_->increase(0);
+    }
+    if (verifier_) {
+      verifier_->skip(journalPath(dest.path(), name));
+    }
+    if (manifest_) {
+      manifest_->addLink(journalPath(dest.path(), name),
+                         target.substr(dest_root_.size()));
+    }
+    return true;
+  }
+
+  // Remember name |name| in |dest| of |inode|, which is being written by
+  // another worker, to link it after all tasks are finished.
+  void deferLink(const SquashfsInode& inode, const DirWriter& dest,
+                 const std::string& name, const PendingDirPtr& pending_dir) {
+    DeferredLink deferred;
+    deferred.key = linkKey(inode);
+    deferred.file_size = inode.file_size;
+    deferred.path = dest.fullPath(name.c_str());
+    deferred.pending_dir = pending_dir;
+    std::lock_guard<std::mutex> lock(deferred_mutex_);
+    deferred_links_.push_back(std::move(deferred));
+  }
+
+  // Link names deferred by deferLink(), then release their folders.
+  void linkDeferred() {
+    for (const DeferredLink& deferred : deferred_links_) {
+      if (failed_) {
+        break;
+      }
+      std::string target;
+      if (!hard_links_.find(0, deferred.key, target) ||
+          link(target.c_str(), deferred.path.c_str()) != 0) {
+        fprintf(stderr, "ExtractImage() failed to link %s: %s\n",
+                deferred.path.c_str(), strerror(errno));
+        failed_ = true;
+        break;
+      }
+      if (stats_) {
+        stats_->hard_links++;
+        stats_->hard_link_bytes += deferred.file_size;
+      }
+      if (progress_) {
+        progress_->increase(0);
+      }
+      if (verifier_) {
+        verifier_->skip(deferred.path.substr(dest_root_.size()));
+      }
+      if (manifest_) {
+        manifest_->addLink(deferred.path.substr(dest_root_.size()),
+                           target.substr(dest_root_.size()));
+      }
+      countItems(deferred.pending_dir, 1, 0);
+    }
+    deferred_links_.clear();
+  }
+
+  bool extractFile(const SquashfsInode& inode, const DirWriterPtr& dest,
+                   const std::string& name,
+                   const PendingDirPtr& pending_dir) {
+    PendingFilePtr file(new PendingFile());
+    file->inode = inode;
+    file->dir = dest;
+    file->pending_dir = pending_dir;
+    file->name = name;
+    file->fd = dest->createFile(name.c_str());
+    if (file->fd == -1) {
+      fprintf(stderr, "ExtractImage() Failed to open dest file: %s, %s\n",
+              dest->fullPath(name.c_str()), strerror(errno));
+      return false;
+    }
+
+    const size_t num_blocks = inode.block_sizes.size();
+    file->block_offsets.resize(num_blocks);
+    uint64_t offset = inode.start_block;
+    uint64_t sparse_bytes = 0;
+    for (size_t i = 0; i < num_blocks; ++i) {
+      file->block_offsets[i] = offset;
+      offset += inode.block_sizes[i] & ~kSquashfsDataUncompressed;
+      if (inode.block_sizes[i] == 0) {
+        sparse_bytes += std::min<uint64_t>(
+            block_size_, inode.file_size - uint64_t(i) * block_size_);
+      }
+    }
+
+    // Sparse blocks are not written, set file size first so that they are
+    // left as holes.
+    if (sparse_bytes > 0) {
+      if (ftruncate(file->fd, static_cast<off_t>(inode.file_size)) != 0) {
+        fprintf(stderr, "ExtractImage() ftruncate() failed: %s, %s\n",
+                dest->fullPath(name.c_str()), strerror(errno));
+        close(file->fd);
+        return false;
+      }
+      if (stats_) {
+        stats_->sparse_files++;
+        stats_->sparse_bytes += sparse_bytes;
+      }
+    } else if (options_.preallocate_size > 0 &&
+               inode.file_size >= uint64_t(options_.preallocate_size) &&
+               PreallocateFile(file->fd,
+                               static_cast<int64_t>(inode.file_size)) &&
+               stats_) {
+      stats_->preallocated_files++;
+      stats_->preallocated_bytes += inode.file_size;
+    }
+
+    // In memory-bounded mode, large files bypass page cache of dest if its
+    // filesystem supports O_DIRECT.
+    file->direct = options_.direct_io &&
+                   inode.file_size >= uint64_t(kMinDirectIoSize) &&
+                   SetDirectIo(file->fd, true);
+    if (file->direct && stats_) {
+      stats_->direct_files++;
+      stats_->direct_bytes += inode.file_size;
+    }
+
+    if (hashing_) {
+      file->chunk_hashes.resize(static_cast<size_t>(
+          (inode.file_size + kHashChunkSize - 1) / kHashChunkSize));
+    }
+
+    if (num_blocks < kMinParallelBlocks || pool_.numWorkers() == 1) {
+      file->remaining = 1;
+      writeBlocks(file, 0, num_blocks);
+      return true;
+    }
+
+    // Decompress blocks of large file in parallel. The last task to finish
+    // closes the file. If content is verified, each task starts at a hash
+    // chunk, so that it hashes its own chunks.
+    size_t blocks_per_task = kBlocksPerTask;
+    if (hashing_ && block_size_ < kHashChunkSize) {
+      const size_t chunk_blocks = kHashChunkSize / block_size_;
+      blocks_per_task = (blocks_per_task + chunk_blocks - 1) /
+                        chunk_blocks * chunk_blocks;
+    }
+    const int num_tasks = static_cast<int>(
+        (num_blocks + blocks_per_task - 1) / blocks_per_task);
+    file->remaining = num_tasks;
+    for (size_t first = 0; first < num_blocks; first += blocks_per_task) {
+      const size_t last = std::min(first + blocks_per_task, num_blocks);
+      pool_.submit(std::bind(&ImageExtractor::writeBlocks, this,
+                             file, first, last));
+    }
+    return true;
+  }
+
+  // Write data blocks in range [first, last) of |file|. The fragment is
+  // written together with the last block.
+  void writeBlocks(PendingFilePtr file, size_t first, size_t last) {
+    const SquashfsInode& inode = file->inode;
+
+    uint8_t* block = blockBuffer();
+    if (!block) {
+      fprintf(stderr, "ExtractImage() out of memory: %s\n",
+              file->dir->fullPath(file->name.c_str()));
+      failed_ = true;
+    }
+    // Bytes handled by this task, including sparse and skipped blocks,
+    // reported to progress at once.
+    int64_t bytes = 0;
+    // Content of this task if it is hashed.
+    std::unique_ptr<ContentHasher> hasher;
+    if (hashing_) {
+      hasher.reset(new ContentHasher());
+    }
+    int64_t hash_nsecs = 0;
+
+    for (size_t i = first; i < last && !failed_; ++i) {
+      const uint64_t file_offset = uint64_t(i) * block_size_;
+      const size_t expected = static_cast<size_t>(
+          std::min<uint64_t>(block_size_, inode.file_size - file_offset));
+      bytes += expected;
+      if (inode.block_sizes[i] == 0) {
+        // Sparse block, left as hole.
+        if (hasher) {
+          hasher->updateZeros(expected);
+        }
+        continue;
+      }
+      const long len = image_->readDataBlock(file->block_offsets[i],
+                                            inode.block_sizes[i],
+                                            block);
+      if (len != static_cast<long>(expected)) {
+        // Other files are still extracted, so that all defects of image
+        // are logged, then extraction fails in run().
+        fprintf(stderr, "ExtractImage() failed to read block %zu: %s\n",
+                i, file->dir->fullPath(file->name.c_str()));
+        file->corrupted = true;
+        if (hasher) {
+          hasher->updateZeros(expected);
+        }
+        continue;
+      }
+      if (hasher) {
+        const int64_t start = NowNsecs();
+        hasher->update(block, expected);
+        hash_nsecs += NowNsecs() - start;
+      }
+      if (!writeContent(*file, block, expected, file_offset)) {
+        fprintf(stderr, "ExtractImage() write() failed: %s, %s\n",
+                file->dir->fullPath(file->name.c_str()), strerror(errno));
+        failed_ = true;
+      }
+    }
+
+    if (last == inode.block_sizes.size() && !failed_ &&
+        inode.fragment != kSquashfsInvalidFragment) {
+      writeFragment(*file, hasher.get());
+      bytes += inode.file_size -
+               inode.block_sizes.size() * uint64_t(block_size_);
+    }
+    if (progress_ && bytes > 0) {
+      progress_->addBytes(bytes);
+    }
+    if (hasher) {
+      // Tasks start at chunk boundaries, see extractFile().
+      const std::vector<uint64_t>& chunks = hasher->finishChunks();
+      const size_t first_chunk = static_cast<size_t>(
+          uint64_t(first) * block_size_ / kHashChunkSize);
+      std::copy(chunks.begin(), chunks.end(),
+                file->chunk_hashes.begin() + first_chunk);
+      if (stats_) {
+        stats_->hash_nsecs += hash_nsecs;
+      }
+    }
+
+    if (--file->remaining == 0) {
+      finishFile(*file);
+    }
+  }
+
+  // Write fragment of |file|, the tail of its content, appending it to
+  // |hasher| if it is not nullptr.
+  void writeFragment(PendingFile& file, ContentHasher* hasher) {
+    const SquashfsInode& inode = file.inode;
+    const uint64_t file_offset = inode.block_sizes.size() * uint64_t(block_size_);
+    const size_t len = static_cast<size_t>(inode.file_size - file_offset);
+    const std::shared_ptr<const std::vector<uint8_t>> fragment =
+        readFragment(inode.fragment);
+    if (!fragment || inode.fragment_offset + len > fragment->size()) {
+      fprintf(stderr, "ExtractImage() failed to read fragment: %s\n",
+              file.dir->fullPath(file.name.c_str()));
+      file.corrupted = true;
+      return;
+    }
+    const uint8_t* data = fragment->data() + inode.fragment_offset;
+    if (hasher) {
+      hasher->update(data, len);
+    }
+    bool ok;
+    if (file.direct) {
+      // Buffer of writeBlocks() is free now.
+      uint8_t* block = blockBuffer();
+      memcpy(block, data, len);
+      ok = writeContent(file, block, len, file_offset);
+    } else {
+      ok = WriteAt(file.fd, data, len, static_cast<off_t>(file_offset));
+    }
+    if (!ok) {
+      fprintf(stderr, "ExtractImage() write() failed: %s, %s\n",
+              file.dir->fullPath(file.name.c_str()), strerror(errno));
+      failed_ = true;
+    }
+  }
+
+  // Returns buffer holding one uncompressed block, reused by each worker
+  // thread. It is aligned and padded for O_DIRECT writes.
+  uint8_t* blockBuffer() {
+    thread_local AlignedBuffer buffer;
+    if (!buffer.reserve(AlignDirectIo(block_size_))) {
+      return nullptr;
+    }
+    return buffer.data();
+  }
+
+  // Write |len| bytes of |data| to |file| at |offset|. If |file| is written
+  // with O_DIRECT, |data| shall be from blockBuffer(), as it is padded with
+  // zeros to alignment, and padding is truncated in finishFile().
+  bool writeContent(PendingFile& file, uint8_t* data, size_t len,
+                    uint64_t offset) {
+    if (!file.direct) {
+      return WriteAt(file.fd, data, len, static_cast<off_t>(offset));
+    }
+    const size_t padded = AlignDirectIo(len);
+    memset(data + len, 0, padded - len);
+    if (WriteAt(file.fd, data, padded, static_cast<off_t>(offset))) {
+      return true;
+    }
+    if (errno != EINVAL) {
+      return false;
+    }
+    // Filesystem accepted O_DIRECT flag but rejects the write. The flag is
+    // shared by all tasks of |file|, and it is never set again.
+    SetDirectIo(file.fd, false);
+    return WriteAt(file.fd, data, padded, static_cast<off_t>(offset));
+  }
+
+  void finishFile(PendingFile& file) {
+    if (file.direct &&
+        ftruncate(file.fd, static_cast<off_t>(file.inode.file_size)) != 0) {
+      fprintf(stderr, "ExtractImage() ftruncate() failed: %s, %s\n",
+              file.dir->fullPath(file.name.c_str()), strerror(errno));
+      failed_ = true;
+    }
+    if (options_.drop_cache && !file.inode.block_sizes.empty()) {
+      // Data blocks are read only once. Fragment blocks are shared by files
+      // and are kept in fragment cache instead.
+      uint64_t start = 0;
+      uint64_t end = 0;
+      image_->dataRange(file.inode, start, end);
+      image_->dropCache(start, end - start);
+    }
+    if (pacer_) {
+      // Content written with O_DIRECT is on disk already.
+      pacer_->add(file.fd, file.direct ?
+                           0 : static_cast<int64_t>(file.inode.file_size));
+    } else {
+      close(file.fd);
+    }
+    file.fd = -1;
+    updateMetadata(file.inode, *file.dir, file.name.c_str());
+    if (hashing_) {
+      const std::string path = journalPath(file.dir->path(), file.name);
+      if (file.corrupted) {
+        if (verifier_) {
+          verifier_->reportError(path, "failed to read content from image");
+        }
+        addManifestItem(file.inode, path, nullptr);
+      } else {
+        const uint64_t hash = CombineChunkHashes(file.chunk_hashes,
+                                                 file.inode.file_size);
+        verifyFile(path, file.inode.file_size, hash);
+        addManifestItem(file.inode, path, &hash);
+      }
+    }
+    if (file.inode.nlink > 1) {
+      hard_links_.insert(0, linkKey(file.inode),
+                         file.dir->fullPath(file.name.c_str()));
+    }
+    if (file.corrupted) {
+      read_errors_++;
+      if (stats_) {
+        stats_->read_errors++;
+      }
+    }
+    if (file.pending_dir) {
+      countItems(file.pending_dir, 1,
+                 static_cast<int64_t>(file.inode.file_size));
+      // Content of file might be incomplete if reading or writing failed.
+      if (file.corrupted) {
+        file.pending_dir->incomplete = true;
+      } else if (!failed_) {
+        recordFile(file.inode, *file.dir, file.name);
+      }
+      file.pending_dir.reset();
+    }
+    // Release parent folder.
+    file.dir.reset();
+    if (progress_) {
+      progress_->increase(0);
+    }
+  }
+
+  // Compare content hash of file at |path| relative to dest folder with
+  // manifest, if content is verified.
+  void verifyFile(const std::string& path, uint64_t size, uint64_t hash) {
+    if (verifier_) {
+      verifier_->check(path, static_cast<int64_t>(size), hash);
+    }
+    if (stats_) {
+      stats_->hashed_files++;
+      stats_->hashed_bytes += static_cast<int64_t>(size);
+    }
+  }
+
+  // Update ownership, permissions, times and xattrs of item |name| in
+  // |dest|. Times of folders are restored after all items are extracted.
+  // Errors are logged and ignored, same as CopyTree().
+  void updateMetadata(const SquashfsInode& inode, DirWriter& dest,
+                      const char* name) {
+    // Update ownership first, or chmod() might ignore SUID/SGID or sticky flag.
+    if (!dest.setOwner(name, inode.uid, inode.gid)) {
+      fprintf(stderr, "ExtractImage() lchown() failed: %s, %d, %d, %s\n",
+              dest.fullPath(name), inode.uid, inode.gid, strerror(errno));
+    }
+    if (inode.type != kSquashfsSymlinkType) {
+      if (!dest.setMode(name, inode.mode & 07777)) {
+        fprintf(stderr, "ExtractImage() chmod() failed: %s, %s\n",
+                dest.fullPath(name), strerror(errno));
+      }
+    }
+    struct timespec times[2];
+    GetInodeTimes(inode, times);
+    if (inode.type == kSquashfsDirType) {
+      dir_times_.add(dest.fullPath(name), times[0], times[1]);
+    } else if (!dest.setTimes(name, times)) {
+      fprintf(stderr, "ExtractImage() utimensat() failed: %s, %s\n",
+              dest.fullPath(name), strerror(errno));
+    }
+
+    const int64_t start_time = stats_ ? NowNsecs() : 0;
+    int64_t values = 0;
+    int64_t bytes = 0;
+    const XattrSetCache::SetPtr xattrs = readXattrs(inode);
+    if (!xattrs) {
+      fprintf(stderr, "ExtractImage() failed to read xattrs: %s\n",
+              dest.fullPath(name));
+    } else {
+      for (const SquashfsXattr& xattr : *xattrs) {
+        if (!dest.setXattr(name, xattr.first.c_str(), xattr.second.data(),
+                           xattr.second.size())) {
+          fprintf(stderr, "ExtractImage() setxattr() failed: %s, %s, %s\n",
+                  dest.fullPath(name), xattr.first.c_str(), strerror(errno));
+          continue;
+        }
+        values++;
+        bytes += static_cast<int64_t>(xattr.second.size());
+      }
+    }
+    if (stats_) {
+      stats_->xattr_items++;
+      if (values > 0) {
+        stats_->xattr_sets++;
+        stats_->xattr_values += values;
+        stats_->xattr_bytes += bytes;
+      }
+      stats_->xattr_nsecs += NowNsecs() - start_time;
+    }
+  }
+
+  // Read xattrs of |inode| of current layer to be set on dest item, or
+  // nullptr on error. mksquashfs stores identical sets once, so sets are
+  // cached by their index, and most items share a few of them.
+  XattrSetCache::SetPtr readXattrs(const SquashfsInode& inode) const {
+    if (inode.xattr == kSquashfsInvalidXattr) {
+      return no_xattrs_;
+    }
+    const uint64_t id = (static_cast<uint64_t>(layer_) << 32) | inode.xattr;
+    XattrSetCache::SetPtr set = xattr_cache_.find(id);
+    if (set) {
+      if (stats_) {
+        stats_->xattr_cache_hits++;
+      }
+      return set;
+    }
+    std::vector<SquashfsXattr> xattrs;
+    if (!image_->readXattrs(inode.xattr, xattrs)) {
+      return nullptr;
+    }
+    // Opaque marks of upper layers are consumed by merging.
+    if (layer_ > 0) {
+      xattrs.erase(std::remove_if(xattrs.begin(), xattrs.end(),
+                                  [](const SquashfsXattr& xattr) {
+                                    return xattr.first.compare(
+                                        0, sizeof(kOverlayXattrPrefix) - 1,
+                                        kOverlayXattrPrefix) == 0;
+                                  }),
+                   xattrs.end());
+    }
+    return xattr_cache_.insert(id, std::move(xattrs));
+  }
+
+  // Add item |inode| at |path| relative to dest folder to manifest, if it
+  // is enabled. |hash| is content hash of regular file, or nullptr if it is
+  // not known.
+  void addManifestItem(const SquashfsInode& inode, const std::string& path,
+                       const uint64_t* hash) {
+    if (!manifest_) {
+      return;
+    }
+    ExtractManifestEntry entry;
+    entry.path = path;
+    entry.mode = inode.mode;
+    entry.uid = inode.uid;
+    entry.gid = inode.gid;
+    if (inode.type == kSquashfsRegType) {
+      entry.size = inode.file_size;
+      if (hash) {
+        entry.hashed = true;
+        entry.content_hash = *hash;
+      }
+    } else if (inode.type == kSquashfsSymlinkType) {
+      ContentHasher hasher;
+      hasher.update(inode.symlink.data(), inode.symlink.size());
+      entry.size = hasher.size();
+      entry.hashed = true;
+      entry.content_hash = hasher.finish();
+    }
+    const XattrSetCache::SetPtr xattrs = readXattrs(inode);
+    if (xattrs) {
+      entry.xattr_hash = HashXattrs(*xattrs);
+    }
+    manifest_->add(entry);
+  }
+
+  // Images from bottom to top, and the one being extracted.
+  const std::vector<const SquashfsImage*> layers_;
+  const SquashfsImage* image_ = nullptr;
+  uint32_t layer_ = 0;
+  const ExtractOptions& options_;
+  ExtractProgress* progress_;
+  ExtractStats* stats_;
+  // Xattr sets of all layers, keyed by layer and index in xattr id table.
+  mutable XattrSetCache xattr_cache_;
+  const XattrSetCache::SetPtr no_xattrs_ = std::make_shared<const XattrSet>();
+  HardLinkMap hard_links_;
+  // Names of files whose inode was being written when they were reached.
+  std::mutex deferred_mutex_;
+  std::vector<DeferredLink> deferred_links_;
+  // Folders whose times are restored after all items are extracted.
+  DirTimes dir_times_;
+  // Journal of finished items, or nullptr.
+  std::unique_ptr<ExtractJournal> journal_;
+  // Compares written files with manifest, or nullptr.
+  std::unique_ptr<ContentVerifier> verifier_;
+  // Records extracted items, or nullptr.
+  std::unique_ptr<ExtractManifestWriter> manifest_;
+  // Content of regular files is hashed for |verifier_| or |manifest_|.
+  bool hashing_ = false;
+  // Path of dest folder, and its device. Items on other devices are mount
+  // points, which are never pruned in incremental mode.
+  std::string dest_root_;
+  dev_t dest_dev_ = 0;
+  // Skips files of unused packages, or nullptr.
+  std::unique_ptr<PackageFilter> filter_;
+  // Files of priority list, see ExtractOptions::priority_list.
+  PriorityMap priorities_;
+  // Writeback of finished files, or nullptr.
+  std::unique_ptr<WritebackPacer> pacer_;
+  // Folders, items and chunks of ordered mode.
+  std::deque<OrderedDir> ordered_dirs_;
+  std::vector<OrderedItem> ordered_items_;
+  std::vector<OrderedChunk> chunks_;
+  std::atomic<size_t> next_chunk_;
+  // Distinguishes per-worker caches of different extractors and layers.
+  uint64_t serial_ = 0;
+  uint32_t block_size_ = 0;
+  const uid_t euid_;
+  const gid_t egid_;
+  const mode_t umask_;
+  // Cleared if io_uring is not available.
+  std::atomic<bool> uring_enabled_;
+  std::atomic<bool> failed_;
+  // Number of files whose content cannot be read from image.
+  std::atomic<int64_t> read_errors_;
+  WorkStealingPool pool_;
+};
+
+}  // namespace
+
+bool ExtractImage(const SquashfsImage& image,
+                  const std::string& dest_dir,
+                  const ExtractOptions& options,
+                  ExtractProgress* progress,
+                  ExtractStats* stats) {
+  return ExtractImages({&image}, dest_dir, options, progress, stats);
+}
+
+bool ExtractImages(const std::vector<const SquashfsImage*>& layers,
+                   const std::string& dest_dir,
+                   const ExtractOptions& options,
+                   ExtractProgress* progress,
+                   ExtractStats* stats) {
+  if (layers.empty()) {
+    return false;
+  }
+  ImageExtractor extractor(layers, options, progress, stats);
+  return extractor.run(dest_dir);
+}
+
+}  // namespace installer
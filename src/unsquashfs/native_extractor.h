@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_NATIVE_EXTRACTOR_H
+#define INSTALLER_UNSQUASHFS_NATIVE_EXTRACTOR_H
+
+#include <string>
+#include <vector>
+
+#include "unsquashfs/extract_options.h"
+
+namespace installer {
+
+class ExtractProgress;
+struct ExtractStats;
+class SquashfsImage;
+
+// Extract content of |image| to |dest_dir| without mounting it, keeping
+// file ownership, permissions, mtime and xattrs. |dest_dir| shall already
+// exist.
+// Directories are walked by |options.jobs| workers, and data blocks of large
+// files are decompressed by several workers at the same time.
+// Inodes with several names are written once and linked afterwards.
+bool ExtractImage(const SquashfsImage& image,
+                  const std::string& dest_dir,
+                  const ExtractOptions& options,
+                  ExtractProgress* progress,
+                  ExtractStats* stats);
+
+// Extract |layers| of a layered filesystem, bottom first, to |dest_dir| as
+// overlayfs would merge them. Folders of all layers are walked first, so that
+// each item is written once, from the topmost layer which has it. In upper
+// layers, character devices 0/0 and ".wh.<name>" files are whiteouts which
+// hide <name> of lower layers, and folders with "trusted.overlay.opaque"
+// xattr or ".wh..wh..opq" file hide all items of lower layers.
+// Items are extracted as in ordered mode. Total of |progress| is reset to
+// the number of merged items.
+bool ExtractImages(const std::vector<const SquashfsImage*>& layers,
+                   const std::string& dest_dir,
+                   const ExtractOptions& options,
+                   ExtractProgress* progress,
+                   ExtractStats* stats);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_NATIVE_EXTRACTOR_H
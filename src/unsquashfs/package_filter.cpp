@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/package_filter.h"
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unordered_map>
+#include <utility>
+
+namespace installer {
+
+namespace {
+
+const char kDpkgStatusFile[] = "/var/lib/dpkg/status";
+const char kDpkgDiversionsFile[] = "/var/lib/dpkg/diversions";
+const char kDpkgInfoDir[] = "/var/lib/dpkg/info/";
+
+// An installed package in dpkg status.
+struct Package {
+  std::string name;
+  std::string arch;
+  bool essential = false;
+  // Alternatives of each item of Depends and Pre-Depends.
+  std::vector<std::vector<std::string>> depends;
+  std::vector<std::string> provides;
+};
+
+std::vector<std::string> SplitText(const std::string& text, char sep) {
+  std::vector<std::string> items;
+  size_t start = 0;
+  while (start <= text.size()) {
+    size_t end = text.find(sep, start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    items.push_back(text.substr(start, end - start));
+    start = end + 1;
+  }
+  return items;
+}
+
+// Returns package name of dependency |item|, e.g. "libc6" of
+// " libc6:amd64 (>= 2.27)".
+std::string DependencyName(const std::string& item) {
+  const size_t start = item.find_first_not_of(" \t");
+  if (start == std::string::npos) {
+    return "";
+  }
+  const size_t end = item.find_first_of(" \t(:[", start);
+  return item.substr(start, end == std::string::npos ?
+                            std::string::npos : end - start);
+}
+
+// Parse installed packages of dpkg |status|.
+void ParseStatus(const std::string& status, std::vector<Package>& packages) {
+  Package package;
+  bool installed = false;
+  for (const std::string& line : SplitText(status, '\n')) {
+    if (line.empty()) {
+      if (installed && !package.name.empty()) {
+        packages.push_back(std::move(package));
+      }
+      package = Package();
+      installed = false;
+      continue;
+    }
+    // Continuation of multi-line fields, e.g. Description.
+    if (line[0] == ' ' || line[0] == '\t') {
+      continue;
+    }
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    const std::string key = line.substr(0, colon);
+    const size_t value_pos = line.find_first_not_of(' ', colon + 1);
+    const std::string value = (value_pos == std::string::npos) ?
+                              "" : line.substr(value_pos);
+    if (key == "Package") {
+      package.name = value;
+    } else if (key == "Architecture") {
+      package.arch = value;
+    } else if (key == "Status") {
+      // "install ok installed", "hold ok installed" and so on.
+      const size_t space = value.rfind(' ');
+      installed = (value.substr(space + 1) == "installed");
+    } else if (key == "Essential") {
+      package.essential = (value == "yes");
+    } else if (key == "Depends" || key == "Pre-Depends") {
+      for (const std::string& item : SplitText(value, ',')) {
+        std::vector<std::string> alternatives;
+        for (const std::string& alternative : SplitText(item, '|')) {
+          alternatives.push_back(DependencyName(alternative));
+        }
+        package.depends.push_back(std::move(alternatives));
+      }
+    } else if (key == "Provides") {
+      for (const std::string& item : SplitText(value, ',')) {
+        package.provides.push_back(DependencyName(item));
+      }
+    }
+  }
+  if (installed && !package.name.empty()) {
+    packages.push_back(std::move(package));
+  }
+}
+
+// Returns packages removed together with |roots|, that is |roots| and
+// packages whose dependencies are not satisfied without them.
+std::vector<bool> RemovalClosure(const std::vector<Package>& packages,
+                                 const std::vector<bool>& roots) {
+  std::vector<bool> removed = roots;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    // Names of kept packages and of virtual packages they provide.
+    std::unordered_set<std::string> available;
+    for (size_t i = 0; i < packages.size(); ++i) {
+      if (!removed[i]) {
+        available.insert(packages[i].name);
+        available.insert(packages[i].provides.begin(),
+                         packages[i].provides.end());
+      }
+    }
+    for (size_t i = 0; i < packages.size(); ++i) {
+      if (removed[i]) {
+        continue;
+      }
+      for (const std::vector<std::string>& alternatives :
+           packages[i].depends) {
+        bool satisfied = false;
+        for (const std::string& name : alternatives) {
+          if (name.empty() || available.count(name) > 0) {
+            satisfied = true;
+            break;
+          }
+        }
+        if (!satisfied) {
+          removed[i] = true;
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+  return removed;
+}
+
+bool MatchesAny(const std::vector<std::string>& patterns,
+                const std::string& name) {
+  for (const std::string& pattern : patterns) {
+    if (fnmatch(pattern.c_str(), name.c_str(), 0) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Maps diverted path to new path and package which diverts it, or ":"
+// for local diversions. Files of other packages are at new path.
+typedef std::unordered_map<std::string, std::pair<std::string, std::string>>
+    DiversionMap;
+
+// Returns <name>:<arch> of |package|, or its name if it has no architecture.
+std::string QualifiedName(const Package& package) {
+  return package.arch.empty() ? package.name :
+                                package.name + ":" + package.arch;
+}
+
+// Read file list of |package| with |reader|, and call |callback| with path
+// of each item in source root, after |diversions| are applied. Returns
+// false if its file list is not found.
+bool ReadFileList(const SourceFileReader& reader, const Package& package,
+                  const DiversionMap& diversions,
+                  const std::function<void(const std::string&)>& callback) {
+  std::string content;
+  // Name of file list has architecture for Multi-Arch: same packages.
+  if (!reader(kDpkgInfoDir + QualifiedName(package) + ".list", content) &&
+      !reader(kDpkgInfoDir + package.name + ".list", content)) {
+    return false;
+  }
+  for (const std::string& path : SplitText(content, '\n')) {
+    if (path.empty() || path[0] != '/' || path == "/.") {
+      continue;
+    }
+    const auto diversion = diversions.find(path);
+    callback((diversion != diversions.end() &&
+              diversion->second.second != package.name) ?
+             diversion->second.first : path);
+  }
+  return true;
+}
+
+// Returns index of a kept or essential package in |removed|, or -1.
+long FindProtected(const std::vector<Package>& packages,
+                   const std::vector<bool>& removed,
+                   const std::vector<std::string>& kept) {
+  for (size_t i = 0; i < packages.size(); ++i) {
+    if (removed[i] &&
+        (packages[i].essential || MatchesAny(kept, packages[i].name))) {
+      return static_cast<long>(i);
+    }
+  }
+  return -1;
+}
+
+}  // namespace
+
+PackageFilter::PackageFilter() {
+}
+
+bool PackageFilter::init(const std::string& list_file,
+                         const SourceFileReader& reader) {
+  packages_.clear();
+  paths_.clear();
+
+  FILE* fp = fopen(list_file.c_str(), "re");
+  if (!fp) {
+    fprintf(stderr, "PackageFilter::init() failed to open %s: %s\n",
+            list_file.c_str(), strerror(errno));
+    return false;
+  }
+  std::vector<std::string> excluded;
+  std::vector<std::string> kept;
+  char* line = nullptr;
+  size_t line_size = 0;
+  ssize_t len;
+  while ((len = getline(&line, &line_size, fp)) > 0) {
+    if (line[len - 1] == '\n') {
+      line[--len] = '\0';
+    }
+    if (len == 0 || line[0] == '#') {
+      continue;
+    }
+    if (line[0] == '!') {
+      kept.push_back(line + 1);
+    } else {
+      excluded.push_back(line);
+    }
+  }
+  free(line);
+  fclose(fp);
+
+  std::string status;
+  if (!reader(kDpkgStatusFile, status)) {
+    fprintf(stderr, "PackageFilter::init() failed to read %s\n",
+            kDpkgStatusFile);
+    return false;
+  }
+  std::vector<Package> packages;
+  ParseStatus(status, packages);
+
+  std::vector<bool> roots(packages.size(), false);
+  for (size_t i = 0; i < packages.size(); ++i) {
+    roots[i] = MatchesAny(excluded, packages[i].name) &&
+               !MatchesAny(kept, packages[i].name);
+  }
+  std::vector<bool> removed = RemovalClosure(packages, roots);
+  if (FindProtected(packages, removed, kept) >= 0) {
+    // Keep packages whose removal alone takes a protected one with it.
+    for (size_t i = 0; i < packages.size(); ++i) {
+      if (!roots[i]) {
+        continue;
+      }
+      std::vector<bool> single(packages.size(), false);
+      single[i] = true;
+      const long found = FindProtected(packages,
+                                       RemovalClosure(packages, single), kept);
+      if (found >= 0) {
+        fprintf(stderr, "PackageFilter::init() keep %s, removing it "
+                "removes %s\n", packages[i].name.c_str(),
+                packages[static_cast<size_t>(found)].name.c_str());
+        roots[i] = false;
+      }
+    }
+    removed = RemovalClosure(packages, roots);
+    if (FindProtected(packages, removed, kept) >= 0) {
+      fprintf(stderr, "PackageFilter::init() no package is excluded, as "
+              "they take kept packages with them\n");
+      return true;
+    }
+  }
+
+  DiversionMap diversions;
+  std::string content;
+  if (reader(kDpkgDiversionsFile, content)) {
+    const std::vector<std::string> lines = SplitText(content, '\n');
+    for (size_t i = 0; i + 2 < lines.size(); i += 3) {
+      diversions[lines[i]] = std::make_pair(lines[i + 1], lines[i + 2]);
+    }
+  }
+
+  std::unordered_set<std::string> dirs;
+  for (size_t i = 0; i < packages.size(); ++i) {
+    if (!removed[i]) {
+      continue;
+    }
+    const std::string qualified = QualifiedName(packages[i]);
+    packages_.push_back(qualified);
+    const bool found = ReadFileList(
+        reader, packages[i], diversions,
+        [this, &dirs](const std::string& path) {
+          paths_.insert(path);
+          for (size_t pos = path.rfind('/'); pos != 0 &&
+               pos != std::string::npos; pos = path.rfind('/', pos - 1)) {
+            dirs.insert(path.substr(0, pos));
+          }
+        });
+    if (!found) {
+      fprintf(stderr, "PackageFilter::init() no file list of %s, its "
+              "files are extracted\n", qualified.c_str());
+    }
+  }
+  // Folders are listed before their items. Those with items are dropped,
+  // in case a symbolic link replaces them in source root, such as /lib of
+  // merged /usr.
+  for (const std::string& dir : dirs) {
+    paths_.erase(dir);
+  }
+  // Files shared with kept packages, such as docs of Multi-Arch: same
+  // packages of other architectures, are kept by dpkg --purge too.
+  if (!paths_.empty()) {
+    for (size_t i = 0; i < packages.size(); ++i) {
+      if (!removed[i]) {
+        ReadFileList(reader, packages[i], diversions,
+                     [this](const std::string& path) {
+                       paths_.erase(path);
+                     });
+      }
+    }
+  }
+  return true;
+}
+
+bool PackageFilter::writePackages(const std::string& file) const {
+  FILE* fp = fopen(file.c_str(), "we");
+  if (!fp) {
+    fprintf(stderr, "PackageFilter::writePackages() failed to create %s: "
+            "%s\n", file.c_str(), strerror(errno));
+    return false;
+  }
+  bool ok = true;
+  for (const std::string& package : packages_) {
+    ok = ok && fprintf(fp, "%s\n", package.c_str()) > 0;
+  }
+  ok = (fclose(fp) == 0) && ok;
+  return ok;
+}
+
+}  // namespace installer
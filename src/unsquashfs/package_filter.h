@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_PACKAGE_FILTER_H
+#define INSTALLER_UNSQUASHFS_PACKAGE_FILTER_H
+
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace installer {
+
+// Reads file at |path| of source root, starting with "/", into |content|.
+typedef std::function<bool(const std::string& path, std::string& content)>
+    SourceFileReader;
+
+// Skips files of unused packages while extracting, instead of writing them
+// and purging the packages afterwards.
+// Package list has shell patterns of package names to be excluded, one per
+// line, e.g. "virtualbox-guest-*". Lines starting with "!" name packages
+// which shall be kept. Empty lines and lines starting with "#" are ignored.
+// Installed packages depending on excluded ones are excluded too, as
+// apt-get purge does. A package is kept, with a message, if that would
+// exclude a kept or essential package.
+// Excluded packages stay in dpkg status of dest folder, together with their
+// maintainer scripts, so that they can be purged with dpkg afterwards.
+class PackageFilter {
+ public:
+  PackageFilter();
+
+  // Read |list_file|, and resolve it against dpkg database of source root
+  // read by |reader|. Returns false on error.
+  bool init(const std::string& list_file, const SourceFileReader& reader);
+
+  // Returns true if item at |path| of source root, starting with "/", is a
+  // file of an excluded package. File lists of packages name folders shared
+  // with other packages too, so folders shall not be passed here.
+  bool excludes(const std::string& path) const {
+    return paths_.count(path) > 0;
+  }
+
+  // Returns excluded packages, as <name>:<arch>.
+  const std::vector<std::string>& packages() const { return packages_; }
+
+  // Write excluded packages to |file|, one per line.
+  bool writePackages(const std::string& file) const;
+
+ private:
+  std::vector<std::string> packages_;
+  std::unordered_set<std::string> paths_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_PACKAGE_FILTER_H
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/package_filter.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <map>
+#include <string>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kStatus[] =
+    "Package: libc6\n"
+    "Status: install ok installed\n"
+    "Architecture: amd64\n"
+    "Essential: yes\n"
+    "Description: GNU C Library\n"
+    " Shared libraries.\n"
+    "\n"
+    "Package: libwireshark11\n"
+    "Status: install ok installed\n"
+    "Architecture: amd64\n"
+    "Depends: libc6 (>= 2.27)\n"
+    "\n"
+    "Package: tshark\n"
+    "Status: install ok installed\n"
+    "Architecture: amd64\n"
+    "Depends: libc6, libwireshark11 (>= 2.6)\n"
+    "\n"
+    "Package: open-vm-tools\n"
+    "Status: install ok installed\n"
+    "Architecture: amd64\n"
+    "Provides: vm-tools\n"
+    "\n"
+    "Package: vm-helper\n"
+    "Status: install ok installed\n"
+    "Architecture: all\n"
+    "Pre-Depends: vm-tools | virtualbox-guest-utils\n"
+    "\n"
+    "Package: btrfs-tools\n"
+    "Status: install ok installed\n"
+    "Architecture: amd64\n"
+    "\n"
+    "Package: deepin-installer\n"
+    "Status: install ok installed\n"
+    "Architecture: amd64\n"
+    "Depends: btrfs-tools\n"
+    "\n"
+    "Package: removed-pkg\n"
+    "Status: deinstall ok config-files\n"
+    "Architecture: amd64\n";
+
+class PackageFilterTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    files_["/var/lib/dpkg/status"] = kStatus;
+    files_["/var/lib/dpkg/info/tshark.list"] =
+        "/.\n/usr\n/usr/bin\n/usr/bin/tshark\n/usr/bin/dumpcap\n";
+    files_["/var/lib/dpkg/info/libwireshark11:amd64.list"] =
+        "/.\n/usr/lib\n/usr/lib/libwireshark.so.11\n";
+    files_["/var/lib/dpkg/info/open-vm-tools.list"] =
+        "/.\n/lib\n/lib/vmhgfs\n/etc/vmware-tools\n";
+    files_["/var/lib/dpkg/info/vm-helper.list"] = "/.\n/usr/bin/vm-helper\n";
+    // dumpcap of tshark is diverted by another package.
+    files_["/var/lib/dpkg/diversions"] =
+        "/usr/bin/dumpcap\n/usr/bin/dumpcap.real\nwrapper\n";
+  }
+
+  bool init(const char* list, PackageFilter& filter) {
+    char path[] = "/tmp/installer-package-filter-XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd == -1) {
+      return false;
+    }
+    const ssize_t len = static_cast<ssize_t>(strlen(list));
+    const bool written = (write(fd, list, size_t(len)) == len);
+    close(fd);
+    const bool ok = written && filter.init(
+        path, [this](const std::string& file, std::string& content) {
+          const auto it = files_.find(file);
+          if (it == files_.end()) {
+            return false;
+          }
+          content = it->second;
+          return true;
+        });
+    unlink(path);
+    return ok;
+  }
+
+  std::map<std::string, std::string> files_;
+};
+
+TEST_F(PackageFilterTest, ExcludeDependents) {
+  PackageFilter filter;
+  ASSERT_TRUE(init("# unused packages\nlibwireshark*\nopen-vm-tools\n",
+                   filter));
+  const std::vector<std::string> expected = {
+      "libwireshark11:amd64", "tshark:amd64", "open-vm-tools:amd64",
+      "vm-helper:all"};
+  EXPECT_EQ(filter.packages(), expected);
+
+  EXPECT_TRUE(filter.excludes("/usr/bin/tshark"));
+  EXPECT_TRUE(filter.excludes("/usr/bin/dumpcap.real"));
+  EXPECT_FALSE(filter.excludes("/usr/bin/dumpcap"));
+  EXPECT_TRUE(filter.excludes("/usr/lib/libwireshark.so.11"));
+  EXPECT_TRUE(filter.excludes("/usr/bin/vm-helper"));
+  // Leaf folders are not known to be folders, /lib has items.
+  EXPECT_TRUE(filter.excludes("/etc/vmware-tools"));
+  EXPECT_FALSE(filter.excludes("/lib"));
+  EXPECT_FALSE(filter.excludes("/usr/bin"));
+  EXPECT_FALSE(filter.excludes("/."));
+}
+
+TEST_F(PackageFilterTest, KeepProtected) {
+  PackageFilter filter;
+  // deepin-installer depends on btrfs-tools, libc6 is essential.
+  ASSERT_TRUE(init("btrfs-tools\nlibc6\ntshark\n!deepin-installer\n",
+                   filter));
+  const std::vector<std::string> expected = {"tshark:amd64"};
+  EXPECT_EQ(filter.packages(), expected);
+  EXPECT_TRUE(filter.excludes("/usr/bin/tshark"));
+  EXPECT_FALSE(filter.excludes("/usr/lib/libwireshark.so.11"));
+
+  char path[] = "/tmp/installer-package-filter-XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_NE(fd, -1);
+  close(fd);
+  ASSERT_TRUE(filter.writePackages(path));
+  FILE* fp = fopen(path, "r");
+  ASSERT_NE(fp, nullptr);
+  char line[64] = {0};
+  ASSERT_NE(fgets(line, sizeof(line), fp), nullptr);
+  EXPECT_STREQ(line, "tshark:amd64\n");
+  EXPECT_EQ(fgets(line, sizeof(line), fp), nullptr);
+  fclose(fp);
+  unlink(path);
+}
+
+TEST_F(PackageFilterTest, KeepSharedFiles) {
+  // Both packages own the same file, as Multi-Arch: same packages of
+  // several architectures do.
+  files_["/var/lib/dpkg/info/tshark.list"] +=
+      "/usr/share/doc/wireshark/README\n";
+  files_["/var/lib/dpkg/info/btrfs-tools.list"] =
+      "/.\n/usr/share/doc/wireshark/README\n/sbin/mkfs.btrfs\n";
+  PackageFilter filter;
+  ASSERT_TRUE(init("tshark\n", filter));
+  const std::vector<std::string> expected = {"tshark:amd64"};
+  EXPECT_EQ(filter.packages(), expected);
+  EXPECT_TRUE(filter.excludes("/usr/bin/tshark"));
+  EXPECT_FALSE(filter.excludes("/usr/share/doc/wireshark/README"));
+  EXPECT_FALSE(filter.excludes("/sbin/mkfs.btrfs"));
+}
+
+TEST_F(PackageFilterTest, MissingStatus) {
+  files_.clear();
+  PackageFilter filter;
+  EXPECT_FALSE(init("tshark\n", filter));
+  EXPECT_TRUE(filter.packages().empty());
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/priority_list.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <utility>
+
+namespace installer {
+
+bool ReadPriorityList(const std::string& list_file, PriorityMap& priorities) {
+  priorities.clear();
+  FILE* fp = fopen(list_file.c_str(), "re");
+  if (!fp) {
+    fprintf(stderr, "ReadPriorityList() failed to open %s: %s\n",
+            list_file.c_str(), strerror(errno));
+    return false;
+  }
+  char* line = nullptr;
+  size_t line_size = 0;
+  ssize_t len;
+  int line_number = 0;
+  bool ok = true;
+  while ((len = getline(&line, &line_size, fp)) > 0) {
+    ++line_number;
+    if (line[len - 1] == '\n') {
+      line[--len] = '\0';
+    }
+    if (len == 0 || line[0] == '#') {
+      continue;
+    }
+    if (line[0] != '/') {
+      fprintf(stderr, "ReadPriorityList() invalid line %d of %s\n",
+              line_number, list_file.c_str());
+      ok = false;
+      break;
+    }
+    const uint32_t rank = static_cast<uint32_t>(priorities.size() + 1);
+    priorities.insert(std::make_pair(std::string(line, size_t(len)), rank));
+  }
+  free(line);
+  fclose(fp);
+  if (!ok) {
+    priorities.clear();
+  }
+  return ok;
+}
+
+}  // namespace installer
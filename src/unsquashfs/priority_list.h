@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_PRIORITY_LIST_H
+#define INSTALLER_UNSQUASHFS_PRIORITY_LIST_H
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+
+namespace installer {
+
+// Priority list names files to be extracted before all others, usually the
+// working set of early boot recorded on a reference machine, one per line
+// in order of first access:
+//   <path>
+// |path| is relative to root of filesystem and starts with "/". Empty lines
+// and lines starting with "#" are ignored. See
+// tools/generate_priority_list.py.
+
+// Maps path of each listed file to its rank in list, starting at 1.
+typedef std::unordered_map<std::string, uint32_t> PriorityMap;
+
+// Read priority list |list_file| into |priorities|. Later lines of the same
+// path are ignored.
+bool ReadPriorityList(const std::string& list_file, PriorityMap& priorities);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_PRIORITY_LIST_H
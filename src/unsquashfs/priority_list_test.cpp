@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/priority_list.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+std::string WriteList(const char* content) {
+  char path[] = "/tmp/installer-priority-list-XXXXXX";
+  const int fd = mkstemp(path);
+  if (fd == -1) {
+    return "";
+  }
+  const ssize_t len = static_cast<ssize_t>(strlen(content));
+  const bool ok = (write(fd, content, size_t(len)) == len);
+  close(fd);
+  return ok ? path : "";
+}
+
+TEST(PriorityList, ReadPriorityList) {
+  const std::string list_file = WriteList(
+      "# early boot of reference machine\n"
+      "/usr/lib/systemd/systemd\n"
+      "\n"
+      "/lib/x86_64-linux-gnu/libc.so.6\n"
+      "/usr/lib/systemd/systemd\n"
+      "/usr/bin/dde-session");
+  ASSERT_FALSE(list_file.empty());
+
+  PriorityMap priorities;
+  ASSERT_TRUE(ReadPriorityList(list_file, priorities));
+  EXPECT_EQ(priorities.size(), 3u);
+  EXPECT_EQ(priorities["/usr/lib/systemd/systemd"], 1u);
+  EXPECT_EQ(priorities["/lib/x86_64-linux-gnu/libc.so.6"], 2u);
+  // Last line without line break.
+  EXPECT_EQ(priorities["/usr/bin/dde-session"], 3u);
+  EXPECT_EQ(unlink(list_file.c_str()), 0);
+}
+
+TEST(PriorityList, InvalidLine) {
+  const std::string list_file = WriteList("/usr/bin/bash\nusr/bin/ls\n");
+  ASSERT_FALSE(list_file.empty());
+
+  PriorityMap priorities;
+  EXPECT_FALSE(ReadPriorityList(list_file, priorities));
+  EXPECT_TRUE(priorities.empty());
+  EXPECT_EQ(unlink(list_file.c_str()), 0);
+
+  EXPECT_FALSE(ReadPriorityList("/nonexistent/priority.list", priorities));
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/progress_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace installer {
+
+namespace {
+
+// Number of attempts to read while writer is updating.
+const int kMaxReadRetries = 100;
+
+}  // namespace
+
+std::string GetProgressShmFile(const std::string& progress_file) {
+  return progress_file + ".shm";
+}
+
+std::string GetProgressFifoFile(const std::string& progress_file) {
+  return progress_file + ".fifo";
+}
+
+int OpenProgressFifo(const std::string& fifo_file) {
+  unlink(fifo_file.c_str());
+  if (mkfifo(fifo_file.c_str(), 0600) != 0) {
+    fprintf(stderr, "OpenProgressFifo() mkfifo() failed: %s, %s\n",
+            fifo_file.c_str(), strerror(errno));
+    return -1;
+  }
+  // O_RDWR on a FIFO is Linux specific, it never blocks.
+  const int fd = open(fifo_file.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) {
+    fprintf(stderr, "OpenProgressFifo() open() failed: %s, %s\n",
+            fifo_file.c_str(), strerror(errno));
+    unlink(fifo_file.c_str());
+  }
+  return fd;
+}
+
+int ConnectProgressFifo(const std::string& fifo_file) {
+  // Fails with ENXIO if nobody reads it.
+  const int fd = open(fifo_file.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) {
+    return -1;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void DrainProgressFifo(int fd) {
+  char buf[256];
+  while (read(fd, buf, sizeof(buf)) > 0) {
+  }
+}
+
+bool ReadProgressShm(const std::string& shm_file, ProgressShm& info) {
+  const int fd = open(shm_file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(ProgressShm)) {
+    close(fd);
+    return false;
+  }
+  void* addr = mmap(nullptr, sizeof(ProgressShm), PROT_READ, MAP_SHARED,
+                    fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+
+  const ProgressShm* shm = static_cast<const ProgressShm*>(addr);
+  const bool ok = ReadProgressShm(shm, info);
+  munmap(addr, sizeof(ProgressShm));
+  return ok;
+}
+
+const ProgressShm* MapProgressShm(const std::string& shm_file) {
+  unlink(shm_file.c_str());
+  const int fd = open(shm_file.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                      0644);
+  if (fd == -1 || ftruncate(fd, sizeof(ProgressShm)) != 0) {
+    fprintf(stderr, "MapProgressShm() failed to create %s: %s\n",
+            shm_file.c_str(), strerror(errno));
+    if (fd != -1) {
+      close(fd);
+    }
+    return nullptr;
+  }
+  void* addr = mmap(nullptr, sizeof(ProgressShm), PROT_READ, MAP_SHARED,
+                    fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "MapProgressShm() mmap() failed: %s, %s\n",
+            shm_file.c_str(), strerror(errno));
+    return nullptr;
+  }
+  return static_cast<const ProgressShm*>(addr);
+}
+
+void UnmapProgressShm(const ProgressShm* shm) {
+  if (shm) {
+    munmap(const_cast<ProgressShm*>(shm), sizeof(ProgressShm));
+  }
+}
+
+bool ReadProgressShm(const ProgressShm* shm, ProgressShm& info) {
+  bool ok = false;
+  for (int i = 0; i < kMaxReadRetries && !ok; ++i) {
+    const uint64_t begin = __atomic_load_n(&shm->sequence, __ATOMIC_ACQUIRE);
+    if (begin & 1) {
+      usleep(100);
+      continue;
+    }
+    info = *shm;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    const uint64_t end = __atomic_load_n(&shm->sequence, __ATOMIC_RELAXED);
+    ok = (begin == end);
+  }
+  return (ok && info.magic == kProgressShmMagic &&
+          info.version == kProgressShmVersion);
+}
+
+}  // namespace installer
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_PROGRESS_SHM_H
+#define INSTALLER_UNSQUASHFS_PROGRESS_SHM_H
+
+#include <stdint.h>
+
+#include <string>
+
+namespace installer {
+
+const uint32_t kProgressShmMagic = 0x55505247;  // "UPRG"
+const uint32_t kProgressShmVersion = 1;
+
+// Fixed layout of extraction progress in shared memory, written by
+// deepin-installer-unsquashfs and read by installer.
+// Writer increases |sequence| to an odd value before updating other fields
+// and to an even value afterwards, so that readers can detect torn reads.
+struct ProgressShm {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sequence;
+
+  int64_t bytes_done;
+  // 0 if unknown, then progress is weighted by files.
+  int64_t bytes_total;
+  int64_t files_done;
+  int64_t files_total;
+
+  // Recent throughput.
+  int64_t bytes_per_second;
+  // Estimated time left in seconds, or -1 if unknown.
+  int64_t eta_seconds;
+
+  // Progress value in range [0, 100], same as in text progress file.
+  int32_t progress;
+  // Set to 1 when extraction is done.
+  int32_t finished;
+};
+
+// Returns path of shared memory file paired with text |progress_file|.
+std::string GetProgressShmFile(const std::string& progress_file);
+
+// Returns path of FIFO paired with text |progress_file|. Installer creates
+// and reads it, and deepin-installer-unsquashfs writes one byte to it each
+// time shared memory is updated, so that installer is woken up instead of
+// polling. Bytes are dropped while FIFO is full, so updates are coalesced.
+std::string GetProgressFifoFile(const std::string& progress_file);
+
+// Create FIFO |fifo_file| and open it without blocking, for reader side.
+// It is opened for writing too, so that it does not report end of file
+// after a writer exits. Returns file descriptor, or -1 on error.
+int OpenProgressFifo(const std::string& fifo_file);
+
+// Open existing FIFO |fifo_file| for writing without blocking, for writer
+// side. Returns file descriptor, or -1 if it does not exist, is not a FIFO
+// or has no reader.
+int ConnectProgressFifo(const std::string& fifo_file);
+
+// Read and discard all bytes pending in FIFO |fd|.
+void DrainProgressFifo(int fd);
+
+// Read a consistent copy of shared memory progress at |shm_file|.
+// Returns false if it does not exist or is invalid.
+bool ReadProgressShm(const std::string& shm_file, ProgressShm& info);
+
+// Create empty shared memory progress file |shm_file| for reader side, and
+// map it once, instead of opening it on each read. deepin-installer-unsquashfs
+// updates the same file in place. Returns nullptr on error.
+const ProgressShm* MapProgressShm(const std::string& shm_file);
+
+// Unmap |shm| returned by MapProgressShm().
+void UnmapProgressShm(const ProgressShm* shm);
+
+// Read a consistent copy of mapped progress |shm|. Returns false if it is
+// invalid, e.g. not written yet.
+bool ReadProgressShm(const ProgressShm* shm, ProgressShm& info);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_PROGRESS_SHM_H
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/progress_shm.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+#include "unsquashfs/extract_progress.h"
+
+namespace installer {
+namespace {
+
+TEST(ProgressShm, ReadProgressShm) {
+  const char kProgressFile[] = "/tmp/installer-unsquashfs-progress";
+  const std::string shm_file = GetProgressShmFile(kProgressFile);
+
+  {
+    ExtractProgress progress;
+    ASSERT_TRUE(progress.open(kProgressFile));
+    progress.setTotal(4, 1000);
+    progress.increase(0);
+    progress.increase(250);
+    progress.finish();
+  }
+
+  ProgressShm info;
+  ASSERT_TRUE(ReadProgressShm(shm_file, info));
+  EXPECT_EQ(info.progress, 100);
+  EXPECT_EQ(info.finished, 1);
+  EXPECT_EQ(info.files_done, 2);
+  EXPECT_EQ(info.files_total, 4);
+  EXPECT_EQ(info.bytes_done, 250);
+  EXPECT_EQ(info.bytes_total, 1000);
+  EXPECT_EQ(info.eta_seconds, 0);
+  EXPECT_EQ(info.sequence % 2, 0u);
+
+  // Text progress file is still written for old readers.
+  FILE* fp = fopen(kProgressFile, "r");
+  ASSERT_NE(fp, nullptr);
+  int value = 0;
+  EXPECT_EQ(fscanf(fp, "%d", &value), 1);
+  EXPECT_EQ(value, 100);
+  fclose(fp);
+
+  remove(kProgressFile);
+  remove(shm_file.c_str());
+  EXPECT_FALSE(ReadProgressShm(shm_file, info));
+}
+
+TEST(ProgressShm, MapProgressShm) {
+  const char kProgressFile[] = "/tmp/installer-unsquashfs-progress-map";
+  const std::string shm_file = GetProgressShmFile(kProgressFile);
+
+  // Reader maps the file before writer starts, and sees its updates.
+  const ProgressShm* shm = MapProgressShm(shm_file);
+  ASSERT_NE(shm, nullptr);
+  ProgressShm info;
+  EXPECT_FALSE(ReadProgressShm(shm, info));
+  {
+    ExtractProgress progress;
+    ASSERT_TRUE(progress.open(kProgressFile));
+    progress.setTotal(2, 100);
+    progress.increase(50);
+    progress.finish();
+  }
+  ASSERT_TRUE(ReadProgressShm(shm, info));
+  EXPECT_EQ(info.progress, 100);
+  EXPECT_EQ(info.files_done, 1);
+  EXPECT_EQ(info.bytes_done, 50);
+  UnmapProgressShm(shm);
+
+  remove(kProgressFile);
+  remove(shm_file.c_str());
+}
+
+TEST(ProgressShm, NotifyFifo) {
+  const char kProgressFile[] = "/tmp/installer-unsquashfs-progress-fifo";
+  const std::string fifo_file = GetProgressFifoFile(kProgressFile);
+  const int fd = OpenProgressFifo(fifo_file);
+  ASSERT_NE(fd, -1);
+  char buf[16];
+  EXPECT_EQ(read(fd, buf, sizeof(buf)), -1);
+  EXPECT_EQ(errno, EAGAIN);
+
+  {
+    ExtractProgress progress;
+    ASSERT_TRUE(progress.open(kProgressFile));
+    progress.setTotal(2, 0);
+    progress.increase(0);
+    progress.finish();
+  }
+  // First update and finish() are notified.
+  EXPECT_EQ(read(fd, buf, sizeof(buf)), 2);
+  DrainProgressFifo(fd);
+  // No end of file after writer exits.
+  EXPECT_EQ(read(fd, buf, sizeof(buf)), -1);
+  EXPECT_EQ(errno, EAGAIN);
+
+  close(fd);
+  remove(fifo_file.c_str());
+  remove(kProgressFile);
+  remove(GetProgressShmFile(kProgressFile).c_str());
+  // Writer does without FIFO if it does not exist.
+  EXPECT_EQ(ConnectProgressFifo(fifo_file), -1);
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/squashfs_decompressor.h"
+
+#include <lzma.h>
+#include <zlib.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "unsquashfs/squashfs_format.h"
+
+namespace installer {
+
+namespace {
+
+// Memory limit of xz and lzma decoder.
+const uint64_t kLzmaMemLimit = 64 * 1024 * 1024;
+
+class ZlibDecompressor : public SquashfsDecompressor {
+ public:
+  long decompress(const uint8_t* src, size_t src_len,
+                  uint8_t* dest, size_t dest_cap) const override {
+    uLongf dest_len = dest_cap;
+    if (uncompress(dest, &dest_len, src, src_len) != Z_OK) {
+      return -1;
+    }
+    return static_cast<long>(dest_len);
+  }
+
+  const char* name() const override { return "gzip"; }
+};
+
+class XzDecompressor : public SquashfsDecompressor {
+ public:
+  long decompress(const uint8_t* src, size_t src_len,
+                  uint8_t* dest, size_t dest_cap) const override {
+    uint64_t mem_limit = kLzmaMemLimit;
+    size_t src_pos = 0;
+    size_t dest_pos = 0;
+    const lzma_ret ret = lzma_stream_buffer_decode(&mem_limit, 0, nullptr,
+                                                   src, &src_pos, src_len,
+                                                   dest, &dest_pos, dest_cap);
+    if (ret != LZMA_OK || src_pos != src_len) {
+      return -1;
+    }
+    return static_cast<long>(dest_pos);
+  }
+
+  const char* name() const override { return "xz"; }
+};
+
+// Legacy lzma format, each block has a lzma_alone header.
+class LzmaDecompressor : public SquashfsDecompressor {
+ public:
+  long decompress(const uint8_t* src, size_t src_len,
+                  uint8_t* dest, size_t dest_cap) const override {
+    lzma_stream stream = LZMA_STREAM_INIT;
+    if (lzma_alone_decoder(&stream, kLzmaMemLimit) != LZMA_OK) {
+      return -1;
+    }
+    stream.next_in = src;
+    stream.avail_in = src_len;
+    stream.next_out = dest;
+    stream.avail_out = dest_cap;
+    const lzma_ret ret = lzma_code(&stream, LZMA_FINISH);
+    const size_t dest_len = dest_cap - stream.avail_out;
+    lzma_end(&stream);
+    if (ret != LZMA_STREAM_END && ret != LZMA_OK) {
+      return -1;
+    }
+    return static_cast<long>(dest_len);
+  }
+
+  const char* name() const override { return "lzma"; }
+};
+
+#ifdef HAVE_LZ4
+class Lz4Decompressor : public SquashfsDecompressor {
+ public:
+  long decompress(const uint8_t* src, size_t src_len,
+                  uint8_t* dest, size_t dest_cap) const override {
+    const int dest_len = LZ4_decompress_safe(
+        reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dest),
+        static_cast<int>(src_len), static_cast<int>(dest_cap));
+    return (dest_len < 0) ? -1 : dest_len;
+  }
+
+  const char* name() const override { return "lz4"; }
+};
+#endif
+
+#ifdef HAVE_ZSTD
+class ZstdDecompressor : public SquashfsDecompressor {
+ public:
+  long decompress(const uint8_t* src, size_t src_len,
+                  uint8_t* dest, size_t dest_cap) const override {
+    const size_t dest_len = ZSTD_decompress(dest, dest_cap, src, src_len);
+    if (ZSTD_isError(dest_len)) {
+      return -1;
+    }
+    return static_cast<long>(dest_len);
+  }
+
+  const char* name() const override { return "zstd"; }
+};
+#endif
+
+}  // namespace
+
+SquashfsDecompressor* CreateSquashfsDecompressor(int compression) {
+  switch (compression) {
+    case kSquashfsZlib: {
+      return new ZlibDecompressor();
+    }
+    case kSquashfsLzma: {
+      return new LzmaDecompressor();
+    }
+    case kSquashfsXz: {
+      return new XzDecompressor();
+    }
+#ifdef HAVE_LZ4
+    case kSquashfsLz4: {
+      return new Lz4Decompressor();
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case kSquashfsZstd: {
+      return new ZstdDecompressor();
+    }
+#endif
+    default: {
+      return nullptr;
+    }
+  }
+}
+
+}  // namespace installer
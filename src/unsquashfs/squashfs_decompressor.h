@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_SQUASHFS_DECOMPRESSOR_H
+#define INSTALLER_UNSQUASHFS_SQUASHFS_DECOMPRESSOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace installer {
+
+// Decompress one metadata block, data block or fragment of squashfs image.
+// Decompress() keeps no state between calls, so one object can be shared
+// by all worker threads.
+class SquashfsDecompressor {
+ public:
+  virtual ~SquashfsDecompressor() {}
+
+  // Decompress |src_len| bytes in |src| into |dest|, which can hold at most
+  // |dest_cap| bytes. Returns size of decompressed data, or -1 on error.
+  virtual long decompress(const uint8_t* src, size_t src_len,
+                          uint8_t* dest, size_t dest_cap) const = 0;
+
+  // Returns name of algorithm, used in log.
+  virtual const char* name() const = 0;
+};
+
+// Create decompressor of |compression| id in squashfs superblock.
+// Returns nullptr if that algorithm is not supported in this build.
+SquashfsDecompressor* CreateSquashfsDecompressor(int compression);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_SQUASHFS_DECOMPRESSOR_H
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/squashfs_format.h"
+
+namespace installer {
+
+bool ParseSquashfsSuperBlock(const uint8_t* buf, SquashfsSuperBlock& sb) {
+  sb.magic = SquashfsLe32(buf);
+  sb.inodes = SquashfsLe32(buf + 4);
+  sb.mkfs_time = SquashfsLe32(buf + 8);
+  sb.block_size = SquashfsLe32(buf + 12);
+  sb.fragments = SquashfsLe32(buf + 16);
+  sb.compression = SquashfsLe16(buf + 20);
+  sb.block_log = SquashfsLe16(buf + 22);
+  sb.flags = SquashfsLe16(buf + 24);
+  sb.no_ids = SquashfsLe16(buf + 26);
+  sb.major = SquashfsLe16(buf + 28);
+  sb.minor = SquashfsLe16(buf + 30);
+  sb.root_inode = SquashfsLe64(buf + 32);
+  sb.bytes_used = SquashfsLe64(buf + 40);
+  sb.id_table_start = SquashfsLe64(buf + 48);
+  sb.xattr_id_table_start = SquashfsLe64(buf + 56);
+  sb.inode_table_start = SquashfsLe64(buf + 64);
+  sb.directory_table_start = SquashfsLe64(buf + 72);
+  sb.fragment_table_start = SquashfsLe64(buf + 80);
+  sb.lookup_table_start = SquashfsLe64(buf + 88);
+
+  if (sb.magic != kSquashfsMagic || sb.major != kSquashfsMajor) {
+    return false;
+  }
+  if (sb.block_size == 0 || sb.block_size > kSquashfsMaxBlockSize ||
+      (1U << sb.block_log) != sb.block_size) {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace installer
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// On-disk layout of squashfs 4.0 filesystem.
+// See fs/squashfs/squashfs_fs.h in linux kernel source for more information.
+// All fields are stored in little endian.
+
+#ifndef INSTALLER_UNSQUASHFS_SQUASHFS_FORMAT_H
+#define INSTALLER_UNSQUASHFS_SQUASHFS_FORMAT_H
+
+#include <stdint.h>
+
+namespace installer {
+
+const uint32_t kSquashfsMagic = 0x73717368;  // "hsqs"
+const uint16_t kSquashfsMajor = 4;
+
+// Size of superblock.
+const int kSquashfsSuperBlockSize = 96;
+
+// Uncompressed size of each metadata block.
+const int kSquashfsMetadataSize = 8192;
+// Bit set in the 16-bit header of a metadata block if it is not compressed.
+const uint16_t kSquashfsMetadataUncompressed = 0x8000;
+
+// Bit set in block size of a data block or fragment if it is not compressed.
+const uint32_t kSquashfsDataUncompressed = 1 << 24;
+// Largest data block.
+const uint32_t kSquashfsMaxBlockSize = 1024 * 1024;
+
+// Value of fragment index in inode if file has no fragment.
+const uint32_t kSquashfsInvalidFragment = 0xFFFFFFFF;
+// Value of xattr index in inode if file has no xattr.
+const uint32_t kSquashfsInvalidXattr = 0xFFFFFFFF;
+// Value of table offset in superblock if that table does not exist.
+const uint64_t kSquashfsInvalidTable = 0xFFFFFFFFFFFFFFFFULL;
+
+// Compression algorithms.
+enum SquashfsCompression {
+  kSquashfsZlib = 1,
+  kSquashfsLzma = 2,
+  kSquashfsLzo = 3,
+  kSquashfsXz = 4,
+  kSquashfsLz4 = 5,
+  kSquashfsZstd = 6,
+};
+
+// Inode types. Extended types are basic types plus 7.
+enum SquashfsInodeType {
+  kSquashfsDirType = 1,
+  kSquashfsRegType = 2,
+  kSquashfsSymlinkType = 3,
+  kSquashfsBlkdevType = 4,
+  kSquashfsChrdevType = 5,
+  kSquashfsFifoType = 6,
+  kSquashfsSocketType = 7,
+  kSquashfsLDirType = 8,
+  kSquashfsLRegType = 9,
+  kSquashfsLSymlinkType = 10,
+  kSquashfsLBlkdevType = 11,
+  kSquashfsLChrdevType = 12,
+  kSquashfsLFifoType = 13,
+  kSquashfsLSocketType = 14,
+};
+
+// Xattr name prefixes, stored in lower bits of xattr type.
+const uint16_t kSquashfsXattrPrefixMask = 0x00FF;
+// Bit set in xattr type if its value is stored out of line.
+const uint16_t kSquashfsXattrValueOol = 0x0100;
+
+// Size of each entry in fragment table and xattr id table.
+const int kSquashfsFragmentEntrySize = 16;
+const int kSquashfsXattrIdEntrySize = 16;
+
+struct SquashfsSuperBlock {
+  uint32_t magic = 0;
+  uint32_t inodes = 0;
+  uint32_t mkfs_time = 0;
+  uint32_t block_size = 0;
+  uint32_t fragments = 0;
+  uint16_t compression = 0;
+  uint16_t block_log = 0;
+  uint16_t flags = 0;
+  uint16_t no_ids = 0;
+  uint16_t major = 0;
+  uint16_t minor = 0;
+  uint64_t root_inode = 0;
+  uint64_t bytes_used = 0;
+  uint64_t id_table_start = 0;
+  uint64_t xattr_id_table_start = 0;
+  uint64_t inode_table_start = 0;
+  uint64_t directory_table_start = 0;
+  uint64_t fragment_table_start = 0;
+  uint64_t lookup_table_start = 0;
+};
+
+inline uint16_t SquashfsLe16(const uint8_t* p) {
+  return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t SquashfsLe32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) |
+         (static_cast<uint32_t>(p[1]) << 8) |
+         (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t SquashfsLe64(const uint8_t* p) {
+  return static_cast<uint64_t>(SquashfsLe32(p)) |
+         (static_cast<uint64_t>(SquashfsLe32(p + 4)) << 32);
+}
+
+// Parse superblock from the first |kSquashfsSuperBlockSize| bytes of image.
+// Returns false if magic number or version does not match.
+bool ParseSquashfsSuperBlock(const uint8_t* buf, SquashfsSuperBlock& sb);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_SQUASHFS_FORMAT_H
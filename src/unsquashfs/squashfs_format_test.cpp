@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/squashfs_format.h"
+
+#include <string.h>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+void PutLe32(uint8_t* p, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    p[i] = static_cast<uint8_t>(value >> (i * 8));
+  }
+}
+
+TEST(SquashfsFormat, ParseSuperBlock) {
+  uint8_t buf[kSquashfsSuperBlockSize];
+  memset(buf, 0, sizeof(buf));
+  PutLe32(buf, kSquashfsMagic);
+  PutLe32(buf + 4, 250000);  // inodes
+  PutLe32(buf + 12, 131072);  // block_size
+  buf[20] = kSquashfsXz;
+  buf[22] = 17;  // block_log
+  buf[28] = 4;  // major
+
+  SquashfsSuperBlock sb;
+  EXPECT_TRUE(ParseSquashfsSuperBlock(buf, sb));
+  EXPECT_EQ(sb.inodes, 250000u);
+  EXPECT_EQ(sb.block_size, 131072u);
+  EXPECT_EQ(sb.compression, kSquashfsXz);
+
+  // Block size does not match block_log.
+  buf[22] = 16;
+  EXPECT_FALSE(ParseSquashfsSuperBlock(buf, sb));
+
+  // Squashfs 3.x is not supported.
+  buf[22] = 17;
+  buf[28] = 3;
+  EXPECT_FALSE(ParseSquashfsSuperBlock(buf, sb));
+}
+
+}  // namespace
+}  // namespace installer
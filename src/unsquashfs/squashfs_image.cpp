@@ -0,0 +1,823 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/squashfs_image.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "unsquashfs/squashfs_decompressor.h"
+
+namespace installer {
+
+namespace {
+
+// Default number of decompressed fragment blocks kept in memory.
+const size_t kFragmentCacheSize = 64;
+
+// Names of xattr prefixes, indexed by xattr type.
+const char* const kXattrPrefixes[] = { "user.", "trusted.", "security." };
+
+// Reads little endian values from a memory range with bounds checking.
+// Once out of range, all later reads return 0 and ok() returns false.
+class ByteReader {
+ public:
+  ByteReader(const uint8_t* data, size_t len) : data_(data), left_(len) {
+  }
+
+  bool ok() const { return ok_; }
+  size_t left() const { return left_; }
+
+  uint16_t u16() {
+    const uint8_t* p = this->skip(2);
+    return p ? SquashfsLe16(p) : 0;
+  }
+
+  uint32_t u32() {
+    const uint8_t* p = this->skip(4);
+    return p ? SquashfsLe32(p) : 0;
+  }
+
+  uint64_t u64() {
+    const uint8_t* p = this->skip(8);
+    return p ? SquashfsLe64(p) : 0;
+  }
+
+  std::string str(size_t len) {
+    const uint8_t* p = this->skip(len);
+    return p ? std::string(reinterpret_cast<const char*>(p), len) :
+               std::string();
+  }
+
+  // Returns pointer to current position and moves forward |len| bytes.
+  const uint8_t* skip(size_t len) {
+    if (!ok_ || len > left_) {
+      ok_ = false;
+      return nullptr;
+    }
+    const uint8_t* p = data_;
+    data_ += len;
+    left_ -= len;
+    return p;
+  }
+
+ private:
+  const uint8_t* data_;
+  size_t left_;
+  bool ok_ = true;
+};
+
+mode_t InodeTypeToMode(int type) {
+  switch (type) {
+    case kSquashfsDirType: {
+      return S_IFDIR;
+    }
+    case kSquashfsRegType: {
+      return S_IFREG;
+    }
+    case kSquashfsSymlinkType: {
+      return S_IFLNK;
+    }
+    case kSquashfsBlkdevType: {
+      return S_IFBLK;
+    }
+    case kSquashfsChrdevType: {
+      return S_IFCHR;
+    }
+    case kSquashfsFifoType: {
+      return S_IFIFO;
+    }
+    case kSquashfsSocketType: {
+      return S_IFSOCK;
+    }
+    default: {
+      return 0;
+    }
+  }
+}
+
+}  // namespace
+
+SquashfsImage::SquashfsImage()
+    : fragment_cache_size_(kFragmentCacheSize) {
+}
+
+SquashfsImage::~SquashfsImage() {
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+bool SquashfsImage::open(const std::string& path) {
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ == -1) {
+    fprintf(stderr, "SquashfsImage::open() failed to open %s: %s\n",
+            path.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    return false;
+  }
+  file_size_ = static_cast<uint64_t>(st.st_size);
+
+  uint8_t buf[kSquashfsSuperBlockSize];
+  if (!readAt(0, buf, sizeof(buf)) || !ParseSquashfsSuperBlock(buf, sb_)) {
+    fprintf(stderr, "SquashfsImage::open() invalid superblock: %s\n",
+            path.c_str());
+    return false;
+  }
+  if (sb_.bytes_used > file_size_) {
+    fprintf(stderr, "SquashfsImage::open() image is truncated: %s\n",
+            path.c_str());
+    return false;
+  }
+
+  decompressor_.reset(CreateSquashfsDecompressor(sb_.compression));
+  if (!decompressor_) {
+    fprintf(stderr, "SquashfsImage::open() unsupported compression: %d\n",
+            sb_.compression);
+    return false;
+  }
+
+  // Collect start offsets of all tables. Metadata blocks of fragment, id,
+  // export and xattr tables are stored before their index arrays.
+  const uint64_t starts[] = {
+      sb_.inode_table_start, sb_.directory_table_start,
+      sb_.fragment_table_start, sb_.lookup_table_start,
+      sb_.id_table_start, sb_.xattr_id_table_start, sb_.bytes_used,
+  };
+  for (uint64_t start : starts) {
+    if (start != kSquashfsInvalidTable) {
+      table_starts_.push_back(start);
+    }
+  }
+  const uint64_t indexes[] = {
+      sb_.fragments > 0 ? sb_.fragment_table_start : kSquashfsInvalidTable,
+      sb_.lookup_table_start, sb_.id_table_start,
+  };
+  for (uint64_t index : indexes) {
+    uint8_t location[8];
+    if (index != kSquashfsInvalidTable && readAt(index, location, 8)) {
+      table_starts_.push_back(SquashfsLe64(location));
+    }
+  }
+  if (sb_.xattr_id_table_start != kSquashfsInvalidTable) {
+    uint8_t header[24];
+    if (!readAt(sb_.xattr_id_table_start, header, sizeof(header))) {
+      return false;
+    }
+    xattr_table_start_ = SquashfsLe64(header);
+    table_starts_.push_back(xattr_table_start_);
+    if (SquashfsLe32(header + 8) > 0) {
+      table_starts_.push_back(SquashfsLe64(header + 16));
+    }
+  }
+
+  if (!loadMetadataTable(sb_.inode_table_start, sb_.directory_table_start,
+                         inode_table_)) {
+    fprintf(stderr, "SquashfsImage::open() failed to read inode table\n");
+    return false;
+  }
+  if (!loadMetadataTable(sb_.directory_table_start,
+                         tableEnd(sb_.directory_table_start), dir_table_)) {
+    fprintf(stderr, "SquashfsImage::open() failed to read directory table\n");
+    return false;
+  }
+  if (!loadIdTable() || !loadFragmentTable() || !loadXattrTable()) {
+    return false;
+  }
+
+  return true;
+}
+
+const char* SquashfsImage::compressionName() const {
+  return decompressor_ ? decompressor_->name() : "unknown";
+}
+
+bool SquashfsImage::readRootInode(SquashfsInode& inode) const {
+  return readInode(sb_.root_inode, inode);
+}
+
+bool SquashfsImage::readInode(uint64_t inode_ref,
+                              SquashfsInode& inode) const {
+  const long pos = locate(inode_table_, inode_ref >> 16, inode_ref & 0xFFFF);
+  if (pos < 0) {
+    fprintf(stderr, "SquashfsImage::readInode() invalid inode: %llx\n",
+            static_cast<unsigned long long>(inode_ref));
+    return false;
+  }
+  size_t next_pos;
+  return parseInode(static_cast<size_t>(pos), inode, next_pos);
+}
+
+bool SquashfsImage::countInodes(uint64_t& num_inodes,
+                                uint64_t& file_bytes) const {
+  num_inodes = 0;
+  file_bytes = 0;
+  // Inodes are packed one after another in inode table.
+  SquashfsInode inode;
+  size_t pos = 0;
+  while (pos < inode_table_.data.size()) {
+    if (!parseInode(pos, inode, pos)) {
+      return false;
+    }
+    num_inodes++;
+    if (inode.type == kSquashfsRegType) {
+      file_bytes += inode.file_size;
+    }
+  }
+  return true;
+}
+
+bool SquashfsImage::parseInode(size_t pos, SquashfsInode& inode,
+                               size_t& next_pos) const {
+  ByteReader reader(inode_table_.data.data() + pos,
+                    inode_table_.data.size() - pos);
+  const int type = reader.u16();
+  const uint16_t mode = reader.u16();
+  const uint16_t uid_index = reader.u16();
+  const uint16_t gid_index = reader.u16();
+  inode.mtime = reader.u32();
+  inode.inode_number = reader.u32();
+  inode.xattr = kSquashfsInvalidXattr;
+  inode.nlink = 1;
+
+  switch (type) {
+    case kSquashfsDirType: {
+      inode.dir_start_block = reader.u32();
+      inode.nlink = reader.u32();
+      inode.file_size = reader.u16();
+      inode.dir_offset = reader.u16();
+      reader.u32();  // parent inode
+      break;
+    }
+    case kSquashfsLDirType: {
+      inode.nlink = reader.u32();
+      inode.file_size = reader.u32();
+      inode.dir_start_block = reader.u32();
+      reader.u32();  // parent inode
+      const uint16_t index_count = reader.u16();
+      inode.dir_offset = reader.u16();
+      inode.xattr = reader.u32();
+      // Skip directory index: index, start block, name size and name.
+      for (uint16_t i = 0; i < index_count && reader.ok(); ++i) {
+        reader.u32();
+        reader.u32();
+        const uint32_t name_size = reader.u32();
+        reader.skip(name_size + 1);
+      }
+      break;
+    }
+    case kSquashfsRegType:
+    case kSquashfsLRegType: {
+      if (type == kSquashfsRegType) {
+        inode.start_block = reader.u32();
+        inode.fragment = reader.u32();
+        inode.fragment_offset = reader.u32();
+        inode.file_size = reader.u32();
+      } else {
+        inode.start_block = reader.u64();
+        inode.file_size = reader.u64();
+        reader.u64();  // sparse
+        inode.nlink = reader.u32();
+        inode.fragment = reader.u32();
+        inode.fragment_offset = reader.u32();
+        inode.xattr = reader.u32();
+      }
+      uint64_t num_blocks = inode.file_size / sb_.block_size;
+      if (inode.fragment == kSquashfsInvalidFragment &&
+          inode.file_size % sb_.block_size != 0) {
+        num_blocks++;
+      }
+      if (num_blocks * 4 > reader.left()) {
+        fprintf(stderr, "SquashfsImage::readInode() invalid block list\n");
+        return false;
+      }
+      inode.block_sizes.resize(num_blocks);
+      for (uint64_t i = 0; i < num_blocks; ++i) {
+        inode.block_sizes[i] = reader.u32();
+      }
+      break;
+    }
+    case kSquashfsSymlinkType:
+    case kSquashfsLSymlinkType: {
+      inode.nlink = reader.u32();
+      const uint32_t target_len = reader.u32();
+      inode.symlink = reader.str(target_len);
+      inode.file_size = target_len;
+      if (type == kSquashfsLSymlinkType) {
+        inode.xattr = reader.u32();
+      }
+      break;
+    }
+    case kSquashfsBlkdevType:
+    case kSquashfsChrdevType:
+    case kSquashfsLBlkdevType:
+    case kSquashfsLChrdevType: {
+      inode.nlink = reader.u32();
+      const uint32_t rdev = reader.u32();
+      inode.rdev = makedev((rdev >> 8) & 0xFFF,
+                           (rdev & 0xFF) | ((rdev >> 12) & 0xFFF00));
+      if (type > kSquashfsSocketType) {
+        inode.xattr = reader.u32();
+      }
+      break;
+    }
+    case kSquashfsFifoType:
+    case kSquashfsSocketType:
+    case kSquashfsLFifoType:
+    case kSquashfsLSocketType: {
+      inode.nlink = reader.u32();
+      if (type > kSquashfsSocketType) {
+        inode.xattr = reader.u32();
+      }
+      break;
+    }
+    default: {
+      fprintf(stderr, "SquashfsImage::readInode() unknown inode type: %d\n",
+              type);
+      return false;
+    }
+  }
+
+  if (!reader.ok() || uid_index >= ids_.size() || gid_index >= ids_.size()) {
+    fprintf(stderr, "SquashfsImage::readInode() corrupted inode: %u\n",
+            inode.inode_number);
+    return false;
+  }
+
+  next_pos = inode_table_.data.size() - reader.left();
+  inode.type = (type > kSquashfsSocketType) ? (type - 7) : type;
+  inode.mode = InodeTypeToMode(inode.type) | (mode & 07777);
+  inode.uid = ids_[uid_index];
+  inode.gid = ids_[gid_index];
+  return true;
+}
+
+bool SquashfsImage::readDir(const SquashfsInode& dir,
+                            std::vector<SquashfsDirEntry>& entries) const {
+  entries.clear();
+  // Size of directory listing includes 3 bytes for "." and "..".
+  if (dir.file_size <= 3) {
+    return true;
+  }
+  const long pos = locate(dir_table_, dir.dir_start_block, dir.dir_offset);
+  if (pos < 0 ||
+      dir_table_.data.size() - static_cast<size_t>(pos) < dir.file_size - 3) {
+    fprintf(stderr, "SquashfsImage::readDir() invalid directory: %u\n",
+            dir.inode_number);
+    return false;
+  }
+
+  ByteReader reader(dir_table_.data.data() + pos, dir.file_size - 3);
+  while (reader.ok() && reader.left() > 0) {
+    const uint32_t count = reader.u32() + 1;
+    const uint32_t start_block = reader.u32();
+    const uint32_t inode_number = reader.u32();
+    for (uint32_t i = 0; i < count && reader.ok(); ++i) {
+      SquashfsDirEntry entry;
+      const uint16_t offset = reader.u16();
+      const int16_t inode_offset = static_cast<int16_t>(reader.u16());
+      entry.type = reader.u16();
+      const uint32_t name_len = reader.u16() + 1U;
+      entry.name = reader.str(name_len);
+      entry.inode_ref = (static_cast<uint64_t>(start_block) << 16) | offset;
+      entry.inode_number = inode_number + inode_offset;
+      entries.push_back(entry);
+    }
+  }
+
+  if (!reader.ok()) {
+    fprintf(stderr, "SquashfsImage::readDir() corrupted directory: %u\n",
+            dir.inode_number);
+    return false;
+  }
+  return true;
+}
+
+bool SquashfsImage::lookup(const std::string& path,
+                           SquashfsInode& inode) const {
+  if (!readRootInode(inode)) {
+    return false;
+  }
+  std::vector<SquashfsDirEntry> entries;
+  size_t start = 0;
+  while (start < path.size()) {
+    size_t end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+    if (end > start) {
+      if (inode.type != kSquashfsDirType || !readDir(inode, entries)) {
+        return false;
+      }
+      const std::string name = path.substr(start, end - start);
+      auto it = std::find_if(entries.begin(), entries.end(),
+                             [&name](const SquashfsDirEntry& entry) {
+                               return entry.name == name;
+                             });
+      if (it == entries.end() || !readInode(it->inode_ref, inode)) {
+        return false;
+      }
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+bool SquashfsImage::readFile(const SquashfsInode& inode,
+                             std::string& content) const {
+  content.clear();
+  if (inode.type != kSquashfsRegType) {
+    return false;
+  }
+  content.resize(static_cast<size_t>(inode.file_size));
+  std::vector<uint8_t> block(sb_.block_size);
+  uint64_t offset = inode.start_block;
+  size_t pos = 0;
+  for (uint32_t size_field : inode.block_sizes) {
+    const size_t len = std::min<size_t>(sb_.block_size, content.size() - pos);
+    // Sparse blocks are left as zeros.
+    if (size_field != 0) {
+      if (readDataBlock(offset, size_field, block.data()) <
+          static_cast<long>(len)) {
+        return false;
+      }
+      memcpy(&content[pos], block.data(), len);
+    }
+    offset += size_field & ~kSquashfsDataUncompressed;
+    pos += len;
+  }
+  if (pos < content.size()) {
+    const std::shared_ptr<const std::vector<uint8_t>> fragment =
+        readFragment(inode.fragment);
+    const size_t len = content.size() - pos;
+    if (!fragment || inode.fragment_offset + len > fragment->size()) {
+      return false;
+    }
+    memcpy(&content[pos], fragment->data() + inode.fragment_offset, len);
+  }
+  return true;
+}
+
+bool SquashfsImage::readXattrs(uint32_t xattr,
+                               std::vector<SquashfsXattr>& xattrs) const {
+  xattrs.clear();
+  if (xattr == kSquashfsInvalidXattr) {
+    return true;
+  }
+  const size_t id_pos = static_cast<size_t>(xattr) * kSquashfsXattrIdEntrySize;
+  if (id_pos + kSquashfsXattrIdEntrySize > xattr_ids_.size()) {
+    return false;
+  }
+  const uint64_t ref = SquashfsLe64(&xattr_ids_[id_pos]);
+  const uint32_t count = SquashfsLe32(&xattr_ids_[id_pos + 8]);
+
+  const long pos = locate(xattr_table_, ref >> 16, ref & 0xFFFF);
+  if (pos < 0) {
+    return false;
+  }
+  const std::vector<uint8_t>& data = xattr_table_.data;
+  ByteReader reader(data.data() + pos, data.size() - static_cast<size_t>(pos));
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint16_t type = reader.u16();
+    const uint16_t name_len = reader.u16();
+    const std::string name = reader.str(name_len);
+    const uint32_t value_len = reader.u32();
+    std::string value;
+    if (type & kSquashfsXattrValueOol) {
+      // Value is stored elsewhere, only its reference is kept here.
+      const uint64_t value_ref = reader.u64();
+      const long value_pos = locate(xattr_table_, value_ref >> 16,
+                                    value_ref & 0xFFFF);
+      if (value_len != 8 || value_pos < 0) {
+        return false;
+      }
+      ByteReader value_reader(data.data() + value_pos,
+                              data.size() - static_cast<size_t>(value_pos));
+      value = value_reader.str(value_reader.u32());
+      if (!value_reader.ok()) {
+        return false;
+      }
+    } else {
+      value = reader.str(value_len);
+    }
+
+    const uint16_t prefix = type & kSquashfsXattrPrefixMask;
+    if (!reader.ok() || prefix > 2) {
+      return false;
+    }
+    xattrs.push_back(SquashfsXattr(kXattrPrefixes[prefix] + name, value));
+  }
+  return true;
+}
+
+long SquashfsImage::readDataBlock(uint64_t offset, uint32_t size_field,
+                                  uint8_t* dest) const {
+  const bool compressed = !(size_field & kSquashfsDataUncompressed);
+  const uint32_t len = size_field & ~kSquashfsDataUncompressed;
+  if (len == 0 || len > sb_.block_size) {
+    return -1;
+  }
+  if (!compressed) {
+    return readAt(offset, dest, len) ? len : -1;
+  }
+
+  // Buffer of compressed data, reused by each worker thread.
+  thread_local std::vector<uint8_t> buf;
+  buf.resize(len);
+  if (!readAt(offset, buf.data(), len)) {
+    return -1;
+  }
+  return decompressor_->decompress(buf.data(), len, dest, sb_.block_size);
+}
+
+std::shared_ptr<const std::vector<uint8_t>> SquashfsImage::readFragment(
+    uint32_t index) const {
+  if (index >= fragments_.size()) {
+    return nullptr;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(fragment_mutex_);
+    fragment_stats_.lookups++;
+    // Wait if another worker is decompressing the same block.
+    fragment_cond_.wait(lock, [this, index]() {
+      return fragment_loading_.count(index) == 0;
+    });
+    for (auto it = fragment_cache_.begin(); it != fragment_cache_.end(); ++it) {
+      if (it->first == index) {
+        fragment_cache_.splice(fragment_cache_.begin(), fragment_cache_, it);
+        return it->second;
+      }
+    }
+    fragment_loading_.insert(index);
+  }
+
+  const FragmentEntry& entry = fragments_[index];
+  std::shared_ptr<std::vector<uint8_t>> data(
+      new std::vector<uint8_t>(sb_.block_size));
+  const long len = readDataBlock(entry.start, entry.size, data->data());
+
+  std::lock_guard<std::mutex> lock(fragment_mutex_);
+  fragment_loading_.erase(index);
+  fragment_cond_.notify_all();
+  if (len < 0) {
+    fprintf(stderr, "SquashfsImage::readFragment() failed to read: %u\n",
+            index);
+    return nullptr;
+  }
+  data->resize(static_cast<size_t>(len));
+
+  fragment_stats_.reads++;
+  if (fragment_read_[index]) {
+    fragment_stats_.rereads++;
+  }
+  fragment_read_[index] = true;
+  fragment_cache_.push_front(FragmentCacheItem(index, data));
+  if (fragment_cache_.size() > fragment_cache_size_) {
+    fragment_cache_.pop_back();
+  }
+  return data;
+}
+
+SquashfsFragmentStats SquashfsImage::fragmentStats() const {
+  std::lock_guard<std::mutex> lock(fragment_mutex_);
+  return fragment_stats_;
+}
+
+void SquashfsImage::dataRange(const SquashfsInode& inode, uint64_t& start,
+                              uint64_t& end) const {
+  start = 0;
+  end = 0;
+  if (!inode.block_sizes.empty()) {
+    start = inode.start_block;
+    end = start;
+    for (uint32_t size : inode.block_sizes) {
+      end += size & ~kSquashfsDataUncompressed;
+    }
+  } else if (inode.fragment < fragments_.size()) {
+    const FragmentEntry& entry = fragments_[inode.fragment];
+    start = entry.start;
+    end = start + (entry.size & ~kSquashfsDataUncompressed);
+  }
+}
+
+void SquashfsImage::readahead(uint64_t offset, uint64_t len) const {
+  // Only a hint, errors are ignored.
+  posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(len),
+                POSIX_FADV_WILLNEED);
+}
+
+void SquashfsImage::dropCache(uint64_t offset, uint64_t len) const {
+  if (len > 0) {
+    posix_fadvise(fd_, static_cast<off_t>(offset), static_cast<off_t>(len),
+                  POSIX_FADV_DONTNEED);
+  }
+}
+
+void SquashfsImage::setFragmentCacheSize(size_t size) {
+  std::lock_guard<std::mutex> lock(fragment_mutex_);
+  fragment_cache_size_ = size;
+  while (fragment_cache_.size() > fragment_cache_size_) {
+    fragment_cache_.pop_back();
+  }
+}
+
+bool SquashfsImage::readAt(uint64_t offset, void* buf, size_t len) const {
+  uint8_t* p = static_cast<uint8_t*>(buf);
+  while (len > 0) {
+    const ssize_t num_read = pread(fd_, p, len, static_cast<off_t>(offset));
+    if (num_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num_read <= 0) {
+      fprintf(stderr, "SquashfsImage::readAt() failed at %llu: %s\n",
+              static_cast<unsigned long long>(offset),
+              num_read < 0 ? strerror(errno) : "end of file");
+      return false;
+    }
+    p += num_read;
+    offset += static_cast<uint64_t>(num_read);
+    len -= static_cast<size_t>(num_read);
+  }
+  return true;
+}
+
+bool SquashfsImage::readMetadataBlock(uint64_t offset,
+                                      std::vector<uint8_t>& data,
+                                      uint64_t& next) const {
+  uint8_t header[2];
+  if (!readAt(offset, header, sizeof(header))) {
+    return false;
+  }
+  const uint16_t size_field = SquashfsLe16(header);
+  const bool compressed = !(size_field & kSquashfsMetadataUncompressed);
+  const size_t len = size_field & ~kSquashfsMetadataUncompressed;
+  if (len == 0 || len > kSquashfsMetadataSize) {
+    fprintf(stderr, "SquashfsImage: invalid metadata block at %llu\n",
+            static_cast<unsigned long long>(offset));
+    return false;
+  }
+  next = offset + 2 + len;
+
+  uint8_t buf[kSquashfsMetadataSize];
+  if (!readAt(offset + 2, buf, len)) {
+    return false;
+  }
+  if (!compressed) {
+    data.insert(data.end(), buf, buf + len);
+    return true;
+  }
+
+  uint8_t block[kSquashfsMetadataSize];
+  const long block_len = decompressor_->decompress(buf, len, block,
+                                                   sizeof(block));
+  if (block_len < 0) {
+    fprintf(stderr, "SquashfsImage: failed to decompress metadata at %llu\n",
+            static_cast<unsigned long long>(offset));
+    return false;
+  }
+  data.insert(data.end(), block, block + block_len);
+  return true;
+}
+
+bool SquashfsImage::loadMetadataTable(uint64_t start, uint64_t end,
+                                      MetadataTable& table) const {
+  uint64_t offset = start;
+  while (offset < end) {
+    table.blocks[offset - start] = table.data.size();
+    if (!readMetadataBlock(offset, table.data, offset)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SquashfsImage::loadIndexedTable(uint64_t index_start, size_t num_bytes,
+                                     std::vector<uint8_t>& data) const {
+  const size_t num_blocks = (num_bytes + kSquashfsMetadataSize - 1) /
+                            kSquashfsMetadataSize;
+  std::vector<uint8_t> index(num_blocks * 8);
+  if (!readAt(index_start, index.data(), index.size())) {
+    return false;
+  }
+  data.clear();
+  for (size_t i = 0; i < num_blocks; ++i) {
+    uint64_t next;
+    if (!readMetadataBlock(SquashfsLe64(&index[i * 8]), data, next)) {
+      return false;
+    }
+  }
+  if (data.size() < num_bytes) {
+    return false;
+  }
+  data.resize(num_bytes);
+  return true;
+}
+
+long SquashfsImage::locate(const MetadataTable& table, uint64_t block,
+                           uint32_t offset) const {
+  const auto it = table.blocks.find(block);
+  if (it == table.blocks.end()) {
+    return -1;
+  }
+  const size_t pos = it->second + offset;
+  if (pos >= table.data.size()) {
+    return -1;
+  }
+  return static_cast<long>(pos);
+}
+
+uint64_t SquashfsImage::tableEnd(uint64_t start) const {
+  uint64_t end = sb_.bytes_used;
+  for (uint64_t table_start : table_starts_) {
+    if (table_start > start && table_start < end) {
+      end = table_start;
+    }
+  }
+  return end;
+}
+
+bool SquashfsImage::loadIdTable() {
+  std::vector<uint8_t> data;
+  if (sb_.no_ids == 0 ||
+      !loadIndexedTable(sb_.id_table_start, sb_.no_ids * 4U, data)) {
+    fprintf(stderr, "SquashfsImage::open() failed to read id table\n");
+    return false;
+  }
+  ids_.resize(sb_.no_ids);
+  for (size_t i = 0; i < ids_.size(); ++i) {
+    ids_[i] = SquashfsLe32(&data[i * 4]);
+  }
+  return true;
+}
+
+bool SquashfsImage::loadFragmentTable() {
+  if (sb_.fragments == 0 ||
+      sb_.fragment_table_start == kSquashfsInvalidTable) {
+    return true;
+  }
+  std::vector<uint8_t> data;
+  if (!loadIndexedTable(sb_.fragment_table_start,
+                        sb_.fragments * size_t(kSquashfsFragmentEntrySize),
+                        data)) {
+    fprintf(stderr, "SquashfsImage::open() failed to read fragment table\n");
+    return false;
+  }
+  fragments_.resize(sb_.fragments);
+  fragment_read_.assign(sb_.fragments, false);
+  for (size_t i = 0; i < fragments_.size(); ++i) {
+    const uint8_t* entry = &data[i * kSquashfsFragmentEntrySize];
+    fragments_[i].start = SquashfsLe64(entry);
+    fragments_[i].size = SquashfsLe32(entry + 8);
+  }
+  return true;
+}
+
+bool SquashfsImage::loadXattrTable() {
+  if (sb_.xattr_id_table_start == kSquashfsInvalidTable) {
+    return true;
+  }
+  uint8_t header[16];
+  if (!readAt(sb_.xattr_id_table_start, header, sizeof(header))) {
+    return false;
+  }
+  const uint32_t num_ids = SquashfsLe32(header + 8);
+  if (num_ids == 0) {
+    return true;
+  }
+  if (!loadIndexedTable(sb_.xattr_id_table_start + sizeof(header),
+                        num_ids * size_t(kSquashfsXattrIdEntrySize),
+                        xattr_ids_) ||
+      !loadMetadataTable(xattr_table_start_, tableEnd(xattr_table_start_),
+                         xattr_table_)) {
+    fprintf(stderr, "SquashfsImage::open() failed to read xattr table\n");
+    return false;
+  }
+  return true;
+}
+
+}  // namespace installer
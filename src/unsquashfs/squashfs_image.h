@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_SQUASHFS_IMAGE_H
+#define INSTALLER_UNSQUASHFS_SQUASHFS_IMAGE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "unsquashfs/squashfs_format.h"
+
+namespace installer {
+
+class SquashfsDecompressor;
+
+// Inode read from inode table. Extended inode types are folded into
+// basic ones.
+struct SquashfsInode {
+  // Basic inode type, kSquashfsDirType ... kSquashfsSocketType.
+  int type = 0;
+  // File type and permission bits, same as st_mode.
+  mode_t mode = 0;
+  uid_t uid = 0;
+  gid_t gid = 0;
+  uint32_t mtime = 0;
+  uint32_t inode_number = 0;
+  uint32_t nlink = 1;
+  // Index into xattr id table, or kSquashfsInvalidXattr.
+  uint32_t xattr = kSquashfsInvalidXattr;
+
+  // Size of regular file, or size of directory listing.
+  uint64_t file_size = 0;
+
+  // Regular file only.
+  uint64_t start_block = 0;
+  uint32_t fragment = kSquashfsInvalidFragment;
+  uint32_t fragment_offset = 0;
+  std::vector<uint32_t> block_sizes;
+
+  // Directory only, location of its listing in directory table.
+  uint32_t dir_start_block = 0;
+  uint16_t dir_offset = 0;
+
+  // Symbolic link only.
+  std::string symlink;
+
+  // Block and character device only.
+  dev_t rdev = 0;
+};
+
+struct SquashfsDirEntry {
+  std::string name;
+  // Reference to inode, (block << 16 | offset) in inode table.
+  uint64_t inode_ref = 0;
+  uint32_t inode_number = 0;
+  int type = 0;
+};
+
+typedef std::pair<std::string, std::string> SquashfsXattr;
+
+// Counters of fragment block cache.
+struct SquashfsFragmentStats {
+  // Calls of readFragment().
+  uint64_t lookups = 0;
+  // Fragment blocks decompressed.
+  uint64_t reads = 0;
+  // Fragment blocks decompressed more than once, after they were evicted
+  // from cache or by several workers at the same time.
+  uint64_t rereads = 0;
+};
+
+// Reads squashfs image without mounting it.
+// Inode, directory, id, fragment and xattr tables are decompressed into memory
+// in open(), so that all other const methods are thread safe.
+class SquashfsImage {
+ public:
+  SquashfsImage();
+  ~SquashfsImage();
+
+  // Open squashfs image at |path| and load its metadata tables.
+  bool open(const std::string& path);
+
+  const SquashfsSuperBlock& superBlock() const { return sb_; }
+
+  // Returns name of compression algorithm.
+  const char* compressionName() const;
+
+  // Read root directory inode.
+  bool readRootInode(SquashfsInode& inode) const;
+
+  // Read inode referenced by |inode_ref|.
+  bool readInode(uint64_t inode_ref, SquashfsInode& inode) const;
+
+  // Walk inode table, counting inodes and total size of regular files.
+  bool countInodes(uint64_t& num_inodes, uint64_t& file_bytes) const;
+
+  // Read entries of directory |dir|.
+  bool readDir(const SquashfsInode& dir,
+               std::vector<SquashfsDirEntry>& entries) const;
+
+  // Find item at |path| relative to root folder, starting with "/".
+  // Symbolic links are not followed. Returns false if it does not exist.
+  bool lookup(const std::string& path, SquashfsInode& inode) const;
+
+  // Read whole content of regular file |inode| into |content|. Meant for
+  // small files, such as dpkg database.
+  bool readFile(const SquashfsInode& inode, std::string& content) const;
+
+  // Read xattrs with |xattr| index in xattr id table.
+  bool readXattrs(uint32_t xattr, std::vector<SquashfsXattr>& xattrs) const;
+
+  // Read and decompress one data block at |offset| of image. |size_field| is
+  // the block size recorded in inode. |dest| shall hold at least block_size
+  // bytes. Returns uncompressed size or -1 on error.
+  long readDataBlock(uint64_t offset, uint32_t size_field,
+                     uint8_t* dest) const;
+
+  // Returns decompressed content of fragment block |index|. Recently used
+  // fragment blocks are cached, as they are shared by many small files.
+  std::shared_ptr<const std::vector<uint8_t>> readFragment(
+      uint32_t index) const;
+
+  SquashfsFragmentStats fragmentStats() const;
+
+  // Get range [start, end) of image holding content of regular file |inode|,
+  // that is its data blocks, or its fragment block if it has no data block.
+  // Both are 0 if file is empty.
+  void dataRange(const SquashfsInode& inode, uint64_t& start,
+                 uint64_t& end) const;
+
+  // Ask kernel to read range [offset, offset + len) of image in background.
+  void readahead(uint64_t offset, uint64_t len) const;
+
+  // Drop range [offset, offset + len) of image from page cache, as it will
+  // not be read again.
+  void dropCache(uint64_t offset, uint64_t len) const;
+
+  // Set maximum number of fragment blocks kept in cache, 64 by default.
+  void setFragmentCacheSize(size_t size);
+
+ private:
+  // Uncompressed content of a list of metadata blocks.
+  struct MetadataTable {
+    std::vector<uint8_t> data;
+    // Maps offset of each block relative to start of table to its position
+    // in |data|.
+    std::map<uint64_t, size_t> blocks;
+  };
+
+  struct FragmentEntry {
+    uint64_t start = 0;
+    uint32_t size = 0;
+  };
+
+  // Parse inode at |pos| of inode table. |next_pos| is set to position of
+  // the inode after it.
+  bool parseInode(size_t pos, SquashfsInode& inode, size_t& next_pos) const;
+
+  // Read |len| bytes at |offset| of image.
+  bool readAt(uint64_t offset, void* buf, size_t len) const;
+
+  // Read and decompress one metadata block at |offset|, appending its content
+  // to |data|. |next| is set to the offset of next metadata block.
+  bool readMetadataBlock(uint64_t offset, std::vector<uint8_t>& data,
+                         uint64_t& next) const;
+
+  // Read all metadata blocks in range [start, end).
+  bool loadMetadataTable(uint64_t start, uint64_t end,
+                         MetadataTable& table) const;
+
+  // Read a table with |num_bytes| of content whose metadata blocks are
+  // listed in an array of 64-bit offsets at |index_start|.
+  bool loadIndexedTable(uint64_t index_start, size_t num_bytes,
+                        std::vector<uint8_t>& data) const;
+
+  // Returns position in |table.data| of (block, offset) reference, or -1.
+  long locate(const MetadataTable& table, uint64_t block,
+              uint32_t offset) const;
+
+  // Returns the smallest table location which is greater than |start|.
+  uint64_t tableEnd(uint64_t start) const;
+
+  bool loadIdTable();
+  bool loadFragmentTable();
+  bool loadXattrTable();
+
+  int fd_ = -1;
+  uint64_t file_size_ = 0;
+  SquashfsSuperBlock sb_;
+  std::unique_ptr<SquashfsDecompressor> decompressor_;
+
+  MetadataTable inode_table_;
+  MetadataTable dir_table_;
+  std::vector<uint32_t> ids_;
+  std::vector<FragmentEntry> fragments_;
+
+  // Xattr id table and key-value table.
+  uint64_t xattr_table_start_ = 0;
+  std::vector<uint8_t> xattr_ids_;
+  MetadataTable xattr_table_;
+
+  // Start offsets of metadata block lists, used to find end of tables.
+  std::vector<uint64_t> table_starts_;
+
+  // LRU cache of decompressed fragment blocks, with at most
+  // |fragment_cache_size_| items.
+  typedef std::pair<uint32_t, std::shared_ptr<const std::vector<uint8_t>>>
+      FragmentCacheItem;
+  mutable std::mutex fragment_mutex_;
+  mutable std::list<FragmentCacheItem> fragment_cache_;
+  size_t fragment_cache_size_;
+  // Fragment blocks being decompressed. Other workers wait for them
+  // instead of decompressing them again.
+  mutable std::set<uint32_t> fragment_loading_;
+  mutable std::condition_variable fragment_cond_;
+  // Fragment blocks decompressed at least once, and counters.
+  mutable std::vector<bool> fragment_read_;
+  mutable SquashfsFragmentStats fragment_stats_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_SQUASHFS_IMAGE_H
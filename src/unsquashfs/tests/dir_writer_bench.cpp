@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures time spent to create one item in a deep destination folder,
+// with full paths as CopyTree() used to do, and with DirWriter.
+// Usage: dir-writer-bench [entries] [parent-folder]
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "unsquashfs/dir_writer.h"
+
+namespace {
+
+// Depth of destination folder, similar to /usr/share/locale/xx/LC_MESSAGES.
+const int kFolderDepth = 6;
+
+double NowSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int RemoveItem(const char* path, const struct stat*, int, struct FTW*) {
+  return remove(path);
+}
+
+// Create regular files, with one folder and one symbolic link of every
+// ten items, the way CopyItem() did before DirWriter.
+void CreateWithPaths(const std::string& dir, int entries) {
+  for (int i = 0; i < entries; ++i) {
+    const std::string dest_file = dir + "/item" + std::to_string(i);
+    const char* dest = dest_file.c_str();
+    struct stat st;
+    if (stat(dest, &st) == 0 && !S_ISDIR(st.st_mode)) {
+      unlink(dest);
+    }
+    if (i % 10 == 0) {
+      mkdir(dest, 0755);
+    } else if (i % 10 == 1) {
+      symlink("item0", dest);
+    } else {
+      close(open(dest, O_CREAT | O_WRONLY | O_CLOEXEC, S_IRUSR | S_IWUSR));
+    }
+    lchown(dest, getuid(), getgid());
+    if (i % 10 != 1) {
+      chmod(dest, 0644);
+    }
+  }
+}
+
+// Create the same items relative to folder descriptor.
+void CreateWithDirWriter(const std::string& dir, int entries) {
+  installer::DirWriter writer;
+  if (!writer.open(dir)) {
+    perror("open()");
+    return;
+  }
+  char name[32];
+  for (int i = 0; i < entries; ++i) {
+    snprintf(name, sizeof(name), "item%d", i);
+    writer.removeItem(name);
+    if (i % 10 == 0) {
+      writer.createDir(name, 0755);
+    } else if (i % 10 == 1) {
+      writer.createSymlink(name, "item0");
+    } else {
+      close(writer.createFile(name));
+    }
+    writer.setOwner(name, getuid(), getgid());
+    if (i % 10 != 1) {
+      writer.setMode(name, 0644);
+    }
+  }
+}
+
+// Returns nanoseconds per entry of |create|, in a new folder under |root|.
+double Measure(const std::string& root, const char* tag, int entries,
+               void (*create)(const std::string&, int)) {
+  std::string dir = root + "/" + tag;
+  mkdir(dir.c_str(), 0755);
+  for (int i = 0; i < kFolderDepth; ++i) {
+    dir += "/level" + std::to_string(i);
+    mkdir(dir.c_str(), 0755);
+  }
+  sync();
+  const double start = NowSeconds();
+  create(dir, entries);
+  const double elapsed = NowSeconds() - start;
+  return elapsed * 1e9 / entries;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const int entries = (argc > 1) ? atoi(argv[1]) : 20000;
+  const std::string parent = (argc > 2) ? argv[2] : "/tmp";
+  if (entries <= 0) {
+    fprintf(stderr, "Invalid number of entries: %s\n", argv[1]);
+    return 1;
+  }
+
+  std::string root = parent + "/dir-writer-bench-XXXXXX";
+  if (mkdtemp(&root[0]) == nullptr) {
+    perror("mkdtemp()");
+    return 1;
+  }
+
+  const double path_ns = Measure(root, "path", entries, CreateWithPaths);
+  const double fd_ns = Measure(root, "fd", entries, CreateWithDirWriter);
+  printf("entries: %d, folder depth: %d\n", entries, kFolderDepth);
+  printf("path based: %.0f ns/entry\n", path_ns);
+  printf("fd relative: %.0f ns/entry\n", fd_ns);
+
+  nftw(root.c_str(), RemoveItem, 16, FTW_DEPTH | FTW_PHYS);
+  return 0;
+}
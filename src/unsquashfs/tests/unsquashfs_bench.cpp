@@ -0,0 +1,872 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Generates a synthetic folder tree, packs it with mksquashfs and extracts
+// it with ExtractImage() and CopyTree(), printing one JSON object per run
+// to stdout. Progress and errors are written to stderr.
+//
+// Usage: deepin-installer-unsquashfs-bench [options]
+//   --files N            number of items to generate, 20000 by default
+//   --files-per-dir N    items in each generated folder, 64 by default
+//   --sizes SPEC         file size distribution, comma separated list of
+//                        <max-size>:<weight>, size of each file is uniform
+//                        between the previous bucket and <max-size>.
+//                        Default is 512:30,4K:35,64K:25,1M:8,16M:2
+//   --hard-links PCT     percent of items which are extra names of files
+//   --xattrs PCT         percent of files with user.bench xattr
+//   --sparse PCT         percent of files larger than 256K with holes
+//   --comp NAME          compression passed to mksquashfs, gzip by default
+//   --seed N             seed of generated content
+//   --image FILE         extract existing image instead of generating one
+//   --work DIR           where tree and image are generated, /tmp by default
+//   --target DIR         where files are extracted, a tmpfs for example;
+//                        defaults to work folder
+//   --ext4 MIB           extract to a loop mounted ext4 filesystem of this
+//                        size, created in work folder; needs root
+//   --runs LIST          comma separated list of runs, of native, ordered,
+//                        uring, copy and copy-ordered; native,ordered by
+//                        default. copy runs read the generated tree.
+//   --repeat N           times to do each run
+//   --jobs N             number of workers
+//   --copy-method NAME   copy method of copy runs
+//   --dirty-window MIB   writeback window of all runs
+//   --memory-budget MIB  memory-bounded mode in all runs
+//   --preallocate KIB    preallocate files of at least this size in all
+//                        runs, 0 to disable; 1024 by default
+//   --drop-caches        drop page cache before each run; needs root
+//   --keep               keep generated tree and image
+//
+// Syscalls are counted with the raw_syscalls:sys_enter tracepoint, which
+// needs tracefs and perf_event_paranoid <= 1 or root; they are null
+// otherwise. Peak RSS is VmHWM, reset before each run.
+// Extents of extracted regular files are counted with FIEMAP after each run,
+// for all files and for files of at least 1M; they are null if target
+// filesystem does not support FIEMAP, tmpfs for example. Use --ext4 to see
+// fragmentation of a real root filesystem.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "unsquashfs/extract_options.h"
+#include "unsquashfs/extract_stats.h"
+#include "unsquashfs/extract_totals.h"
+#include "unsquashfs/memory_budget.h"
+#include "unsquashfs/native_extractor.h"
+#include "unsquashfs/squashfs_image.h"
+#include "unsquashfs/tree_copier.h"
+
+namespace {
+
+// Size of content pool which generated files are sliced from.
+const size_t kCorpusSize = 4 * 1024 * 1024;
+
+// Files smaller than this are never made sparse.
+const int64_t kSparseMinSize = 256 * 1024;
+
+// Data written at start and end of sparse files, the rest is a hole.
+const int64_t kSparseDataSize = 64 * 1024;
+
+// Files of at least this size are counted separately in extents report.
+const int64_t kLargeFileSize = 1024 * 1024;
+
+const char kDefaultSizes[] = "512:30,4K:35,64K:25,1M:8,16M:2";
+
+struct SizeBucket {
+  int64_t max_size;
+  int weight;
+};
+
+struct BenchOptions {
+  int files = 20000;
+  int files_per_dir = 64;
+  std::vector<SizeBucket> sizes;
+  int hard_link_percent = 2;
+  int xattr_percent = 5;
+  int sparse_percent = 10;
+  std::string comp = "gzip";
+  uint32_t seed = 1;
+  std::string image;
+  std::string work_dir = "/tmp";
+  std::string target;
+  int ext4_mib = 0;
+  std::vector<std::string> runs;
+  int repeat = 1;
+  bool drop_caches = false;
+  bool keep = false;
+  int64_t memory_budget = 0;
+  installer::ExtractOptions extract;
+};
+
+// Summary of one run.
+struct RunResult {
+  bool ok = false;
+  double seconds = 0;
+  double sync_seconds = 0;
+  // -1 if syscalls are not counted.
+  int64_t syscalls = -1;
+  int64_t peak_rss_kb = 0;
+  // Average extents of regular files, and of large ones, -1 if they are
+  // not counted.
+  double extents_per_file = -1;
+  double extents_per_large_file = -1;
+};
+
+// Extents of regular files in a tree, counted by CountExtents().
+struct ExtentCount {
+  bool supported = true;
+  int64_t files = 0;
+  int64_t extents = 0;
+  int64_t large_files = 0;
+  int64_t large_extents = 0;
+};
+
+// nftw() passes no user data to its callback.
+ExtentCount g_extent_count;
+
+// xorshift32, enough to generate reproducible trees.
+class Random {
+ public:
+  explicit Random(uint32_t seed) : state_(seed ? seed : 1) {}
+
+  uint32_t next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 17;
+    state_ ^= state_ << 5;
+    return state_;
+  }
+
+  // Returns a number in range [min, max].
+  int64_t range(int64_t min, int64_t max) {
+    if (max <= min) {
+      return min;
+    }
+    const uint64_t value = (static_cast<uint64_t>(next()) << 32) | next();
+    return min + static_cast<int64_t>(value % (max - min + 1));
+  }
+
+  bool percent(int pct) {
+    return static_cast<int>(next() % 100) < pct;
+  }
+
+ private:
+  uint32_t state_;
+};
+
+double NowSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int RemoveItem(const char* path, const struct stat*, int, struct FTW*) {
+  return remove(path);
+}
+
+void RemoveTree(const std::string& path) {
+  nftw(path.c_str(), RemoveItem, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+int CountExtents(const char* path, const struct stat* st, int type,
+                 struct FTW*) {
+  if (type != FTW_F || !S_ISREG(st->st_mode) || st->st_size == 0) {
+    return 0;
+  }
+  const int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return 0;
+  }
+  // With no room for extents, only their number is returned.
+  struct fiemap map;
+  memset(&map, 0, sizeof(map));
+  map.fm_length = FIEMAP_MAX_OFFSET;
+  map.fm_flags = FIEMAP_FLAG_SYNC;
+  const bool ok = (ioctl(fd, FS_IOC_FIEMAP, &map) == 0);
+  close(fd);
+  if (!ok) {
+    g_extent_count.supported = false;
+    return 1;
+  }
+  g_extent_count.files++;
+  g_extent_count.extents += map.fm_mapped_extents;
+  if (st->st_size >= kLargeFileSize) {
+    g_extent_count.large_files++;
+    g_extent_count.large_extents += map.fm_mapped_extents;
+  }
+  return 0;
+}
+
+// Set average extents per file of |dest_dir| in |result|.
+void CountTreeExtents(const std::string& dest_dir, RunResult& result) {
+  g_extent_count = ExtentCount();
+  nftw(dest_dir.c_str(), CountExtents, 16, FTW_PHYS);
+  if (!g_extent_count.supported) {
+    return;
+  }
+  const ExtentCount& count = g_extent_count;
+  result.extents_per_file = (count.files > 0) ?
+      static_cast<double>(count.extents) / count.files : 0;
+  result.extents_per_large_file = (count.large_files > 0) ?
+      static_cast<double>(count.large_extents) / count.large_files : 0;
+}
+
+// Parse size with optional K, M or G suffix.
+bool ParseSize(const std::string& text, int64_t& size) {
+  char* end = nullptr;
+  const long long value = strtoll(text.c_str(), &end, 10);
+  if (end == text.c_str() || value < 0) {
+    return false;
+  }
+  int64_t unit = 1;
+  if (*end == 'K' || *end == 'k') {
+    unit = 1024;
+    ++end;
+  } else if (*end == 'M' || *end == 'm') {
+    unit = 1024 * 1024;
+    ++end;
+  } else if (*end == 'G' || *end == 'g') {
+    unit = 1024 * 1024 * 1024;
+    ++end;
+  }
+  if (*end != '\0') {
+    return false;
+  }
+  size = value * unit;
+  return true;
+}
+
+std::vector<std::string> SplitList(const std::string& text) {
+  std::vector<std::string> items;
+  size_t start = 0;
+  while (start <= text.size()) {
+    size_t end = text.find(',', start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    if (end > start) {
+      items.push_back(text.substr(start, end - start));
+    }
+    start = end + 1;
+  }
+  return items;
+}
+
+bool ParseSizes(const std::string& text, std::vector<SizeBucket>& sizes) {
+  sizes.clear();
+  int64_t last = -1;
+  for (const std::string& item : SplitList(text)) {
+    const size_t colon = item.find(':');
+    SizeBucket bucket;
+    bucket.weight = 1;
+    if (!ParseSize(item.substr(0, colon), bucket.max_size) ||
+        bucket.max_size <= last) {
+      return false;
+    }
+    if (colon != std::string::npos) {
+      bucket.weight = atoi(item.c_str() + colon + 1);
+      if (bucket.weight < 0) {
+        return false;
+      }
+    }
+    last = bucket.max_size;
+    sizes.push_back(bucket);
+  }
+  return !sizes.empty();
+}
+
+int64_t PickSize(const std::vector<SizeBucket>& sizes, Random& random) {
+  int total = 0;
+  for (const SizeBucket& bucket : sizes) {
+    total += bucket.weight;
+  }
+  int pick = (total > 0) ? static_cast<int>(random.next() % total) : 0;
+  int64_t min = 0;
+  for (const SizeBucket& bucket : sizes) {
+    if (pick < bucket.weight) {
+      return random.range(min, bucket.max_size);
+    }
+    pick -= bucket.weight;
+    min = bucket.max_size + 1;
+  }
+  return sizes.back().max_size;
+}
+
+// Fill |corpus| with text like blocks and some random ones, so that
+// generated files compress about as well as a root filesystem.
+void FillCorpus(std::vector<char>& corpus, Random& random) {
+  static const char* const kWords[] = {
+      "deepin", "installer", "usr", "share", "lib", "config", "locale",
+      "void", "return", "static", "int", "const", "package", "version",
+      "0x7f454c46", "\n", "\t", "=", ";", "{", "}",
+  };
+  const size_t num_words = sizeof(kWords) / sizeof(kWords[0]);
+  const size_t block = 4096;
+  corpus.resize(kCorpusSize);
+  for (size_t pos = 0; pos < corpus.size(); pos += block) {
+    const bool binary = (random.next() % 4 == 0);
+    size_t i = pos;
+    while (i < pos + block) {
+      if (binary) {
+        corpus[i++] = static_cast<char>(random.next());
+      } else {
+        const char* word = kWords[random.next() % num_words];
+        for (; *word && i < pos + block; ++word) {
+          corpus[i++] = *word;
+        }
+        if (i < pos + block) {
+          corpus[i++] = ' ';
+        }
+      }
+    }
+  }
+}
+
+bool WriteSlice(int fd, const std::vector<char>& corpus, Random& random,
+                int64_t offset, int64_t len) {
+  while (len > 0) {
+    const size_t start = static_cast<size_t>(
+        random.range(0, static_cast<int64_t>(corpus.size()) - 1));
+    const size_t chunk = static_cast<size_t>(
+        std::min<int64_t>(len, corpus.size() - start));
+    const ssize_t n = pwrite(fd, &corpus[start], chunk, offset);
+    if (n <= 0) {
+      return false;
+    }
+    offset += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool CreateFile(const std::string& path, int64_t size, bool sparse,
+                const std::vector<char>& corpus, Random& random) {
+  const int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC,
+                      0644);
+  if (fd < 0) {
+    fprintf(stderr, "CreateFile() open %s failed: %s\n",
+            path.c_str(), strerror(errno));
+    return false;
+  }
+  bool ok;
+  if (sparse) {
+    ok = (ftruncate(fd, size) == 0) &&
+         WriteSlice(fd, corpus, random, 0, kSparseDataSize) &&
+         WriteSlice(fd, corpus, random, size - kSparseDataSize,
+                    kSparseDataSize);
+  } else {
+    ok = WriteSlice(fd, corpus, random, 0, size);
+  }
+  if (!ok) {
+    fprintf(stderr, "CreateFile() write %s failed: %s\n",
+            path.c_str(), strerror(errno));
+  }
+  close(fd);
+  return ok;
+}
+
+// Generate folder tree with |options.files| items in |root|.
+bool GenerateTree(const BenchOptions& options, const std::string& root) {
+  Random random(options.seed);
+  std::vector<char> corpus;
+  FillCorpus(corpus, random);
+
+  std::vector<std::string> files;
+  bool use_xattrs = (options.xattr_percent > 0);
+  std::string dir;
+  int64_t bytes = 0;
+  int num_files = 0;
+  int num_links = 0;
+  int num_sparse = 0;
+  int num_xattrs = 0;
+  for (int i = 0; i < options.files; ++i) {
+    // Two levels of folders, |files_per_dir| items in each.
+    const int dir_index = i / options.files_per_dir;
+    if (i % options.files_per_dir == 0) {
+      const std::string parent = root + "/d" +
+          std::to_string(dir_index / options.files_per_dir);
+      mkdir(parent.c_str(), 0755);
+      dir = parent + "/d" + std::to_string(dir_index);
+      if (mkdir(dir.c_str(), 0755) != 0) {
+        fprintf(stderr, "GenerateTree() mkdir %s failed: %s\n",
+                dir.c_str(), strerror(errno));
+        return false;
+      }
+    }
+    const std::string path = dir + "/f" + std::to_string(i);
+
+    if (!files.empty() && random.percent(options.hard_link_percent)) {
+      const std::string& target = files[random.next() % files.size()];
+      if (link(target.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "GenerateTree() link %s failed: %s\n",
+                path.c_str(), strerror(errno));
+        return false;
+      }
+      ++num_links;
+      continue;
+    }
+
+    const int64_t size = PickSize(options.sizes, random);
+    const bool sparse = (size >= kSparseMinSize) &&
+                        random.percent(options.sparse_percent);
+    if (!CreateFile(path, size, sparse, corpus, random)) {
+      return false;
+    }
+    if (use_xattrs && random.percent(options.xattr_percent)) {
+      char value[64];
+      const int len = snprintf(value, sizeof(value), "bench-%u-%d",
+                               random.next(), i);
+      if (lsetxattr(path.c_str(), "user.bench", value, len, 0) == 0) {
+        ++num_xattrs;
+      } else {
+        fprintf(stderr, "GenerateTree() xattrs disabled, lsetxattr "
+                "failed: %s\n", strerror(errno));
+        use_xattrs = false;
+      }
+    }
+    files.push_back(path);
+    bytes += size;
+    ++num_files;
+    if (sparse) {
+      ++num_sparse;
+    }
+  }
+  fprintf(stderr, "generated %d files of %lld bytes, %d hard links, "
+          "%d sparse files, %d xattrs\n", num_files,
+          static_cast<long long>(bytes), num_links, num_sparse, num_xattrs);
+  return true;
+}
+
+// Run |args| and wait for it. Standard output is discarded.
+bool RunCommand(const std::vector<std::string>& args) {
+  const pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork()");
+    return false;
+  }
+  if (pid == 0) {
+    const int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+      dup2(null_fd, STDOUT_FILENO);
+    }
+    std::vector<char*> argv;
+    for (const std::string& arg : args) {
+      argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    execvp(argv[0], argv.data());
+    fprintf(stderr, "RunCommand() exec %s failed: %s\n",
+            argv[0], strerror(errno));
+    _exit(127);
+  }
+  int status = 0;
+  if (waitpid(pid, &status, 0) != pid ||
+      !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "RunCommand() %s failed\n", args[0].c_str());
+    return false;
+  }
+  return true;
+}
+
+bool CreateExt4(const std::string& image, const std::string& mount_point,
+                int size_mib) {
+  const int fd = open(image.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    perror("CreateExt4() open()");
+    return false;
+  }
+  const bool ok = (ftruncate(fd, static_cast<off_t>(size_mib) << 20) == 0);
+  close(fd);
+  return ok &&
+         RunCommand({"mkfs.ext4", "-q", "-F", image}) &&
+         mkdir(mount_point.c_str(), 0755) == 0 &&
+         RunCommand({"mount", "-o", "loop", image, mount_point});
+}
+
+// Returns id of raw_syscalls:sys_enter tracepoint, or -1.
+long ReadSyscallTracepoint() {
+  const char* const kIdFiles[] = {
+      "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+      "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+  };
+  for (const char* id_file : kIdFiles) {
+    FILE* fp = fopen(id_file, "r");
+    if (fp) {
+      long id = -1;
+      if (fscanf(fp, "%ld", &id) != 1) {
+        id = -1;
+      }
+      fclose(fp);
+      return id;
+    }
+  }
+  return -1;
+}
+
+// Open counter of system calls of this process and threads created later,
+// which are folded into it when they exit. Returns -1 if not supported.
+int OpenSyscallCounter() {
+  const long id = ReadSyscallTracepoint();
+  if (id < 0) {
+    fprintf(stderr, "syscalls not counted, tracefs is not available\n");
+    return -1;
+  }
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_TRACEPOINT;
+  attr.size = sizeof(attr);
+  attr.config = static_cast<uint64_t>(id);
+  attr.disabled = 1;
+  attr.inherit = 1;
+  const int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1,
+                                          -1, PERF_FLAG_FD_CLOEXEC));
+  if (fd < 0) {
+    fprintf(stderr, "syscalls not counted, perf_event_open() failed: %s\n",
+            strerror(errno));
+  }
+  return fd;
+}
+
+// Reset high water mark of resident set size.
+void ResetPeakRss() {
+  const int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    if (write(fd, "5", 1) != 1) {
+      perror("ResetPeakRss() write()");
+    }
+    close(fd);
+  }
+}
+
+int64_t ReadPeakRss() {
+  FILE* fp = fopen("/proc/self/status", "r");
+  if (!fp) {
+    return 0;
+  }
+  char line[256];
+  long long kb = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    if (sscanf(line, "VmHWM: %lld kB", &kb) == 1) {
+      break;
+    }
+  }
+  fclose(fp);
+  return kb;
+}
+
+void DropCaches() {
+  sync();
+  const int fd = open("/proc/sys/vm/drop_caches", O_WRONLY | O_CLOEXEC);
+  if (fd < 0 || write(fd, "3", 1) != 1) {
+    perror("DropCaches()");
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+// Extract |image_file| or copy |src_dir| to |dest_dir| as |run| says.
+RunResult Run(const BenchOptions& options, const std::string& run,
+              const std::string& image_file, const std::string& src_dir,
+              const std::string& dest_dir, int counter_fd,
+              installer::ExtractStats& stats) {
+  installer::ExtractOptions extract = options.extract;
+  const bool copy = (run == "copy" || run == "copy-ordered");
+  extract.ordered = (run == "ordered" || run == "copy-ordered");
+  extract.use_io_uring = (run == "uring");
+  if (options.memory_budget > 0) {
+    installer::ApplyMemoryBudget(options.memory_budget, extract);
+  }
+
+  RunResult result;
+  if (mkdir(dest_dir.c_str(), 0755) != 0) {
+    perror("Run() mkdir()");
+    return result;
+  }
+  if (options.drop_caches) {
+    DropCaches();
+  }
+  ResetPeakRss();
+  if (counter_fd >= 0) {
+    ioctl(counter_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter_fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  const double start = NowSeconds();
+  if (copy) {
+    result.ok = installer::CopyTree(src_dir, dest_dir, extract, nullptr,
+                                    &stats);
+  } else {
+    installer::SquashfsImage image;
+    result.ok = image.open(image_file);
+    const size_t cache_size = installer::GetFragmentCacheSize(
+        extract, image.superBlock().block_size);
+    if (cache_size > 0) {
+      image.setFragmentCacheSize(cache_size);
+    }
+    result.ok = result.ok &&
+                installer::ExtractImage(image, dest_dir, extract, nullptr,
+                                        &stats);
+  }
+  result.seconds = NowSeconds() - start;
+  if (counter_fd >= 0) {
+    ioctl(counter_fd, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t count = 0;
+    if (read(counter_fd, &count, sizeof(count)) == sizeof(count)) {
+      result.syscalls = static_cast<int64_t>(count);
+    }
+  }
+  result.peak_rss_kb = ReadPeakRss();
+
+  const double sync_start = NowSeconds();
+  sync();
+  result.sync_seconds = NowSeconds() - sync_start;
+  CountTreeExtents(dest_dir, result);
+  return result;
+}
+
+void PrintResult(const std::string& run, int repeat, int jobs,
+                 const installer::ExtractTotals& totals,
+                 const RunResult& result,
+                 const installer::ExtractStats& stats) {
+  const double seconds = (result.seconds > 0) ? result.seconds : 1e-9;
+  printf("{\"run\":\"%s\",\"repeat\":%d,\"jobs\":%d,\"ok\":%s,"
+         "\"files\":%lld,\"bytes\":%lld,\"seconds\":%.3f,"
+         "\"sync_seconds\":%.3f,\"files_per_second\":%.0f,"
+         "\"mb_per_second\":%.1f,",
+         run.c_str(), repeat, jobs, result.ok ? "true" : "false",
+         static_cast<long long>(totals.files),
+         static_cast<long long>(totals.bytes), result.seconds,
+         result.sync_seconds, totals.files / seconds,
+         totals.bytes / seconds / (1024 * 1024));
+  if (result.syscalls >= 0) {
+    printf("\"syscalls\":%lld,\"syscalls_per_file\":%.1f,",
+           static_cast<long long>(result.syscalls),
+           (totals.files > 0) ?
+               static_cast<double>(result.syscalls) / totals.files : 0.0);
+  } else {
+    printf("\"syscalls\":null,\"syscalls_per_file\":null,");
+  }
+  if (result.extents_per_file >= 0) {
+    printf("\"extents_per_file\":%.2f,\"extents_per_large_file\":%.2f,",
+           result.extents_per_file, result.extents_per_large_file);
+  } else {
+    printf("\"extents_per_file\":null,\"extents_per_large_file\":null,");
+  }
+  printf("\"peak_rss_kb\":%lld,\"hard_links\":%lld,\"sparse_files\":%lld,"
+         "\"fragment_reads\":%lld,\"fragment_rereads\":%lld,"
+         "\"uring_ops\":%lld,\"writeback_bytes\":%lld,"
+         "\"direct_bytes\":%lld,\"preallocated_files\":%lld}\n",
+         static_cast<long long>(result.peak_rss_kb),
+         static_cast<long long>(stats.hard_links.load()),
+         static_cast<long long>(stats.sparse_files.load()),
+         static_cast<long long>(stats.fragment_reads.load()),
+         static_cast<long long>(stats.fragment_rereads.load()),
+         static_cast<long long>(stats.uring_ops.load()),
+         static_cast<long long>(stats.writeback_bytes.load()),
+         static_cast<long long>(stats.direct_bytes.load()),
+         static_cast<long long>(stats.preallocated_files.load()));
+  fflush(stdout);
+}
+
+void PrintUsage(const char* program) {
+  fprintf(stderr, "Usage: %s [--files N] [--files-per-dir N] [--sizes SPEC] "
+          "[--hard-links PCT] [--xattrs PCT] [--sparse PCT] [--comp NAME] "
+          "[--seed N] [--image FILE] [--work DIR] [--target DIR] "
+          "[--ext4 MIB] [--runs LIST] [--repeat N] [--jobs N] "
+          "[--copy-method NAME] [--dirty-window MIB] [--memory-budget MIB] "
+          "[--preallocate KIB] [--drop-caches] [--keep]\n", program);
+}
+
+bool ParseArgs(int argc, char* argv[], BenchOptions& options) {
+  options.extract.jobs = installer::GetDefaultJobs();
+  ParseSizes(kDefaultSizes, options.sizes);
+  options.runs = SplitList("native,ordered");
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--drop-caches") {
+      options.drop_caches = true;
+      continue;
+    }
+    if (arg == "--keep") {
+      options.keep = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const std::string value = argv[++i];
+    const int number = atoi(value.c_str());
+    if (arg == "--files") {
+      options.files = number;
+    } else if (arg == "--files-per-dir") {
+      options.files_per_dir = number;
+    } else if (arg == "--sizes") {
+      if (!ParseSizes(value, options.sizes)) {
+        fprintf(stderr, "Invalid size distribution: %s\n", value.c_str());
+        return false;
+      }
+    } else if (arg == "--hard-links") {
+      options.hard_link_percent = number;
+    } else if (arg == "--xattrs") {
+      options.xattr_percent = number;
+    } else if (arg == "--sparse") {
+      options.sparse_percent = number;
+    } else if (arg == "--comp") {
+      options.comp = value;
+    } else if (arg == "--seed") {
+      options.seed = static_cast<uint32_t>(strtoul(value.c_str(), nullptr,
+                                                   10));
+    } else if (arg == "--image") {
+      options.image = value;
+    } else if (arg == "--work") {
+      options.work_dir = value;
+    } else if (arg == "--target") {
+      options.target = value;
+    } else if (arg == "--ext4") {
+      options.ext4_mib = number;
+    } else if (arg == "--runs") {
+      options.runs = SplitList(value);
+    } else if (arg == "--repeat") {
+      options.repeat = number;
+    } else if (arg == "--jobs") {
+      options.extract.jobs = number;
+    } else if (arg == "--copy-method") {
+      if (!installer::ParseCopyMethod(value, options.extract.copy_method)) {
+        fprintf(stderr, "Invalid copy method: %s\n", value.c_str());
+        return false;
+      }
+    } else if (arg == "--dirty-window") {
+      options.extract.dirty_window = static_cast<int64_t>(number) << 20;
+    } else if (arg == "--memory-budget") {
+      options.memory_budget = static_cast<int64_t>(number) << 20;
+    } else if (arg == "--preallocate") {
+      options.extract.preallocate_size = static_cast<int64_t>(number) << 10;
+    } else {
+      return false;
+    }
+  }
+  for (const std::string& run : options.runs) {
+    if (run != "native" && run != "ordered" && run != "uring" &&
+        run != "copy" && run != "copy-ordered") {
+      fprintf(stderr, "Invalid run: %s\n", run.c_str());
+      return false;
+    }
+  }
+  return options.files > 0 && options.files_per_dir > 0 &&
+         options.repeat > 0 && options.extract.jobs > 0 &&
+         !options.runs.empty();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  BenchOptions options;
+  if (!ParseArgs(argc, argv, options)) {
+    PrintUsage(argv[0]);
+    return 1;
+  }
+
+  std::string work = options.work_dir + "/unsquashfs-bench-XXXXXX";
+  if (mkdtemp(&work[0]) == nullptr) {
+    perror("mkdtemp()");
+    return 1;
+  }
+  const std::string src_dir = work + "/src";
+  std::string image_file = options.image;
+  bool ok = true;
+  if (image_file.empty()) {
+    image_file = work + "/bench.squashfs";
+    const double start = NowSeconds();
+    ok = (mkdir(src_dir.c_str(), 0755) == 0) &&
+         GenerateTree(options, src_dir) &&
+         RunCommand({"mksquashfs", src_dir, image_file, "-noappend",
+                     "-no-progress", "-comp", options.comp});
+    fprintf(stderr, "image generated in %.1f s\n", NowSeconds() - start);
+  }
+
+  installer::ExtractTotals totals;
+  if (ok) {
+    installer::SquashfsImage image;
+    ok = image.open(image_file) && installer::CountImageTotals(image, totals);
+    if (!ok) {
+      fprintf(stderr, "Failed to read image: %s\n", image_file.c_str());
+    }
+  }
+
+  std::string target = options.target.empty() ? work : options.target;
+  const std::string ext4_mount = work + "/ext4";
+  bool ext4_mounted = false;
+  if (ok && options.ext4_mib > 0) {
+    ok = ext4_mounted = CreateExt4(work + "/ext4.img", ext4_mount,
+                                   options.ext4_mib);
+    target = ext4_mount;
+  }
+
+  // Extracted files are owned by users of image, as the installer does.
+  const mode_t old_mask = umask(0);
+  const int counter_fd = ok ? OpenSyscallCounter() : -1;
+  int index = 0;
+  for (int repeat = 0; ok && repeat < options.repeat; ++repeat) {
+    for (const std::string& run : options.runs) {
+      if (run.compare(0, 4, "copy") == 0 && !options.image.empty()) {
+        fprintf(stderr, "Skip %s run, no source tree of image\n",
+                run.c_str());
+        continue;
+      }
+      const std::string dest_dir = target + "/unsquashfs-bench-run" +
+                                   std::to_string(index++);
+      installer::ExtractStats stats;
+      const RunResult result = Run(options, run, image_file, src_dir,
+                                   dest_dir, counter_fd, stats);
+      PrintResult(run, repeat, options.extract.jobs, totals, result, stats);
+      RemoveTree(dest_dir);
+      sync();
+      ok = result.ok;
+    }
+  }
+  if (counter_fd >= 0) {
+    close(counter_fd);
+  }
+  umask(old_mask);
+
+  if (ext4_mounted) {
+    RunCommand({"umount", ext4_mount});
+  }
+  if (options.keep) {
+    fprintf(stderr, "kept %s\n", work.c_str());
+  } else {
+    RemoveTree(work);
+  }
+  return ok ? 0 : 1;
+}
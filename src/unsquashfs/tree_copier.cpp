@@ -0,0 +1,691 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/tree_copier.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "unsquashfs/content_hash.h"
+#include "unsquashfs/content_verifier.h"
+#include "unsquashfs/dir_times.h"
+#include "unsquashfs/dir_writer.h"
+#include "unsquashfs/extract_progress.h"
+#include "unsquashfs/extract_stats.h"
+#include "unsquashfs/file_copier.h"
+#include "unsquashfs/hard_link_map.h"
+#include "unsquashfs/incremental_install.h"
+#include "unsquashfs/package_filter.h"
+#include "unsquashfs/work_stealing_pool.h"
+#include "unsquashfs/writeback_pacer.h"
+#include "unsquashfs/xattr_copier.h"
+
+#define S_IMODE 07777
+
+namespace installer {
+
+namespace {
+
+// Join folder |dir| and item |name| into |buf|, reusing its memory.
+const char* JoinPath(const std::string& dir, const char* name,
+                     std::string& buf) {
+  buf.assign(dir);
+  buf.push_back('/');
+  buf.append(name);
+  return buf.c_str();
+}
+
+// Update ownership, permissions, xattrs and times of item |name| in |dest|
+// to those of source item |src_file|, whose lstat() result is |st|. Xattrs
+// are copied through |src_item_fd| and |dest_item_fd| if they are not -1.
+// Errors are logged and ignored.
+void UpdateMetadata(const char* src_file, const char* name,
+                    const struct stat& st, DirWriter& dest,
+                    int src_item_fd, int dest_item_fd, ExtractStats* stats) {
+  const mode_t mode = st.st_mode & S_IMODE;
+
+  // Update ownership first, or chmod() might ignore SUID/SGID or sticky flag.
+  if (!dest.setOwner(name, st.st_uid, st.st_gid)) {
+    fprintf(stderr, "CopyItem() lchown() failed: %s, %d, %d\n",
+            dest.fullPath(name), st.st_uid, st.st_gid);
+    perror("lchown()");
+    // Ignores copy file error.
+//    ok = false;
+  }
+  // Update permissions.
+  if (!S_ISLNK(st.st_mode)) {
+    if (!dest.setMode(name, mode)) {
+      fprintf(stderr, "CopyItem() chmod failed: %s, %ul\n",
+              dest.fullPath(name), mode);
+      perror("chmod()");
+      // Ignores chmod error.
+//      ok = false;
+    }
+  }
+
+  // Xattrs are copied after ownership, as lchown() clears file capabilities.
+  if (!CopyXattrs(src_item_fd, src_file, dest_item_fd, dest.fullPath(name),
+                  stats)) {
+    // NOTE(xushaohua): Do not exit when failed to copy file capacities.
+    // This may be happen in Alpha based computer.
+    fprintf(stderr, "CopyXattrs() failed: %s\n", src_file);
+//    ok = false;
+  }
+
+  // Times of folders are restored after items in them are copied.
+  if (!S_ISDIR(st.st_mode)) {
+    const struct timespec times[2] = {st.st_atim, st.st_mtim};
+    if (!dest.setTimes(name, times)) {
+      fprintf(stderr, "CopyItem() utimensat() failed: %s, %s\n",
+              dest.fullPath(name), strerror(errno));
+    }
+  }
+}
+
+// Copy regular file |name| in folder |src_fd| to |dest| with |copier|.
+// |src_file| is full path of source file, used in error messages.
+// |st| is lstat() result of source file, its metadata is updated while both
+// files are open. Content is appended to |hasher| if it is not nullptr.
+bool SendFile(int src_fd, const char* src_file, const char* name,
+              const struct stat& st, DirWriter& dest, FileCopier& copier,
+              WritebackPacer* pacer, ContentHasher* hasher,
+              ExtractStats* stats) {
+  const off_t file_size = st.st_size;
+  const int src_file_fd = openat(src_fd, name, O_RDONLY | O_CLOEXEC);
+  if (src_file_fd == -1) {
+    fprintf(stderr, "SendFile() Failed to open src file: %s\n", src_file);
+    perror("Open src file failed!");
+    return false;
+  }
+
+  const int dest_fd = dest.createFile(name);
+  if (dest_fd == -1) {
+    fprintf(stderr, "SendFile() Failed to open dest file: %s\n",
+            dest.fullPath(name));
+    perror("Open dest file failed!");
+    close(src_file_fd);
+    return false;
+  }
+
+  const bool ok = copier.copy(src_file_fd, dest_fd, file_size, src_file,
+                              hasher);
+  UpdateMetadata(src_file, name, st, dest, src_file_fd, dest_fd, stats);
+
+  close(src_file_fd);
+  if (pacer) {
+    pacer->add(dest_fd, file_size);
+  } else {
+    close(dest_fd);
+  }
+
+  return ok;
+}
+
+bool CopySymLink(int src_fd, const char* src_file, const char* name,
+                 DirWriter& dest) {
+  char target[PATH_MAX];
+  const ssize_t link_len = readlinkat(src_fd, name, target, PATH_MAX - 1);
+  if (link_len <= 0) {
+    fprintf(stderr, "CopySymLink() readlink() failed: %s\n", src_file);
+    perror("readlink() error");
+    return false;
+  }
+  target[link_len] = '\0';
+
+  if (!dest.createSymlink(name, target)) {
+    fprintf(stderr, "CopySymLink() symlink() failed, %s (%s -> %s)\n",
+            strerror(errno), dest.fullPath(name), target);
+    return false;
+  }
+  return true;
+}
+
+// Read whole content of regular file |path| into |content|.
+bool ReadFile(const std::string& path, std::string& content) {
+  FILE* fp = fopen(path.c_str(), "re");
+  if (!fp) {
+    return false;
+  }
+  content.clear();
+  char buf[64 * 1024];
+  size_t len;
+  while ((len = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    content.append(buf, len);
+  }
+  const bool ok = !ferror(fp);
+  fclose(fp);
+  return ok;
+}
+
+// Copy item |name| in folder |src_fd| to |dest|. |src_file| is full path of
+// source item, and |st| is its lstat() result. Regular files are handed to
+// |pacer| after copied if it is not nullptr, and their content is appended
+// to |hasher| if it is not nullptr.
+bool CopyItem(int src_fd, const char* src_file, const char* name,
+              const struct stat& st, DirWriter& dest, FileCopier& copier,
+              WritebackPacer* pacer, ContentHasher* hasher,
+              ExtractStats* stats) {
+  // Get file mode.
+  const mode_t mode = st.st_mode & S_IMODE;
+  bool ok = true;
+
+  // Remove dest item if it exists and is not a folder.
+  dest.removeItem(name);
+
+  if (S_ISLNK(st.st_mode)) {
+    // Symbolic link
+    ok = CopySymLink(src_fd, src_file, name, dest);
+  } else if (S_ISREG(st.st_mode)) {
+    // Regular file
+    ok = SendFile(src_fd, src_file, name, st, dest, copier, pacer, hasher,
+                  stats);
+  } else if (S_ISDIR(st.st_mode)) {
+    // Directory
+    ok = dest.createDir(name, mode);
+  } else if (S_ISCHR(st.st_mode)) {
+    // Character device
+    ok = dest.createNode(name, mode | S_IFCHR, st.st_rdev);
+  } else if (S_ISBLK(st.st_mode)) {
+    // For block device.
+    ok = dest.createNode(name, mode | S_IFBLK, st.st_rdev);
+  } else if (S_ISFIFO(st.st_mode)) {
+    // FIFO
+    ok = dest.createNode(name, mode | S_IFIFO, 0);
+  } else if (S_ISSOCK(st.st_mode)) {
+    // Socket
+    ok = dest.createNode(name, mode | S_IFSOCK, 0);
+  } else {
+    fprintf(stderr, "CopyItem() Unknown file mode: %d\n", st.st_mode);
+  }
+
+  if (!ok) {
+    fprintf(stderr, "Failed to copy item: %s\n", dest.fullPath(name));
+    // Ignore copy file error.
+    // Return if error occurs
+//    return 1;
+  }
+
+  // Metadata of regular file is updated by SendFile() while it is open.
+  if (!S_ISREG(st.st_mode)) {
+    UpdateMetadata(src_file, name, st, dest, -1, -1, stats);
+  }
+  return ok;
+}
+
+// Another name of a file being copied by other worker, linked to it after
+// all tasks are finished.
+struct DeferredLink {
+  uint64_t dev = 0;
+  uint64_t ino = 0;
+  int64_t size = 0;
+  std::string path;
+};
+
+// Walks source tree and copies items. Each directory is a task of
+// WorkStealingPool, so independent subtrees are copied in parallel.
+class TreeCopier {
+ public:
+  TreeCopier(const ExtractOptions& options, ExtractProgress* progress,
+             ExtractStats* stats)
+      : options_(options),
+        copier_(options, stats),
+        progress_(progress),
+        stats_(stats),
+        ordered_(options.ordered),
+        failed_(false),
+        pool_(options.jobs) {
+    if (options.dirty_window > 0) {
+      pacer_.reset(new WritebackPacer(options.dirty_window, stats));
+    }
+  }
+
+  bool run(const std::string& src_dir, const std::string& dest_dir) {
+    if (!options_.manifest_file.empty()) {
+      verifier_.reset(new ContentVerifier());
+      if (!verifier_->open(options_.manifest_file, options_.failure_report)) {
+        return false;
+      }
+    }
+    dest_root_ = dest_dir;
+    struct stat root_st;
+    if (stat(dest_dir.c_str(), &root_st) == 0) {
+      dest_dev_ = root_st.st_dev;
+    }
+    // Files of all packages are copied if package list is invalid, they
+    // are purged after installation then.
+    if (!options_.exclude_packages.empty()) {
+      filter_.reset(new PackageFilter());
+      if (!filter_->init(options_.exclude_packages,
+                         [&src_dir](const std::string& path,
+                                    std::string& content) {
+                           return ReadFile(src_dir + path, content);
+                         })) {
+        filter_.reset();
+      }
+    }
+
+    const int src_fd = open(src_dir.c_str(), O_RDONLY | O_DIRECTORY |
+                            O_CLOEXEC);
+    DirWriter dest;
+    if (src_fd == -1 || !dest.open(dest_dir)) {
+      fprintf(stderr, "CopyTree() failed to open %s or %s: %s\n",
+              src_dir.c_str(), dest_dir.c_str(), strerror(errno));
+      if (src_fd != -1) {
+        close(src_fd);
+      }
+      return false;
+    }
+
+    // Copy attributes of root folder, which is "." of itself.
+    struct stat st;
+    bool ok = (fstatat(src_fd, ".", &st, AT_SYMLINK_NOFOLLOW) == 0);
+    if (!ok) {
+      fprintf(stderr, "CopyTree() call lstat() failed: %s\n", src_dir.c_str());
+      perror("lstat()");
+    } else {
+      ok = copyItem(src_fd, src_dir, ".", st, dest);
+    }
+    close(src_fd);
+    if (!ok) {
+      return false;
+    }
+
+    pool_.submit(std::bind(&TreeCopier::copyDir, this, src_dir, dest_dir));
+    pool_.waitForDone();
+    linkDeferred();
+    if (!failed_) {
+      dir_times_.restore();
+    }
+    if (pacer_) {
+      pacer_->finish();
+    }
+    if (verifier_ && !failed_) {
+      const int64_t failures = verifier_->finish();
+      if (stats_) {
+        stats_->verify_failures += failures;
+      }
+      if (failures > 0) {
+        fprintf(stderr, "CopyTree() %lld files failed verification\n",
+                static_cast<long long>(failures));
+        return false;
+      }
+    }
+    if (filter_ && !failed_ && !options_.excluded_packages_file.empty() &&
+        !filter_->writePackages(options_.excluded_packages_file)) {
+      return false;
+    }
+    return !failed_;
+  }
+
+ private:
+  bool copyItem(int src_fd, const std::string& src_dir, const char* name,
+                const struct stat& st, DirWriter& dest) {
+    if (keepItem(src_fd, src_dir, name, st, dest)) {
+      return true;
+    }
+    const bool is_hard_link = S_ISREG(st.st_mode) && st.st_nlink > 1;
+    bool ok;
+    // Size of content copied, linked files do not add to it.
+    int64_t bytes = 0;
+    if (is_hard_link && linkItem(name, st, dest)) {
+      ok = true;
+    } else if (is_hard_link && !hard_links_.claim(st.st_dev, st.st_ino)) {
+      // Another name of it is being copied by other worker.
+      deferLink(name, st, dest);
+      return true;
+    } else {
+      // Full path of source item, reused by each worker thread.
+      thread_local std::string src_buf;
+      const char* src_file = JoinPath(src_dir, name, src_buf);
+      ContentHasher hasher;
+      const bool verify = verifier_ && S_ISREG(st.st_mode);
+      ok = CopyItem(src_fd, src_file, name, st, dest, copier_,
+                    pacer_.get(), verify ? &hasher : nullptr, stats_);
+      if (verify) {
+        verifyFile(name, dest, ok, hasher);
+      }
+      if (ok && is_hard_link) {
+        hard_links_.insert(st.st_dev, st.st_ino, dest.fullPath(name));
+      }
+      if (S_ISDIR(st.st_mode)) {
+        dir_times_.add(dest.fullPath(name), st.st_atim, st.st_mtim);
+      }
+      if (S_ISREG(st.st_mode)) {
+        bytes = st.st_size;
+      }
+    }
+    if (progress_) {
+      progress_->increase(bytes);
+    }
+    return ok;
+  }
+
+  // Returns true if source item |name| with lstat() result |st| is a file of
+  // a package excluded by |filter_|, which is not copied to |dest|.
+  bool excludeItem(const char* name, const struct stat& st,
+                   const DirWriter& dest) {
+    if (!filter_ || S_ISDIR(st.st_mode)) {
+      return false;
+    }
+    const std::string path = relativePath(dest.fullPath(name));
+    if (!filter_->excludes(path)) {
+      return false;
+    }
+    const int64_t bytes = S_ISREG(st.st_mode) ? st.st_size : 0;
+    if (verifier_) {
+      verifier_->skip(path);
+    }
+    if (progress_) {
+      progress_->skip(1, bytes);
+    }
+    if (stats_) {
+      stats_->excluded_files++;
+      stats_->excluded_bytes += bytes;
+    }
+    return true;
+  }
+
+  // Returns true if item |name| in |dest|, left by previous installation in
+  // incremental mode, has content of source item |name| in |src_fd| already.
+  // Then only its metadata is updated.
+  bool keepItem(int src_fd, const std::string& src_dir, const char* name,
+                const struct stat& st, DirWriter& dest) {
+    if (!options_.incremental ||
+        (!S_ISREG(st.st_mode) && !S_ISLNK(st.st_mode))) {
+      return false;
+    }
+    std::string target;
+    if (S_ISLNK(st.st_mode)) {
+      target.resize(static_cast<size_t>(st.st_size));
+      if (readlinkat(src_fd, name, &target[0], target.size()) != st.st_size) {
+        return false;
+      }
+    }
+    if (!IsUnchangedItem(dest, name, st.st_mode, uint64_t(st.st_size),
+                         st.st_mtim, st.st_nlink, target)) {
+      return false;
+    }
+    if (verifier_ && S_ISREG(st.st_mode)) {
+      // Reading is much cheaper than writing, so content is compared
+      // with manifest if it is available.
+      const std::string path = relativePath(dest.fullPath(name));
+      uint64_t size = 0;
+      uint64_t hash = 0;
+      const int fd = openat(dest.fd(), name, O_RDONLY | O_NOFOLLOW |
+                            O_CLOEXEC);
+      if (fd == -1) {
+        return false;
+      }
+      posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      const bool hashed = HashFile(fd, size, hash);
+      close(fd);
+      if (!hashed ||
+          !verifier_->matches(path, static_cast<int64_t>(size), hash)) {
+        return false;
+      }
+      verifier_->check(path, static_cast<int64_t>(size), hash);
+      if (stats_) {
+        stats_->hashed_files++;
+        stats_->hashed_bytes += static_cast<int64_t>(size);
+      }
+    }
+
+    thread_local std::string src_buf;
+    UpdateMetadata(JoinPath(src_dir, name, src_buf), name, st, dest, -1, -1,
+                   stats_);
+    const int64_t bytes = S_ISREG(st.st_mode) ? st.st_size : 0;
+    if (progress_) {
+      progress_->skip(1, bytes);
+    }
+    if (stats_) {
+      stats_->unchanged_files++;
+      stats_->unchanged_bytes += bytes;
+    }
+    return true;
+  }
+
+  // Compare content of regular file |name| in |dest|, which was passed to
+  // |hasher| while copied, with manifest.
+  void verifyFile(const char* name, const DirWriter& dest, bool copied,
+                  ContentHasher& hasher) {
+    const std::string path = relativePath(dest.fullPath(name));
+    if (!copied) {
+      verifier_->reportError(path, "failed to copy content");
+      return;
+    }
+    const int64_t size = static_cast<int64_t>(hasher.size());
+    verifier_->check(path, size, hasher.finish());
+    if (stats_) {
+      stats_->hashed_files++;
+      stats_->hashed_bytes += size;
+    }
+  }
+
+  // Returns path of |dest_file| relative to dest folder, starting with "/".
+  std::string relativePath(const std::string& dest_file) const {
+    return dest_file.substr(dest_root_.size());
+  }
+
+  // Link |name| to the file already copied from the same source inode.
+  // As they share one inode, ownership, mode and xattrs are not updated.
+  bool linkItem(const char* name, const struct stat& st, DirWriter& dest) {
+    std::string target;
+    if (!hard_links_.find(st.st_dev, st.st_ino, target)) {
+      return false;
+    }
+    dest.removeItem(name);
+    if (!dest.linkFrom(target.c_str(), name)) {
+      fprintf(stderr, "CopyTree() link() failed: %s -> %s, %s\n",
+              dest.fullPath(name), target.c_str(), strerror(errno));
+      return false;
+    }
+    if (stats_) {
+      stats_->hard_links++;
+      stats_->hard_link_bytes += st.st_size;
+    }
+    if (verifier_) {
+      verifier_->skip(relativePath(dest.fullPath(name)));
+    }
+    return true;
+  }
+
+  // Remember |name| in |dest| to be linked to its source inode after all
+  // tasks are finished.
+  void deferLink(const char* name, const struct stat& st,
+                 const DirWriter& dest) {
+    DeferredLink deferred;
+    deferred.dev = st.st_dev;
+    deferred.ino = st.st_ino;
+    deferred.size = st.st_size;
+    deferred.path = dest.fullPath(name);
+    std::lock_guard<std::mutex> lock(deferred_mutex_);
+    deferred_links_.push_back(std::move(deferred));
+  }
+
+  // Link names deferred by deferLink().
+  void linkDeferred() {
+    for (const DeferredLink& deferred : deferred_links_) {
+      if (failed_) {
+        break;
+      }
+      std::string target;
+      if (!hard_links_.find(deferred.dev, deferred.ino, target) ||
+          link(target.c_str(), deferred.path.c_str()) != 0) {
+        fprintf(stderr, "CopyTree() failed to link %s: %s\n",
+                deferred.path.c_str(), strerror(errno));
+        failed_ = true;
+        break;
+      }
+      if (stats_) {
+        stats_->hard_links++;
+        stats_->hard_link_bytes += deferred.size;
+      }
+      if (verifier_) {
+        verifier_->skip(relativePath(deferred.path));
+      }
+      if (progress_) {
+        progress_->increase(0);
+      }
+    }
+    deferred_links_.clear();
+  }
+
+  // Copy children of |src_dir| to |dest_dir|. Items are accessed relative to
+  // descriptors of both folders. Sub-folders are scheduled as new tasks
+  // after they are created.
+  void copyDir(const std::string& src_dir, const std::string& dest_dir) {
+    if (failed_) {
+      return;
+    }
+
+    DIR* dir = opendir(src_dir.c_str());
+    if (dir == nullptr) {
+      fprintf(stderr, "CopyTree() opendir() failed: %s, %s\n",
+              src_dir.c_str(), strerror(errno));
+      failed_ = true;
+      return;
+    }
+    DirWriter dest;
+    if (!dest.open(dest_dir)) {
+      fprintf(stderr, "CopyTree() failed to open %s: %s\n",
+              dest_dir.c_str(), strerror(errno));
+      closedir(dir);
+      failed_ = true;
+      return;
+    }
+    const int src_fd = dirfd(dir);
+
+    // Read all entries first. In ordered mode they are sorted by inode
+    // number, which follows layout of squashfs image, so that its blocks
+    // are read in order.
+    std::vector<std::pair<ino_t, std::string>> entries;
+    // Names of source items, and whether they are folders, in incremental
+    // mode.
+    std::unordered_map<std::string, bool> items;
+    struct dirent* entry;
+    struct stat st;
+    while ((entry = readdir(dir)) != nullptr) {
+      const char* name = entry->d_name;
+      if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+        entries.push_back(std::make_pair(entry->d_ino, std::string(name)));
+        if (options_.incremental) {
+          bool is_dir = (entry->d_type == DT_DIR);
+          if (entry->d_type == DT_UNKNOWN) {
+            is_dir = (fstatat(src_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+                      S_ISDIR(st.st_mode));
+          }
+          // Files of excluded packages left by previous installation are
+          // removed too.
+          if (is_dir || !filter_ ||
+              !filter_->excludes(relativePath(dest.fullPath(name)))) {
+            items[name] = is_dir;
+          }
+        }
+      }
+    }
+    if (options_.incremental) {
+      PruneDir(dest, items, dest_dir == dest_root_, dest_dev_, stats_);
+    }
+    if (ordered_) {
+      std::sort(entries.begin(), entries.end());
+    }
+
+    for (const auto& item : entries) {
+      if (failed_) {
+        break;
+      }
+      const char* name = item.second.c_str();
+
+      if (fstatat(src_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        fprintf(stderr, "CopyItem() call lstat() failed: %s/%s\n",
+                src_dir.c_str(), name);
+        perror("lstat()");
+        failed_ = true;
+        break;
+      }
+
+      if (excludeItem(name, st, dest)) {
+        continue;
+      }
+      if (!copyItem(src_fd, src_dir, name, st, dest)) {
+        failed_ = true;
+        break;
+      }
+
+      if (S_ISDIR(st.st_mode)) {
+        pool_.submit(std::bind(&TreeCopier::copyDir, this,
+                               src_dir + "/" + name, dest_dir + "/" + name));
+      }
+    }
+
+    closedir(dir);
+  }
+
+  const ExtractOptions& options_;
+  FileCopier copier_;
+  // Writeback of copied files, or nullptr.
+  std::unique_ptr<WritebackPacer> pacer_;
+  ExtractProgress* progress_;
+  ExtractStats* stats_;
+  HardLinkMap hard_links_;
+  // Compares copied files with manifest, or nullptr.
+  std::unique_ptr<ContentVerifier> verifier_;
+  // Skips files of unused packages, or nullptr.
+  std::unique_ptr<PackageFilter> filter_;
+  // Path of dest folder, and its device. Items on other devices are mount
+  // points, which are never pruned in incremental mode.
+  std::string dest_root_;
+  dev_t dest_dev_ = 0;
+  // Names of files whose inode was being copied when they were reached.
+  std::mutex deferred_mutex_;
+  std::vector<DeferredLink> deferred_links_;
+  // Folders whose times are restored after all items are copied.
+  DirTimes dir_times_;
+  const bool ordered_;
+  std::atomic<bool> failed_;
+  WorkStealingPool pool_;
+};
+
+}  // namespace
+
+bool CopyTree(const std::string& src_dir,
+              const std::string& dest_dir,
+              const ExtractOptions& options,
+              ExtractProgress* progress,
+              ExtractStats* stats) {
+  TreeCopier copier(options, progress, stats);
+  return copier.run(src_dir, dest_dir);
+}
+
+}  // namespace installer
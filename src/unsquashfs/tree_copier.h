@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_TREE_COPIER_H
+#define INSTALLER_UNSQUASHFS_TREE_COPIER_H
+
+#include <string>
+
+#include "unsquashfs/extract_options.h"
+
+namespace installer {
+
+class ExtractProgress;
+struct ExtractStats;
+
+// Copy content of |src_dir| to |dest_dir|, keeping file ownership, permissions,
+// times and xattrs. |dest_dir| shall already exist.
+// Directory subtrees are distributed among |options.jobs| workers.
+// Files with several hard links are copied once and linked afterwards.
+// Each copied item is reported to |progress|, and counters to |stats|.
+bool CopyTree(const std::string& src_dir,
+              const std::string& dest_dir,
+              const ExtractOptions& options,
+              ExtractProgress* progress,
+              ExtractStats* stats);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_TREE_COPIER_H
@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/tree_verifier.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "unsquashfs/content_hash.h"
+#include "unsquashfs/content_verifier.h"
+#include "unsquashfs/extract_stats.h"
+#include "unsquashfs/work_stealing_pool.h"
+
+namespace installer {
+
+namespace {
+
+int64_t NowNsecs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Walks a folder tree and hashes its regular files. Each folder is a task of
+// WorkStealingPool.
+class TreeHasher {
+ public:
+  // Called with path relative to root of tree, starting with "/", size and
+  // content hash of each regular file. |error| is nullptr if the file was
+  // read without error.
+  typedef std::function<void(const std::string& path, int64_t size,
+                             uint64_t hash, const char* error)> Callback;
+
+  TreeHasher(const ExtractOptions& options, ExtractStats* stats,
+             const Callback& callback)
+      : options_(options),
+        stats_(stats),
+        callback_(callback),
+        failed_(false),
+        pool_(options.jobs) {
+  }
+
+  bool run(const std::string& root) {
+    root_ = root;
+    pool_.submit(std::bind(&TreeHasher::hashDir, this, std::string()));
+    pool_.waitForDone();
+    return !failed_;
+  }
+
+ private:
+  // Hash files in folder |path| relative to root, and schedule its
+  // sub-folders.
+  void hashDir(const std::string& path) {
+    const std::string dir_path = root_ + path;
+    DIR* dir = opendir(dir_path.c_str());
+    if (dir == nullptr) {
+      fprintf(stderr, "VerifyTree() opendir() failed: %s, %s\n",
+              dir_path.c_str(), strerror(errno));
+      failed_ = true;
+      return;
+    }
+    const int dir_fd = dirfd(dir);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      const char* name = entry->d_name;
+      if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        continue;
+      }
+      struct stat st;
+      if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        continue;
+      }
+      const std::string item_path = path + "/" + name;
+      if (S_ISDIR(st.st_mode)) {
+        pool_.submit(std::bind(&TreeHasher::hashDir, this, item_path));
+      } else if (S_ISREG(st.st_mode)) {
+        hashFile(dir_fd, name, item_path);
+      }
+    }
+    closedir(dir);
+  }
+
+  void hashFile(int dir_fd, const char* name, const std::string& path) {
+    const int fd = openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+      callback_(path, 0, 0, strerror(errno));
+      return;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Read buffer, reused by each worker thread.
+    thread_local std::vector<char> buf;
+    buf.resize(std::max<size_t>(options_.buffer_size, kHashChunkSize));
+    ContentHasher hasher;
+    int64_t hash_nsecs = 0;
+    const char* error = nullptr;
+    while (true) {
+      const ssize_t len = read(fd, buf.data(), buf.size());
+      if (len < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        error = strerror(errno);
+        break;
+      }
+      if (len == 0) {
+        break;
+      }
+      const int64_t start = NowNsecs();
+      hasher.update(buf.data(), static_cast<size_t>(len));
+      hash_nsecs += NowNsecs() - start;
+    }
+    close(fd);
+
+    const uint64_t hash = hasher.finish();
+    if (stats_) {
+      stats_->hashed_files++;
+      stats_->hashed_bytes += static_cast<int64_t>(hasher.size());
+      stats_->hash_nsecs += hash_nsecs;
+    }
+    callback_(path, static_cast<int64_t>(hasher.size()), hash, error);
+  }
+
+  const ExtractOptions& options_;
+  ExtractStats* stats_;
+  Callback callback_;
+  std::string root_;
+  std::atomic<bool> failed_;
+  WorkStealingPool pool_;
+};
+
+}  // namespace
+
+bool VerifyTree(const std::string& dir, const ExtractOptions& options,
+                ExtractStats* stats) {
+  ContentVerifier verifier;
+  if (!verifier.open(options.manifest_file, options.failure_report)) {
+    return false;
+  }
+  TreeHasher hasher(options, stats,
+                    [&verifier](const std::string& path, int64_t size,
+                                uint64_t hash, const char* error) {
+    if (error) {
+      verifier.reportError(path, error);
+    } else {
+      verifier.check(path, size, hash);
+    }
+  });
+  const bool ok = hasher.run(dir);
+  const int64_t failures = verifier.finish();
+  if (stats) {
+    stats->verify_failures += failures;
+  }
+  return ok && failures == 0;
+}
+
+bool CreateManifest(const std::string& dir, const std::string& manifest_file,
+                    const ExtractOptions& options, ExtractStats* stats) {
+  typedef std::tuple<std::string, int64_t, uint64_t> ManifestEntry;
+  std::mutex mutex;
+  std::vector<ManifestEntry> entries;
+  bool read_ok = true;
+  TreeHasher hasher(options, stats,
+                    [&](const std::string& path, int64_t size,
+                        uint64_t hash, const char* error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error) {
+      fprintf(stderr, "CreateManifest() failed to read %s: %s\n",
+              path.c_str(), error);
+      read_ok = false;
+    } else {
+      entries.push_back(std::make_tuple(path, size, hash));
+    }
+  });
+  if (!hasher.run(dir) || !read_ok) {
+    return false;
+  }
+  std::sort(entries.begin(), entries.end());
+
+  FILE* fp = fopen(manifest_file.c_str(), "we");
+  if (!fp) {
+    fprintf(stderr, "CreateManifest() failed to create %s: %s\n",
+            manifest_file.c_str(), strerror(errno));
+    return false;
+  }
+  bool ok = true;
+  for (const ManifestEntry& entry : entries) {
+    ok = ok && WriteManifestEntry(fp, std::get<0>(entry), std::get<1>(entry),
+                                  std::get<2>(entry));
+  }
+  ok = (fclose(fp) == 0) && ok;
+  return ok;
+}
+
+}  // namespace installer
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_TREE_VERIFIER_H
+#define INSTALLER_UNSQUASHFS_TREE_VERIFIER_H
+
+#include <string>
+
+#include "unsquashfs/extract_options.h"
+
+namespace installer {
+
+struct ExtractStats;
+
+// Hash regular files in |dir|, which was extracted before, and compare them
+// with |options.manifest_file|. Failures are written to
+// |options.failure_report|. Folders are walked by |options.jobs| workers.
+// Returns false if any file does not match.
+bool VerifyTree(const std::string& dir, const ExtractOptions& options,
+                ExtractStats* stats);
+
+// Hash regular files in |dir| and write them to |manifest_file|, sorted
+// by path.
+bool CreateManifest(const std::string& dir, const std::string& manifest_file,
+                    const ExtractOptions& options, ExtractStats* stats);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_TREE_VERIFIER_H
@@ -0,0 +1,350 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/uring_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+// fsetxattr and direct descriptors were added to io_uring in the same
+// kernel release as IORING_FILE_INDEX_ALLOC.
+#if defined(__NR_io_uring_setup) && defined(IORING_FILE_INDEX_ALLOC)
+#define INSTALLER_HAVE_IO_URING
+#endif
+
+namespace installer {
+
+#ifdef INSTALLER_HAVE_IO_URING
+
+namespace {
+
+// Large enough for kMaxFiles chains of the longest length.
+const unsigned kRingEntries = 512;
+
+// Operations of one file chain, stored in user_data of each sqe.
+enum ChainOp {
+  kOpUnlink,
+  kOpOpen,
+  kOpWrite,
+  kOpXattr,
+  kOpClose,
+};
+
+const int kRequiredOps[] = {
+    IORING_OP_UNLINKAT,
+    IORING_OP_OPENAT,
+    IORING_OP_WRITE,
+    IORING_OP_FSETXATTR,
+    IORING_OP_CLOSE,
+};
+
+int IoUringSetup(unsigned entries, io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int IoUringEnter(int fd, unsigned to_submit, unsigned min_complete,
+                 unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+int IoUringRegister(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode,
+                                  arg, nr_args));
+}
+
+unsigned* RingField(void* ring, uint32_t offset) {
+  return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+}
+
+uint64_t MakeUserData(size_t file_index, ChainOp op) {
+  return (uint64_t(file_index) << 8) | op;
+}
+
+}  // namespace
+
+UringWriter::UringWriter() {
+}
+
+UringWriter::~UringWriter() {
+  if (sqes_) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (ring_fd_ != -1) {
+    close(ring_fd_);
+  }
+}
+
+bool UringWriter::init() {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = IoUringSetup(kRingEntries, &params);
+  if (ring_fd_ < 0) {
+    ring_fd_ = -1;
+    fprintf(stderr, "UringWriter() io_uring_setup() failed: %s\n",
+            strerror(errno));
+    return false;
+  }
+
+  // Check that all operations used are supported.
+  const size_t probe_ops = 256;
+  std::vector<uint8_t> probe_buf(sizeof(io_uring_probe) +
+                                 probe_ops * sizeof(io_uring_probe_op));
+  io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probe_buf.data());
+  if (IoUringRegister(ring_fd_, IORING_REGISTER_PROBE, probe,
+                      probe_ops) < 0) {
+    fprintf(stderr, "UringWriter() failed to probe operations: %s\n",
+            strerror(errno));
+    return false;
+  }
+  for (int op : kRequiredOps) {
+    if (op > probe->last_op ||
+        !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+      fprintf(stderr, "UringWriter() operation %d is not supported\n", op);
+      return false;
+    }
+  }
+
+  // Files are opened as direct descriptors, one slot for each file of a
+  // batch, so that later operations of the chain can refer to it.
+  int fds[kMaxFiles];
+  for (size_t i = 0; i < kMaxFiles; ++i) {
+    fds[i] = -1;
+  }
+  if (IoUringRegister(ring_fd_, IORING_REGISTER_FILES, fds, kMaxFiles) < 0) {
+    fprintf(stderr, "UringWriter() failed to register files: %s\n",
+            strerror(errno));
+    return false;
+  }
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ = params.cq_off.cqes +
+                  params.cq_entries * sizeof(io_uring_cqe);
+  const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+  if (single_mmap && cq_ring_size_ > sq_ring_size_) {
+    sq_ring_size_ = cq_ring_size_;
+  }
+  sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  if (sq_ring_ == MAP_FAILED) {
+    sq_ring_ = nullptr;
+    return false;
+  }
+  if (single_mmap) {
+    cq_ring_ = sq_ring_;
+  } else {
+    cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+    if (cq_ring_ == MAP_FAILED) {
+      cq_ring_ = nullptr;
+      return false;
+    }
+  }
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+  sq_tail_ = RingField(sq_ring_, params.sq_off.tail);
+  sq_mask_ = RingField(sq_ring_, params.sq_off.ring_mask);
+  sq_array_ = RingField(sq_ring_, params.sq_off.array);
+  cq_head_ = RingField(cq_ring_, params.cq_off.head);
+  cq_tail_ = RingField(cq_ring_, params.cq_off.tail);
+  cq_mask_ = RingField(cq_ring_, params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<io_uring_cqe*>(
+      static_cast<char*>(cq_ring_) + params.cq_off.cqes);
+  return true;
+}
+
+io_uring_sqe* UringWriter::getSqe() {
+  // All sqes are consumed by kernel in each write(), so the ring is empty
+  // when a batch starts.
+  const unsigned tail = *sq_tail_ + num_pending_;
+  const unsigned index = tail & *sq_mask_;
+  io_uring_sqe* sqe = &sqes_[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sq_array_[index] = index;
+  num_pending_++;
+  return sqe;
+}
+
+bool UringWriter::write(std::vector<UringFile>& files, int& num_ops,
+                        int& num_enters) {
+  num_ops = 0;
+  num_enters = 0;
+  if (files.empty()) {
+    return true;
+  }
+  if (ring_fd_ == -1 || files.size() > kMaxFiles) {
+    return false;
+  }
+
+  // Each operation is hard linked to the next one, so that they run in order
+  // and close is always reached even if an earlier step fails.
+  for (size_t i = 0; i < files.size(); ++i) {
+    UringFile& file = files[i];
+    file.ok = true;
+    const unsigned slot = static_cast<unsigned>(i);
+
+    io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_UNLINKAT;
+    sqe->flags = IOSQE_IO_HARDLINK;
+    sqe->fd = file.dir_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(file.path.c_str());
+    sqe->user_data = MakeUserData(i, kOpUnlink);
+
+    sqe = getSqe();
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->flags = IOSQE_IO_HARDLINK;
+    sqe->fd = file.dir_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(file.path.c_str());
+    sqe->len = file.mode;
+    // O_CLOEXEC is not allowed for direct descriptors.
+    sqe->open_flags = O_CREAT | O_WRONLY | O_TRUNC;
+    sqe->file_index = slot + 1;
+    sqe->user_data = MakeUserData(i, kOpOpen);
+
+    if (file.size > 0) {
+      sqe = getSqe();
+      sqe->opcode = IORING_OP_WRITE;
+      sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+      sqe->fd = static_cast<int>(slot);
+      sqe->addr = reinterpret_cast<uint64_t>(file.data);
+      sqe->len = static_cast<uint32_t>(file.size);
+      sqe->off = 0;
+      sqe->user_data = MakeUserData(i, kOpWrite);
+    }
+
+    if (file.xattrs) {
+      for (const auto& xattr : *file.xattrs) {
+        sqe = getSqe();
+        sqe->opcode = IORING_OP_FSETXATTR;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        sqe->fd = static_cast<int>(slot);
+        sqe->addr = reinterpret_cast<uint64_t>(xattr.first.c_str());
+        sqe->addr2 = reinterpret_cast<uint64_t>(xattr.second.data());
+        sqe->len = static_cast<uint32_t>(xattr.second.size());
+        sqe->user_data = MakeUserData(i, kOpXattr);
+      }
+    }
+
+    sqe = getSqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+    sqe->user_data = MakeUserData(i, kOpClose);
+  }
+
+  const unsigned num_sqes = num_pending_;
+  num_ops = static_cast<int>(num_sqes);
+  __atomic_store_n(sq_tail_, *sq_tail_ + num_sqes, __ATOMIC_RELEASE);
+  num_pending_ = 0;
+
+  unsigned to_submit = num_sqes;
+  unsigned num_done = 0;
+  while (num_done < num_sqes) {
+    const int ret = IoUringEnter(ring_fd_, to_submit, num_sqes - num_done,
+                                 IORING_ENTER_GETEVENTS);
+    num_enters++;
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      fprintf(stderr, "UringWriter() io_uring_enter() failed: %s\n",
+              strerror(errno));
+      return false;
+    }
+    to_submit -= std::min<unsigned>(to_submit, unsigned(ret));
+
+    unsigned head = *cq_head_;
+    const unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+      const size_t index = static_cast<size_t>(cqe.user_data >> 8);
+      const ChainOp op = static_cast<ChainOp>(cqe.user_data & 0xff);
+      num_done++;
+      if (index >= files.size()) {
+        continue;
+      }
+      UringFile& file = files[index];
+      if (op == kOpUnlink) {
+        // Most files do not exist yet.
+        if (cqe.res < 0 && cqe.res != -ENOENT) {
+          file.ok = false;
+        }
+      } else if (op == kOpWrite) {
+        if (cqe.res != static_cast<int>(file.size)) {
+          file.ok = false;
+        }
+      } else if (cqe.res < 0) {
+        file.ok = false;
+      }
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+  return true;
+}
+
+#else  // INSTALLER_HAVE_IO_URING
+
+UringWriter::UringWriter() {
+}
+
+UringWriter::~UringWriter() {
+}
+
+bool UringWriter::init() {
+  fprintf(stderr, "UringWriter() io_uring is not supported in this build\n");
+  return false;
+}
+
+io_uring_sqe* UringWriter::getSqe() {
+  return nullptr;
+}
+
+bool UringWriter::write(std::vector<UringFile>& files, int& num_ops,
+                        int& num_enters) {
+  (void) files;
+  num_ops = 0;
+  num_enters = 0;
+  return false;
+}
+
+#endif  // INSTALLER_HAVE_IO_URING
+
+}  // namespace installer
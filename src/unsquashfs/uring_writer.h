@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_URING_WRITER_H
+#define INSTALLER_UNSQUASHFS_URING_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "unsquashfs/xattr_copier.h"
+
+struct io_uring_cqe;
+struct io_uring_sqe;
+
+namespace installer {
+
+// A small file to be created by UringWriter.
+struct UringFile {
+  // Folder descriptor which |path| is relative to.
+  int dir_fd = -1;
+  std::string path;
+  // Permission bits, applied when file is created.
+  mode_t mode = 0;
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+  // Xattrs set after content is written, or nullptr.
+  std::shared_ptr<const XattrSet> xattrs;
+  // Keeps |data| alive until it is written.
+  std::shared_ptr<const std::vector<uint8_t>> buffer;
+
+  // Set by UringWriter::write(), true if all operations succeeded.
+  bool ok = false;
+};
+
+// Creates small files with io_uring. Each file is a chain of unlinkat,
+// openat, write, fsetxattr and close operations, and chains of many files
+// are submitted with one io_uring_enter() call.
+// Ownership is not changed, so only files owned by current user shall be
+// written here. Not thread safe, each worker owns its UringWriter.
+class UringWriter {
+ public:
+  // Limits of one write() call.
+  static const size_t kMaxFiles = 32;
+  static const size_t kMaxXattrs = 8;
+
+  UringWriter();
+  ~UringWriter();
+
+  // Set up io_uring. Returns false if kernel does not support io_uring or
+  // any of the operations used.
+  bool init();
+
+  // Create |files|, at most kMaxFiles, each with at most kMaxXattrs xattrs.
+  // Existing files at same path are removed first.
+  // |num_ops| is set to number of operations submitted and |num_enters| to
+  // number of io_uring_enter() calls.
+  // Returns false if io_uring itself fails, result of each file is
+  // in its |ok| field.
+  bool write(std::vector<UringFile>& files, int& num_ops, int& num_enters);
+
+ private:
+  io_uring_sqe* getSqe();
+
+  int ring_fd_ = -1;
+  void* sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void* cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned* sq_tail_ = nullptr;
+  unsigned* sq_mask_ = nullptr;
+  unsigned* sq_array_ = nullptr;
+  unsigned* cq_head_ = nullptr;
+  unsigned* cq_tail_ = nullptr;
+  unsigned* cq_mask_ = nullptr;
+  io_uring_cqe* cqes_ = nullptr;
+
+  // Number of sqes filled since last submission.
+  unsigned num_pending_ = 0;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_URING_WRITER_H
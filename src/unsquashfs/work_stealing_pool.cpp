@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/work_stealing_pool.h"
+
+namespace installer {
+
+namespace {
+
+// Pool and index of current worker thread.
+thread_local const WorkStealingPool* g_current_pool = nullptr;
+thread_local int g_current_index = -1;
+
+}  // namespace
+
+WorkStealingPool::WorkStealingPool(int num_workers)
+    : queued_(0),
+      pending_(0),
+      next_worker_(0) {
+  if (num_workers < 1) {
+    num_workers = 1;
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    workers_.emplace_back(new Worker());
+  }
+  for (int i = 0; i < num_workers; ++i) {
+    threads_.emplace_back(&WorkStealingPool::run, this, i);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+    quit_ = true;
+  }
+  wake_cond_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkStealingPool::submit(const Task& task) {
+  int index;
+  if (g_current_pool == this) {
+    index = g_current_index;
+  } else {
+    index = static_cast<int>(next_worker_++ % workers_.size());
+  }
+
+  pending_++;
+  {
+    Worker* worker = workers_[index].get();
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->tasks.push_back(task);
+  }
+  queued_++;
+
+  // Take the lock so that a worker between checking |queued_| and
+  // going to sleep does not miss this notification.
+  {
+    std::lock_guard<std::mutex> lock(state_mutex_);
+  }
+  wake_cond_.notify_one();
+}
+
+void WorkStealingPool::waitForDone() {
+  std::unique_lock<std::mutex> lock(state_mutex_);
+  done_cond_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+// static
+int WorkStealingPool::CurrentWorker() {
+  return g_current_index;
+}
+
+void WorkStealingPool::run(int index) {
+  g_current_pool = this;
+  g_current_index = index;
+
+  Task task;
+  while (true) {
+    if (popLocal(index, task) || steal(index, task)) {
+      queued_--;
+      task();
+      task = nullptr;
+      if (--pending_ == 0) {
+        std::lock_guard<std::mutex> lock(state_mutex_);
+        done_cond_.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(state_mutex_);
+    wake_cond_.wait(lock, [this]() { return quit_ || queued_ > 0; });
+    if (quit_) {
+      break;
+    }
+  }
+
+  g_current_pool = nullptr;
+  g_current_index = -1;
+}
+
+bool WorkStealingPool::popLocal(int index, Task& task) {
+  Worker* worker = workers_[index].get();
+  std::lock_guard<std::mutex> lock(worker->mutex);
+  if (worker->tasks.empty()) {
+    return false;
+  }
+  task = std::move(worker->tasks.back());
+  worker->tasks.pop_back();
+  return true;
+}
+
+bool WorkStealingPool::steal(int index, Task& task) {
+  const int num_workers = numWorkers();
+  for (int i = 1; i < num_workers; ++i) {
+    Worker* victim = workers_[(index + i) % num_workers].get();
+    std::lock_guard<std::mutex> lock(victim->mutex);
+    if (!victim->tasks.empty()) {
+      task = std::move(victim->tasks.front());
+      victim->tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace installer
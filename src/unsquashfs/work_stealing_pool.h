@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_WORK_STEALING_POOL_H
+#define INSTALLER_UNSQUASHFS_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace installer {
+
+// A fixed size thread pool in which every worker owns a task deque.
+// A worker pushes and pops tasks at the back of its own deque, so directory
+// subtrees are walked depth first and stay hot in dentry cache. When its
+// deque runs dry, it steals from the front of another worker's deque, which
+// holds the oldest, and usually the largest, subtrees.
+class WorkStealingPool {
+ public:
+  typedef std::function<void()> Task;
+
+  // Starts |num_workers| threads. |num_workers| is at least 1.
+  explicit WorkStealingPool(int num_workers);
+  ~WorkStealingPool();
+
+  // Returns number of worker threads.
+  int numWorkers() const { return static_cast<int>(workers_.size()); }
+
+  // Schedule |task|. If called from a worker thread of this pool, |task| is
+  // appended to the deque of that worker, or else workers are picked in turn.
+  void submit(const Task& task);
+
+  // Block until all submitted tasks, including tasks submitted by
+  // other tasks, have finished.
+  void waitForDone();
+
+  // Returns index of current worker thread in its pool, or -1 if current
+  // thread is not a pool worker.
+  static int CurrentWorker();
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void run(int index);
+  bool popLocal(int index, Task& task);
+  bool steal(int index, Task& task);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+
+  // Protects |quit_| and is used with |wake_cond_| and |done_cond_|.
+  std::mutex state_mutex_;
+  std::condition_variable wake_cond_;
+  std::condition_variable done_cond_;
+  bool quit_ = false;
+
+  // Number of tasks waiting in deques.
+  std::atomic<long> queued_;
+  // Number of tasks submitted but not finished yet.
+  std::atomic<long> pending_;
+  // Used to distribute tasks submitted from outside of pool.
+  std::atomic<unsigned int> next_worker_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_WORK_STEALING_POOL_H
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/work_stealing_pool.h"
+
+#include <atomic>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+void SubmitTree(WorkStealingPool* pool, std::atomic<int>* counter, int depth) {
+  (*counter)++;
+  if (depth > 0) {
+    for (int i = 0; i < 3; ++i) {
+      pool->submit([=]() { SubmitTree(pool, counter, depth - 1); });
+    }
+  }
+}
+
+TEST(WorkStealingPool, NestedTasks) {
+  WorkStealingPool pool(4);
+  std::atomic<int> counter(0);
+  pool.submit([&]() { SubmitTree(&pool, &counter, 5); });
+  pool.waitForDone();
+  // 1 + 3 + 9 + 27 + 81 + 243
+  EXPECT_EQ(counter, 364);
+}
+
+TEST(WorkStealingPool, CurrentWorker) {
+  WorkStealingPool pool(2);
+  std::atomic<int> index(-1);
+  pool.submit([&]() { index = WorkStealingPool::CurrentWorker(); });
+  pool.waitForDone();
+  EXPECT_GE(index, 0);
+  EXPECT_LT(index, pool.numWorkers());
+  EXPECT_EQ(WorkStealingPool::CurrentWorker(), -1);
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/writeback_pacer.h"
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "unsquashfs/extract_stats.h"
+
+namespace installer {
+
+namespace {
+
+// Files not flushed yet keep their descriptors open, so their number is
+// limited too.
+const size_t kMaxPendingFiles = 512;
+
+int64_t NowNsecs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+}  // namespace
+
+WritebackPacer::WritebackPacer(int64_t dirty_window, ExtractStats* stats)
+    : dirty_window_(dirty_window),
+      stats_(stats) {
+}
+
+WritebackPacer::~WritebackPacer() {
+  this->finish();
+}
+
+void WritebackPacer::add(int fd, int64_t size) {
+  // Start writeback without waiting for it. Errors are ignored, as pacing
+  // is only an optimization.
+  if (size > 0) {
+    sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+  }
+
+  std::vector<PendingFile> flushing;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    files_.push_back(PendingFile{fd, size});
+    dirty_bytes_ += size;
+    while (dirty_bytes_ > dirty_window_ ||
+           files_.size() > kMaxPendingFiles) {
+      flushing.push_back(files_.front());
+      dirty_bytes_ -= files_.front().size;
+      files_.pop_front();
+    }
+  }
+
+  // Wait outside of lock, so that other workers go on writing.
+  for (const PendingFile& file : flushing) {
+    this->flush(file);
+  }
+}
+
+void WritebackPacer::finish() {
+  std::deque<PendingFile> files;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    files.swap(files_);
+    dirty_bytes_ = 0;
+  }
+  for (const PendingFile& file : files) {
+    this->flush(file);
+  }
+}
+
+void WritebackPacer::flush(const PendingFile& file) {
+  if (file.size > 0) {
+    const int64_t start = NowNsecs();
+    // Data is written back, but metadata is not committed as fsync() does,
+    // which is left to the final sync of filesystem.
+    sync_file_range(file.fd, 0, 0, SYNC_FILE_RANGE_WAIT_BEFORE |
+                    SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    // Clean pages are not needed any more, release them to keep memory
+    // usage flat on live system.
+    posix_fadvise(file.fd, 0, 0, POSIX_FADV_DONTNEED);
+    if (stats_) {
+      stats_->writeback_files++;
+      stats_->writeback_bytes += file.size;
+      stats_->writeback_nsecs += NowNsecs() - start;
+    }
+  }
+  close(file.fd);
+}
+
+}  // namespace installer
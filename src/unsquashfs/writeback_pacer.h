@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_WRITEBACK_PACER_H
+#define INSTALLER_UNSQUASHFS_WRITEBACK_PACER_H
+
+#include <stdint.h>
+
+#include <deque>
+#include <mutex>
+
+namespace installer {
+
+struct ExtractStats;
+
+// Keeps size of written but not yet flushed file content under a window,
+// so that page cache is written back during extraction instead of all at
+// once when target is unmounted.
+// Writeback of each finished file is started with sync_file_range() at once.
+// When the window is full, the oldest files are waited for, and their pages
+// are dropped from page cache with posix_fadvise(POSIX_FADV_DONTNEED).
+// Its methods are thread safe.
+class WritebackPacer {
+ public:
+  // |dirty_window| is the maximum size of content not flushed, in bytes.
+  WritebackPacer(int64_t dirty_window, ExtractStats* stats);
+  ~WritebackPacer();
+
+  // Take ownership of |fd| of a finished file with |size| bytes of content.
+  // It is closed after its content is flushed. Might wait for writeback of
+  // older files.
+  void add(int fd, int64_t size);
+
+  // Wait for writeback of all files.
+  void finish();
+
+ private:
+  WritebackPacer(const WritebackPacer&) = delete;
+  WritebackPacer& operator=(const WritebackPacer&) = delete;
+
+  struct PendingFile {
+    int fd;
+    int64_t size;
+  };
+
+  // Wait for writeback of |file| and close it.
+  void flush(const PendingFile& file);
+
+  const int64_t dirty_window_;
+  ExtractStats* stats_;
+
+  // Protects |files_| and |dirty_bytes_|.
+  std::mutex mutex_;
+  std::deque<PendingFile> files_;
+  int64_t dirty_bytes_ = 0;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_WRITEBACK_PACER_H
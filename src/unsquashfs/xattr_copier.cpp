@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/xattr_copier.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "unsquashfs/extract_stats.h"
+
+namespace installer {
+
+namespace {
+
+// Initial size of name list and value buffers, enough for most items.
+const size_t kInitialBufferSize = 1024;
+
+int64_t NowNsecs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+ssize_t ListXattrs(int fd, const char* path, char* buf, size_t size) {
+  return (fd == -1) ? llistxattr(path, buf, size) :
+                      flistxattr(fd, buf, size);
+}
+
+ssize_t GetXattr(int fd, const char* path, const char* name, char* buf,
+                 size_t size) {
+  return (fd == -1) ? lgetxattr(path, name, buf, size) :
+                      fgetxattr(fd, name, buf, size);
+}
+
+int SetXattr(int fd, const char* path, const char* name, const char* value,
+             size_t size) {
+  return (fd == -1) ? lsetxattr(path, name, value, size, 0) :
+                      fsetxattr(fd, name, value, size, 0);
+}
+
+// Call |read| with |buf|. If |buf| is too small, its size is probed by
+// calling |read| with empty buffer, and it is grown and read again, as
+// the value might change between calls. Returns size read, or -1.
+template <typename ReadFunc>
+ssize_t ReadProbed(std::vector<char>& buf, ReadFunc read) {
+  if (buf.size() < kInitialBufferSize) {
+    buf.resize(kInitialBufferSize);
+  }
+  while (true) {
+    ssize_t len = read(buf.data(), buf.size());
+    if (len >= 0 || errno != ERANGE) {
+      return len;
+    }
+    len = read(nullptr, 0);
+    if (len < 0) {
+      return len;
+    }
+    buf.resize(std::max(size_t(len), buf.size() * 2));
+  }
+}
+
+}  // namespace
+
+bool CopyXattrs(int src_fd, const char* src_file, int dest_fd,
+                const char* dest_file, ExtractStats* stats) {
+  const int64_t start_time = stats ? NowNsecs() : 0;
+  // Reused by all items copied by each worker.
+  thread_local std::vector<char> list;
+  thread_local std::vector<char> value;
+
+  bool ok = true;
+  int64_t values = 0;
+  int64_t bytes = 0;
+  const ssize_t list_len = ReadProbed(list, [=](char* buf, size_t size) {
+    return ListXattrs(src_fd, src_file, buf, size);
+  });
+  if (list_len < 0) {
+    // Source filesystem does not support extended attributes.
+    if (errno != ENOTSUP) {
+      fprintf(stderr, "CopyXattrs() listxattr() failed: %s, %s\n",
+              src_file, strerror(errno));
+      ok = false;
+    }
+  }
+  for (ssize_t pos = 0; pos < list_len; pos += strlen(&list[pos]) + 1) {
+    const char* name = &list[pos];
+    const ssize_t value_len = ReadProbed(value, [=](char* buf, size_t size) {
+      return GetXattr(src_fd, src_file, name, buf, size);
+    });
+    if (value_len < 0) {
+      // It was removed after listed.
+      if (errno != ENODATA) {
+        fprintf(stderr, "CopyXattrs() getxattr() failed: %s, %s, %s\n",
+                src_file, name, strerror(errno));
+        ok = false;
+      }
+      continue;
+    }
+    if (SetXattr(dest_fd, dest_file, name, value.data(),
+                 size_t(value_len)) != 0) {
+      fprintf(stderr, "CopyXattrs() setxattr() failed: %s, %s, %s\n",
+              dest_file, name, strerror(errno));
+      ok = false;
+      continue;
+    }
+    values++;
+    bytes += value_len;
+  }
+
+  if (stats) {
+    stats->xattr_items++;
+    if (values > 0) {
+      stats->xattr_sets++;
+      stats->xattr_values += values;
+      stats->xattr_bytes += bytes;
+    }
+    stats->xattr_nsecs += NowNsecs() - start_time;
+  }
+  return ok;
+}
+
+XattrSetCache::SetPtr XattrSetCache::find(uint64_t id) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = ids_.find(id);
+  return (it == ids_.end()) ? nullptr : it->second;
+}
+
+XattrSetCache::SetPtr XattrSetCache::insert(uint64_t id, XattrSet xattrs) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  SetPtr& set = sets_[xattrs];
+  if (!set) {
+    set = std::make_shared<const XattrSet>(std::move(xattrs));
+  }
+  ids_[id] = set;
+  return set;
+}
+
+size_t XattrSetCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sets_.size();
+}
+
+}  // namespace installer
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_XATTR_COPIER_H
+#define INSTALLER_UNSQUASHFS_XATTR_COPIER_H
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace installer {
+
+struct ExtractStats;
+
+// Xattrs of one item, as (name, value) pairs.
+typedef std::vector<std::pair<std::string, std::string>> XattrSet;
+
+// Copy all xattrs (access control lists, file capabilities and security
+// labels) of source item to dest item. Items are accessed by |src_fd| and
+// |dest_fd|, or by |src_file| and |dest_file| without following symbolic
+// links if they are -1. Name list and values are read into buffers reused by
+// each thread, which grow to the size reported by kernel, so values of any
+// size are copied whole.
+// Source filesystem without xattr support has no xattrs. Returns false if
+// any xattr could not be copied, which is logged. Time spent and xattrs
+// copied are added to |stats| if it is not nullptr.
+bool CopyXattrs(int src_fd, const char* src_file, int dest_fd,
+                const char* dest_file, ExtractStats* stats);
+
+// Xattr sets of source image looked up by their id, so that a set shared by
+// many items, such as one file capability on many binaries, is decoded only
+// once. Sets with the same content are interned, and share one copy even if
+// they have different ids. Its methods are thread safe.
+class XattrSetCache {
+ public:
+  typedef std::shared_ptr<const XattrSet> SetPtr;
+
+  // Returns set cached as |id|, or nullptr.
+  SetPtr find(uint64_t id) const;
+
+  // Cache |xattrs| as set |id|, and returns interned copy of it.
+  SetPtr insert(uint64_t id, XattrSet xattrs);
+
+  // Returns number of sets with different content.
+  size_t size() const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::unordered_map<uint64_t, SetPtr> ids_;
+  std::map<XattrSet, SetPtr> sets_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_XATTR_COPIER_H
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/xattr_copier.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+#include "unsquashfs/extract_stats.h"
+
+namespace installer {
+namespace {
+
+TEST(XattrCopier, CopyLargeValues) {
+  char tmp_dir[] = "/tmp/installer-xattr-copier-XXXXXX";
+  ASSERT_NE(mkdtemp(tmp_dir), nullptr);
+  const std::string src_file = std::string(tmp_dir) + "/src";
+  const std::string dest_file = std::string(tmp_dir) + "/dest";
+  const int src_fd = open(src_file.c_str(), O_RDWR | O_CREAT, 0644);
+  const int dest_fd = open(dest_file.c_str(), O_RDWR | O_CREAT, 0644);
+  ASSERT_NE(src_fd, -1);
+  ASSERT_NE(dest_fd, -1);
+
+  // Longer than XATTR_NAME_MAX and than initial buffer.
+  const std::string large(4000, 'x');
+  if (fsetxattr(src_fd, "user.large", large.data(), large.size(), 0) != 0) {
+    EXPECT_EQ(errno, ENOTSUP);
+  } else {
+    ASSERT_EQ(fsetxattr(src_fd, "user.small", "abc", 3, 0), 0);
+    ExtractStats stats;
+    EXPECT_TRUE(CopyXattrs(src_fd, src_file.c_str(), dest_fd,
+                           dest_file.c_str(), &stats));
+    std::string value(8192, '\0');
+    EXPECT_EQ(fgetxattr(dest_fd, "user.large", &value[0], value.size()),
+              static_cast<ssize_t>(large.size()));
+    EXPECT_EQ(value.substr(0, large.size()), large);
+    EXPECT_EQ(fgetxattr(dest_fd, "user.small", &value[0], value.size()), 3);
+    EXPECT_EQ(stats.xattr_items, 1);
+    EXPECT_EQ(stats.xattr_values, 2);
+    EXPECT_EQ(stats.xattr_bytes, static_cast<int64_t>(large.size() + 3));
+
+    // By path, without file descriptors.
+    const std::string other_file = std::string(tmp_dir) + "/other";
+    close(open(other_file.c_str(), O_RDWR | O_CREAT, 0644));
+    EXPECT_TRUE(CopyXattrs(-1, src_file.c_str(), -1, other_file.c_str(),
+                           nullptr));
+    EXPECT_EQ(lgetxattr(other_file.c_str(), "user.large", &value[0],
+                        value.size()),
+              static_cast<ssize_t>(large.size()));
+    unlink(other_file.c_str());
+  }
+
+  close(src_fd);
+  close(dest_fd);
+  unlink(src_file.c_str());
+  unlink(dest_file.c_str());
+  rmdir(tmp_dir);
+}
+
+TEST(XattrCopier, InternSets) {
+  XattrSetCache cache;
+  EXPECT_EQ(cache.find(1), nullptr);
+  const XattrSet caps = {{"security.capability", "\x01\x02"}};
+  const XattrSetCache::SetPtr first = cache.insert(1, caps);
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(*first, caps);
+  EXPECT_EQ(cache.find(1), first);
+
+  // Same content under another id shares one copy.
+  EXPECT_EQ(cache.insert(2, caps), first);
+  EXPECT_EQ(cache.find(2), first);
+  EXPECT_EQ(cache.size(), 1u);
+
+  const XattrSet acl = {{"system.posix_acl_access", "acl"}};
+  EXPECT_NE(cache.insert(3, acl), first);
+  EXPECT_EQ(cache.size(), 2u);
+}
+
+}  // namespace
+}  // namespace installer
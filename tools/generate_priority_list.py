@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Generate priority list of deepin-installer-unsquashfs from a trace of file
+# accesses during boot of a reference machine. Files are listed in order of
+# first access, and are extracted first and together with --priority-list.
+#
+# Record a trace with fatrace, which uses fanotify, started as early as
+# possible, e.g. from a systemd service ordered before sysinit.target:
+#   fatrace --timestamp --output /var/log/boot.trace
+# and stop it after desktop session is ready. `systemd-analyze` prints when
+# graphical.target was reached, pass it as --until to cut the tail of trace.
+# Plain lists of paths, one per line, are accepted too.
+#
+# Usage:
+#   generate_priority_list.py [--root DIR] [--until SECONDS] [--max-size MIB]
+#                             [-o OUTPUT] TRACE...
+# With --root, usually the mounted filesystem.squashfs, only regular files
+# in it are kept, and --max-size limits total size of listed files.
+
+import argparse
+import os
+import re
+import sys
+
+# Paths which are not extracted from filesystem.squashfs.
+EXCLUDED_PREFIXES = ("/dev/", "/proc/", "/sys/", "/run/", "/tmp/",
+                     "/var/log/", "/var/cache/", "/var/tmp/", "/home/",
+                     "/root/", "/media/", "/mnt/")
+
+# Line of fatrace, with optional timestamp:
+#   [HH:MM:SS.ffffff ]comm(pid): EVENTS /path
+FATRACE_LINE = re.compile(
+    r"^(?:(\d+):(\d+):(\d+(?:\.\d+)?) )?.*?\(\d+\): ([RWOCDU<>+]+) (/.*)$")
+
+# Events of fatrace which read a file.
+READ_EVENTS = set("RO")
+
+
+def parse_trace(trace_file, until):
+    """Yield paths read in |trace_file|, stopping |until| seconds after its
+    first timestamped event if |until| is not None."""
+    start = None
+    with open(trace_file, errors="replace") as fh:
+        for line in fh:
+            line = line.rstrip("\n")
+            match = FATRACE_LINE.match(line)
+            if not match:
+                if line.startswith("/"):
+                    yield line
+                continue
+            hours, minutes, seconds, events, path = match.groups()
+            if seconds is not None and until is not None:
+                now = int(hours) * 3600 + int(minutes) * 60 + float(seconds)
+                if start is None:
+                    start = now
+                # Trace crossing midnight.
+                if now < start:
+                    now += 24 * 3600
+                if now - start > until:
+                    break
+            if READ_EVENTS & set(events):
+                yield path
+
+
+def file_size(root, path):
+    """Returns size of regular file |path| in |root|, or -1."""
+    full_path = os.path.join(root, path.lstrip("/"))
+    if os.path.islink(full_path) or not os.path.isfile(full_path):
+        return -1
+    return os.path.getsize(full_path)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate priority list from boot trace")
+    parser.add_argument("traces", metavar="TRACE", nargs="+",
+                        help="fatrace output or list of paths")
+    parser.add_argument("--root", help="keep regular files in this folder only")
+    parser.add_argument("--until", type=float,
+                        help="seconds of trace to use, from its first event")
+    parser.add_argument("--max-size", type=int, default=0,
+                        help="maximum total size in MiB, used with --root")
+    parser.add_argument("-o", "--output", help="output file, default stdout")
+    args = parser.parse_args()
+
+    seen = set()
+    paths = []
+    total = 0
+    limit = args.max_size * 1024 * 1024
+    for trace_file in args.traces:
+        for path in parse_trace(trace_file, args.until):
+            path = os.path.normpath(path)
+            if path in seen or path.startswith(EXCLUDED_PREFIXES):
+                continue
+            seen.add(path)
+            if args.root:
+                size = file_size(args.root, path)
+                if size < 0:
+                    continue
+                if limit > 0 and total + size > limit:
+                    continue
+                total += size
+            paths.append(path)
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    out.write("# Generated by generate_priority_list.py from %s\n" %
+              " ".join(os.path.basename(t) for t in args.traces))
+    for path in paths:
+        out.write(path + "\n")
+    if out is not sys.stdout:
+        out.close()
+    print("%d files, %d bytes" % (len(paths), total), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()